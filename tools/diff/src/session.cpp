@@ -0,0 +1,306 @@
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include "filter.h"
+#include "session.h"
+
+const OpcodeKey CLIENT_KEY_BIT = 0x10000;
+
+
+OpcodeKey MakeOpcodeKey(uint8_t origin, uint16_t opcode) {
+    return (origin == CaptureClient ? CLIENT_KEY_BIT : 0) | opcode;
+}
+
+
+bool IsClientKey(OpcodeKey key) {
+    return (key & CLIENT_KEY_BIT) != 0;
+}
+
+
+std::string GetOpcodeName(OpcodeKey key) {
+    char name[16];
+    uint8_t first = key & 0xff;
+    uint8_t second = (key >> 8) & 0xff;
+    if (isgraph(first) && isgraph(second)) {
+        snprintf(name, sizeof(name), "%s %c%c", IsClientKey(key) ? "up" : "down", first, second);
+    }
+    else {
+        snprintf(name, sizeof(name), "%s 0x%02x%02x", IsClientKey(key) ? "up" : "down", first, second);
+    }
+    return name;
+}
+
+
+// "up:mv", "down:++" or "up:0x0000" with the bytes in wire order
+bool ParseOpcodeKey(const char* text, OpcodeKey& key) {
+    const char* opcode = strchr(text, ':');
+    if (opcode == NULL) {
+        return false;
+    }
+    bool client = strncmp(text, "up:", 3) == 0;
+    if (!client && strncmp(text, "down:", 5) != 0) {
+        return false;
+    }
+    opcode++;
+    uint16_t value;
+    if (strncmp(opcode, "0x", 2) == 0 && strlen(opcode) == 6) {
+        unsigned long bytes = strtoul(opcode + 2, NULL, 16);
+        value = (bytes >> 8) | ((bytes & 0xff) << 8);
+    }
+    else if (strlen(opcode) == 2) {
+        value = (uint8_t)opcode[0] | ((uint8_t)opcode[1] << 8);
+    }
+    else {
+        return false;
+    }
+    key = MakeOpcodeKey(client ? CaptureClient : CaptureServer, value);
+    return true;
+}
+
+
+Session::Session() : m_path(""), m_startNs(0), m_endNs(0), m_counting(false), m_chunks(0), m_packets(0), m_bytes(0),
+    m_unknownBytes(0), m_cursor(NULL), m_left(0) {
+    memset(&m_options, 0, sizeof(m_options));
+    memset(m_unanswered, 0, sizeof(m_unanswered));
+}
+
+
+bool Session::IsWanted(uint16_t port) const {
+    return m_options.port != 0 ? port == m_options.port : port != MASTER_SERVER_PORT;
+}
+
+
+void Session::Restart() {
+    m_reader.Rewind();
+    m_left = 0;
+    m_streams.clear();
+}
+
+
+// Walks the packets of the wanted ports in capture order
+bool Session::NextPacket(SessionPacket& packet) {
+    for (;;) {
+        if (m_left == 0) {
+            if (!m_reader.Next(m_record)) {
+                return false;
+            }
+            if (m_counting) {
+                m_chunks++;
+                if (m_startNs == 0) {
+                    m_startNs = m_record.timestamp;
+                }
+                m_endNs = m_record.timestamp;
+            }
+            if (!IsWanted(m_record.port)) {
+                continue;
+            }
+            // The rest of a packet the last chunk ended in goes in front
+            Stream& stream = m_streams[(uint32_t)m_record.port << 8 | m_record.origin];
+            if (stream.carry.empty()) {
+                m_cursor = m_record.payload;
+                m_left = m_record.length;
+            }
+            else {
+                m_joined.swap(stream.carry);
+                stream.carry.clear();
+                m_joined.append((const char*)m_record.payload, m_record.length);
+                m_cursor = (const uint8_t*)m_joined.data();
+                m_left = m_joined.size();
+            }
+        }
+        FilterDirection direction = m_record.origin == CaptureClient ? FilterOutbound : FilterInbound;
+        size_t length = GetPacketLength(direction, m_cursor, m_left);
+        if (length == 0) {
+            if (m_counting) {
+                m_unknownBytes += m_left;
+            }
+            m_left = 0;
+            continue;
+        }
+        if (length > m_left) {
+            m_streams[(uint32_t)m_record.port << 8 | m_record.origin].carry.assign((const char*)m_cursor, m_left);
+            m_left = 0;
+            continue;
+        }
+        packet.timestamp = m_record.timestamp;
+        packet.origin = m_record.origin;
+        packet.port = m_record.port;
+        packet.opcode = m_cursor[0] | (m_cursor[1] << 8);
+        packet.length = length;
+        m_cursor += length;
+        m_left -= length;
+        return true;
+    }
+}
+
+
+void Session::MatchPairs(const SessionPacket& packet) {
+    OpcodeKey key = MakeOpcodeKey(packet.origin, packet.opcode);
+    for (size_t i = 0; i < m_options.pairCount; i++) {
+        std::deque<Pending>& pending = m_pending[i];
+        while (!pending.empty() && packet.timestamp - pending.front().timestamp > PAIR_TIMEOUT_NS) {
+            pending.pop_front();
+            m_unanswered[i]++;
+        }
+        if (key == m_options.pairs[i].request) {
+            pending.push_back({packet.timestamp, packet.port});
+        }
+        else if (key == m_options.pairs[i].response) {
+            // The oldest request on the same connection gets the answer
+            for (auto it = pending.begin(); it != pending.end(); ++it) {
+                if (it->port == packet.port) {
+                    m_latencies[i].push_back(packet.timestamp - it->timestamp);
+                    pending.erase(it);
+                    break;
+                }
+            }
+        }
+    }
+}
+
+
+bool Session::Load(const char* path, const SessionOptions& options) {
+    m_path = path;
+    m_options = options;
+    if (!m_reader.Open(path)) {
+        fprintf(stderr, "<Diff> %s isn't a capture\n", path);
+        return false;
+    }
+    if (!this->CountPackets()) {
+        fprintf(stderr, "<Diff> %s never has %s, not aligning it\n", path, GetOpcodeName(options.align).c_str());
+        m_options.hasAlign = false;
+        this->CountPackets();
+    }
+    if (m_reader.IsTruncated()) {
+        fprintf(stderr, "<Diff> %s is truncated, using what's there\n", path);
+    }
+    return true;
+}
+
+
+// First pass: opcode totals and request latencies. False if the anchor never came.
+bool Session::CountPackets() {
+    this->Restart();
+    m_startNs = 0;
+    m_chunks = 0;
+    m_packets = 0;
+    m_bytes = 0;
+    m_unknownBytes = 0;
+    m_opcodes.clear();
+    for (size_t i = 0; i < MAX_PAIRS; i++) {
+        m_latencies[i].clear();
+        m_pending[i].clear();
+        m_unanswered[i] = 0;
+    }
+
+    m_counting = true;
+    bool aligned = !m_options.hasAlign;
+    SessionPacket packet;
+    while (this->NextPacket(packet)) {
+        OpcodeKey key = MakeOpcodeKey(packet.origin, packet.opcode);
+        // Everything before the anchor is left out
+        if (!aligned && key != m_options.align) {
+            continue;
+        }
+        if (!aligned) {
+            m_startNs = packet.timestamp;
+            aligned = true;
+        }
+        OpcodeStats& stats = m_opcodes[key];
+        stats.count++;
+        stats.bytes += packet.length;
+        m_packets++;
+        m_bytes += packet.length;
+        this->MatchPairs(packet);
+    }
+    m_counting = false;
+    for (size_t i = 0; i < m_options.pairCount; i++) {
+        m_unanswered[i] += m_pending[i].size();
+        m_pending[i].clear();
+    }
+    return aligned;
+}
+
+
+// Second pass: windows of opcode counts and the events, from the aligned start
+void Session::CollectEvents(const std::unordered_set<OpcodeKey>& noisy) {
+    this->Restart();
+    uint64_t windowNs = m_options.windowSeconds * 1e9;
+    m_windows.assign((m_endNs - m_startNs) / windowNs + 1, WindowCounts());
+    m_events.clear();
+    SessionPacket packet;
+    while (this->NextPacket(packet)) {
+        if (packet.timestamp < m_startNs) {
+            continue;
+        }
+        OpcodeKey key = MakeOpcodeKey(packet.origin, packet.opcode);
+        uint64_t offset = packet.timestamp - m_startNs;
+        m_windows[offset / windowNs][key]++;
+        if (noisy.count(key) == 0) {
+            m_events.push_back({(uint32_t)(offset / 1000000), key});
+        }
+    }
+}
+
+
+const char* Session::GetPath() const {
+    return m_path;
+}
+
+
+double Session::GetSeconds() const {
+    return (m_endNs - m_startNs) / 1e9;
+}
+
+
+uint64_t Session::GetChunkCount() const {
+    return m_chunks;
+}
+
+
+uint64_t Session::GetPacketCount() const {
+    return m_packets;
+}
+
+
+uint64_t Session::GetByteCount() const {
+    return m_bytes;
+}
+
+
+uint64_t Session::GetUnknownBytes() const {
+    return m_unknownBytes;
+}
+
+
+const std::unordered_map<OpcodeKey, OpcodeStats>& Session::GetOpcodes() const {
+    return m_opcodes;
+}
+
+
+double Session::GetRate(OpcodeKey key) const {
+    auto found = m_opcodes.find(key);
+    double seconds = this->GetSeconds();
+    return found == m_opcodes.end() || seconds <= 0 ? 0 : found->second.count / seconds;
+}
+
+
+const std::vector<WindowCounts>& Session::GetWindows() const {
+    return m_windows;
+}
+
+
+std::vector<uint64_t>& Session::GetLatencies(size_t pair) {
+    return m_latencies[pair];
+}
+
+
+uint64_t Session::GetUnanswered(size_t pair) const {
+    return m_unanswered[pair];
+}
+
+
+const std::vector<SessionEvent>& Session::GetEvents() const {
+    return m_events;
+}
@@ -0,0 +1,144 @@
+#ifndef SESSION_H
+#define SESSION_H
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include "capture.h"
+
+const double DEFAULT_WINDOW_SECONDS = 10;
+// Opcodes seen more often than this per second are traffic rather than events
+const double DEFAULT_NOISE_RATE = 1;
+// A request without an answer by then is counted as unanswered
+const uint64_t PAIR_TIMEOUT_NS = 5000000000ull;
+const size_t MAX_PAIRS = 16;
+
+
+// Opcode together with the side that sent it, client ones have the high bit set
+typedef uint32_t OpcodeKey;
+
+OpcodeKey MakeOpcodeKey(uint8_t, uint16_t);
+bool IsClientKey(OpcodeKey);
+// "up mv", "down ++" or the hex of opcodes that aren't printable
+std::string GetOpcodeName(OpcodeKey);
+bool ParseOpcodeKey(const char *, OpcodeKey &);
+
+
+// A client request and the server packet that answers it
+struct PacketPair {
+    OpcodeKey request;
+    OpcodeKey response;
+};
+
+
+struct SessionOptions {
+    // 0 for every game server port
+    uint16_t port;
+    // Times are counted from the first packet with this key, or from the start
+    OpcodeKey align;
+    bool hasAlign;
+    double windowSeconds;
+    PacketPair pairs[MAX_PAIRS];
+    size_t pairCount;
+};
+
+
+// One framed packet of a capture
+struct SessionPacket {
+    uint64_t timestamp;
+    uint8_t origin;
+    uint16_t port;
+    uint16_t opcode;
+    uint32_t length;
+};
+
+
+struct OpcodeStats {
+    uint64_t count;
+    uint64_t bytes;
+};
+
+
+// Packet counts of each opcode in one window of time
+typedef std::unordered_map<OpcodeKey, uint32_t> WindowCounts;
+
+
+// A packet that is an event rather than traffic, at its offset into the session
+struct SessionEvent {
+    uint32_t milliseconds;
+    OpcodeKey key;
+};
+
+
+// A capture read through its mapping, first for statistics and then again
+// for the events once it is known which opcodes are just traffic. Packets
+// split across chunks are joined, chunks that can't be framed are counted
+// as unknown and skipped.
+class Session {
+  public:
+    Session();
+    bool Load(const char *, const SessionOptions &);
+    void CollectEvents(const std::unordered_set<OpcodeKey> &);
+
+    const char * GetPath() const;
+    double GetSeconds() const;
+    uint64_t GetChunkCount() const;
+    uint64_t GetPacketCount() const;
+    uint64_t GetByteCount() const;
+    uint64_t GetUnknownBytes() const;
+    const std::unordered_map<OpcodeKey, OpcodeStats> & GetOpcodes() const;
+    double GetRate(OpcodeKey) const;
+    const std::vector<WindowCounts> & GetWindows() const;
+    // Request to response times in ns for each configured pair
+    std::vector<uint64_t> & GetLatencies(size_t);
+    uint64_t GetUnanswered(size_t) const;
+    const std::vector<SessionEvent> & GetEvents() const;
+
+  private:
+    struct Stream {
+        std::string carry;
+    };
+
+    // A request waiting for its answer on one port
+    struct Pending {
+        uint64_t timestamp;
+        uint16_t port;
+    };
+
+    const char* m_path;
+    SessionOptions m_options;
+    CaptureReader m_reader;
+    uint64_t m_startNs;
+    uint64_t m_endNs;
+    // Only the first pass counts chunks and bytes
+    bool m_counting;
+    uint64_t m_chunks;
+    uint64_t m_packets;
+    uint64_t m_bytes;
+    uint64_t m_unknownBytes;
+    std::unordered_map<OpcodeKey, OpcodeStats> m_opcodes;
+    std::vector<WindowCounts> m_windows;
+    std::vector<uint64_t> m_latencies[MAX_PAIRS];
+    std::deque<Pending> m_pending[MAX_PAIRS];
+    uint64_t m_unanswered[MAX_PAIRS];
+    std::vector<SessionEvent> m_events;
+
+    // Where the packet walk is within the current chunk
+    CaptureRecord m_record;
+    const uint8_t* m_cursor;
+    size_t m_left;
+    std::unordered_map<uint32_t, Stream> m_streams;
+    std::string m_joined;
+
+    bool IsWanted(uint16_t) const;
+    bool NextPacket(SessionPacket &);
+    void Restart();
+    bool CountPackets();
+    void MatchPairs(const SessionPacket &);
+};
+
+#endif
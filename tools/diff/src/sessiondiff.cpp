@@ -0,0 +1,370 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "sessiondiff.h"
+
+
+void PrintSummary(const Session& a, const Session& b) {
+    printf("%-6s %10s %10s %12s %14s %12s  %s\n", "", "seconds", "chunks", "packets", "bytes", "unknown", "capture");
+    const Session* sessions[] = {&a, &b};
+    for (size_t i = 0; i < 2; i++) {
+        const Session& session = *sessions[i];
+        printf("%-6s %10.1f %10lu %12lu %14lu %12lu  %s\n", i == 0 ? "A" : "B", session.GetSeconds(),
+               (unsigned long)session.GetChunkCount(), (unsigned long)session.GetPacketCount(),
+               (unsigned long)session.GetByteCount(), (unsigned long)session.GetUnknownBytes(), session.GetPath());
+    }
+}
+
+
+// Opcodes whose rate moved the most against how noisy a rate that size is
+void PrintRates(const Session& a, const Session& b, size_t top) {
+    struct Change {
+        OpcodeKey key;
+        double rateA;
+        double rateB;
+        double score;
+    };
+    std::unordered_set<OpcodeKey> keys;
+    for (auto it = a.GetOpcodes().begin(); it != a.GetOpcodes().end(); ++it) {
+        keys.insert(it->first);
+    }
+    for (auto it = b.GetOpcodes().begin(); it != b.GetOpcodes().end(); ++it) {
+        keys.insert(it->first);
+    }
+    std::vector<Change> changes;
+    for (auto it = keys.begin(); it != keys.end(); ++it) {
+        auto foundA = a.GetOpcodes().find(*it);
+        auto foundB = b.GetOpcodes().find(*it);
+        uint64_t countA = foundA == a.GetOpcodes().end() ? 0 : foundA->second.count;
+        uint64_t countB = foundB == b.GetOpcodes().end() ? 0 : foundB->second.count;
+        if (countA < MIN_REPORTED_PACKETS && countB < MIN_REPORTED_PACKETS) {
+            continue;
+        }
+        double rateA = a.GetRate(*it);
+        double rateB = b.GetRate(*it);
+        changes.push_back({*it, rateA, rateB, fabs(rateB - rateA) / sqrt(rateA + rateB)});
+    }
+    std::sort(changes.begin(), changes.end(), [](const Change& x, const Change& y) {
+        return x.score > y.score;
+    });
+
+    printf("\nOpcode rates, biggest changes first\n");
+    printf("%-12s %12s %12s %10s\n", "opcode", "A /s", "B /s", "change");
+    for (size_t i = 0; i < changes.size() && i < top; i++) {
+        const Change& change = changes[i];
+        char relative[32];
+        if (change.rateA > 0) {
+            snprintf(relative, sizeof(relative), "%+.1f%%", (change.rateB - change.rateA) / change.rateA * 100);
+        }
+        else {
+            snprintf(relative, sizeof(relative), "new");
+        }
+        printf("%-12s %12.3f %12.3f %10s\n", GetOpcodeName(change.key).c_str(), change.rateA, change.rateB, relative);
+    }
+}
+
+
+static double GetPercentile(std::vector<uint64_t>& values, double fraction) {
+    if (values.empty()) {
+        return NAN;
+    }
+    size_t index = std::min(values.size() - 1, (size_t)(values.size() * fraction));
+    return values[index] / 1e6;
+}
+
+
+void PrintLatencies(Session& a, Session& b, const SessionOptions& options) {
+    printf("\nRequest to response, ms\n");
+    printf("%-24s %8s %8s %8s %8s %8s %8s %9s %9s\n", "pair", "A n", "A p50", "A p90", "B n", "B p50", "B p90",
+           "p50 shift", "lost A/B");
+    for (size_t i = 0; i < options.pairCount; i++) {
+        std::vector<uint64_t>& latenciesA = a.GetLatencies(i);
+        std::vector<uint64_t>& latenciesB = b.GetLatencies(i);
+        if (latenciesA.empty() && latenciesB.empty() && a.GetUnanswered(i) == 0 && b.GetUnanswered(i) == 0) {
+            continue;
+        }
+        std::sort(latenciesA.begin(), latenciesA.end());
+        std::sort(latenciesB.begin(), latenciesB.end());
+        std::string name = GetOpcodeName(options.pairs[i].request) + " > " +
+                           GetOpcodeName(options.pairs[i].response).substr(5);
+        double medianA = GetPercentile(latenciesA, 0.5);
+        double medianB = GetPercentile(latenciesB, 0.5);
+        char lost[32];
+        snprintf(lost, sizeof(lost), "%lu/%lu", (unsigned long)a.GetUnanswered(i), (unsigned long)b.GetUnanswered(i));
+        printf("%-24s %8lu %8.2f %8.2f %8lu %8.2f %8.2f %+9.2f %9s\n", name.c_str(),
+               (unsigned long)latenciesA.size(), medianA, GetPercentile(latenciesA, 0.9),
+               (unsigned long)latenciesB.size(), medianB, GetPercentile(latenciesB, 0.9), medianB - medianA, lost);
+    }
+}
+
+
+// Windows where the mix of opcodes differs the most, with what differs in them
+void PrintWindows(const Session& a, const Session& b, double windowSeconds, size_t top) {
+    struct Difference {
+        size_t window;
+        double distance;
+        std::vector<std::pair<int64_t, OpcodeKey> > opcodes;
+    };
+    const std::vector<WindowCounts>& windowsA = a.GetWindows();
+    const std::vector<WindowCounts>& windowsB = b.GetWindows();
+    static const WindowCounts empty;
+    std::vector<Difference> differences;
+    for (size_t w = 0; w < std::max(windowsA.size(), windowsB.size()); w++) {
+        const WindowCounts& countsA = w < windowsA.size() ? windowsA[w] : empty;
+        const WindowCounts& countsB = w < windowsB.size() ? windowsB[w] : empty;
+        Difference difference = {w, 0, std::vector<std::pair<int64_t, OpcodeKey> >()};
+        uint64_t total = 0;
+        for (auto it = countsA.begin(); it != countsA.end(); ++it) {
+            auto other = countsB.find(it->first);
+            int64_t delta = (other == countsB.end() ? 0 : (int64_t)other->second) - it->second;
+            difference.opcodes.push_back(std::make_pair(delta, it->first));
+            total += it->second;
+        }
+        for (auto it = countsB.begin(); it != countsB.end(); ++it) {
+            if (countsA.count(it->first) == 0) {
+                difference.opcodes.push_back(std::make_pair((int64_t)it->second, it->first));
+            }
+            total += it->second;
+        }
+        for (size_t i = 0; i < difference.opcodes.size(); i++) {
+            difference.distance += llabs(difference.opcodes[i].first);
+        }
+        if (total < MIN_REPORTED_PACKETS || difference.distance == 0) {
+            continue;
+        }
+        difference.distance /= total;
+        differences.push_back(difference);
+    }
+    std::sort(differences.begin(), differences.end(), [](const Difference& x, const Difference& y) {
+        return x.distance > y.distance;
+    });
+
+    printf("\nMost different %.0f s windows, packets B minus A\n", windowSeconds);
+    for (size_t i = 0; i < differences.size() && i < top; i++) {
+        Difference& difference = differences[i];
+        std::sort(difference.opcodes.begin(), difference.opcodes.end(),
+                  [](const std::pair<int64_t, OpcodeKey>& x, const std::pair<int64_t, OpcodeKey>& y) {
+            return llabs(x.first) > llabs(y.first);
+        });
+        printf("+%8.0f s  %6.2f%% ", difference.window * windowSeconds, difference.distance * 50);
+        for (size_t j = 0; j < difference.opcodes.size() && j < 4 && difference.opcodes[j].first != 0; j++) {
+            printf("  %s %+ld", GetOpcodeName(difference.opcodes[j].second).c_str(), (long)difference.opcodes[j].first);
+        }
+        printf("\n");
+    }
+}
+
+
+static bool IsRunEqual(const std::vector<SessionEvent>& a, size_t i, const std::vector<SessionEvent>& b, size_t j) {
+    for (size_t k = 0; k < RESYNC_RUN; k++) {
+        if (i + k >= a.size() || j + k >= b.size()) {
+            // Agreeing all the way to the end counts
+            return i + k >= a.size() && j + k >= b.size();
+        }
+        if (a[i + k].key != b[j + k].key) {
+            return false;
+        }
+    }
+    return true;
+}
+
+
+static std::string DescribeEvents(const std::vector<SessionEvent>& events, size_t start, size_t count) {
+    std::string text;
+    for (size_t i = 0; i < count && i < MAX_SPAN_EVENTS; i++) {
+        text += (i > 0 ? ", " : "") + GetOpcodeName(events[start + i].key);
+    }
+    if (count > MAX_SPAN_EVENTS) {
+        text += ", ...";
+    }
+    return count == 0 ? "nothing" : text;
+}
+
+
+static void PrintSpan(const std::vector<SessionEvent>& eventsA, size_t startA, size_t endA,
+                      const std::vector<SessionEvent>& eventsB, size_t startB, size_t endB) {
+    uint32_t at = endA > startA ? eventsA[startA].milliseconds : eventsB[startB].milliseconds;
+    printf("+%9.1f s  A: %s\n             B: %s\n", at / 1e3, DescribeEvents(eventsA, startA, endA - startA).c_str(),
+           DescribeEvents(eventsB, startB, endB - startB).c_str());
+}
+
+
+// Walks both event sequences together. On a mismatch it looks for the
+// nearest point, by events skipped on both sides, where they agree again
+// for a few events. When there is none within the lookahead it steps past
+// whichever event came first and tries again, so a long burst on one side
+// only costs the events in it. Everything skipped until the two agree again
+// is one divergent span.
+void PrintEventDiff(const Session& a, const Session& b, size_t top) {
+    const std::vector<SessionEvent>& eventsA = a.GetEvents();
+    const std::vector<SessionEvent>& eventsB = b.GetEvents();
+    size_t i = 0;
+    size_t j = 0;
+    size_t matched = 0;
+    size_t spans = 0;
+    // Where the divergent span being walked started, if there is one
+    bool diverging = false;
+    size_t spanA = 0;
+    size_t spanB = 0;
+    std::vector<int64_t> drift;
+    printf("\nEvents: %lu in A, %lu in B\n", (unsigned long)eventsA.size(), (unsigned long)eventsB.size());
+    while (i < eventsA.size() || j < eventsB.size()) {
+        if (i < eventsA.size() && j < eventsB.size() && eventsA[i].key == eventsB[j].key) {
+            drift.push_back((int64_t)eventsB[j].milliseconds - eventsA[i].milliseconds);
+            i++;
+            j++;
+            matched++;
+            continue;
+        }
+        if (!diverging) {
+            diverging = true;
+            spanA = i;
+            spanB = j;
+        }
+        // Once one side has run out, the rest of the other is all that's left
+        size_t skipA = eventsA.size() - i;
+        size_t skipB = eventsB.size() - j;
+        bool found = skipA == 0 || skipB == 0;
+        for (size_t distance = 1; distance <= 2 * RESYNC_LOOKAHEAD && !found; distance++) {
+            for (size_t di = 0; di <= distance && !found; di++) {
+                size_t dj = distance - di;
+                if (di > RESYNC_LOOKAHEAD || dj > RESYNC_LOOKAHEAD || i + di > eventsA.size() ||
+                        j + dj > eventsB.size()) {
+                    continue;
+                }
+                if (IsRunEqual(eventsA, i + di, eventsB, j + dj)) {
+                    skipA = di;
+                    skipB = dj;
+                    found = true;
+                }
+            }
+        }
+        if (!found) {
+            bool earlierA = eventsA[i].milliseconds <= eventsB[j].milliseconds;
+            skipA = earlierA ? 1 : 0;
+            skipB = earlierA ? 0 : 1;
+        }
+        i += skipA;
+        j += skipB;
+        if (found) {
+            if (spans < top) {
+                PrintSpan(eventsA, spanA, i, eventsB, spanB, j);
+            }
+            spans++;
+            diverging = false;
+        }
+    }
+    size_t longest = std::max(eventsA.size(), eventsB.size());
+    printf("%lu divergent spans, %.1f%% of events in step", (unsigned long)spans,
+           longest > 0 ? matched * 100.0 / longest : 100.0);
+    if (!drift.empty()) {
+        int64_t last = drift.back();
+        std::sort(drift.begin(), drift.end());
+        printf(", B runs %+.2f s from A at the median and %+.2f s by the end", drift[drift.size() / 2] / 1e3,
+               last / 1e3);
+    }
+    printf("\n");
+}
+
+
+std::unordered_set<OpcodeKey> GetNoisyOpcodes(const Session& a, const Session& b, double rate) {
+    std::unordered_set<OpcodeKey> noisy;
+    const Session* sessions[] = {&a, &b};
+    for (size_t i = 0; i < 2; i++) {
+        const std::unordered_map<OpcodeKey, OpcodeStats>& opcodes = sessions[i]->GetOpcodes();
+        for (auto it = opcodes.begin(); it != opcodes.end(); ++it) {
+            if (sessions[i]->GetRate(it->first) > rate) {
+                noisy.insert(it->first);
+            }
+        }
+    }
+    return noisy;
+}
+
+
+static void Usage(const char* name) {
+    fprintf(stderr, "usage: %s A.cap B.cap [--port N] [--align up|down:OPCODE] [--window SECONDS]\n"
+            "       [--pair up:OPCODE=down:OPCODE]... [--noise PER_SECOND] [--top N]\n", name);
+}
+
+
+int main(int argc, char** argv) {
+    if (argc < 3) {
+        Usage(argv[0]);
+        return 2;
+    }
+    SessionOptions options;
+    memset(&options, 0, sizeof(options));
+    options.windowSeconds = DEFAULT_WINDOW_SECONDS;
+    double noise = DEFAULT_NOISE_RATE;
+    size_t top = DEFAULT_TOP;
+    bool customPairs = false;
+    for (int i = 3; i < argc; i++) {
+        bool hasValue = i + 1 < argc;
+        if (strcmp(argv[i], "--port") == 0 && hasValue) {
+            options.port = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--align") == 0 && hasValue && ParseOpcodeKey(argv[i + 1], options.align)) {
+            options.hasAlign = true;
+            i++;
+        }
+        else if (strcmp(argv[i], "--window") == 0 && hasValue && atof(argv[i + 1]) > 0) {
+            options.windowSeconds = atof(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--pair") == 0 && hasValue && options.pairCount < MAX_PAIRS) {
+            // The defaults only stand in until pairs are given
+            if (!customPairs) {
+                options.pairCount = 0;
+                customPairs = true;
+            }
+            std::string pair = argv[++i];
+            size_t separator = pair.find('=');
+            PacketPair& added = options.pairs[options.pairCount];
+            if (separator == std::string::npos || !ParseOpcodeKey(pair.substr(0, separator).c_str(), added.request) ||
+                    !ParseOpcodeKey(pair.substr(separator + 1).c_str(), added.response)) {
+                Usage(argv[0]);
+                return 2;
+            }
+            options.pairCount++;
+        }
+        else if (strcmp(argv[i], "--noise") == 0 && hasValue) {
+            noise = atof(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--top") == 0 && hasValue) {
+            top = atoi(argv[++i]);
+        }
+        else {
+            Usage(argv[0]);
+            return 2;
+        }
+    }
+    if (!customPairs) {
+        // Reload, pickup and shot, each with what the server says back
+        const char* defaults[][2] = {{"up:rl", "down:rl"}, {"up:ee", "down:cp"}, {"up:*i", "down:la"}};
+        for (size_t i = 0; i < sizeof(defaults) / sizeof(defaults[0]); i++) {
+            ParseOpcodeKey(defaults[i][0], options.pairs[i].request);
+            ParseOpcodeKey(defaults[i][1], options.pairs[i].response);
+            options.pairCount++;
+        }
+    }
+
+    Session a;
+    Session b;
+    if (!a.Load(argv[1], options) || !b.Load(argv[2], options)) {
+        return 1;
+    }
+    std::unordered_set<OpcodeKey> noisy = GetNoisyOpcodes(a, b, noise);
+    a.CollectEvents(noisy);
+    b.CollectEvents(noisy);
+
+    PrintSummary(a, b);
+    PrintRates(a, b, top);
+    PrintLatencies(a, b, options);
+    PrintWindows(a, b, options.windowSeconds, top);
+    PrintEventDiff(a, b, top);
+    return 0;
+}
@@ -0,0 +1,30 @@
+#ifndef SESSIONDIFF_H
+#define SESSIONDIFF_H
+
+#include <cstddef>
+#include <cstdint>
+#include <unordered_set>
+#include "session.h"
+
+const size_t DEFAULT_TOP = 10;
+// Opcodes and windows with fewer packets than this in both sessions aren't worth reporting
+const uint64_t MIN_REPORTED_PACKETS = 5;
+// How far ahead the event diff looks for the two sessions to agree again, and on how many events
+const size_t RESYNC_LOOKAHEAD = 32;
+const size_t RESYNC_RUN = 3;
+const size_t MAX_SPAN_EVENTS = 6;
+
+
+// Two sessions go through a first pass each for opcode totals and request
+// latencies, which decides which opcodes are mere traffic, then a second pass
+// each for windows and events. Events are compared with a greedy diff that
+// resyncs within a lookahead, or steps past the earlier event when it can't,
+// so hours of events diff in linear time.
+void PrintSummary(const Session &, const Session &);
+void PrintRates(const Session &, const Session &, size_t);
+void PrintLatencies(Session &, Session &, const SessionOptions &);
+void PrintWindows(const Session &, const Session &, double, size_t);
+void PrintEventDiff(const Session &, const Session &, size_t);
+std::unordered_set<OpcodeKey> GetNoisyOpcodes(const Session &, const Session &, double);
+
+#endif
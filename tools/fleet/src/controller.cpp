@@ -0,0 +1,486 @@
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <poll.h>
+#include <sstream>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "controller.h"
+
+volatile sig_atomic_t STOPPING = 0;
+
+
+static void Stop(int) {
+    STOPPING = 1;
+}
+
+
+static uint64_t GetNanoseconds() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+
+// "a; b;c" to {"a", "b", "c"}
+static std::vector<std::string> SplitCommands(const std::string& text) {
+    std::vector<std::string> commands;
+    std::stringstream stream(text);
+    std::string command;
+    while (std::getline(stream, command, ';')) {
+        size_t first = command.find_first_not_of(" \t");
+        size_t last = command.find_last_not_of(" \t\r");
+        if (first != std::string::npos) {
+            commands.push_back(command.substr(first, last - first + 1));
+        }
+    }
+    return commands;
+}
+
+
+static float Distance(float x, float y, float z, const FleetZone& zone) {
+    return sqrtf((zone.x - x) * (zone.x - x) + (zone.y - y) * (zone.y - y) + (zone.z - z) * (zone.z - z));
+}
+
+
+FleetController::FleetController() : m_listener(-1), m_nextBatch(1) {
+}
+
+
+FleetController::~FleetController() {
+    for (size_t i = 0; i < m_clients.size(); i++) {
+        close(m_clients[i].fd);
+    }
+    if (m_listener >= 0) {
+        close(m_listener);
+        unlink(m_path.c_str());
+    }
+}
+
+
+bool FleetController::Listen(const char* path) {
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(address.sun_path)) {
+        fprintf(stderr, "<Fleet> Socket path too long: %s\n", path);
+        return false;
+    }
+    strcpy(address.sun_path, path);
+
+    m_listener = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (m_listener < 0) {
+        perror("<Fleet> socket");
+        return false;
+    }
+    // A controller that died leaves its socket file behind
+    unlink(path);
+    if (bind(m_listener, (struct sockaddr*)&address, sizeof(address)) != 0 ||
+            listen(m_listener, MAX_FLEET_CLIENTS) != 0) {
+        perror("<Fleet> bind");
+        close(m_listener);
+        m_listener = -1;
+        return false;
+    }
+    m_path = path;
+    fprintf(stderr, "<Fleet> Listening on %s\n", path);
+    return true;
+}
+
+
+void FleetController::Accept() {
+    for (;;) {
+        int fd = accept4(m_listener, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            return;
+        }
+        if (m_clients.size() >= MAX_FLEET_CLIENTS) {
+            close(fd);
+            continue;
+        }
+        FleetClient client;
+        memset(&client, 0, sizeof(client));
+        client.fd = fd;
+        client.lastSeenNs = GetNanoseconds();
+        m_clients.push_back(client);
+    }
+}
+
+
+// Drains everything the client sent, false once it has gone away
+bool FleetController::Receive(FleetClient& client) {
+    char message[FLEET_MAX_MESSAGE];
+    for (;;) {
+        ssize_t length = recv(client.fd, message, sizeof(message), MSG_DONTWAIT);
+        if (length < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            return true;
+        }
+        if (length <= 0) {
+            return false;
+        }
+        uint64_t now = GetNanoseconds();
+        uint32_t type = *(uint32_t*)message;
+        if (type == FleetTelemetryMessage && (size_t)length == sizeof(FleetTelemetry)) {
+            if (!client.reported) {
+                fprintf(stderr, "<Fleet> %u joined as %s\n", ((FleetTelemetry*)message)->pid,
+                        ((FleetTelemetry*)message)->name);
+            }
+            memcpy(&client.telemetry, message, sizeof(FleetTelemetry));
+            client.telemetry.name[FLEET_NAME_LENGTH - 1] = 0;
+            client.telemetry.region[FLEET_REGION_LENGTH - 1] = 0;
+            client.reported = true;
+            client.lastSeenNs = now;
+        }
+        else if (type == FleetAckMessage && (size_t)length == sizeof(FleetAck)) {
+            if (((FleetAck*)message)->batch == client.lastBatch && client.lastBatchSentNs != 0) {
+                client.roundTripUs = (now - client.lastBatchSentNs) / 1e3;
+                client.lastBatchSentNs = 0;
+            }
+            client.lastSeenNs = now;
+        }
+    }
+}
+
+
+void FleetController::Drop(size_t index) {
+    if (m_clients[index].reported) {
+        fprintf(stderr, "<Fleet> %u (%s) left\n", m_clients[index].telemetry.pid, m_clients[index].telemetry.name);
+    }
+    close(m_clients[index].fd);
+    m_clients.erase(m_clients.begin() + index);
+}
+
+
+// Comma separated pids or player names, "all" for everyone
+std::vector<size_t> FleetController::Select(const std::string& selector) const {
+    std::vector<size_t> selected;
+    std::vector<std::string> names;
+    std::stringstream stream(selector);
+    std::string name;
+    while (std::getline(stream, name, ',')) {
+        names.push_back(name);
+    }
+    for (size_t i = 0; i < m_clients.size(); i++) {
+        const FleetClient& client = m_clients[i];
+        for (size_t j = 0; j < names.size(); j++) {
+            if (names[j] == "all" || (client.reported && (names[j] == client.telemetry.name ||
+                    strtoul(names[j].c_str(), NULL, 10) == client.telemetry.pid))) {
+                selected.push_back(i);
+                break;
+            }
+        }
+    }
+    return selected;
+}
+
+
+// Packs the commands once, then hands the same messages to every target.
+// Returns how many clients got the whole batch.
+size_t FleetController::SendBatch(const std::vector<std::string>& commands, const std::vector<size_t>& targets) {
+    std::vector<std::string> messages;
+    std::string message;
+    uint32_t batch = m_nextBatch++;
+    FleetBatch header = {FleetBatchMessage, batch, 0, 0};
+    for (size_t i = 0; i <= commands.size(); i++) {
+        bool full = i == commands.size() ||
+            sizeof(FleetBatch) + message.size() + commands[i].size() + 1 > FLEET_MAX_MESSAGE;
+        if (full && header.count > 0) {
+            header.length = message.size();
+            messages.push_back(std::string((const char*)&header, sizeof(header)) + message);
+            message.clear();
+            header.count = 0;
+        }
+        if (i < commands.size() && sizeof(FleetBatch) + commands[i].size() + 1 <= FLEET_MAX_MESSAGE) {
+            message.append(commands[i].c_str(), commands[i].size() + 1);
+            header.count++;
+        }
+    }
+
+    uint64_t start = GetNanoseconds();
+    size_t delivered = 0;
+    for (size_t i = 0; i < targets.size(); i++) {
+        FleetClient& client = m_clients[targets[i]];
+        bool sent = true;
+        for (size_t j = 0; j < messages.size() && sent; j++) {
+            sent = send(client.fd, messages[j].data(), messages[j].size(), MSG_DONTWAIT | MSG_NOSIGNAL) ==
+                   (ssize_t)messages[j].size();
+        }
+        if (sent) {
+            client.lastBatch = batch;
+            client.lastBatchSentNs = GetNanoseconds();
+            delivered++;
+        }
+    }
+    uint64_t elapsed = GetNanoseconds() - start;
+    fprintf(stderr, "<Fleet> batch %u: %lu commands to %lu of %lu clients in %.1f us\n", batch,
+            (unsigned long)commands.size(), (unsigned long)delivered, (unsigned long)targets.size(), elapsed / 1e3);
+    return delivered;
+}
+
+
+void FleetController::PrintView() const {
+    uint64_t now = GetNanoseconds();
+    size_t reported = 0;
+    uint64_t load = 0, claims = 0, commands = 0;
+    double frameMs = 0;
+    printf("%-7s %-16s %-16s %8s %8s %7s %5s %5s %6s %7s %5s %6s %6s %8s\n", "pid", "name", "region", "x", "y",
+           "z", "hp", "mana", "frame", "hook", "load", "claims", "cmds", "rtt");
+    for (size_t i = 0; i < m_clients.size(); i++) {
+        const FleetClient& client = m_clients[i];
+        if (!client.reported) {
+            continue;
+        }
+        const FleetTelemetry& t = client.telemetry;
+        bool stale = (now - client.lastSeenNs) / 1e9 > FLEET_STALE_AFTER;
+        printf("%-7u %-16s %-16s %8.0f %8.0f %7.0f %5d %5d %4.1fms %5.0fus %5u %6u %6lu %6.0fus%s\n", t.pid, t.name,
+               t.region, t.x, t.y, t.z, t.health, t.mana, t.frameMs, t.hookUs, t.load, t.claims,
+               (unsigned long)t.commands, client.roundTripUs, stale ? " stale" : "");
+        reported++;
+        load += t.load;
+        claims += t.claims;
+        commands += t.commands;
+        frameMs += t.frameMs;
+    }
+    printf("%lu clients, %lu waypoints queued, %lu claims, %lu commands run, mean frame %.1f ms, %lu zones waiting\n",
+           (unsigned long)reported, (unsigned long)load, (unsigned long)claims, (unsigned long)commands,
+           reported == 0 ? 0 : frameMs / reported, (unsigned long)m_zones.size());
+    fflush(stdout);
+}
+
+
+// Every zone goes to the client in its region that would get there soonest,
+// counting the waypoints it already has queued. Each client then visits its
+// zones nearest first, appended to whatever route it is already on.
+void FleetController::Schedule() {
+    uint64_t now = GetNanoseconds();
+    std::vector<std::vector<FleetZone>> routes(m_clients.size());
+    std::vector<uint32_t> loads(m_clients.size());
+    std::vector<FleetZone> ends(m_clients.size());
+    for (size_t i = 0; i < m_clients.size(); i++) {
+        const FleetTelemetry& t = m_clients[i].telemetry;
+        loads[i] = t.load;
+        ends[i].x = t.x;
+        ends[i].y = t.y;
+        ends[i].z = t.z;
+    }
+
+    std::vector<FleetZone> unassigned;
+    for (size_t z = 0; z < m_zones.size(); z++) {
+        const FleetZone& zone = m_zones[z];
+        size_t best = m_clients.size();
+        float bestCost = INFINITY;
+        for (size_t i = 0; i < m_clients.size(); i++) {
+            const FleetClient& client = m_clients[i];
+            if (!client.reported || (now - client.lastSeenNs) / 1e9 > FLEET_STALE_AFTER ||
+                    zone.region != client.telemetry.region) {
+                continue;
+            }
+            float cost = loads[i] + Distance(ends[i].x, ends[i].y, ends[i].z, zone) / FLEET_DISTANCE_PER_LOAD;
+            if (cost < bestCost) {
+                best = i;
+                bestCost = cost;
+            }
+        }
+        if (best == m_clients.size()) {
+            unassigned.push_back(zone);
+            continue;
+        }
+        routes[best].push_back(zone);
+        loads[best]++;
+        ends[best] = zone;
+    }
+
+    for (size_t i = 0; i < m_clients.size(); i++) {
+        std::vector<FleetZone>& zones = routes[i];
+        if (zones.empty()) {
+            continue;
+        }
+        std::vector<std::string> commands;
+        const FleetTelemetry& t = m_clients[i].telemetry;
+        float x = t.x, y = t.y, z = t.z;
+        while (!zones.empty()) {
+            size_t nearest = 0;
+            for (size_t j = 1; j < zones.size(); j++) {
+                if (Distance(x, y, z, zones[j]) < Distance(x, y, z, zones[nearest])) {
+                    nearest = j;
+                }
+            }
+            char command[128];
+            snprintf(command, sizeof(command), "rt add %.0f %.0f %.0f %.0f", zones[nearest].x, zones[nearest].y,
+                     zones[nearest].z, zones[nearest].dwell);
+            commands.push_back(command);
+            x = zones[nearest].x;
+            y = zones[nearest].y;
+            z = zones[nearest].z;
+            zones.erase(zones.begin() + nearest);
+        }
+        commands.push_back("rt go");
+        fprintf(stderr, "<Fleet> %u (%s) gets %lu zones\n", t.pid, t.name, (unsigned long)commands.size() - 1);
+        SendBatch(commands, std::vector<size_t>(1, i));
+    }
+    if (!unassigned.empty()) {
+        fprintf(stderr, "<Fleet> %lu zones have nobody in their region, kept for later\n",
+                (unsigned long)unassigned.size());
+    }
+    m_zones = unassigned;
+}
+
+
+bool FleetController::Execute(const std::string& line) {
+    std::stringstream stream(line);
+    std::string verb;
+    stream >> verb;
+    std::string rest;
+    std::getline(stream, rest);
+
+    if (verb.empty() || verb == "view") {
+        PrintView();
+    }
+    else if (verb == "all" || verb == "to") {
+        std::string selector = "all";
+        if (verb == "to") {
+            std::stringstream targets(rest);
+            targets >> selector;
+            std::getline(targets, rest);
+        }
+        std::vector<std::string> commands = SplitCommands(rest);
+        std::vector<size_t> targets = Select(selector);
+        if (commands.empty() || targets.empty()) {
+            fprintf(stderr, "<Fleet> Nothing to send or nobody to send it to\n");
+        }
+        else {
+            SendBatch(commands, targets);
+        }
+    }
+    else if (verb == "zone") {
+        FleetZone zone;
+        zone.dwell = DEFAULT_ZONE_DWELL;
+        std::stringstream arguments(rest);
+        if (arguments >> zone.region >> zone.x >> zone.y >> zone.z) {
+            arguments >> zone.dwell;
+            m_zones.push_back(zone);
+        }
+        else {
+            fprintf(stderr, "<Fleet> zone <region> <x> <y> <z> [dwell]\n");
+        }
+    }
+    else if (verb == "zones") {
+        if (rest.find("clear") != std::string::npos) {
+            m_zones.clear();
+        }
+        for (size_t i = 0; i < m_zones.size(); i++) {
+            printf("%s %.0f %.0f %.0f %.0f\n", m_zones[i].region.c_str(), m_zones[i].x, m_zones[i].y, m_zones[i].z,
+                   m_zones[i].dwell);
+        }
+        printf("%lu zones waiting\n", (unsigned long)m_zones.size());
+    }
+    else if (verb == "schedule") {
+        Schedule();
+    }
+    else if (verb == "quit" || verb == "exit") {
+        return false;
+    }
+    else {
+        fprintf(stderr, "commands:\n"
+                "  view                       telemetry of every client\n"
+                "  all <cmd>[; <cmd>...]      send a batch to every client\n"
+                "  to <pid|name>[,...] <cmds> send a batch to some of them\n"
+                "  zone <region> x y z [s]    queue a farming zone\n"
+                "  zones [clear]              list or drop queued zones\n"
+                "  schedule                   hand queued zones out by load\n"
+                "  quit\n");
+    }
+    return true;
+}
+
+
+void FleetController::Run(float watch) {
+    signal(SIGINT, Stop);
+    signal(SIGTERM, Stop);
+    bool console = true;
+    uint64_t nextView = GetNanoseconds() + (uint64_t)(watch * 1e9);
+    std::string pending;
+
+    while (!STOPPING) {
+        std::vector<struct pollfd> fds;
+        fds.push_back({m_listener, POLLIN, 0});
+        fds.push_back({console ? STDIN_FILENO : -1, POLLIN, 0});
+        for (size_t i = 0; i < m_clients.size(); i++) {
+            fds.push_back({m_clients[i].fd, POLLIN, 0});
+        }
+        int timeout = watch > 0 ? (int)std::max<int64_t>(0, ((int64_t)nextView - (int64_t)GetNanoseconds()) / 1000000) : -1;
+        if (poll(fds.data(), fds.size(), timeout) < 0 && errno != EINTR) {
+            perror("<Fleet> poll");
+            return;
+        }
+
+        if (fds[0].revents & POLLIN) {
+            Accept();
+        }
+        // Clients before the console, so a view shows what just arrived
+        for (size_t i = fds.size() - 1; i >= 2; i--) {
+            if (fds[i].revents != 0 && !Receive(m_clients[i - 2])) {
+                Drop(i - 2);
+            }
+        }
+        if (fds[1].revents != 0) {
+            char buffer[4096];
+            ssize_t length = read(STDIN_FILENO, buffer, sizeof(buffer));
+            if (length <= 0) {
+                // Piped commands are done, keep serving until interrupted
+                console = false;
+            }
+            else {
+                pending.append(buffer, length);
+            }
+            size_t end;
+            while ((end = pending.find('\n')) != std::string::npos) {
+                std::string line = pending.substr(0, end);
+                pending.erase(0, end + 1);
+                if (!Execute(line)) {
+                    return;
+                }
+            }
+        }
+        if (watch > 0 && GetNanoseconds() >= nextView) {
+            PrintView();
+            nextView = GetNanoseconds() + (uint64_t)(watch * 1e9);
+        }
+    }
+}
+
+
+static void Usage(const char* name) {
+    fprintf(stderr, "usage: %s [--socket PATH] [--watch SECONDS]\n", name);
+}
+
+
+int main(int argc, char** argv) {
+    const char* path = DEFAULT_FLEET_SOCKET;
+    float watch = 0;
+    for (int i = 1; i < argc; i++) {
+        bool hasValue = i + 1 < argc;
+        if (strcmp(argv[i], "--socket") == 0 && hasValue) {
+            path = argv[++i];
+        }
+        else if (strcmp(argv[i], "--watch") == 0 && hasValue) {
+            watch = atof(argv[++i]);
+        }
+        else {
+            Usage(argv[0]);
+            return 2;
+        }
+    }
+    FleetController controller;
+    if (!controller.Listen(path)) {
+        return 1;
+    }
+    controller.Run(watch);
+    return 0;
+}
@@ -0,0 +1,70 @@
+#ifndef CONTROLLER_H
+#define CONTROLLER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "fleet.h"
+
+const size_t MAX_FLEET_CLIENTS = 64;
+// Seconds without telemetry before a client is left out of scheduling
+const float FLEET_STALE_AFTER = 2;
+const float DEFAULT_ZONE_DWELL = 30;
+// Distance that weighs as much as one queued waypoint when handing out zones
+const float FLEET_DISTANCE_PER_LOAD = 20000;
+
+
+// One hooked client as the controller sees it
+struct FleetClient {
+    int fd;
+    bool reported;
+    FleetTelemetry telemetry;
+    uint64_t lastSeenNs;
+    // Send to acknowledgement of the last batch, the client runs it on its next tick
+    uint32_t lastBatch;
+    uint64_t lastBatchSentNs;
+    double roundTripUs;
+};
+
+
+// A farming zone waiting to be handed to whichever client can take it soonest
+struct FleetZone {
+    std::string region;
+    float x;
+    float y;
+    float z;
+    float dwell;
+};
+
+
+// Accepts every client's hook library on one SOCK_SEQPACKET socket, fans
+// command batches out to them and keeps their latest telemetry. Commands are
+// chat commands, so anything a client understands can be sent. One thread,
+// one poll() loop, console commands come from stdin.
+class FleetController {
+  public:
+    FleetController();
+    ~FleetController();
+    bool Listen(const char *);
+    void Run(float);
+    // Runs one console line, false when it asks to quit
+    bool Execute(const std::string &);
+
+  private:
+    int m_listener;
+    std::string m_path;
+    std::vector<FleetClient> m_clients;
+    std::vector<FleetZone> m_zones;
+    uint32_t m_nextBatch;
+
+    void Accept();
+    bool Receive(FleetClient &);
+    void Drop(size_t);
+    std::vector<size_t> Select(const std::string &) const;
+    size_t SendBatch(const std::vector<std::string> &, const std::vector<size_t> &);
+    void PrintView() const;
+    void Schedule();
+};
+
+#endif
@@ -0,0 +1,95 @@
+"""Generate a counting and timing interposer for every member function
+declared in pwn3.h.
+
+Each interposer times the call through BeginProfiledCall() and
+EndProfiledCall() around the game's own definition, see src/apiprofile.h.
+Functions the hook library already defines by hand are skipped with all their
+overloads, as are constructors, destructors and the first virtual function
+of each class. That one is the key function, and defining it would give this
+library its own copy of the class's vtable.
+
+Interposing only replaces the symbol, so virtual functions are counted when
+they are called directly and not when the game calls them through a vtable.
+The hand-written hooks, World::Tick among them, aren't counted at all.
+"""
+import sys
+from typing import List, Set, Tuple
+
+from pwn3decl import declarations, hand_written, split_parameters
+
+
+def generate(header: str, skip: Set[str]) -> str:
+    definitions = []
+    entries = []
+    keyed = set()
+    for owner, match in declarations(header):
+        virtual, static, result, name, parameters, const = match.groups()
+        if virtual and owner not in keyed:
+            keyed.add(owner)
+            continue
+        if f'{owner}::{name}' in skip or name in (owner, f'~{owner}'):
+            continue
+        result = result.replace('enum ', '').strip()
+        types = [parameter.replace('enum ', '')
+                 for parameter in split_parameters(parameters)]
+        definitions.extend(define(owner, name, result, types, bool(static),
+                                  bool(const), len(entries)))
+        entries.append(entry(owner, name, types, bool(const), bool(virtual)))
+
+    lines = ['// Generated by gen_profile.py, do not edit',
+             '#include "pwn3.h"', '#include "apiprofile.h"', '',
+             f'static_assert({len(entries)} <= MAX_PROFILED_FUNCTIONS, '
+             '"raise MAX_PROFILED_FUNCTIONS in apiprofile.h");', '',
+             f'ProfiledFunction GENERATED_FUNCTIONS[{len(entries)}] = {{']
+    lines.extend(f'    {{{text}}},' for text in entries)
+    lines.extend(['};', '', ''])
+    lines.extend(definitions)
+    lines.extend(['// Before the game can call any of them',
+                  'static bool REGISTERED = (RegisterProfiledFunctions('
+                  f'GENERATED_FUNCTIONS, {len(entries)}), true);'])
+    return '\n'.join(lines) + '\n'
+
+
+def entry(owner: str, name: str, types: List[str], const: bool,
+          virtual: bool) -> str:
+    # Statics are left as members too, only the parameters' mangling is used
+    member = f'void ({owner}::*)({", ".join(types)})'
+    return (f'"{owner}::{name}", &typeid({member}), '
+            f'{"true" if const else "false"}, '
+            f'{"true" if virtual else "false"}, NULL, false')
+
+
+def define(owner: str, name: str, result: str, types: List[str],
+           static: bool, const: bool, index: int) -> List[str]:
+    arguments = ', '.join(f'{kind} a{i}' for i, kind in enumerate(types))
+    signature = f'{result} {owner}::{name}({arguments})' + \
+        (' const' if const else '')
+    pointer, values = signature_of(owner, types, static, const)
+    call = f'(({result} (*)({pointer}))function.real)({values})'
+    body = [f'    ProfiledFunction& function = GENERATED_FUNCTIONS[{index}];',
+            '    uint64_t start = BeginProfiledCall(function);']
+    if result == 'void':
+        body.append(f'    {call};')
+        body.append(f'    EndProfiledCall({index}, start);')
+    else:
+        body.append(f'    {result} value = {call};')
+        body.append(f'    EndProfiledCall({index}, start);')
+        body.append('    return value;')
+    return [f'{signature} {{'] + body + ['}', '', '']
+
+
+def signature_of(owner: str, types: List[str], static: bool,
+                 const: bool) -> Tuple[str, str]:
+    """Parameter and argument lists to call a member as a plain function.
+    """
+    values = [f'a{i}' for i in range(len(types))]
+    if not static:
+        types = [f'{"const " if const else ""}{owner} *'] + types
+        values = ['this'] + values
+    return ', '.join(types), ', '.join(values)
+
+
+if __name__ == '__main__':
+    if len(sys.argv) < 2:
+        sys.exit(f'usage: {sys.argv[0]} pwn3.h [hand-written sources...]')
+    sys.stdout.write(generate(sys.argv[1], hand_written(sys.argv[2:])))
@@ -0,0 +1,73 @@
+"""Walk the member functions declared in pwn3.h.
+
+Shared by gen_profile.py here and tools/replay/gen_stubs.py, which generate
+a definition for every declaration that isn't already written by hand.
+"""
+import re
+from typing import Iterator, List, Set, Tuple
+
+CLASS_PATTERN = re.compile(r'^(class|struct)\s+(\w+)\b[^;]*\{')
+METHOD_PATTERN = re.compile(
+    r'^(virtual\s+)?(static\s+)?(.*?)\s*(~\w+|\b\w+)\s*\((.*)\)\s*(const)?\s*;$')
+DEFINITION_PATTERN = re.compile(r'^(?!\s)(?:.*?[\s*&])?(\w+)::(~?\w+)\s*\(')
+
+
+def split_parameters(parameters: str) -> List[str]:
+    """Split a parameter list on the commas that are not inside templates.
+    """
+    result = []
+    depth = 0
+    current = ''
+    for char in parameters:
+        if char in '<(':
+            depth += 1
+        elif char in '>)':
+            depth -= 1
+        if char == ',' and depth == 0:
+            result.append(current.strip())
+            current = ''
+        else:
+            current += char
+    if current.strip() and current.strip() != 'void':
+        result.append(current.strip())
+    return result
+
+
+def hand_written(paths: List[str]) -> Set[str]:
+    """Collect Class::Method names defined at the top level of the sources.
+    """
+    names = set()
+    for path in paths:
+        with open(path) as file:
+            for line in file:
+                match = DEFINITION_PATTERN.match(line)
+                if match:
+                    names.add(f'{match.group(1)}::{match.group(2)}')
+    return names
+
+
+def declarations(header: str) -> Iterator[Tuple[str, re.Match]]:
+    """Walk the member functions of the non-template classes in a header.
+
+    Yields:
+        Tuple[str, re.Match]: owning class and METHOD_PATTERN match, in
+            declaration order, operators left out
+    """
+    depth = 0
+    current = None
+    template = False
+    with open(header) as file:
+        for raw in file:
+            line = raw.split('//')[0].strip()
+            if depth == 0:
+                match = CLASS_PATTERN.match(line)
+                if match:
+                    current = None if template else match.group(2)
+                template = line.startswith('template')
+            elif depth == 1 and current is not None:
+                match = METHOD_PATTERN.match(line)
+                if match and 'operator' not in line:
+                    yield current, match
+            depth += line.count('{') - line.count('}')
+            if depth == 0:
+                current = None if line.startswith('}') else current
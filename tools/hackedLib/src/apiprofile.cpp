@@ -0,0 +1,222 @@
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+#include <regex.h>
+#include <string>
+#include "apiprofile.h"
+#include "hook.h"
+
+
+struct ThreadApiCalls {
+    std::atomic<long> tid;
+    std::atomic<uint64_t> calls[MAX_PROFILED_FUNCTIONS];
+    std::atomic<uint64_t> ns[MAX_PROFILED_FUNCTIONS];
+};
+
+// Set once when the library loads, before the game calls anything
+ProfiledFunction* PROFILED_FUNCTIONS = NULL;
+size_t PROFILED_FUNCTION_COUNT = 0;
+size_t PROFILED_VIRTUAL_COUNT = 0;
+size_t PROFILED_MISSING_COUNT = 0;
+
+ThreadApiCalls THREAD_API_CALLS[MAX_PROFILED_THREADS];
+std::atomic<size_t> THREAD_API_CALL_COUNT(0);
+static __thread ThreadApiCalls* CURRENT_THREAD_API_CALLS = NULL;
+
+
+
+static ThreadApiCalls* GetThreadApiCalls() {
+    if (CURRENT_THREAD_API_CALLS == NULL) {
+        CURRENT_THREAD_API_CALLS = ClaimThreadSlot(THREAD_API_CALLS, THREAD_API_CALL_COUNT);
+    }
+    return CURRENT_THREAD_API_CALLS;
+}
+
+
+static bool IsIdentifier(const std::string& text) {
+    for (char c : text) {
+        if (!isalnum((unsigned char)c) && c != '_') {
+            return false;
+        }
+    }
+    return !text.empty();
+}
+
+
+void SelectProfiledFunctions(const char* selection) {
+    for (size_t i = 0; i < PROFILED_FUNCTION_COUNT; i++) {
+        PROFILED_FUNCTIONS[i].selected = false;
+    }
+    const char* entry = selection;
+    while (*entry != '\0') {
+        const char* end = strchr(entry, ',');
+        std::string pattern(entry, end != NULL ? end - entry : strlen(entry));
+        entry = end != NULL ? end + 1 : entry + pattern.size();
+        // A bare name is a class, anything else a pattern
+        if (IsIdentifier(pattern)) {
+            pattern = "^" + pattern + "::";
+        }
+        regex_t expression;
+        if (pattern.empty() || regcomp(&expression, pattern.c_str(), REG_EXTENDED | REG_NOSUB) != 0) {
+            printf("<Api> Ignoring selection '%s'\n", pattern.c_str());
+            continue;
+        }
+        for (size_t i = 0; i < PROFILED_FUNCTION_COUNT; i++) {
+            ProfiledFunction& function = PROFILED_FUNCTIONS[i];
+            if (function.real != NULL && regexec(&expression, function.name, 0, NULL, 0) == 0) {
+                function.selected = true;
+            }
+        }
+        regfree(&expression);
+    }
+}
+
+
+size_t GetProfiledFunctionCount() {
+    return PROFILED_FUNCTION_COUNT;
+}
+
+
+// The symbol is rebuilt from the member pointer type's mangling, which is
+// M<class>Fv<parameters>E, so the compiler does the hard part
+static bool GetSymbolName(const ProfiledFunction& function, std::string& symbol) {
+    const char* type = function.type->name();
+    const char* method = strstr(function.name, "::");
+    if (type[0] != 'M' || !isdigit((unsigned char)type[1]) || method == NULL) {
+        return false;
+    }
+    char* classEnd;
+    size_t classLength = strtoul(type + 1, &classEnd, 10);
+    classEnd += classLength;
+    size_t typeLength = strlen(type);
+    if ((size_t)(classEnd - type) + 3 > typeLength || strncmp(classEnd, "Fv", 2) != 0) {
+        return false;
+    }
+    symbol = "_ZN";
+    if (function.isConst) {
+        symbol += "K";
+    }
+    symbol.append(type + 1, classEnd - type - 1);
+    symbol += std::to_string(strlen(method + 2)) + (method + 2) + "E";
+    symbol.append(classEnd + 2, type + typeLength - 1 - (classEnd + 2));
+    return true;
+}
+
+
+// Looking the symbol up twice is harmless, so racing threads don't need a lock
+static void* ResolveProfiledFunction(ProfiledFunction& function) {
+    std::string symbol;
+    if (function.real == NULL && GetSymbolName(function, symbol)) {
+        function.real = RealFunction<void*>(symbol.c_str());
+    }
+    return function.real;
+}
+
+
+void RegisterProfiledFunctions(ProfiledFunction* functions, size_t count) {
+    PROFILED_FUNCTIONS = functions;
+    PROFILED_FUNCTION_COUNT = count;
+    PROFILED_VIRTUAL_COUNT = 0;
+    PROFILED_MISSING_COUNT = 0;
+    // The game can't call what it doesn't define, and without this build our
+    // own code would have had nothing to call either, so those entries are
+    // only left out of selection and the report
+    for (size_t i = 0; i < count; i++) {
+        if (ResolveProfiledFunction(functions[i]) == NULL) {
+            fprintf(stderr, "<Api> %s isn't in the game library, not profiling it\n", functions[i].name);
+            PROFILED_MISSING_COUNT++;
+        }
+        else if (functions[i].isVirtual) {
+            PROFILED_VIRTUAL_COUNT++;
+        }
+    }
+    const char* selection = getenv("PWN3_API_PROFILE");
+    if (selection != NULL) {
+        SelectProfiledFunctions(selection);
+    }
+}
+
+
+uint64_t BeginProfiledCall(ProfiledFunction& function) {
+    if (function.real == NULL) {
+        ResolveProfiledFunction(function);
+    }
+    return function.selected ? GetNanoseconds() : 0;
+}
+
+
+void EndProfiledCall(size_t index, uint64_t start) {
+    if (start == 0) {
+        return;
+    }
+    uint64_t elapsed = GetNanoseconds() - start;
+    ThreadApiCalls* slot = GetThreadApiCalls();
+    slot->calls[index].fetch_add(1, std::memory_order_relaxed);
+    slot->ns[index].fetch_add(elapsed, std::memory_order_relaxed);
+}
+
+
+void ResetApiProfile() {
+    for (size_t t = 0; t < MAX_PROFILED_THREADS; t++) {
+        for (size_t i = 0; i < MAX_PROFILED_FUNCTIONS; i++) {
+            THREAD_API_CALLS[t].calls[i].store(0, std::memory_order_relaxed);
+            THREAD_API_CALLS[t].ns[i].store(0, std::memory_order_relaxed);
+        }
+    }
+}
+
+
+struct ApiTotal {
+    size_t index;
+    uint64_t calls;
+    uint64_t ns;
+    // The thread that spent the most time in it
+    long tid;
+    uint64_t threadNs;
+};
+
+
+void ReportApiProfile(FILE* out) {
+    if (PROFILED_FUNCTIONS == NULL) {
+        fprintf(out, "<Api> Not profiling, preload the library built with 'make profile'\n");
+        return;
+    }
+    size_t threads = std::min(THREAD_API_CALL_COUNT.load(std::memory_order_relaxed), MAX_PROFILED_THREADS);
+    static ApiTotal totals[MAX_PROFILED_FUNCTIONS];
+    size_t count = 0;
+    size_t selected = 0;
+    for (size_t i = 0; i < PROFILED_FUNCTION_COUNT; i++) {
+        selected += PROFILED_FUNCTIONS[i].selected;
+        ApiTotal total = {i, 0, 0, 0, 0};
+        for (size_t t = 0; t < threads; t++) {
+            uint64_t ns = THREAD_API_CALLS[t].ns[i].load(std::memory_order_relaxed);
+            total.calls += THREAD_API_CALLS[t].calls[i].load(std::memory_order_relaxed);
+            total.ns += ns;
+            if (ns > total.threadNs) {
+                total.threadNs = ns;
+                total.tid = THREAD_API_CALLS[t].tid.load(std::memory_order_relaxed);
+            }
+        }
+        if (total.calls > 0) {
+            totals[count++] = total;
+        }
+    }
+    std::sort(totals, totals + count, [](const ApiTotal& a, const ApiTotal& b) {
+        return a.ns > b.ns;
+    });
+
+    fprintf(out, "<Api> %lu of %lu functions timed, %lu called, on %lu threads\n", (unsigned long)selected,
+            (unsigned long)(PROFILED_FUNCTION_COUNT - PROFILED_MISSING_COUNT), (unsigned long)count,
+            (unsigned long)threads);
+    fprintf(out, "<Api> Not counted: calls through a vtable to the %lu virtual ones, and the hooks written by "
+            "hand like World::Tick\n", (unsigned long)PROFILED_VIRTUAL_COUNT);
+    for (size_t i = 0; i < count && i < API_REPORT_FUNCTIONS; i++) {
+        const ApiTotal& total = totals[i];
+        fprintf(out, "    %s: %lu calls, %.2f ms, %.2f us each, %.0f%% on thread %ld\n",
+                PROFILED_FUNCTIONS[total.index].name, (unsigned long)total.calls, total.ns / 1e6,
+                total.ns / 1e3 / total.calls, total.ns > 0 ? 100.0 * total.threadNs / total.ns : 100.0, total.tid);
+    }
+    fflush(out);
+}
@@ -0,0 +1,48 @@
+#ifndef APIPROFILE_H
+#define APIPROFILE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <typeinfo>
+
+const size_t MAX_PROFILED_FUNCTIONS = 1024;
+// Threads claim a table on their first profiled call, the last one is shared on overflow
+const size_t MAX_PROFILED_THREADS = 64;
+const size_t API_REPORT_FUNCTIONS = 25;
+
+
+// One game function with a generated interposer, see gen_profile.py
+struct ProfiledFunction {
+    // Class::Method
+    const char* name;
+    // void (Class::*)(parameters), whose mangled name carries the parameters' mangling
+    const std::type_info* type;
+    bool isConst;
+    // Only counted when called directly, the game's calls through a vtable never see it
+    bool isVirtual;
+    // The game's own definition, looked up at registration or on an earlier first call
+    void* real;
+    bool selected;
+};
+
+
+// PWN3_API_PROFILE picks what is timed, as a comma separated list of class
+// names and extended regular expressions matched against Class::Method.
+// Everything else passes straight through its interposer. The generated
+// table registers itself when the profiling build of the library loads, and
+// functions the game library doesn't have are left out of it.
+void RegisterProfiledFunctions(ProfiledFunction *, size_t);
+void SelectProfiledFunctions(const char *);
+size_t GetProfiledFunctionCount();
+void ResetApiProfile();
+void ReportApiProfile(FILE *);
+
+// Interposers bracket the real call with these, so calls are timed
+// inclusively. Begin looks up the game's definition if the call comes before
+// registration and returns 0 for functions that aren't selected, which End
+// then ignores. Each thread adds into its own table.
+uint64_t BeginProfiledCall(ProfiledFunction &);
+void EndProfiledCall(size_t, uint64_t);
+
+#endif
@@ -0,0 +1,395 @@
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "board.h"
+#include "events.h"
+#include "hook.h"
+
+// "PCB1"
+const uint32_t BOARD_MAGIC = 0x31424350;
+const uint32_t BOARD_VERSION = 1;
+// Lease times are kept in 1/16 s ticks since the board was created
+const float BOARD_TICKS_PER_SECOND = 16;
+// A claim is key:32 owner:6 expiry:26, the expiry wraps after about 48 days
+const uint32_t CLAIM_EXPIRY_BITS = 26;
+const uint32_t CLAIM_EXPIRY_MASK = (1u << CLAIM_EXPIRY_BITS) - 1;
+const size_t NO_CLIENT = (size_t)-1;
+// How long to wait for another client to finish setting up a new board
+const int BOARD_SETUP_WAIT_MS = 1000;
+
+
+
+static uint64_t MakeClaim(uint32_t key, size_t owner, uint32_t expiry) {
+    return ((uint64_t)key << 32) | ((uint64_t)(owner + 1) << CLAIM_EXPIRY_BITS) | (expiry & CLAIM_EXPIRY_MASK);
+}
+
+
+static uint32_t ClaimKey(uint64_t claim) {
+    return (uint32_t)(claim >> 32);
+}
+
+
+static size_t ClaimOwner(uint64_t claim) {
+    return (size_t)((uint32_t)claim >> CLAIM_EXPIRY_BITS) - 1;
+}
+
+
+CoordinationBoard::CoordinationBoard() :
+    m_header(NULL), m_index(NO_CLIENT), m_pid(0), m_contested(0) {
+}
+
+
+CoordinationBoard::~CoordinationBoard() {
+    this->Close();
+}
+
+
+bool CoordinationBoard::Open(const char* name) {
+    this->Close();
+
+    int fd = shm_open(name, O_RDWR | O_CREAT, 0600);
+    if (fd < 0) {
+        printf("<Board> Could not open %s\n", name);
+        return false;
+    }
+    // A fresh object is empty, an existing one has to be the shape we expect
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (st.st_size == 0 && ftruncate(fd, sizeof(Header)) != 0) ||
+            (st.st_size != 0 && (size_t)st.st_size != sizeof(Header))) {
+        printf("<Board> %s has the wrong size\n", name);
+        close(fd);
+        return false;
+    }
+    void* mapping = mmap(NULL, sizeof(Header), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        printf("<Board> Could not map %s\n", name);
+        return false;
+    }
+    Header* header = (Header*)mapping;
+
+    // Whoever gets here first sets the board up, everyone else waits for it
+    uint32_t state = 0;
+    if (header->state.compare_exchange_strong(state, 1)) {
+        header->magic = BOARD_MAGIC;
+        header->version = BOARD_VERSION;
+        header->epochNs = GetNanoseconds();
+        header->state.store(2, std::memory_order_release);
+    }
+    for (int waited = 0; header->state.load(std::memory_order_acquire) != 2 && waited < BOARD_SETUP_WAIT_MS; waited++) {
+        struct timespec pause = {0, 1000000};
+        nanosleep(&pause, NULL);
+    }
+    if (header->state.load(std::memory_order_acquire) != 2 || header->magic != BOARD_MAGIC ||
+            header->version != BOARD_VERSION) {
+        printf("<Board> %s isn't a board we understand\n", name);
+        munmap(mapping, sizeof(Header));
+        return false;
+    }
+
+    m_header = header;
+    m_pid = (uint32_t)getpid();
+    if (!this->Join()) {
+        printf("<Board> %s has no free client slots, waiting for one\n", name);
+    }
+    return true;
+}
+
+
+void CoordinationBoard::Close() {
+    if (m_header == NULL) {
+        return;
+    }
+    // Hand back our claims and slot rather than waiting for them to lapse,
+    // unless the slot has gone to someone else and the claims with it
+    if (m_index != NO_CLIENT) {
+        uint64_t lease = m_header->clients[m_index].lease.load();
+        if ((uint32_t)(lease >> 32) == m_pid) {
+            this->ClearClaims(m_index);
+            m_header->clients[m_index].lease.compare_exchange_strong(lease, 0);
+        }
+    }
+    munmap(m_header, sizeof(Header));
+    m_header = NULL;
+    m_index = NO_CLIENT;
+}
+
+
+bool CoordinationBoard::IsOpen() const {
+    return m_header != NULL;
+}
+
+
+bool CoordinationBoard::HasClientSlot() const {
+    return m_header != NULL && m_index != NO_CLIENT;
+}
+
+
+size_t CoordinationBoard::GetClientIndex() const {
+    return m_index;
+}
+
+
+uint32_t CoordinationBoard::Now() const {
+    return (uint32_t)((GetNanoseconds() - m_header->epochNs) * BOARD_TICKS_PER_SECOND / 1e9);
+}
+
+
+// Take over the first slot that is free, has lapsed or belongs to a dead process
+bool CoordinationBoard::Join() {
+    uint32_t now = this->Now();
+    uint64_t lease = ((uint64_t)m_pid << 32) | (uint32_t)(now + BOARD_CLIENT_LEASE * BOARD_TICKS_PER_SECOND);
+    for (size_t i = 0; i < MAX_BOARD_CLIENTS; i++) {
+        Client& client = m_header->clients[i];
+        uint64_t current = client.lease.load(std::memory_order_acquire);
+        pid_t holder = (pid_t)(current >> 32);
+        bool dead = holder != 0 && kill(holder, 0) != 0 && errno == ESRCH;
+        if ((this->IsClientLive(current, now) && !dead) || !client.lease.compare_exchange_strong(current, lease)) {
+            continue;
+        }
+        // Claims the last holder left under this index would look like ours
+        this->ClearClaims(i);
+        m_index = i;
+        uint32_t sequence = client.sequence.load(std::memory_order_relaxed);
+        client.sequence.store(sequence + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        memset(&client.pose, 0, sizeof(client.pose));
+        client.pose.pid = m_pid;
+        client.sequence.store(sequence + 2, std::memory_order_release);
+        return true;
+    }
+    return false;
+}
+
+
+void CoordinationBoard::ClearClaims(size_t index) {
+    for (size_t i = 0; i < BOARD_CLAIM_SLOTS; i++) {
+        uint64_t claim = m_header->claims[i].load(std::memory_order_relaxed);
+        if (claim != 0 && ClaimOwner(claim) == index) {
+            m_header->claims[i].compare_exchange_strong(claim, 0);
+        }
+    }
+}
+
+
+bool CoordinationBoard::IsClientLive(uint64_t lease, uint32_t now) const {
+    return lease != 0 && (int32_t)((uint32_t)lease - now) > 0;
+}
+
+
+bool CoordinationBoard::IsClaimLive(uint64_t claim, uint32_t now) const {
+    uint32_t left = ((uint32_t)claim - now) & CLAIM_EXPIRY_MASK;
+    return claim != 0 && left != 0 && left < (CLAIM_EXPIRY_MASK >> 1);
+}
+
+
+size_t CoordinationBoard::Home(uint32_t key) const {
+    return (size_t)((key * 2654435761u) >> 20) % BOARD_CLAIM_SLOTS;
+}
+
+
+// Renew our slot and write our pose under the sequence lock
+void CoordinationBoard::Publish(const char* name, const char* region, float x, float y, float z, float yaw) {
+    if (m_header == NULL) {
+        return;
+    }
+    uint32_t now = this->Now();
+    uint64_t lease = ((uint64_t)m_pid << 32) | (uint32_t)(now + BOARD_CLIENT_LEASE * BOARD_TICKS_PER_SECOND);
+    if (m_index != NO_CLIENT) {
+        // A stall longer than the lease can lose the slot to someone else
+        uint64_t current = m_header->clients[m_index].lease.load(std::memory_order_relaxed);
+        if ((uint32_t)(current >> 32) != m_pid ||
+                !m_header->clients[m_index].lease.compare_exchange_strong(current, lease)) {
+            m_index = NO_CLIENT;
+        }
+    }
+    if (m_index == NO_CLIENT && !this->Join()) {
+        return;
+    }
+
+    Client& client = m_header->clients[m_index];
+    uint32_t sequence = client.sequence.load(std::memory_order_relaxed);
+    client.sequence.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    client.pose.pid = m_pid;
+    client.pose.region = EventStore::Key(region);
+    client.pose.x = x;
+    client.pose.y = y;
+    client.pose.z = z;
+    client.pose.yaw = yaw;
+    snprintf(client.pose.name, sizeof(client.pose.name), "%s", name == NULL ? "" : name);
+    client.sequence.store(sequence + 2, std::memory_order_release);
+}
+
+
+// Consistent copies of every live client's pose, our own included
+size_t CoordinationBoard::GetClients(BoardPose* poses, size_t maxCount) const {
+    if (m_header == NULL) {
+        return 0;
+    }
+    uint32_t now = this->Now();
+    size_t count = 0;
+    for (size_t i = 0; i < MAX_BOARD_CLIENTS && count < maxCount; i++) {
+        const Client& client = m_header->clients[i];
+        if (!this->IsClientLive(client.lease.load(std::memory_order_acquire), now)) {
+            continue;
+        }
+        // A writer that died mid-update leaves the sequence odd, so give up eventually
+        for (int attempt = 0; attempt < 100; attempt++) {
+            uint32_t before = client.sequence.load(std::memory_order_acquire);
+            if (before & 1) {
+                continue;
+            }
+            memcpy(&poses[count], (const void*)&client.pose, sizeof(BoardPose));
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (client.sequence.load(std::memory_order_relaxed) == before) {
+                count++;
+                break;
+            }
+        }
+    }
+    return count;
+}
+
+
+bool CoordinationBoard::IsNearOtherClient(const char* region, float x, float y, float z, float radius) const {
+    BoardPose poses[MAX_BOARD_CLIENTS];
+    size_t count = this->GetClients(poses, MAX_BOARD_CLIENTS);
+    uint32_t regionKey = EventStore::Key(region);
+    for (size_t i = 0; i < count; i++) {
+        float dx = poses[i].x - x, dy = poses[i].y - y, dz = poses[i].z - z;
+        if (poses[i].pid != m_pid && poses[i].region == regionKey && dx * dx + dy * dy + dz * dz < radius * radius) {
+            return true;
+        }
+    }
+    return false;
+}
+
+
+// True if the target is now ours. Without a board, or with the probe window
+// full, everyone just goes ahead as they would alone.
+bool CoordinationBoard::Claim(const char* region, uint32_t id) {
+    if (!this->HasClientSlot()) {
+        return true;
+    }
+    uint32_t key = TargetKey(region, id);
+    size_t home = this->Home(key);
+    for (;;) {
+        uint32_t now = this->Now();
+        uint32_t expiry = now + (uint32_t)(BOARD_CLAIM_LEASE * BOARD_TICKS_PER_SECOND);
+        uint64_t wanted = MakeClaim(key, m_index, expiry);
+        size_t free = BOARD_CLAIM_SLOTS;
+        uint64_t freeClaim = 0;
+        for (size_t i = 0; i < BOARD_PROBE_LIMIT; i++) {
+            size_t slot = (home + i) % BOARD_CLAIM_SLOTS;
+            uint64_t claim = m_header->claims[slot].load(std::memory_order_acquire);
+            bool live = this->IsClaimLive(claim, now);
+            if (live && ClaimKey(claim) == key) {
+                if (ClaimOwner(claim) != m_index) {
+                    m_contested++;
+                    return false;
+                }
+                // Ours already, only touch the shared line when the lease runs low
+                uint32_t left = ((uint32_t)claim - now) & CLAIM_EXPIRY_MASK;
+                if (left < BOARD_RENEW_MARGIN * BOARD_TICKS_PER_SECOND) {
+                    m_header->claims[slot].compare_exchange_strong(claim, wanted);
+                }
+                return true;
+            }
+            if (!live && free == BOARD_CLAIM_SLOTS) {
+                free = slot;
+                freeClaim = claim;
+            }
+        }
+        if (free == BOARD_CLAIM_SLOTS) {
+            return true;
+        }
+        if (!m_header->claims[free].compare_exchange_strong(freeClaim, wanted)) {
+            continue;
+        }
+
+        // Someone else may have claimed the same target in another slot while
+        // we weren't looking. Whoever sees the other backs off, so at worst
+        // nobody gets it this tick, never both.
+        for (size_t i = 0; i < BOARD_PROBE_LIMIT; i++) {
+            size_t slot = (home + i) % BOARD_CLAIM_SLOTS;
+            uint64_t claim = m_header->claims[slot].load(std::memory_order_acquire);
+            if (slot != free && ClaimKey(claim) == key && ClaimOwner(claim) != m_index &&
+                    this->IsClaimLive(claim, now)) {
+                m_header->claims[free].compare_exchange_strong(wanted, 0);
+                m_contested++;
+                return false;
+            }
+        }
+        return true;
+    }
+}
+
+
+void CoordinationBoard::Release(const char* region, uint32_t id) {
+    if (!this->HasClientSlot()) {
+        return;
+    }
+    uint32_t key = TargetKey(region, id);
+    size_t home = this->Home(key);
+    for (size_t i = 0; i < BOARD_PROBE_LIMIT; i++) {
+        size_t slot = (home + i) % BOARD_CLAIM_SLOTS;
+        uint64_t claim = m_header->claims[slot].load(std::memory_order_relaxed);
+        if (claim != 0 && ClaimKey(claim) == key && ClaimOwner(claim) == m_index) {
+            m_header->claims[slot].compare_exchange_strong(claim, 0);
+        }
+    }
+}
+
+
+bool CoordinationBoard::IsClaimedByOther(const char* region, uint32_t id) const {
+    if (!this->IsOpen()) {
+        return false;
+    }
+    uint32_t key = TargetKey(region, id);
+    size_t home = this->Home(key);
+    uint32_t now = this->Now();
+    for (size_t i = 0; i < BOARD_PROBE_LIMIT; i++) {
+        uint64_t claim = m_header->claims[(home + i) % BOARD_CLAIM_SLOTS].load(std::memory_order_acquire);
+        if (ClaimKey(claim) == key && ClaimOwner(claim) != m_index && this->IsClaimLive(claim, now)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+
+size_t CoordinationBoard::GetClaimCount() const {
+    if (!this->HasClientSlot()) {
+        return 0;
+    }
+    uint32_t now = this->Now();
+    size_t count = 0;
+    for (size_t i = 0; i < BOARD_CLAIM_SLOTS; i++) {
+        uint64_t claim = m_header->claims[i].load(std::memory_order_relaxed);
+        count += claim != 0 && ClaimOwner(claim) == m_index && this->IsClaimLive(claim, now);
+    }
+    return count;
+}
+
+
+uint64_t CoordinationBoard::GetContested() const {
+    return m_contested;
+}
+
+
+// Actor ids are only unique within a region, so the region is part of the key
+uint32_t CoordinationBoard::TargetKey(const char* region, uint32_t id) {
+    uint32_t key = EventStore::Key(region) * 0x9e3779b1u ^ id;
+    key ^= key >> 16;
+    key *= 0x85ebca6bu;
+    key ^= key >> 13;
+    return key == 0 ? 1 : key;
+}
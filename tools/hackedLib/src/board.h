@@ -0,0 +1,100 @@
+#ifndef BOARD_H
+#define BOARD_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+// Shared memory object every client on the host maps, PWN3_BOARD overrides it
+const char DEFAULT_BOARD_NAME[] = "/pwn3-board";
+// Client indices are packed into 6 bits of a claim, 0 meaning nobody
+const size_t MAX_BOARD_CLIENTS = 63;
+const size_t BOARD_CLAIM_SLOTS = 4096;
+// Slots tried from a target's home slot before the board counts as full
+const size_t BOARD_PROBE_LIMIT = 32;
+const size_t BOARD_NAME_LENGTH = 32;
+// Seconds a client slot or claim survives without being renewed
+const float BOARD_CLIENT_LEASE = 5;
+const float BOARD_CLAIM_LEASE = 3;
+// Claims are renewed once less than this much of their lease is left
+const float BOARD_RENEW_MARGIN = 1.5;
+// Heatmap cells this close to another client's pose are left to them
+const float BOARD_EXPLORE_RADIUS = 3000;
+
+
+// What one client last published about itself
+struct BoardPose {
+    uint32_t pid;
+    uint32_t region;
+    float x;
+    float y;
+    float z;
+    float yaw;
+    char name[BOARD_NAME_LENGTH];
+};
+
+
+// Host-wide board through which hooked clients split up targets. Each client
+// owns one slot, leased by CAS and renewed every tick, and publishes its pose
+// there under a sequence lock. Targets are claimed by CAS on a single word
+// holding the target key, the owner and the lease expiry, so a client that
+// dies simply lets its claims lapse. Nothing ever blocks.
+class CoordinationBoard {
+  public:
+    CoordinationBoard();
+    ~CoordinationBoard();
+    bool Open(const char *);
+    void Close();
+    // Open while the board is mapped, even without a client slot. Publish()
+    // keeps trying to get one, and until then claims act as if we were alone.
+    bool IsOpen() const;
+    bool HasClientSlot() const;
+    size_t GetClientIndex() const;
+
+    void Publish(const char *, const char *, float, float, float, float);
+    size_t GetClients(BoardPose *, size_t) const;
+    bool IsNearOtherClient(const char *, float, float, float, float) const;
+
+    bool Claim(const char *, uint32_t);
+    void Release(const char *, uint32_t);
+    bool IsClaimedByOther(const char *, uint32_t) const;
+    size_t GetClaimCount() const;
+    uint64_t GetContested() const;
+
+    static uint32_t TargetKey(const char *, uint32_t);
+
+  private:
+    struct Client {
+        // Holder pid in the high half, lease expiry in the low half
+        std::atomic<uint64_t> lease;
+        // Odd while the pose is being written
+        std::atomic<uint32_t> sequence;
+        BoardPose pose;
+    };
+
+    struct Header {
+        uint32_t magic;
+        uint32_t version;
+        // 0 fresh, 1 being set up, 2 ready
+        std::atomic<uint32_t> state;
+        uint32_t reserved;
+        // CLOCK_MONOTONIC at creation, lease times count from here
+        uint64_t epochNs;
+        Client clients[MAX_BOARD_CLIENTS];
+        std::atomic<uint64_t> claims[BOARD_CLAIM_SLOTS];
+    };
+
+    Header *m_header;
+    size_t m_index;
+    uint32_t m_pid;
+    uint64_t m_contested;
+
+    uint32_t Now() const;
+    bool Join();
+    void ClearClaims(size_t);
+    bool IsClientLive(uint64_t, uint32_t) const;
+    bool IsClaimLive(uint64_t, uint32_t) const;
+    size_t Home(uint32_t) const;
+};
+
+#endif
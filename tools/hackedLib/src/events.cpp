@@ -0,0 +1,267 @@
+#include <cmath>
+#include <cstdlib>
+#include <ctime>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#include "events.h"
+
+
+EventFilter::EventFilter() :
+    fromTime(0), toTime(0xffffffff), actor(EVENT_ANY), key(EVENT_ANY), region(EVENT_ANY) {
+}
+
+
+EventAggregate::EventAggregate() :
+    count(0), sum(0), min(INFINITY), max(-INFINITY) {
+}
+
+
+static uint64_t MonotonicMilliseconds() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+
+EventStore::EventStore() : m_region(0), m_startTime(MonotonicMilliseconds()) {
+    for (size_t i = 0; i < EventTypeCount; i++) {
+        m_open[i] = NULL;
+    }
+}
+
+
+EventStore::~EventStore() {
+    for (size_t i = 0; i < EventTypeCount; i++) {
+        for (size_t j = 0; j < m_chunks[i].size(); j++) {
+            free(m_chunks[i][j]);
+        }
+    }
+}
+
+
+uint32_t EventStore::Key(const char* name) {
+    if (name == NULL) {
+        return 0;
+    }
+    // FNV-1a, with the wildcard value kept free
+    uint32_t hash = 2166136261u;
+    for (const char* c = name; *c; c++) {
+        hash = (hash ^ (uint8_t)*c) * 16777619u;
+    }
+    return hash == EVENT_ANY ? hash - 1 : hash;
+}
+
+
+uint32_t EventStore::Now() const {
+    return (uint32_t)(MonotonicMilliseconds() - m_startTime);
+}
+
+
+void EventStore::SetRegion(const char* region) {
+    uint32_t key = EventStore::Key(region);
+    if (key == m_region) {
+        return;
+    }
+    // Chunks never span regions, so a region filter is answered by zone maps
+    m_region = key;
+    for (size_t i = 0; i < EventTypeCount; i++) {
+        m_open[i] = NULL;
+    }
+}
+
+
+uint32_t EventStore::GetRegion() const {
+    return m_region;
+}
+
+
+EventStore::Chunk * EventStore::GetOpenChunk(EventType type) {
+    Chunk* chunk = m_open[type];
+    if (chunk != NULL && chunk->count < EVENT_CHUNK_ROWS) {
+        return chunk;
+    }
+
+    // Header and columns share one allocation, each column 64-byte aligned
+    size_t header = (sizeof(Chunk) + 63) & ~(size_t)63;
+    size_t columns = type == PositionEvent ? 6 : 4;
+    chunk = (Chunk*)aligned_alloc(64, header + columns * EVENT_CHUNK_ROWS * sizeof(uint32_t));
+    if (chunk == NULL) {
+        return NULL;
+    }
+    char* column = (char*)chunk + header;
+    chunk->time = (uint32_t*)column;
+    chunk->actor = (uint32_t*)(column += EVENT_CHUNK_ROWS * sizeof(uint32_t));
+    chunk->key = (uint32_t*)(column += EVENT_CHUNK_ROWS * sizeof(uint32_t));
+    chunk->value = (float*)(column += EVENT_CHUNK_ROWS * sizeof(uint32_t));
+    chunk->y = NULL;
+    chunk->z = NULL;
+    if (type == PositionEvent) {
+        chunk->y = (float*)(column += EVENT_CHUNK_ROWS * sizeof(float));
+        chunk->z = (float*)(column += EVENT_CHUNK_ROWS * sizeof(float));
+    }
+    chunk->count = 0;
+    chunk->region = m_region;
+    chunk->minTime = chunk->minActor = chunk->minKey = 0xffffffff;
+    chunk->maxTime = chunk->maxActor = chunk->maxKey = 0;
+
+    m_chunks[type].push_back(chunk);
+    m_open[type] = chunk;
+    return chunk;
+}
+
+
+size_t EventStore::Append(EventType type, uint32_t actor, uint32_t key) {
+    Chunk* chunk = this->GetOpenChunk(type);
+    if (chunk == NULL) {
+        return EVENT_CHUNK_ROWS;
+    }
+    uint32_t time = this->Now();
+    size_t row = chunk->count++;
+    chunk->time[row] = time;
+    chunk->actor[row] = actor;
+    chunk->key[row] = key;
+
+    // Maintain zone maps
+    if (time < chunk->minTime) chunk->minTime = time;
+    if (time > chunk->maxTime) chunk->maxTime = time;
+    if (actor < chunk->minActor) chunk->minActor = actor;
+    if (actor > chunk->maxActor) chunk->maxActor = actor;
+    if (key < chunk->minKey) chunk->minKey = key;
+    if (key > chunk->maxKey) chunk->maxKey = key;
+    return row;
+}
+
+
+void EventStore::Append(EventType type, uint32_t actor, uint32_t key, float value) {
+    size_t row = this->Append(type, actor, key);
+    if (row < EVENT_CHUNK_ROWS) {
+        m_open[type]->value[row] = value;
+    }
+}
+
+
+void EventStore::AppendPosition(uint32_t actor, float x, float y, float z) {
+    size_t row = this->Append(PositionEvent, actor, m_region);
+    if (row < EVENT_CHUNK_ROWS) {
+        m_open[PositionEvent]->value[row] = x;
+        m_open[PositionEvent]->y[row] = y;
+        m_open[PositionEvent]->z[row] = z;
+    }
+}
+
+
+size_t EventStore::GetCount(EventType type) const {
+    size_t count = 0;
+    for (size_t i = 0; i < m_chunks[type].size(); i++) {
+        count += m_chunks[type][i]->count;
+    }
+    return count;
+}
+
+
+bool EventStore::Overlaps(const Chunk* chunk, const EventFilter& filter) {
+    if (chunk->count == 0) {
+        return false;
+    }
+    if (filter.region != EVENT_ANY && filter.region != chunk->region) {
+        return false;
+    }
+    if (filter.fromTime > chunk->maxTime || filter.toTime < chunk->minTime) {
+        return false;
+    }
+    if (filter.actor != EVENT_ANY && (filter.actor < chunk->minActor || filter.actor > chunk->maxActor)) {
+        return false;
+    }
+    if (filter.key != EVENT_ANY && (filter.key < chunk->minKey || filter.key > chunk->maxKey)) {
+        return false;
+    }
+    return true;
+}
+
+
+void EventStore::Scan(const Chunk* chunk, const EventFilter& filter, EventAggregate& result) {
+    size_t count = chunk->count;
+    size_t row = 0;
+    bool anyActor = filter.actor == EVENT_ANY;
+    bool anyKey = filter.key == EVENT_ANY;
+
+#ifdef __SSE2__
+    // SSE2 only has signed compares, so bias the unsigned timestamps
+    const __m128i bias = _mm_set1_epi32((int)0x80000000);
+    const __m128i from = _mm_xor_si128(_mm_set1_epi32((int)filter.fromTime), bias);
+    const __m128i to = _mm_xor_si128(_mm_set1_epi32((int)filter.toTime), bias);
+    const __m128i actor = _mm_set1_epi32((int)filter.actor);
+    const __m128i key = _mm_set1_epi32((int)filter.key);
+    const __m128 positiveInfinity = _mm_set1_ps(INFINITY);
+    const __m128 negativeInfinity = _mm_set1_ps(-INFINITY);
+    __m128 sum = _mm_setzero_ps();
+    __m128 min = positiveInfinity;
+    __m128 max = negativeInfinity;
+    uint64_t matched = 0;
+
+    for (; row + 4 <= count; row += 4) {
+        __m128i time = _mm_xor_si128(_mm_load_si128((const __m128i*)(chunk->time + row)), bias);
+        __m128i outside = _mm_or_si128(_mm_cmpgt_epi32(from, time), _mm_cmpgt_epi32(time, to));
+        __m128i mask = _mm_andnot_si128(outside, _mm_set1_epi32(-1));
+        if (!anyActor) {
+            mask = _mm_and_si128(mask, _mm_cmpeq_epi32(_mm_load_si128((const __m128i*)(chunk->actor + row)), actor));
+        }
+        if (!anyKey) {
+            mask = _mm_and_si128(mask, _mm_cmpeq_epi32(_mm_load_si128((const __m128i*)(chunk->key + row)), key));
+        }
+        __m128 lanes = _mm_castsi128_ps(mask);
+        int bits = _mm_movemask_ps(lanes);
+        if (bits == 0) {
+            continue;
+        }
+        matched += __builtin_popcount(bits);
+        __m128 value = _mm_load_ps(chunk->value + row);
+        __m128 selected = _mm_and_ps(lanes, value);
+        sum = _mm_add_ps(sum, selected);
+        min = _mm_min_ps(min, _mm_or_ps(selected, _mm_andnot_ps(lanes, positiveInfinity)));
+        max = _mm_max_ps(max, _mm_or_ps(selected, _mm_andnot_ps(lanes, negativeInfinity)));
+    }
+
+    // Fold the lanes into the running aggregate
+    float lanes[4];
+    _mm_storeu_ps(lanes, sum);
+    result.sum += (double)lanes[0] + lanes[1] + lanes[2] + lanes[3];
+    _mm_storeu_ps(lanes, min);
+    for (size_t i = 0; i < 4; i++) {
+        result.min = lanes[i] < result.min ? lanes[i] : result.min;
+    }
+    _mm_storeu_ps(lanes, max);
+    for (size_t i = 0; i < 4; i++) {
+        result.max = lanes[i] > result.max ? lanes[i] : result.max;
+    }
+    result.count += matched;
+#endif
+
+    // Whatever doesn't fill a full vector
+    for (; row < count; row++) {
+        uint32_t time = chunk->time[row];
+        if (time < filter.fromTime || time > filter.toTime ||
+                (!anyActor && chunk->actor[row] != filter.actor) ||
+                (!anyKey && chunk->key[row] != filter.key)) {
+            continue;
+        }
+        float value = chunk->value[row];
+        result.count++;
+        result.sum += value;
+        result.min = value < result.min ? value : result.min;
+        result.max = value > result.max ? value : result.max;
+    }
+}
+
+
+EventAggregate EventStore::Aggregate(EventType type, const EventFilter& filter) const {
+    EventAggregate result;
+    const std::vector<Chunk*>& chunks = m_chunks[type];
+    for (size_t i = 0; i < chunks.size(); i++) {
+        if (EventStore::Overlaps(chunks[i], filter)) {
+            EventStore::Scan(chunks[i], filter, result);
+        }
+    }
+    return result;
+}
@@ -0,0 +1,91 @@
+#ifndef EVENTS_H
+#define EVENTS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Rows per chunk, a multiple of the SIMD width
+const size_t EVENT_CHUNK_ROWS = 4096;
+// Wildcard for actor, key and region filters
+const uint32_t EVENT_ANY = 0xffffffff;
+
+enum EventType {
+    HealthEvent,    // actor = actor, value = new health
+    DamageEvent,    // actor = victim, key = our weapon if we just attacked it else 0, value = damage
+    AttackEvent,    // actor = attacker, key = interned attack name, value = target
+    StateEvent,     // actor = actor, key = interned state name, value = enabled
+    PickupEvent,    // actor = player, key = item, value = count
+    KillEvent,      // actor = killer, key = weapon, value = killed
+    PositionEvent,  // actor = actor, value = x, y, z
+    EventTypeCount
+};
+
+
+struct EventFilter {
+    uint32_t fromTime;
+    uint32_t toTime;
+    uint32_t actor;
+    uint32_t key;
+    uint32_t region;
+
+    EventFilter();
+};
+
+
+struct EventAggregate {
+    uint64_t count;
+    double sum;
+    float min;
+    float max;
+
+    EventAggregate();
+};
+
+
+// Append-only store of decoded session events, split per type into columnar
+// chunks. Each chunk keeps min/max zone maps so queries skip whole chunks
+// before scanning the survivors four rows at a time.
+class EventStore {
+  public:
+    EventStore();
+    ~EventStore();
+    static uint32_t Key(const char *);
+    uint32_t Now() const;
+    void SetRegion(const char *);
+    uint32_t GetRegion() const;
+    void Append(EventType, uint32_t, uint32_t, float);
+    void AppendPosition(uint32_t, float, float, float);
+    size_t GetCount(EventType) const;
+    EventAggregate Aggregate(EventType, const EventFilter &) const;
+
+  private:
+    struct Chunk {
+        uint32_t count;
+        uint32_t region;
+        uint32_t minTime;
+        uint32_t maxTime;
+        uint32_t minActor;
+        uint32_t maxActor;
+        uint32_t minKey;
+        uint32_t maxKey;
+        uint32_t *time;
+        uint32_t *actor;
+        uint32_t *key;
+        float *value;
+        float *y;
+        float *z;
+    };
+
+    std::vector<Chunk *> m_chunks[EventTypeCount];
+    Chunk *m_open[EventTypeCount];
+    uint32_t m_region;
+    uint64_t m_startTime;
+
+    Chunk * GetOpenChunk(EventType);
+    size_t Append(EventType, uint32_t, uint32_t);
+    static bool Overlaps(const Chunk *, const EventFilter &);
+    static void Scan(const Chunk *, const EventFilter &, EventAggregate &);
+};
+
+#endif
@@ -0,0 +1,930 @@
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <vector>
+#include "filter.h"
+#include "hook.h"
+#include "sockets.h"
+
+
+// Body of each known packet after its two byte opcode, as in tools/proxy/parser.py:
+// B u8, ? bool, H u16, h i16, I u32, i i32, f float, s u16 length and text, xN N unknown bytes
+struct PacketLayout {
+    char opcode[3];
+    int direction;
+    const char* fields;
+};
+
+const int BothDirections = -1;
+
+static const PacketLayout LAYOUTS[] = {
+    {{0, 0, 0}, BothDirections, ""},
+    {"mv", BothDirections, "fffx8"},
+    {"jp", BothDirections, "?"},
+    {"rn", BothDirections, "?"},
+    {"s=", BothDirections, "B"},
+    {"*i", BothDirections, "sfff"},
+    {"#*", BothDirections, "s"},
+    {"mk", BothDirections, "IIBsfff"},
+    {"ch", BothDirections, "s"},
+    {"cp", BothDirections, "sI"},
+    {"ee", BothDirections, "I"},
+    // Asking for a reload is empty, the answer names weapon and ammo
+    {"rl", FilterOutbound, ""},
+    {"rl", FilterInbound, "ssI"},
+    {"++", BothDirections, "Ih"},
+    {"ma", BothDirections, "H"},
+    {"ps", BothDirections, "x28"},
+    {"st", BothDirections, "Is"},
+    {"tr", BothDirections, "IsI"},
+    {"la", BothDirections, "sI"},
+};
+const size_t LAYOUT_COUNT = sizeof(LAYOUTS) / sizeof(LAYOUTS[0]);
+
+
+// Rules sorted by direction and opcode, with the range of each opcode
+struct FilterTable {
+    std::vector<FilterRule> rules;
+    std::atomic<uint64_t>* hits;
+    uint16_t first[FilterDirectionCount][65536];
+    uint16_t count[FilterDirectionCount][65536];
+};
+
+
+// Where a connection's stream stands between two chunks
+struct StreamFraming {
+    // Bytes of a split packet still to come
+    uint32_t skip;
+    // Saw an opcode without a layout, nothing is framed until a chunk frames exactly again
+    bool lost;
+    // Start of a split packet that was cut before its length could be told
+    uint8_t headLength;
+    uint8_t head[MAX_PACKET_HEAD];
+};
+
+
+enum PacketFraming {PacketWhole, PacketSplit, PacketCut, PacketUnknown};
+
+
+enum DelayedState {DelayedFree, DelayedFilling, DelayedReady, DelayedSending};
+
+struct DelayedPacket {
+    std::atomic<int> state;
+    int fd;
+    uint64_t sequence;
+    uint64_t dueNs;
+    size_t length;
+    uint8_t data[MAX_DELAYED_PACKET_SIZE];
+};
+
+// Index into LAYOUTS for each opcode, -1 for ones we can't frame
+int8_t LAYOUT_INDEX[FilterDirectionCount][65536];
+bool LAYOUTS_BUILT = false;
+
+std::atomic<FilterTable*> FILTER(NULL);
+// A send or recv may still be reading a replaced table, so they are only ever retired
+std::vector<FilterTable*> RETIRED_FILTERS;
+
+// Per descriptor and direction, touched only by the thread doing that direction's I/O
+StreamFraming FRAMING[MAX_SOCKETS][FilterDirectionCount];
+
+DelayedPacket DELAYED[MAX_DELAYED_PACKETS];
+std::atomic<uint64_t> DELAYED_SEQUENCE(0);
+
+std::atomic<uint64_t> FILTER_PACKETS(0);
+std::atomic<uint64_t> FILTER_SPLIT(0);
+std::atomic<uint64_t> FILTER_UNKNOWN(0);
+std::atomic<uint64_t> FILTER_OVERFLOW(0);
+std::atomic<uint64_t> FILTER_RESYNCHRONIZED(0);
+FilterOutput FILTER_OUTPUT = NULL;
+
+
+
+static uint16_t GetOpcode(const uint8_t* data) {
+    return data[0] | (data[1] << 8);
+}
+
+
+static void BuildLayoutIndex() {
+    memset(LAYOUT_INDEX, -1, sizeof(LAYOUT_INDEX));
+    for (size_t i = 0; i < LAYOUT_COUNT; i++) {
+        uint16_t opcode = GetOpcode((const uint8_t*)LAYOUTS[i].opcode);
+        for (int direction = 0; direction < FilterDirectionCount; direction++) {
+            if (LAYOUTS[i].direction == BothDirections || LAYOUTS[i].direction == direction) {
+                LAYOUT_INDEX[direction][opcode] = i;
+            }
+        }
+    }
+    LAYOUTS_BUILT = true;
+}
+
+
+static size_t GetFieldSize(char type) {
+    switch (type) {
+        case 'B': case '?': return 1;
+        case 'H': case 'h': return 2;
+        case 'I': case 'i': case 'f': return 4;
+    }
+    return 0;
+}
+
+
+// Finds the fields of a packet body. False when the body isn't all there, with
+// its full length if that is known by then and 0 otherwise.
+static bool FramePacket(const char* layout, const uint8_t* body, size_t available, FilterField* fields,
+                        size_t& fieldCount, size_t& length) {
+    size_t offset = 0;
+    fieldCount = 0;
+    for (const char* type = layout; *type != 0; type++) {
+        size_t size;
+        if (*type == 'x') {
+            char* end;
+            offset += strtoul(type + 1, &end, 10);
+            type = end - 1;
+            continue;
+        }
+        if (*type == 's') {
+            if (offset + 2 > available) {
+                length = 0;
+                return false;
+            }
+            size = 2 + (body[offset] | (body[offset + 1] << 8));
+        }
+        else {
+            size = GetFieldSize(*type);
+        }
+        if (fieldCount < MAX_FILTER_FIELDS) {
+            fields[fieldCount].offset = offset;
+            fields[fieldCount].length = size;
+            fields[fieldCount].type = *type;
+            fieldCount++;
+        }
+        offset += size;
+    }
+    length = offset;
+    return offset <= available;
+}
+
+
+template <typename T, typename Compare>
+static bool TestNumber(const FilterPredicate& predicate, const uint8_t* field, size_t) {
+    T value;
+    memcpy(&value, field, sizeof(T));
+    return Compare()((double)value, predicate.number);
+}
+
+
+static bool TestTextEqual(const FilterPredicate& predicate, const uint8_t* field, size_t length) {
+    return length - 2 == predicate.textLength && memcmp(field + 2, predicate.text, predicate.textLength) == 0;
+}
+
+
+static bool TestTextNotEqual(const FilterPredicate& predicate, const uint8_t* field, size_t length) {
+    return !TestTextEqual(predicate, field, length);
+}
+
+
+static bool TestTextContains(const FilterPredicate& predicate, const uint8_t* field, size_t length) {
+    return memmem(field + 2, length - 2, predicate.text, predicate.textLength) != NULL;
+}
+
+
+template <typename Compare>
+static FilterTest GetNumberTest(char type) {
+    switch (type) {
+        case 'B': return TestNumber<uint8_t, Compare>;
+        case '?': return TestNumber<bool, Compare>;
+        case 'H': return TestNumber<uint16_t, Compare>;
+        case 'h': return TestNumber<int16_t, Compare>;
+        case 'I': return TestNumber<uint32_t, Compare>;
+        case 'i': return TestNumber<int32_t, Compare>;
+        case 'f': return TestNumber<float, Compare>;
+    }
+    return NULL;
+}
+
+
+// Picks the test for a field type and operator once, so matching is one indirect call
+static FilterTest CompileTest(char type, const char* operation) {
+    if (type == 's') {
+        return strcmp(operation, "==") == 0 ? TestTextEqual :
+               strcmp(operation, "!=") == 0 ? TestTextNotEqual :
+               strcmp(operation, "~") == 0 ? TestTextContains : NULL;
+    }
+    return strcmp(operation, "==") == 0 ? GetNumberTest<std::equal_to<double> >(type) :
+           strcmp(operation, "!=") == 0 ? GetNumberTest<std::not_equal_to<double> >(type) :
+           strcmp(operation, "<") == 0 ? GetNumberTest<std::less<double> >(type) :
+           strcmp(operation, "<=") == 0 ? GetNumberTest<std::less_equal<double> >(type) :
+           strcmp(operation, ">") == 0 ? GetNumberTest<std::greater<double> >(type) :
+           strcmp(operation, ">=") == 0 ? GetNumberTest<std::greater_equal<double> >(type) : NULL;
+}
+
+
+template <typename T>
+static void WriteValue(T value, uint8_t* field) {
+    memcpy(field, &value, sizeof(T));
+}
+
+
+static void WriteNumber(char type, double value, uint8_t* field) {
+    switch (type) {
+        case 'B': WriteValue<uint8_t>((int64_t)value, field); break;
+        case '?': WriteValue<bool>(value != 0, field); break;
+        case 'H': WriteValue<uint16_t>((int64_t)value, field); break;
+        case 'h': WriteValue<int16_t>((int64_t)value, field); break;
+        case 'I': WriteValue<uint32_t>((int64_t)value, field); break;
+        case 'i': WriteValue<int32_t>((int64_t)value, field); break;
+        case 'f': WriteValue<float>(value, field); break;
+    }
+}
+
+
+// Splits off the next word, or the next "quoted string"
+static bool NextToken(char*& cursor, char* token, size_t capacity) {
+    while (isspace(*cursor)) {
+        cursor++;
+    }
+    if (*cursor == 0) {
+        return false;
+    }
+    size_t length = 0;
+    if (*cursor == '"') {
+        for (cursor++; *cursor != 0 && *cursor != '"'; cursor++) {
+            if (length + 1 < capacity) {
+                token[length++] = *cursor;
+            }
+        }
+        if (*cursor == '"') {
+            cursor++;
+        }
+    }
+    else {
+        for (; *cursor != 0 && !isspace(*cursor); cursor++) {
+            if (length + 1 < capacity) {
+                token[length++] = *cursor;
+            }
+        }
+    }
+    token[length] = 0;
+    return true;
+}
+
+
+static bool ParseOpcode(const char* token, uint16_t& opcode) {
+    if (strncmp(token, "0x", 2) == 0 && strlen(token) == 6) {
+        char* end;
+        unsigned long value = strtoul(token + 2, &end, 16);
+        // Written in wire order, first byte first
+        opcode = (value >> 8) | ((value & 0xff) << 8);
+        return *end == 0;
+    }
+    if (strlen(token) == 2) {
+        opcode = GetOpcode((const uint8_t*)token);
+        return true;
+    }
+    return false;
+}
+
+
+static bool ParseField(const char* token, const char* layout, uint8_t& field, char& type) {
+    if (token[0] != '$' || !isdigit(token[1])) {
+        return false;
+    }
+    field = atoi(token + 1);
+    size_t index = 0;
+    for (const char* cursor = layout; *cursor != 0; cursor++) {
+        if (*cursor == 'x') {
+            char* end;
+            strtoul(cursor + 1, &end, 10);
+            cursor = end - 1;
+            continue;
+        }
+        if (index++ == field) {
+            type = *cursor;
+            return field < MAX_FILTER_FIELDS;
+        }
+    }
+    return false;
+}
+
+
+// Hex bytes and $N fields, until the end of the line
+static bool ParsePayload(char*& cursor, const char* layout, FilterRule& rule) {
+    char token[128];
+    size_t length = 0;
+    rule.partCount = 0;
+    while (NextToken(cursor, token, sizeof(token))) {
+        if (rule.partCount == MAX_FILTER_PAYLOAD_PARTS) {
+            return false;
+        }
+        FilterPayloadPart& part = rule.parts[rule.partCount++];
+        uint8_t field;
+        char type;
+        if (ParseField(token, layout, field, type)) {
+            part.field = field;
+            part.offset = 0;
+            part.length = 0;
+            continue;
+        }
+        size_t digits = strlen(token);
+        if (digits % 2 != 0 || length + digits / 2 > MAX_FILTER_PAYLOAD) {
+            return false;
+        }
+        part.field = -1;
+        part.offset = length;
+        for (size_t i = 0; i < digits; i += 2) {
+            char pair[3] = {token[i], token[i + 1], 0};
+            char* end;
+            rule.payload[length++] = strtoul(pair, &end, 16);
+            if (*end != 0) {
+                return false;
+            }
+        }
+        part.length = length - part.offset;
+    }
+    return rule.partCount > 0;
+}
+
+
+// Parses one rule, false with a reason for anything it doesn't understand
+static bool ParseRule(char* line, FilterRule& rule, const char*& error) {
+    char token[MAX_FILTER_TEXT];
+    char* cursor = line;
+    memset(&rule, 0, sizeof(rule));
+    error = "expected up or down";
+    if (!NextToken(cursor, token, sizeof(token)) || (strcmp(token, "up") != 0 && strcmp(token, "down") != 0)) {
+        return false;
+    }
+    rule.direction = strcmp(token, "up") == 0 ? FilterOutbound : FilterInbound;
+    error = "expected an opcode";
+    if (!NextToken(cursor, token, sizeof(token)) || !ParseOpcode(token, rule.opcode)) {
+        return false;
+    }
+    error = "no layout for that opcode";
+    int layoutIndex = LAYOUT_INDEX[rule.direction][rule.opcode];
+    if (layoutIndex < 0) {
+        return false;
+    }
+    const char* layout = LAYOUTS[layoutIndex].fields;
+
+    error = "expected if or then";
+    if (!NextToken(cursor, token, sizeof(token))) {
+        return false;
+    }
+    if (strcmp(token, "if") == 0) {
+        do {
+            error = "too many conditions";
+            if (rule.predicateCount == MAX_FILTER_PREDICATES) {
+                return false;
+            }
+            FilterPredicate& predicate = rule.predicates[rule.predicateCount++];
+            char operation[4];
+            char type;
+            error = "expected $N OP VALUE";
+            if (!NextToken(cursor, token, sizeof(token)) || !ParseField(token, layout, predicate.field, type) ||
+                    !NextToken(cursor, operation, sizeof(operation)) ||
+                    !NextToken(cursor, predicate.text, sizeof(predicate.text))) {
+                return false;
+            }
+            predicate.textLength = strlen(predicate.text);
+            predicate.number = strtod(predicate.text, NULL);
+            predicate.test = CompileTest(type, operation);
+            error = "operator doesn't apply to that field";
+            if (predicate.test == NULL) {
+                return false;
+            }
+            error = "expected and or then";
+            if (!NextToken(cursor, token, sizeof(token))) {
+                return false;
+            }
+        } while (strcmp(token, "and") == 0);
+    }
+    if (strcmp(token, "then") != 0 || !NextToken(cursor, token, sizeof(token))) {
+        return false;
+    }
+
+    char type;
+    error = "bad arguments";
+    if (strcmp(token, "drop") == 0) {
+        rule.action = FilterDrop;
+    }
+    else if (strcmp(token, "dup") == 0) {
+        rule.action = FilterDuplicate;
+    }
+    else if (strcmp(token, "set") == 0) {
+        rule.action = FilterSet;
+        if (!NextToken(cursor, token, sizeof(token)) || !ParseField(token, layout, rule.field, type) || type == 's' ||
+                !NextToken(cursor, token, sizeof(token))) {
+            return false;
+        }
+        rule.value = strtod(token, NULL);
+    }
+    else if (strcmp(token, "delay") == 0) {
+        rule.action = FilterDelay;
+        if (!NextToken(cursor, token, sizeof(token))) {
+            return false;
+        }
+        rule.delayNs = strtod(token, NULL) * 1000000;
+        // The game is waiting in recv(), holding its data back isn't ours to do
+        error = "only outbound packets can be delayed here";
+        if (rule.direction != FilterOutbound) {
+            return false;
+        }
+    }
+    else if (strcmp(token, "inject") == 0 || strcmp(token, "reply") == 0) {
+        rule.action = strcmp(token, "inject") == 0 ? FilterInject : FilterReply;
+        if (!ParsePayload(cursor, layout, rule)) {
+            return false;
+        }
+        error = "only inbound packets can be replied to here";
+        if (rule.action == FilterReply && rule.direction != FilterInbound) {
+            return false;
+        }
+    }
+    else {
+        error = "unknown action";
+        return false;
+    }
+    error = "trailing words";
+    return !NextToken(cursor, token, sizeof(token));
+}
+
+
+bool LoadPacketFilter(const char* path) {
+    FILE* file = fopen(path, "r");
+    if (file == NULL) {
+        printf("<Filter> Can't open %s\n", path);
+        return false;
+    }
+    if (!LAYOUTS_BUILT) {
+        BuildLayoutIndex();
+    }
+    FilterTable* table = new FilterTable();
+    char line[512];
+    int number = 0;
+    bool valid = true;
+    while (fgets(line, sizeof(line), file) != NULL) {
+        number++;
+        char* cursor = line;
+        char token[8];
+        // Comments take the whole line, #* is an opcode
+        if (!NextToken(cursor, token, sizeof(token)) || token[0] == '#') {
+            continue;
+        }
+        FilterRule rule;
+        const char* error;
+        if (!ParseRule(line, rule, error)) {
+            printf("<Filter> %s:%d: %s\n", path, number, error);
+            valid = false;
+            continue;
+        }
+        rule.line = number;
+        table->rules.push_back(rule);
+    }
+    fclose(file);
+    if (!valid) {
+        delete table;
+        return false;
+    }
+
+    // Rules of an opcode sit together in file order
+    std::stable_sort(table->rules.begin(), table->rules.end(), [](const FilterRule& a, const FilterRule& b) {
+        return a.direction != b.direction ? a.direction < b.direction : a.opcode < b.opcode;
+    });
+    memset(table->count, 0, sizeof(table->count));
+    for (size_t i = 0; i < table->rules.size(); i++) {
+        const FilterRule& rule = table->rules[i];
+        if (table->count[rule.direction][rule.opcode]++ == 0) {
+            table->first[rule.direction][rule.opcode] = i;
+        }
+    }
+    table->hits = new std::atomic<uint64_t>[table->rules.size() + 1]();
+    FilterTable* previous = FILTER.exchange(table, std::memory_order_acq_rel);
+    if (previous != NULL) {
+        RETIRED_FILTERS.push_back(previous);
+    }
+    printf("<Filter> %lu rules loaded from %s\n", (unsigned long)table->rules.size(), path);
+    return true;
+}
+
+
+void ClearPacketFilter() {
+    FilterTable* previous = FILTER.exchange(NULL, std::memory_order_acq_rel);
+    if (previous != NULL) {
+        RETIRED_FILTERS.push_back(previous);
+    }
+}
+
+
+bool IsPacketFilterActive() {
+    return FILTER.load(std::memory_order_relaxed) != NULL;
+}
+
+
+void ResetPacketFilter(int fd) {
+    if (fd < 0 || fd >= MAX_SOCKETS) {
+        return;
+    }
+    memset(FRAMING[fd], 0, sizeof(FRAMING[fd]));
+    for (size_t i = 0; i < MAX_DELAYED_PACKETS; i++) {
+        int ready = DelayedReady;
+        if (DELAYED[i].fd == fd) {
+            DELAYED[i].state.compare_exchange_strong(ready, DelayedFree);
+        }
+    }
+}
+
+
+static size_t BuildPayload(const FilterRule& rule, const uint8_t* packet, const FilterField* fields, size_t fieldCount,
+                           uint8_t* out, size_t capacity) {
+    size_t length = 0;
+    for (size_t i = 0; i < rule.partCount; i++) {
+        const FilterPayloadPart& part = rule.parts[i];
+        const uint8_t* source = rule.payload + part.offset;
+        size_t size = part.length;
+        if (part.field >= 0) {
+            if ((size_t)part.field >= fieldCount) {
+                continue;
+            }
+            source = packet + 2 + fields[part.field].offset;
+            size = fields[part.field].length;
+        }
+        if (length + size > capacity) {
+            return 0;
+        }
+        memcpy(out + length, source, size);
+        length += size;
+    }
+    return length;
+}
+
+
+static bool DelayPacket(int fd, const uint8_t* packet, size_t length, uint64_t delayNs) {
+    if (length > MAX_DELAYED_PACKET_SIZE) {
+        return false;
+    }
+    for (size_t i = 0; i < MAX_DELAYED_PACKETS; i++) {
+        int expected = DelayedFree;
+        if (!DELAYED[i].state.compare_exchange_strong(expected, DelayedFilling, std::memory_order_acquire)) {
+            continue;
+        }
+        DelayedPacket& delayed = DELAYED[i];
+        delayed.fd = fd;
+        delayed.sequence = DELAYED_SEQUENCE.fetch_add(1, std::memory_order_relaxed);
+        delayed.dueNs = GetNanoseconds() + delayNs;
+        delayed.length = length;
+        memcpy(delayed.data, packet, length);
+        delayed.state.store(DelayedReady, std::memory_order_release);
+        return true;
+    }
+    return false;
+}
+
+
+void SetPacketFilterOutput(FilterOutput output) {
+    FILTER_OUTPUT = output;
+}
+
+
+static bool QueuePacket(int fd, const uint8_t* packet, size_t length) {
+    return FILTER_OUTPUT != NULL && FILTER_OUTPUT(fd, packet, length);
+}
+
+
+static PacketFraming FrameNextPacket(FilterDirection direction, const uint8_t* data, size_t available,
+                                     FilterField* fields, size_t& fieldCount, size_t& length) {
+    if (!LAYOUTS_BUILT) {
+        BuildLayoutIndex();
+    }
+    length = 0;
+    if (available < 2) {
+        return PacketCut;
+    }
+    int layoutIndex = LAYOUT_INDEX[direction][GetOpcode(data)];
+    if (layoutIndex < 0) {
+        return PacketUnknown;
+    }
+    size_t bodyLength;
+    if (FramePacket(LAYOUTS[layoutIndex].fields, data + 2, available - 2, fields, fieldCount, bodyLength)) {
+        length = bodyLength + 2;
+        return PacketWhole;
+    }
+    if (bodyLength > 0) {
+        length = bodyLength + 2;
+        return PacketSplit;
+    }
+    return PacketCut;
+}
+
+
+size_t GetPacketLength(FilterDirection direction, const uint8_t* data, size_t length) {
+    FilterField fields[MAX_FILTER_FIELDS];
+    size_t fieldCount;
+    size_t packetLength;
+    switch (FrameNextPacket(direction, data, length, fields, fieldCount, packetLength)) {
+        case PacketWhole: case PacketSplit: return packetLength;
+        case PacketCut: return length + 1;
+        case PacketUnknown: break;
+    }
+    return 0;
+}
+
+
+static bool FramesExactly(FilterDirection direction, const uint8_t* data, size_t length) {
+    FilterField fields[MAX_FILTER_FIELDS];
+    size_t fieldCount;
+    size_t position = 0;
+    while (position < length) {
+        size_t packetLength;
+        if (FrameNextPacket(direction, data + position, length - position, fields, fieldCount, packetLength) !=
+            PacketWhole) {
+            return false;
+        }
+        position += packetLength;
+    }
+    return true;
+}
+
+
+static void LoseFraming(StreamFraming& framing) {
+    FILTER_UNKNOWN.fetch_add(1, std::memory_order_relaxed);
+    framing.lost = true;
+    framing.skip = 0;
+    framing.headLength = 0;
+}
+
+
+// Passes over the part of a chunk that belongs to a packet from the ones
+// before, and returns where the first packet of its own starts
+static size_t ResumeStream(StreamFraming& framing, FilterDirection direction, const uint8_t* data, size_t length) {
+    if (framing.lost) {
+        // A chunk made of whole packets and nothing else most likely starts on one
+        if (!FramesExactly(direction, data, length)) {
+            return length;
+        }
+        FILTER_RESYNCHRONIZED.fetch_add(1, std::memory_order_relaxed);
+        framing.lost = false;
+        return 0;
+    }
+    if (framing.skip > 0) {
+        size_t skipped = std::min<size_t>(framing.skip, length);
+        framing.skip -= skipped;
+        return skipped;
+    }
+    if (framing.headLength == 0) {
+        return 0;
+    }
+    uint8_t head[MAX_PACKET_HEAD];
+    size_t taken = std::min(length, MAX_PACKET_HEAD - framing.headLength);
+    memcpy(head, framing.head, framing.headLength);
+    memcpy(head + framing.headLength, data, taken);
+    FilterField fields[MAX_FILTER_FIELDS];
+    size_t fieldCount;
+    size_t packetLength;
+    switch (FrameNextPacket(direction, head, framing.headLength + taken, fields, fieldCount, packetLength)) {
+        case PacketWhole:
+        case PacketSplit:
+            packetLength -= framing.headLength;
+            framing.headLength = 0;
+            if (packetLength <= length) {
+                return packetLength;
+            }
+            framing.skip = packetLength - length;
+            return length;
+        case PacketCut:
+            if (taken == length && framing.headLength + taken < MAX_PACKET_HEAD) {
+                memcpy(framing.head + framing.headLength, data, taken);
+                framing.headLength += taken;
+                return length;
+            }
+            break;
+        case PacketUnknown:
+            break;
+    }
+    LoseFraming(framing);
+    return length;
+}
+
+
+// Remembers where a packet that runs past the end of its chunk continues
+static void SplitStream(StreamFraming& framing, PacketFraming result, const uint8_t* packet, size_t available,
+                        size_t packetLength) {
+    if (result == PacketUnknown) {
+        LoseFraming(framing);
+        return;
+    }
+    FILTER_SPLIT.fetch_add(1, std::memory_order_relaxed);
+    if (result == PacketSplit) {
+        framing.skip = packetLength - available;
+    }
+    else if (available < MAX_PACKET_HEAD) {
+        memcpy(framing.head, packet, available);
+        framing.headLength = available;
+    }
+    else {
+        LoseFraming(framing);
+    }
+}
+
+
+void TrackPackets(FilterDirection direction, int fd, const uint8_t* data, size_t length) {
+    if (fd < 0 || fd >= MAX_SOCKETS) {
+        return;
+    }
+    StreamFraming& framing = FRAMING[fd][direction];
+    size_t position = ResumeStream(framing, direction, data, length);
+    while (position < length) {
+        FilterField fields[MAX_FILTER_FIELDS];
+        size_t fieldCount;
+        size_t packetLength;
+        PacketFraming result = FrameNextPacket(direction, data + position, length - position, fields, fieldCount,
+                                               packetLength);
+        if (result != PacketWhole) {
+            SplitStream(framing, result, data + position, length - position, packetLength);
+            break;
+        }
+        position += packetLength;
+    }
+}
+
+
+bool IsAtPacketBoundary(FilterDirection direction, int fd) {
+    if (fd < 0 || fd >= MAX_SOCKETS) {
+        return false;
+    }
+    const StreamFraming& framing = FRAMING[fd][direction];
+    return !framing.lost && framing.skip == 0 && framing.headLength == 0;
+}
+
+
+size_t FilterPackets(FilterDirection direction, int fd, const uint8_t* data, size_t length, uint8_t* out,
+                     size_t capacity) {
+    FilterTable* table = FILTER.load(std::memory_order_acquire);
+    if (table == NULL || length > capacity || fd < 0 || fd >= MAX_SOCKETS) {
+        size_t copied = std::min(length, capacity);
+        memcpy(out, data, copied);
+        if (fd >= 0 && fd < MAX_SOCKETS) {
+            TrackPackets(direction, fd, data, copied);
+        }
+        return copied;
+    }
+    StreamFraming& framing = FRAMING[fd][direction];
+    size_t position = ResumeStream(framing, direction, data, length);
+    memcpy(out, data, position);
+    size_t written = position;
+
+    while (position < length) {
+        const uint8_t* packet = data + position;
+        size_t available = length - position;
+        FilterField fields[MAX_FILTER_FIELDS];
+        size_t fieldCount;
+        size_t packetLength;
+        PacketFraming result = FrameNextPacket(direction, packet, available, fields, fieldCount, packetLength);
+        if (result != PacketWhole) {
+            SplitStream(framing, result, packet, available, packetLength);
+            break;
+        }
+        uint16_t opcode = GetOpcode(packet);
+        size_t count = table->count[direction][opcode];
+        memcpy(out + written, packet, packetLength);
+        position += packetLength;
+        if (count == 0) {
+            written += packetLength;
+            continue;
+        }
+        FILTER_PACKETS.fetch_add(1, std::memory_order_relaxed);
+
+        // Growth has to leave room for the rest of the chunk as it is
+        size_t room = capacity - written - packetLength - (length - position);
+        uint8_t* copy = out + written;
+        bool keep = true;
+        size_t extra = 0;
+        size_t first = table->first[direction][opcode];
+        for (size_t i = first; i < first + count && keep; i++) {
+            const FilterRule& rule = table->rules[i];
+            bool matched = true;
+            for (size_t p = 0; p < rule.predicateCount && matched; p++) {
+                const FilterPredicate& predicate = rule.predicates[p];
+                matched = predicate.field < fieldCount &&
+                          predicate.test(predicate, copy + 2 + fields[predicate.field].offset,
+                                         fields[predicate.field].length);
+            }
+            if (!matched) {
+                continue;
+            }
+            table->hits[i].fetch_add(1, std::memory_order_relaxed);
+            uint8_t payload[MAX_FILTER_PAYLOAD + 256];
+            size_t payloadLength;
+            switch (rule.action) {
+                case FilterDrop:
+                    keep = false;
+                    break;
+                case FilterSet:
+                    if (rule.field < fieldCount) {
+                        WriteNumber(fields[rule.field].type, rule.value, copy + 2 + fields[rule.field].offset);
+                    }
+                    break;
+                case FilterDelay:
+                    keep = !DelayPacket(fd, copy, packetLength, rule.delayNs);
+                    break;
+                case FilterDuplicate:
+                    if (extra + packetLength > room) {
+                        FILTER_OVERFLOW.fetch_add(1, std::memory_order_relaxed);
+                        break;
+                    }
+                    memcpy(copy + packetLength + extra, copy, packetLength);
+                    extra += packetLength;
+                    break;
+                case FilterInject:
+                    payloadLength = BuildPayload(rule, copy, fields, fieldCount, payload, sizeof(payload));
+                    if (extra + payloadLength > room) {
+                        FILTER_OVERFLOW.fetch_add(1, std::memory_order_relaxed);
+                        break;
+                    }
+                    memcpy(copy + packetLength + extra, payload, payloadLength);
+                    extra += payloadLength;
+                    break;
+                case FilterReply:
+                    payloadLength = BuildPayload(rule, copy, fields, fieldCount, payload, sizeof(payload));
+                    if (payloadLength > 0 && !QueuePacket(fd, payload, payloadLength)) {
+                        FILTER_OVERFLOW.fetch_add(1, std::memory_order_relaxed);
+                    }
+                    break;
+            }
+        }
+        if (keep) {
+            written += packetLength + extra;
+        }
+        else if (extra > 0) {
+            // Dropped or delayed, but what was added after it still goes
+            memmove(copy, copy + packetLength, extra);
+            written += extra;
+        }
+    }
+    // Whatever couldn't be framed goes through as it is
+    memcpy(out + written, data + position, length - position);
+    return written + length - position;
+}
+
+
+void FlushDelayedPackets() {
+    uint64_t now = GetNanoseconds();
+    size_t due[MAX_DELAYED_PACKETS];
+    size_t dueCount = 0;
+    for (size_t i = 0; i < MAX_DELAYED_PACKETS; i++) {
+        if (DELAYED[i].state.load(std::memory_order_acquire) == DelayedReady && DELAYED[i].dueNs <= now) {
+            due[dueCount++] = i;
+        }
+    }
+    // Packets held for the same time leave in the order they were held
+    std::sort(due, due + dueCount, [](size_t a, size_t b) {
+        return DELAYED[a].sequence < DELAYED[b].sequence;
+    });
+    int held[MAX_DELAYED_PACKETS];
+    size_t heldCount = 0;
+    for (size_t i = 0; i < dueCount; i++) {
+        DelayedPacket& delayed = DELAYED[due[i]];
+        if (std::find(held, held + heldCount, delayed.fd) != held + heldCount) {
+            continue;
+        }
+        int ready = DelayedReady;
+        if (!delayed.state.compare_exchange_strong(ready, DelayedSending, std::memory_order_acquire)) {
+            continue;
+        }
+        // Held back by a full queue, it tries again next frame and later ones
+        // for the same connection wait behind it
+        if (!QueuePacket(delayed.fd, delayed.data, delayed.length)) {
+            delayed.state.store(DelayedReady, std::memory_order_release);
+            held[heldCount++] = delayed.fd;
+            continue;
+        }
+        delayed.state.store(DelayedFree, std::memory_order_release);
+    }
+}
+
+
+void ReportPacketFilter(FILE* out) {
+    FilterTable* table = FILTER.load(std::memory_order_acquire);
+    if (table == NULL) {
+        fprintf(out, "<Filter> Off\n");
+        return;
+    }
+    size_t delayed = 0;
+    for (size_t i = 0; i < MAX_DELAYED_PACKETS; i++) {
+        delayed += DELAYED[i].state.load(std::memory_order_relaxed) != DelayedFree;
+    }
+    fprintf(out, "<Filter> %lu rules, %lu packets matched an opcode, %lu split across chunks, %lu unknown "
+            "(framing lost), %lu resynchronized, %lu additions that didn't fit, %lu delayed now\n",
+            (unsigned long)table->rules.size(), (unsigned long)FILTER_PACKETS.load(),
+            (unsigned long)FILTER_SPLIT.load(), (unsigned long)FILTER_UNKNOWN.load(),
+            (unsigned long)FILTER_RESYNCHRONIZED.load(), (unsigned long)FILTER_OVERFLOW.load(), (unsigned long)delayed);
+    for (size_t i = 0; i < table->rules.size(); i++) {
+        const FilterRule& rule = table->rules[i];
+        fprintf(out, "<Filter>   line %d, %s %c%c: %lu hits\n", rule.line,
+                rule.direction == FilterOutbound ? "up" : "down", isprint(rule.opcode & 0xff) ? rule.opcode & 0xff : '.',
+                isprint(rule.opcode >> 8) ? rule.opcode >> 8 : '.', (unsigned long)table->hits[i].load());
+    }
+}
@@ -0,0 +1,110 @@
+#ifndef FILTER_H
+#define FILTER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+
+const size_t MAX_FILTER_FIELDS = 8;
+const size_t MAX_FILTER_PREDICATES = 4;
+const size_t MAX_FILTER_TEXT = 64;
+const size_t MAX_FILTER_PAYLOAD = 64;
+const size_t MAX_FILTER_PAYLOAD_PARTS = 8;
+// Chunks are rewritten into a per-thread buffer this big, larger ones go through untouched
+const size_t FILTER_SCRATCH_SIZE = 65536;
+const size_t MAX_DELAYED_PACKETS = 64;
+const size_t MAX_DELAYED_PACKET_SIZE = 512;
+// A packet cut before its length can be told is carried into the next chunk up to this much
+const size_t MAX_PACKET_HEAD = 64;
+
+enum FilterDirection {FilterOutbound, FilterInbound, FilterDirectionCount};
+enum FilterActionType {FilterDrop, FilterSet, FilterDuplicate, FilterDelay, FilterInject, FilterReply};
+typedef bool (*FilterOutput)(int, const uint8_t *, size_t);
+
+
+// Where a decoded field sits in a packet. Strings include their length prefix.
+struct FilterField {
+    uint16_t offset;
+    uint16_t length;
+    char type;
+};
+
+
+struct FilterPredicate;
+typedef bool (*FilterTest)(const FilterPredicate &, const uint8_t *, size_t);
+
+// A comparison compiled down to the function for its field type and operator
+struct FilterPredicate {
+    FilterTest test;
+    uint8_t field;
+    double number;
+    char text[MAX_FILTER_TEXT];
+    size_t textLength;
+};
+
+
+// Literal bytes, or a field of the matched packet copied as it is on the wire
+struct FilterPayloadPart {
+    int field;
+    uint16_t offset;
+    uint16_t length;
+};
+
+
+struct FilterRule {
+    uint16_t opcode;
+    FilterDirection direction;
+    FilterPredicate predicates[MAX_FILTER_PREDICATES];
+    size_t predicateCount;
+    FilterActionType action;
+    uint8_t field;
+    double value;
+    uint64_t delayNs;
+    uint8_t payload[MAX_FILTER_PAYLOAD];
+    FilterPayloadPart parts[MAX_FILTER_PAYLOAD_PARTS];
+    size_t partCount;
+    int line;
+};
+
+
+// Declarative packet rules for the game connections, one per line:
+//
+//     up|down OPCODE [if $N OP VALUE [and ...]] then ACTION
+//
+// OPCODE is two characters or 0x and four hex digits in wire order, $N is
+// the N-th field of the packet's layout and OP is one of == != < <= > >= or
+// ~ (contains, for strings). ACTION is drop, dup, set $N VALUE, delay MS,
+// inject PAYLOAD or reply PAYLOAD, where PAYLOAD is hex bytes and $N fields.
+// inject adds bytes after the packet, reply sends them back to its sender
+// between the packets it is already getting.
+//
+// Rules are compiled into a table indexed by opcode, so packets without
+// rules only cost the lookup and a length walk, and applying them never
+// allocates. Outbound packets can be delayed, inbound ones replied to; the
+// proxy takes the same rule files and can do both in either direction.
+bool LoadPacketFilter(const char *);
+void ClearPacketFilter();
+bool IsPacketFilterActive();
+// Forget framing state and delayed packets of a connection
+void ResetPacketFilter(int);
+
+// Rewrites a chunk into the given buffer and returns its new length. A chunk
+// that would not fit is copied unchanged. An opcode without a layout loses
+// the connection's framing in that direction, and chunks then go through
+// untouched until one is made of whole packets from start to end.
+size_t FilterPackets(FilterDirection, int, const uint8_t *, size_t, uint8_t *, size_t);
+// Keeps a connection's framing up to date over chunks that aren't filtered,
+// so rules and queued packets can start on a packet boundary at any time
+void TrackPackets(FilterDirection, int, const uint8_t *, size_t);
+bool IsAtPacketBoundary(FilterDirection, int);
+// Length of the packet at the start of a buffer by the same layouts, 0 for an
+// unknown opcode and more than the buffer holds when it continues past it
+size_t GetPacketLength(FilterDirection, const uint8_t *, size_t);
+// Replies and delayed packets are handed to this to go out between the
+// connection's own packets, see QueueSocketPacket()
+void SetPacketFilterOutput(FilterOutput);
+// Hands over delayed packets that are due, from World::Tick
+void FlushDelayedPackets();
+void ReportPacketFilter(FILE *);
+
+#endif
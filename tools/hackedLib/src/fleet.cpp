@@ -0,0 +1,159 @@
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "fleet.h"
+
+
+FleetLink::FleetLink() :
+    m_path(DEFAULT_FLEET_SOCKET), m_fd(-1), m_retryTimer(0), m_telemetryTimer(0), m_commands(0) {
+}
+
+
+FleetLink::~FleetLink() {
+    this->Disconnect();
+}
+
+
+void FleetLink::SetPath(const char* path) {
+    this->Disconnect();
+    m_path = path;
+    m_retryTimer = 0;
+}
+
+
+const char* FleetLink::GetPath() const {
+    return m_path.c_str();
+}
+
+
+bool FleetLink::IsConnected() const {
+    return m_fd >= 0;
+}
+
+
+void FleetLink::Disconnect() {
+    if (m_fd >= 0) {
+        close(m_fd);
+        m_fd = -1;
+    }
+    m_retryTimer = FLEET_RETRY_INTERVAL;
+}
+
+
+bool FleetLink::Connect() {
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (m_path.size() >= sizeof(address.sun_path)) {
+        return false;
+    }
+    strcpy(address.sun_path, m_path.c_str());
+
+    int fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        return false;
+    }
+    // Local connects finish straight away or fail straight away
+    if (connect(fd, (struct sockaddr*)&address, sizeof(address)) != 0) {
+        close(fd);
+        return false;
+    }
+    m_fd = fd;
+    m_telemetryTimer = 0;
+    printf("<Fleet> Connected to %s\n", m_path.c_str());
+    return true;
+}
+
+
+bool FleetLink::Send(const void* message, size_t length) {
+    if (m_fd < 0) {
+        return false;
+    }
+    if (send(m_fd, message, length, MSG_DONTWAIT | MSG_NOSIGNAL) == (ssize_t)length) {
+        return true;
+    }
+    // A full queue just loses this message, anything else loses the controller
+    if (errno != EAGAIN && errno != EWOULDBLOCK) {
+        printf("<Fleet> Lost %s\n", m_path.c_str());
+        this->Disconnect();
+    }
+    return false;
+}
+
+
+void FleetLink::Poll(float dt, std::vector<std::string>& commands) {
+    m_acks.clear();
+    if (m_fd < 0) {
+        m_retryTimer -= dt;
+        if (m_retryTimer > 0 || !this->Connect()) {
+            m_retryTimer = m_retryTimer > 0 ? m_retryTimer : FLEET_RETRY_INTERVAL;
+            return;
+        }
+    }
+
+    char message[FLEET_MAX_MESSAGE];
+    for (;;) {
+        ssize_t length = recv(m_fd, message, sizeof(message), MSG_DONTWAIT);
+        if (length < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            return;
+        }
+        if (length <= 0) {
+            printf("<Fleet> Lost %s\n", m_path.c_str());
+            this->Disconnect();
+            return;
+        }
+        FleetBatch* batch = (FleetBatch*)message;
+        if ((size_t)length < sizeof(FleetBatch) || batch->type != FleetBatchMessage ||
+                batch->length > (size_t)length - sizeof(FleetBatch)) {
+            continue;
+        }
+        const char* text = message + sizeof(FleetBatch);
+        const char* end = text + batch->length;
+        FleetAck ack = {FleetAckMessage, (uint32_t)getpid(), batch->batch, 0};
+        while (text < end && ack.executed < batch->count) {
+            size_t commandLength = strnlen(text, end - text);
+            commands.push_back(std::string(text, commandLength));
+            text += commandLength + 1;
+            ack.executed++;
+        }
+        m_commands += ack.executed;
+        m_acks.push_back(ack);
+    }
+}
+
+
+void FleetLink::Acknowledge() {
+    for (size_t i = 0; i < m_acks.size(); i++) {
+        this->Send(&m_acks[i], sizeof(FleetAck));
+    }
+    m_acks.clear();
+}
+
+
+bool FleetLink::IsTelemetryDue(float dt) {
+    if (m_fd < 0) {
+        return false;
+    }
+    m_telemetryTimer -= dt;
+    if (m_telemetryTimer > 0) {
+        return false;
+    }
+    m_telemetryTimer = FLEET_TELEMETRY_INTERVAL;
+    return true;
+}
+
+
+void FleetLink::SendTelemetry(FleetTelemetry& telemetry) {
+    telemetry.type = FleetTelemetryMessage;
+    telemetry.pid = (uint32_t)getpid();
+    telemetry.commands = m_commands;
+    this->Send(&telemetry, sizeof(telemetry));
+}
+
+
+uint64_t FleetLink::GetCommandCount() const {
+    return m_commands;
+}
@@ -0,0 +1,93 @@
+#ifndef FLEET_H
+#define FLEET_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "heatmap.h"
+
+// Unix socket the fleet controller listens on, PWN3_FLEET overrides it
+const char DEFAULT_FLEET_SOCKET[] = "/tmp/pwn3-fleet.sock";
+// Largest single message either side sends, batches are split to fit
+const size_t FLEET_MAX_MESSAGE = 8192;
+const size_t FLEET_NAME_LENGTH = 32;
+// The whole heatmap region, the controller matches zones against it exactly
+const size_t FLEET_REGION_LENGTH = HEATMAP_REGION_LENGTH;
+const float FLEET_TELEMETRY_INTERVAL = 0.25;
+// Seconds between attempts to reach a controller that isn't there
+const float FLEET_RETRY_INTERVAL = 2;
+
+enum FleetMessageType {FleetTelemetryMessage = 1, FleetAckMessage, FleetBatchMessage};
+
+
+// Everything the controller shows and schedules on, sent a few times a second
+struct FleetTelemetry {
+    uint32_t type;
+    uint32_t pid;
+    char name[FLEET_NAME_LENGTH];
+    char region[FLEET_REGION_LENGTH];
+    float x;
+    float y;
+    float z;
+    int32_t health;
+    int32_t mana;
+    float frameMs;
+    float hookUs;
+    // Waypoints left on the current route
+    uint32_t load;
+    uint32_t claims;
+    uint64_t commands;
+};
+
+
+struct FleetAck {
+    uint32_t type;
+    uint32_t pid;
+    uint32_t batch;
+    uint32_t executed;
+};
+
+
+// Followed by length bytes of NUL-terminated chat commands
+struct FleetBatch {
+    uint32_t type;
+    uint32_t batch;
+    uint32_t count;
+    uint32_t length;
+};
+
+
+// Client side of the controller connection. Everything happens on the game
+// thread once per tick over a non-blocking SOCK_SEQPACKET socket, so a batch
+// arrives whole or not at all and a missing controller costs nothing.
+class FleetLink {
+  public:
+    FleetLink();
+    ~FleetLink();
+    void SetPath(const char *);
+    const char * GetPath() const;
+    bool IsConnected() const;
+    void Disconnect();
+
+    // Connects when due, then collects every command that has arrived
+    void Poll(float, std::vector<std::string> &);
+    // Tells the controller the batches from the last Poll have been run
+    void Acknowledge();
+    bool IsTelemetryDue(float);
+    void SendTelemetry(FleetTelemetry &);
+    uint64_t GetCommandCount() const;
+
+  private:
+    std::string m_path;
+    int m_fd;
+    float m_retryTimer;
+    float m_telemetryTimer;
+    std::vector<FleetAck> m_acks;
+    uint64_t m_commands;
+
+    bool Connect();
+    bool Send(const void *, size_t);
+};
+
+#endif
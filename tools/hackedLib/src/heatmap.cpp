@@ -0,0 +1,211 @@
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "heatmap.h"
+
+// "PHM1"
+const uint32_t HEATMAP_MAGIC = 0x314d4850;
+// Fold the decay into the cells before exp() gets anywhere near overflowing
+const double HEATMAP_MAX_EXPONENT = 40;
+
+
+Heatmap::Heatmap() :
+    m_header(NULL), m_cells(NULL), m_mappedSize(0),
+    m_decayRate(logf(2) / HEATMAP_HALF_LIFE), m_addScale(1) {
+}
+
+
+Heatmap::~Heatmap() {
+    this->Close();
+}
+
+
+bool Heatmap::Open(const char* path) {
+    this->Close();
+
+    size_t cellCount = (size_t)HEATMAP_SIZE_X * HEATMAP_SIZE_Y * HEATMAP_SIZE_Z;
+    size_t size = sizeof(Header) + cellCount * sizeof(float);
+
+    int fd = open(path, O_RDWR | O_CREAT, 0644);
+    if (fd < 0) {
+        printf("<Heatmap> Could not open %s\n", path);
+        return false;
+    }
+
+    // Anything that isn't a grid of our exact shape gets reset
+    struct stat st;
+    bool fresh = fstat(fd, &st) != 0 || (size_t)st.st_size != size;
+    if ((fresh && ftruncate(fd, 0) != 0) || ftruncate(fd, size) != 0) {
+        printf("<Heatmap> Could not size %s\n", path);
+        close(fd);
+        return false;
+    }
+
+    void* mapping = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        printf("<Heatmap> Could not map %s\n", path);
+        return false;
+    }
+
+    m_header = (Header*)mapping;
+    m_cells = (float*)(m_header + 1);
+    m_mappedSize = size;
+
+    if (fresh || m_header->magic != HEATMAP_MAGIC || m_header->sizeX != HEATMAP_SIZE_X ||
+            m_header->sizeY != HEATMAP_SIZE_Y || m_header->sizeZ != HEATMAP_SIZE_Z ||
+            m_header->cellSize != HEATMAP_CELL_SIZE || m_header->cellHeight != HEATMAP_CELL_HEIGHT) {
+        memset(mapping, 0, size);
+        m_header->magic = HEATMAP_MAGIC;
+        m_header->sizeX = HEATMAP_SIZE_X;
+        m_header->sizeY = HEATMAP_SIZE_Y;
+        m_header->sizeZ = HEATMAP_SIZE_Z;
+        m_header->cellSize = HEATMAP_CELL_SIZE;
+        m_header->cellHeight = HEATMAP_CELL_HEIGHT;
+    }
+    m_header->halfLife = HEATMAP_HALF_LIFE;
+    m_addScale = (float)exp(m_decayRate * m_header->clock);
+    return true;
+}
+
+
+void Heatmap::Close() {
+    if (m_header == NULL) {
+        return;
+    }
+    this->Sync();
+    munmap(m_header, m_mappedSize);
+    m_header = NULL;
+    m_cells = NULL;
+    m_mappedSize = 0;
+}
+
+
+bool Heatmap::IsOpen() const {
+    return m_header != NULL;
+}
+
+
+void Heatmap::Advance(float dt) {
+    if (m_header == NULL || dt <= 0) {
+        return;
+    }
+    // Instead of shrinking every cell, grow the weight of future samples
+    m_header->clock += dt;
+    if (m_decayRate * m_header->clock > HEATMAP_MAX_EXPONENT) {
+        this->Rescale();
+    }
+    m_addScale = (float)exp(m_decayRate * m_header->clock);
+}
+
+
+void Heatmap::Rescale() {
+    float factor = (float)exp(-m_decayRate * m_header->clock);
+    size_t cellCount = (size_t)HEATMAP_SIZE_X * HEATMAP_SIZE_Y * HEATMAP_SIZE_Z;
+    for (size_t i = 0; i < cellCount; i++) {
+        m_cells[i] *= factor;
+    }
+    m_header->clock = 0;
+}
+
+
+bool Heatmap::CellIndex(float x, float y, float z, uint32_t& cx, uint32_t& cy, uint32_t& cz) const {
+    // Grid is centered on the world origin
+    long ix = (long)floorf(x / HEATMAP_CELL_SIZE) + HEATMAP_SIZE_X / 2;
+    long iy = (long)floorf(y / HEATMAP_CELL_SIZE) + HEATMAP_SIZE_Y / 2;
+    long iz = (long)floorf(z / HEATMAP_CELL_HEIGHT) + HEATMAP_SIZE_Z / 2;
+    if (ix < 0 || iy < 0 || iz < 0 ||
+            ix >= (long)HEATMAP_SIZE_X || iy >= (long)HEATMAP_SIZE_Y || iz >= (long)HEATMAP_SIZE_Z) {
+        return false;
+    }
+    cx = (uint32_t)ix;
+    cy = (uint32_t)iy;
+    cz = (uint32_t)iz;
+    return true;
+}
+
+
+void Heatmap::Add(float x, float y, float z, float weight) {
+    uint32_t cx, cy, cz;
+    if (m_header == NULL || !this->CellIndex(x, y, z, cx, cy, cz)) {
+        return;
+    }
+    m_cells[((size_t)cz * HEATMAP_SIZE_Y + cy) * HEATMAP_SIZE_X + cx] += weight * m_addScale;
+}
+
+
+float Heatmap::Get(float x, float y, float z) const {
+    uint32_t cx, cy, cz;
+    if (m_header == NULL || !this->CellIndex(x, y, z, cx, cy, cz)) {
+        return 0;
+    }
+    return m_cells[((size_t)cz * HEATMAP_SIZE_Y + cy) * HEATMAP_SIZE_X + cx] / m_addScale;
+}
+
+
+size_t Heatmap::Hottest(float x, float y, float z, float radius, Cell* out, size_t k) const {
+    if (m_header == NULL || k == 0) {
+        return 0;
+    }
+
+    // Clamp the search window to the grid
+    long rxy = (long)ceilf(radius / HEATMAP_CELL_SIZE);
+    long rz = (long)ceilf(radius / HEATMAP_CELL_HEIGHT);
+    long cx = (long)floorf(x / HEATMAP_CELL_SIZE) + HEATMAP_SIZE_X / 2;
+    long cy = (long)floorf(y / HEATMAP_CELL_SIZE) + HEATMAP_SIZE_Y / 2;
+    long cz = (long)floorf(z / HEATMAP_CELL_HEIGHT) + HEATMAP_SIZE_Z / 2;
+    long x0 = cx - rxy < 0 ? 0 : cx - rxy;
+    long y0 = cy - rxy < 0 ? 0 : cy - rxy;
+    long z0 = cz - rz < 0 ? 0 : cz - rz;
+    long x1 = cx + rxy >= (long)HEATMAP_SIZE_X ? HEATMAP_SIZE_X - 1 : cx + rxy;
+    long y1 = cy + rxy >= (long)HEATMAP_SIZE_Y ? HEATMAP_SIZE_Y - 1 : cy + rxy;
+    long z1 = cz + rz >= (long)HEATMAP_SIZE_Z ? HEATMAP_SIZE_Z - 1 : cz + rz;
+
+    // Keep the k hottest cells sorted in out, hottest first
+    size_t found = 0;
+    float radiusSquared = radius * radius;
+    for (long iz = z0; iz <= z1; iz++) {
+        for (long iy = y0; iy <= y1; iy++) {
+            const float* row = m_cells + ((size_t)iz * HEATMAP_SIZE_Y + iy) * HEATMAP_SIZE_X;
+            for (long ix = x0; ix <= x1; ix++) {
+                float heat = row[ix];
+                if (heat <= 0 || (found == k && heat <= out[k - 1].heat)) {
+                    continue;
+                }
+                float wx = (ix - (long)HEATMAP_SIZE_X / 2 + 0.5f) * HEATMAP_CELL_SIZE;
+                float wy = (iy - (long)HEATMAP_SIZE_Y / 2 + 0.5f) * HEATMAP_CELL_SIZE;
+                float wz = (iz - (long)HEATMAP_SIZE_Z / 2 + 0.5f) * HEATMAP_CELL_HEIGHT;
+                float dx = wx - x, dy = wy - y;
+                if (dx * dx + dy * dy > radiusSquared) {
+                    continue;
+                }
+                size_t slot = found < k ? found++ : k - 1;
+                while (slot > 0 && out[slot - 1].heat < heat) {
+                    out[slot] = out[slot - 1];
+                    slot--;
+                }
+                out[slot].x = wx;
+                out[slot].y = wy;
+                out[slot].z = wz;
+                out[slot].heat = heat;
+            }
+        }
+    }
+
+    // Convert from stored units back to decayed heat
+    for (size_t i = 0; i < found; i++) {
+        out[i].heat /= m_addScale;
+    }
+    return found;
+}
+
+
+void Heatmap::Sync() {
+    if (m_header != NULL) {
+        msync(m_header, m_mappedSize, MS_ASYNC);
+    }
+}
@@ -0,0 +1,65 @@
+#ifndef HEATMAP_H
+#define HEATMAP_H
+
+#include <cstddef>
+#include <cstdint>
+
+// Grid dimensions shared by every heatmap file
+const uint32_t HEATMAP_SIZE_X = 256;
+const uint32_t HEATMAP_SIZE_Y = 256;
+const uint32_t HEATMAP_SIZE_Z = 8;
+const float HEATMAP_CELL_SIZE = 1000;
+const float HEATMAP_CELL_HEIGHT = 4000;
+const float HEATMAP_HALF_LIFE = 120;
+// Longest region name kept for the current heatmap, with its NUL
+const size_t HEATMAP_REGION_LENGTH = 128;
+
+
+// Fixed-resolution 3D density grid for one region, backed by a memory-mapped
+// file. Decay is applied lazily through a global scale factor, so adding a
+// sample only touches the one cell it lands in.
+class Heatmap {
+  public:
+    struct Cell {
+        float x;
+        float y;
+        float z;
+        float heat;
+    };
+
+    Heatmap();
+    ~Heatmap();
+    bool Open(const char *);
+    void Close();
+    bool IsOpen() const;
+    void Advance(float);
+    void Add(float, float, float, float);
+    float Get(float, float, float) const;
+    size_t Hottest(float, float, float, float, Cell *, size_t) const;
+    void Sync();
+
+  private:
+    struct Header {
+        uint32_t magic;
+        uint32_t sizeX;
+        uint32_t sizeY;
+        uint32_t sizeZ;
+        float cellSize;
+        float cellHeight;
+        float halfLife;
+        float reserved;
+        // Seconds of decay folded into the stored values since last rescale
+        double clock;
+    };
+
+    Header *m_header;
+    float *m_cells;
+    size_t m_mappedSize;
+    float m_decayRate;
+    float m_addScale;
+
+    bool CellIndex(float, float, float, uint32_t &, uint32_t &, uint32_t &) const;
+    void Rescale();
+};
+
+#endif
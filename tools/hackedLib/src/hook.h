@@ -0,0 +1,40 @@
+#ifndef HOOK_H
+#define HOOK_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <ctime>
+#include <dlfcn.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+// Look up the game library's own implementation of a function we interpose,
+// so our version can observe the call and then pass it through. Member
+// functions take the object as their first argument.
+template <class T>
+T RealFunction(const char* symbol) {
+    return (T)dlsym(RTLD_NEXT, symbol);
+}
+
+
+// The one clock every hook measures its own time with
+inline uint64_t GetNanoseconds() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+
+// Hands the calling thread the next slot of a per-thread counter table and
+// records its tid there. The last slot is shared once the table is full.
+// Callers keep the result in a __thread pointer of their own.
+template <class T, size_t N>
+T* ClaimThreadSlot(T (&slots)[N], std::atomic<size_t>& claimed) {
+    size_t index = claimed.fetch_add(1, std::memory_order_relaxed);
+    T* slot = &slots[index < N ? index : N - 1];
+    slot->tid.store(syscall(SYS_gettid), std::memory_order_relaxed);
+    return slot;
+}
+
+#endif
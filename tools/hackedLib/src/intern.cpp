@@ -0,0 +1,118 @@
+#include <atomic>
+#include <cstring>
+#include "intern.h"
+
+struct InternEntry {
+    uint32_t hash;
+    uint32_t offset;
+    uint32_t length;
+};
+
+// Slots hold an entry index plus one, published once the entry is written
+std::atomic<uint32_t> INTERN_SLOTS[INTERN_TABLE_SLOTS];
+InternEntry INTERN_ENTRIES[MAX_INTERNED_STRINGS];
+char INTERN_ARENA[INTERN_ARENA_SIZE];
+std::atomic<uint32_t> INTERN_COUNT(0);
+size_t INTERN_ARENA_USED = 0;
+std::atomic_flag INTERN_LOCK = ATOMIC_FLAG_INIT;
+
+std::atomic<uint64_t> INTERN_LOOKUPS(0);
+std::atomic<uint64_t> INTERN_FULL(0);
+
+
+// FNV-1a, the same hash the event store keys names with
+static uint32_t HashBytes(const char* text, size_t length) {
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < length; i++) {
+        hash = (hash ^ (uint8_t)text[i]) * 16777619u;
+    }
+    return hash;
+}
+
+
+// Probes from the hash's home slot, stopping at the match or the first empty slot
+static bool FindSlot(const char* text, size_t length, uint32_t hash, size_t& slot, uint32_t& id) {
+    for (size_t probe = 0; probe < INTERN_TABLE_SLOTS; probe++) {
+        slot = (hash + probe) & (INTERN_TABLE_SLOTS - 1);
+        uint32_t value = INTERN_SLOTS[slot].load(std::memory_order_acquire);
+        if (value == 0) {
+            return false;
+        }
+        const InternEntry& entry = INTERN_ENTRIES[value - 1];
+        if (entry.hash == hash && entry.length == length && memcmp(INTERN_ARENA + entry.offset, text, length) == 0) {
+            id = value - 1;
+            return true;
+        }
+    }
+    slot = INTERN_TABLE_SLOTS;
+    return false;
+}
+
+
+uint32_t InternString(const char* text) {
+    return text == NULL ? INTERN_NONE : InternString(text, strlen(text));
+}
+
+
+uint32_t InternString(const char* text, size_t length) {
+    INTERN_LOOKUPS.fetch_add(1, std::memory_order_relaxed);
+    uint32_t hash = HashBytes(text, length);
+    size_t slot;
+    uint32_t id;
+    if (FindSlot(text, length, hash, slot, id)) {
+        return id;
+    }
+
+    while (INTERN_LOCK.test_and_set(std::memory_order_acquire)) {
+    }
+    // Someone else may have added it, or taken our slot, while we waited
+    if (FindSlot(text, length, hash, slot, id)) {
+        INTERN_LOCK.clear(std::memory_order_release);
+        return id;
+    }
+    id = INTERN_COUNT.load(std::memory_order_relaxed);
+    if (slot == INTERN_TABLE_SLOTS || id == MAX_INTERNED_STRINGS || INTERN_ARENA_USED + length + 1 > INTERN_ARENA_SIZE) {
+        INTERN_LOCK.clear(std::memory_order_release);
+        INTERN_FULL.fetch_add(1, std::memory_order_relaxed);
+        return INTERN_NONE;
+    }
+    InternEntry& entry = INTERN_ENTRIES[id];
+    entry.hash = hash;
+    entry.offset = INTERN_ARENA_USED;
+    entry.length = length;
+    memcpy(INTERN_ARENA + INTERN_ARENA_USED, text, length);
+    INTERN_ARENA[INTERN_ARENA_USED + length] = '\0';
+    INTERN_ARENA_USED += length + 1;
+    INTERN_COUNT.store(id + 1, std::memory_order_release);
+    INTERN_SLOTS[slot].store(id + 1, std::memory_order_release);
+    INTERN_LOCK.clear(std::memory_order_release);
+    return id;
+}
+
+
+const char* GetInternedString(uint32_t id) {
+    if (id >= INTERN_COUNT.load(std::memory_order_acquire)) {
+        return NULL;
+    }
+    return INTERN_ARENA + INTERN_ENTRIES[id].offset;
+}
+
+
+size_t GetInternedLength(uint32_t id) {
+    if (id >= INTERN_COUNT.load(std::memory_order_acquire)) {
+        return 0;
+    }
+    return INTERN_ENTRIES[id].length;
+}
+
+
+size_t GetInternedCount() {
+    return INTERN_COUNT.load(std::memory_order_acquire);
+}
+
+
+void ReportInternedStrings(FILE* out) {
+    fprintf(out, "<Strings> %lu interned in %lu bytes, %lu lookups, table full %lu times\n",
+            (unsigned long)GetInternedCount(), (unsigned long)INTERN_ARENA_USED,
+            (unsigned long)INTERN_LOOKUPS.load(), (unsigned long)INTERN_FULL.load());
+}
@@ -0,0 +1,27 @@
+#ifndef INTERN_H
+#define INTERN_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+
+// State, item, region and blueprint names only number in the hundreds
+const size_t MAX_INTERNED_STRINGS = 16384;
+const size_t INTERN_TABLE_SLOTS = 32768;
+const size_t INTERN_ARENA_SIZE = 1 << 20;
+const uint32_t INTERN_NONE = 0xFFFFFFFF;
+
+
+// Process-wide table of the strings the hooks see over and over. Each distinct
+// string is copied once into an arena and gets a small dense ID, found again
+// by a hash of its bytes. Lookups never lock or allocate; only adding a new
+// string takes a spinlock. IDs and the returned text stay valid for the life
+// of the process. When the table is full INTERN_NONE is returned.
+uint32_t InternString(const char *);
+uint32_t InternString(const char *, size_t);
+const char * GetInternedString(uint32_t);
+size_t GetInternedLength(uint32_t);
+size_t GetInternedCount();
+void ReportInternedStrings(FILE *);
+
+#endif
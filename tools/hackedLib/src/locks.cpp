@@ -0,0 +1,212 @@
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <cxxabi.h>
+#include <dlfcn.h>
+#include <pthread.h>
+#include "hook.h"
+#include "locks.h"
+
+typedef int (*MutexLockFunction)(pthread_mutex_t*);
+typedef int (*ConditionWaitFunction)(pthread_cond_t*, pthread_mutex_t*);
+
+
+struct LockEntry {
+    // 0 free, 1 being claimed, 2 ready
+    std::atomic<int> state;
+    LockWaitKind kind;
+    const void* lock;
+    const void* caller;
+    std::atomic<uint64_t> waits;
+    std::atomic<uint64_t> totalNs;
+    std::atomic<uint64_t> maxNs;
+    std::atomic<uint64_t> gameThreadNs;
+};
+
+// Open addressed on (kind, lock, caller), entries are claimed with a CAS and never freed
+LockEntry LOCK_ENTRIES[MAX_LOCK_SITES];
+std::atomic<uint64_t> DROPPED_LOCK_WAITS(0);
+
+static const char* LOCK_THRESHOLD_VARIABLE = getenv("PWN3_LOCK_THRESHOLD_US");
+std::atomic<bool> LOCK_PROFILING(getenv("PWN3_LOCK_PROFILE") != NULL);
+std::atomic<uint64_t> LOCK_THRESHOLD_NS(LOCK_THRESHOLD_VARIABLE != NULL ?
+                                        strtoull(LOCK_THRESHOLD_VARIABLE, NULL, 10) * 1000 :
+                                        LOCK_WAIT_THRESHOLD_NS);
+std::atomic<pthread_t> LOCK_GAME_THREAD(0);
+
+// Resolved without a function static, whose guard could itself take a mutex
+static MutexLockFunction REAL_MUTEX_LOCK = NULL;
+static MutexLockFunction REAL_MUTEX_TRYLOCK = NULL;
+static ConditionWaitFunction REAL_CONDITION_WAIT = NULL;
+
+
+
+void SetLockProfiling(bool enabled) {
+    LOCK_PROFILING = enabled;
+}
+
+
+bool IsLockProfilingEnabled() {
+    return LOCK_PROFILING;
+}
+
+
+void SetLockGameThread() {
+    pthread_t self = pthread_self();
+    if (LOCK_GAME_THREAD.load(std::memory_order_relaxed) != self) {
+        LOCK_GAME_THREAD.store(self, std::memory_order_relaxed);
+    }
+}
+
+
+static LockEntry* FindLockEntry(LockWaitKind kind, const void* lock, const void* caller) {
+    uint64_t hash = ((uintptr_t)lock * 0x9E3779B97F4A7C15ull) ^ ((uintptr_t)caller * 0xC2B2AE3D27D4EB4Full) ^ kind;
+    size_t start = (hash >> 32) % MAX_LOCK_SITES;
+    for (size_t probe = 0; probe < MAX_LOCK_SITES; probe++) {
+        LockEntry& entry = LOCK_ENTRIES[(start + probe) % MAX_LOCK_SITES];
+        int state = entry.state.load(std::memory_order_acquire);
+        if (state == 0) {
+            if (entry.state.compare_exchange_strong(state, 1, std::memory_order_acquire)) {
+                entry.kind = kind;
+                entry.lock = lock;
+                entry.caller = caller;
+                entry.state.store(2, std::memory_order_release);
+                return &entry;
+            }
+        }
+        // Another thread is filling in the key, which is only a few stores
+        while (state == 1) {
+            state = entry.state.load(std::memory_order_acquire);
+        }
+        if (entry.kind == kind && entry.lock == lock && entry.caller == caller) {
+            return &entry;
+        }
+    }
+    return NULL;
+}
+
+
+static void RecordLockWait(LockWaitKind kind, const void* lock, const void* caller, uint64_t elapsed) {
+    if (elapsed < LOCK_THRESHOLD_NS.load(std::memory_order_relaxed)) {
+        return;
+    }
+    LockEntry* entry = FindLockEntry(kind, lock, caller);
+    if (entry == NULL) {
+        DROPPED_LOCK_WAITS.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    entry->waits.fetch_add(1, std::memory_order_relaxed);
+    entry->totalNs.fetch_add(elapsed, std::memory_order_relaxed);
+    uint64_t previous = entry->maxNs.load(std::memory_order_relaxed);
+    while (elapsed > previous && !entry->maxNs.compare_exchange_weak(previous, elapsed, std::memory_order_relaxed)) {
+    }
+    if (pthread_equal(pthread_self(), LOCK_GAME_THREAD.load(std::memory_order_relaxed))) {
+        entry->gameThreadNs.fetch_add(elapsed, std::memory_order_relaxed);
+    }
+}
+
+
+extern "C" int pthread_mutex_lock(pthread_mutex_t* mutex) {
+    if (REAL_MUTEX_LOCK == NULL) {
+        REAL_MUTEX_LOCK = RealFunction<MutexLockFunction>("pthread_mutex_lock");
+        REAL_MUTEX_TRYLOCK = RealFunction<MutexLockFunction>("pthread_mutex_trylock");
+    }
+    if (!LOCK_PROFILING.load(std::memory_order_relaxed)) {
+        return REAL_MUTEX_LOCK(mutex);
+    }
+    // Only contended locks get timed
+    if (REAL_MUTEX_TRYLOCK(mutex) == 0) {
+        return 0;
+    }
+    uint64_t start = GetNanoseconds();
+    int result = REAL_MUTEX_LOCK(mutex);
+    RecordLockWait(MutexWait, mutex, __builtin_return_address(0), GetNanoseconds() - start);
+    return result;
+}
+
+
+// Includes the time spent waiting to be signalled, which is idle time for
+// worker threads but a stall when the game thread is the one waiting
+extern "C" int pthread_cond_wait(pthread_cond_t* condition, pthread_mutex_t* mutex) {
+    if (REAL_CONDITION_WAIT == NULL) {
+        REAL_CONDITION_WAIT = RealFunction<ConditionWaitFunction>("pthread_cond_wait");
+    }
+    if (!LOCK_PROFILING.load(std::memory_order_relaxed)) {
+        return REAL_CONDITION_WAIT(condition, mutex);
+    }
+    uint64_t start = GetNanoseconds();
+    int result = REAL_CONDITION_WAIT(condition, mutex);
+    RecordLockWait(ConditionWait, condition, __builtin_return_address(0), GetNanoseconds() - start);
+    return result;
+}
+
+
+size_t GetLockSites(LockSite* sites, size_t capacity) {
+    size_t count = 0;
+    for (size_t i = 0; i < MAX_LOCK_SITES && count < capacity; i++) {
+        LockEntry& entry = LOCK_ENTRIES[i];
+        if (entry.state.load(std::memory_order_acquire) != 2 || entry.waits.load(std::memory_order_relaxed) == 0) {
+            continue;
+        }
+        LockSite& site = sites[count++];
+        site.kind = entry.kind;
+        site.lock = entry.lock;
+        site.caller = entry.caller;
+        site.waits = entry.waits.load(std::memory_order_relaxed);
+        site.totalNs = entry.totalNs.load(std::memory_order_relaxed);
+        site.maxNs = entry.maxNs.load(std::memory_order_relaxed);
+        site.gameThreadNs = entry.gameThreadNs.load(std::memory_order_relaxed);
+    }
+    return count;
+}
+
+
+// Keys stay claimed so concurrent lookups never see a slot change owner
+void ResetLockSites() {
+    for (size_t i = 0; i < MAX_LOCK_SITES; i++) {
+        LOCK_ENTRIES[i].waits = 0;
+        LOCK_ENTRIES[i].totalNs = 0;
+        LOCK_ENTRIES[i].maxNs = 0;
+        LOCK_ENTRIES[i].gameThreadNs = 0;
+    }
+    DROPPED_LOCK_WAITS = 0;
+}
+
+
+static void PrintCaller(FILE* out, const void* caller) {
+    Dl_info info;
+    if (dladdr(caller, &info) == 0) {
+        fprintf(out, "%p", caller);
+        return;
+    }
+    if (info.dli_sname == NULL) {
+        fprintf(out, "%s+%#lx", info.dli_fname, (unsigned long)((uintptr_t)caller - (uintptr_t)info.dli_fbase));
+        return;
+    }
+    int status;
+    char* demangled = abi::__cxa_demangle(info.dli_sname, NULL, NULL, &status);
+    fprintf(out, "%s+%#lx", status == 0 ? demangled : info.dli_sname,
+            (unsigned long)((uintptr_t)caller - (uintptr_t)info.dli_saddr));
+    free(demangled);
+}
+
+
+void ReportLocks(FILE* out) {
+    static LockSite sites[MAX_LOCK_SITES];
+    size_t count = GetLockSites(sites, MAX_LOCK_SITES);
+    // Waits on the game thread first, then everything else by total time
+    std::sort(sites, sites + count, [](const LockSite& a, const LockSite& b) {
+        return a.gameThreadNs != b.gameThreadNs ? a.gameThreadNs > b.gameThreadNs : a.totalNs > b.totalNs;
+    });
+
+    fprintf(out, "<Locks> %lu sites over %.3f ms, %lu waits dropped\n", (unsigned long)count,
+            LOCK_THRESHOLD_NS / 1e6, (unsigned long)DROPPED_LOCK_WAITS.load());
+    for (size_t i = 0; i < count && i < LOCK_REPORT_SITES; i++) {
+        fprintf(out, "    %s %p: %lu waits, %.2f ms total, %.2f ms max, %.2f ms on game thread, from ",
+                sites[i].kind == MutexWait ? "mutex" : "cond", sites[i].lock, (unsigned long)sites[i].waits,
+                sites[i].totalNs / 1e6, sites[i].maxNs / 1e6, sites[i].gameThreadNs / 1e6);
+        PrintCaller(out, sites[i].caller);
+        fprintf(out, "\n");
+    }
+    fflush(out);
+}
@@ -0,0 +1,41 @@
+#ifndef LOCKS_H
+#define LOCKS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+
+// Distinct (lock, caller) pairs that can be recorded, later ones are dropped
+const size_t MAX_LOCK_SITES = 1024;
+// Waits shorter than this are not recorded, PWN3_LOCK_THRESHOLD_US overrides it
+const uint64_t LOCK_WAIT_THRESHOLD_NS = 100000;
+const size_t LOCK_REPORT_SITES = 20;
+
+enum LockWaitKind {MutexWait, ConditionWait};
+
+
+// Aggregated waits on one lock from one call site
+struct LockSite {
+    LockWaitKind kind;
+    const void* lock;
+    const void* caller;
+    uint64_t waits;
+    uint64_t totalNs;
+    uint64_t maxNs;
+    uint64_t gameThreadNs;
+};
+
+
+// pthread_mutex_lock() and pthread_cond_wait() are always interposed, but
+// only time anything while profiling is on (PWN3_LOCK_PROFILE at startup or
+// SetLockProfiling). Uncontended mutexes are taken with a trylock and never
+// read the clock.
+void SetLockProfiling(bool);
+bool IsLockProfilingEnabled();
+// Called from World::Tick so waits on the game thread can be told apart
+void SetLockGameThread();
+size_t GetLockSites(LockSite *, size_t);
+void ResetLockSites();
+void ReportLocks(FILE *);
+
+#endif
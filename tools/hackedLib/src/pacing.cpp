@@ -0,0 +1,169 @@
+#include <cmath>
+#include "pacing.h"
+
+const char* CULPRIT_NAMES[FrameCulpritCount] = {"unknown", "region change", "allocation burst", "packet burst",
+                                                "hook overrun", "blocking syscalls"};
+
+
+FramePacer::FramePacer() {
+    this->Reset();
+}
+
+
+void FramePacer::Reset() {
+    for (size_t i = 0; i < FRAME_HISTOGRAM_BUCKETS; i++) {
+        m_histogram[i].store(0, std::memory_order_relaxed);
+    }
+    m_frames.store(0, std::memory_order_relaxed);
+    m_baseline = 0;
+    m_spikeCount = 0;
+    m_spikeRun = 0;
+    for (size_t i = 0; i < FrameCulpritCount; i++) {
+        m_culprits[i] = 0;
+    }
+}
+
+
+FrameCulprit FramePacer::Blame(const FrameCauses& causes) {
+    // Loading a region dwarfs everything else that frame
+    if (causes.regionChanged) {
+        return RegionChangeCulprit;
+    }
+    float scores[FrameCulpritCount] = {
+        1,
+        0,
+        (float)causes.minorFaults / SPIKE_FAULT_THRESHOLD,
+        (float)causes.bytesReceived / SPIKE_PACKET_THRESHOLD,
+        (float)causes.hookNs / SPIKE_OVERRUN_NS,
+        (float)causes.blockedNs / SPIKE_BLOCKED_NS,
+    };
+    size_t culprit = UnknownCulprit;
+    for (size_t i = 1; i < FrameCulpritCount; i++) {
+        if (scores[i] >= scores[culprit]) {
+            culprit = i;
+        }
+    }
+    return (FrameCulprit)culprit;
+}
+
+
+const char* FramePacer::GetCulpritName(FrameCulprit culprit) {
+    return CULPRIT_NAMES[culprit];
+}
+
+
+void FramePacer::Record(float dt, const FrameCauses& causes) {
+    if (!(dt > 0)) {
+        return;
+    }
+    size_t bucket = (size_t)(dt / FRAME_BUCKET_WIDTH);
+    bucket = bucket < FRAME_HISTOGRAM_BUCKETS ? bucket : FRAME_HISTOGRAM_BUCKETS - 1;
+    m_histogram[bucket].fetch_add(1, std::memory_order_relaxed);
+    uint64_t frame = m_frames.fetch_add(1, std::memory_order_relaxed);
+    m_history[frame % FRAME_HISTORY] = dt;
+
+    if (frame == 0) {
+        m_baseline = dt;
+        return;
+    }
+    if (dt > m_baseline * SPIKE_FACTOR && dt - m_baseline > SPIKE_MIN_EXCESS) {
+        // A busier region or a lower frame cap would otherwise be spikes forever
+        if (++m_spikeRun >= FRAME_REBASELINE_SPIKES) {
+            float total = 0;
+            for (size_t i = 0; i < FRAME_REBASELINE_SPIKES; i++) {
+                total += m_history[(frame - i) % FRAME_HISTORY];
+            }
+            m_baseline = total / FRAME_REBASELINE_SPIKES;
+            m_spikeRun = 0;
+            return;
+        }
+        FrameSpike& spike = m_spikes[m_spikeCount++ % MAX_FRAME_SPIKES];
+        spike.frame = frame;
+        spike.dt = dt;
+        spike.baseline = m_baseline;
+        spike.culprit = FramePacer::Blame(causes);
+        spike.causes = causes;
+        m_culprits[spike.culprit]++;
+        // Spikes stay out of the baseline so a burst doesn't hide the next one
+        return;
+    }
+    m_spikeRun = 0;
+    m_baseline += (dt - m_baseline) * FRAME_BASELINE_SMOOTHING;
+}
+
+
+uint64_t FramePacer::GetFrameCount() const {
+    return m_frames.load(std::memory_order_relaxed);
+}
+
+
+float FramePacer::GetBaseline() const {
+    return m_baseline;
+}
+
+
+float FramePacer::GetPercentile(float percentile) const {
+    uint64_t counts[FRAME_HISTOGRAM_BUCKETS];
+    uint64_t total = 0;
+    for (size_t i = 0; i < FRAME_HISTOGRAM_BUCKETS; i++) {
+        counts[i] = m_histogram[i].load(std::memory_order_relaxed);
+        total += counts[i];
+    }
+    if (total == 0) {
+        return 0;
+    }
+    uint64_t rank = (uint64_t)ceilf(percentile * total);
+    uint64_t seen = 0;
+    for (size_t i = 0; i < FRAME_HISTOGRAM_BUCKETS; i++) {
+        seen += counts[i];
+        if (seen >= rank) {
+            return (i + 1) * FRAME_BUCKET_WIDTH;
+        }
+    }
+    return FRAME_HISTOGRAM_BUCKETS * FRAME_BUCKET_WIDTH;
+}
+
+
+uint64_t FramePacer::GetSpikeCount() const {
+    return m_spikeCount;
+}
+
+
+size_t FramePacer::GetSpikes(FrameSpike* spikes, size_t capacity) const {
+    // Most recent first
+    size_t count = 0;
+    while (count < capacity && count < m_spikeCount && count < MAX_FRAME_SPIKES) {
+        spikes[count] = m_spikes[(m_spikeCount - 1 - count) % MAX_FRAME_SPIKES];
+        count++;
+    }
+    return count;
+}
+
+
+uint64_t FramePacer::GetCulpritCount(FrameCulprit culprit) const {
+    return m_culprits[culprit];
+}
+
+
+bool FramePacer::IsOscillating() const {
+    // Most of the recent frames alternate between fast and slow
+    uint64_t frames = this->GetFrameCount();
+    if (frames < FRAME_HISTORY) {
+        return false;
+    }
+    size_t flips = 0;
+    float previous = 0;
+    for (size_t i = 1; i < FRAME_HISTORY; i++) {
+        float step = m_history[(frames - i) % FRAME_HISTORY] - m_history[(frames - i - 1) % FRAME_HISTORY];
+        if (fabsf(step) > m_baseline * 0.25f && step * previous < 0) {
+            flips++;
+        }
+        previous = step;
+    }
+    return flips > FRAME_HISTORY / 2;
+}
+
+
+bool FramePacer::HasLongTail() const {
+    return this->GetFrameCount() >= 100 && this->GetPercentile(0.99) > this->GetPercentile(0.5) * 3;
+}
@@ -0,0 +1,81 @@
+#ifndef PACING_H
+#define PACING_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+// Histogram of frame deltas, the last bucket collects everything slower
+const size_t FRAME_HISTOGRAM_BUCKETS = 256;
+const float FRAME_BUCKET_WIDTH = 0.0005;
+const size_t FRAME_HISTORY = 64;
+const size_t MAX_FRAME_SPIKES = 32;
+// A frame is a spike when it is this much slower than the running baseline
+const float SPIKE_FACTOR = 1.5;
+const float SPIKE_MIN_EXCESS = 0.004;
+const float FRAME_BASELINE_SMOOTHING = 0.05;
+// This many spikes in a row are the new normal, and the baseline restarts from their average
+const size_t FRAME_REBASELINE_SPIKES = 30;
+// What counts as a burst of each possible culprit within one frame
+const uint64_t SPIKE_FAULT_THRESHOLD = 256;
+const uint64_t SPIKE_PACKET_THRESHOLD = 65536;
+const uint64_t SPIKE_OVERRUN_NS = 2000000;
+const uint64_t SPIKE_BLOCKED_NS = 2000000;
+
+enum FrameCulprit {UnknownCulprit, RegionChangeCulprit, AllocationCulprit, PacketBurstCulprit, HookOverrunCulprit,
+                   SyscallCulprit, FrameCulpritCount};
+
+
+// What happened between two ticks, gathered by the caller
+struct FrameCauses {
+    bool regionChanged;
+    uint64_t minorFaults;
+    uint64_t bytesReceived;
+    uint64_t hookNs;
+    uint64_t blockedNs;
+};
+
+
+struct FrameSpike {
+    uint64_t frame;
+    float dt;
+    float baseline;
+    FrameCulprit culprit;
+    FrameCauses causes;
+};
+
+
+// Records every World::Tick delta. Spikes are blamed on whichever of the
+// frame's causes overshot its threshold the most, and the recent deltas are
+// checked for oscillation and the histogram for a long tail. Only the game
+// thread records, the histogram can be read from anywhere.
+class FramePacer {
+  public:
+    FramePacer();
+    void Record(float, const FrameCauses &);
+    void Reset();
+
+    uint64_t GetFrameCount() const;
+    float GetBaseline() const;
+    float GetPercentile(float) const;
+    uint64_t GetSpikeCount() const;
+    size_t GetSpikes(FrameSpike *, size_t) const;
+    uint64_t GetCulpritCount(FrameCulprit) const;
+    bool IsOscillating() const;
+    bool HasLongTail() const;
+
+    static FrameCulprit Blame(const FrameCauses &);
+    static const char * GetCulpritName(FrameCulprit);
+
+  private:
+    std::atomic<uint32_t> m_histogram[FRAME_HISTOGRAM_BUCKETS];
+    std::atomic<uint64_t> m_frames;
+    float m_baseline;
+    float m_history[FRAME_HISTORY];
+    FrameSpike m_spikes[MAX_FRAME_SPIKES];
+    uint64_t m_spikeCount;
+    size_t m_spikeRun;
+    uint64_t m_culprits[FrameCulpritCount];
+};
+
+#endif
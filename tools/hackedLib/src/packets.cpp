@@ -0,0 +1,231 @@
+#include <atomic>
+#include <cmath>
+#include <cstring>
+#include "packets.h"
+#include "pwn3.h"
+#include "sockets.h"
+
+struct alignas(PACKET_BUFFER_ALIGNMENT) PacketBuffer {
+    uint8_t data[PACKET_BUFFER_SIZE];
+};
+
+PacketBuffer PACKET_BUFFERS[PACKET_BUFFER_COUNT];
+// Free list of buffer indices plus one, the head carries a tag against ABA
+std::atomic<uint32_t> PACKET_NEXT[PACKET_BUFFER_COUNT];
+std::atomic<uint64_t> PACKET_FREE(0);
+
+std::atomic<uint64_t> PACKET_BORROWED(0);
+std::atomic<uint64_t> PACKET_EXHAUSTED(0);
+std::atomic<uint64_t> PACKET_BROKEN(0);
+std::atomic<uint64_t> PACKET_SENT(0);
+std::atomic<uint32_t> PACKET_IN_USE(0);
+std::atomic<uint32_t> PACKET_PEAK(0);
+
+static void PushBuffer(uint32_t index) {
+    uint64_t head = PACKET_FREE.load(std::memory_order_relaxed);
+    uint64_t next;
+    do {
+        PACKET_NEXT[index].store((uint32_t)head, std::memory_order_relaxed);
+        next = ((head >> 32) + 1) << 32 | (index + 1);
+    } while (!PACKET_FREE.compare_exchange_weak(head, next, std::memory_order_release, std::memory_order_relaxed));
+}
+
+
+static bool FillPool() {
+    for (uint32_t i = PACKET_BUFFER_COUNT; i > 0; i--) {
+        PushBuffer(i - 1);
+    }
+    return true;
+}
+
+
+uint8_t* BorrowPacketBuffer() {
+    static bool filled = FillPool();
+    (void)filled;
+    uint64_t head = PACKET_FREE.load(std::memory_order_acquire);
+    uint64_t next;
+    do {
+        if ((uint32_t)head == 0) {
+            PACKET_EXHAUSTED.fetch_add(1, std::memory_order_relaxed);
+            return NULL;
+        }
+        uint32_t index = (uint32_t)head - 1;
+        next = ((head >> 32) + 1) << 32 | PACKET_NEXT[index].load(std::memory_order_relaxed);
+    } while (!PACKET_FREE.compare_exchange_weak(head, next, std::memory_order_acquire, std::memory_order_acquire));
+
+    PACKET_BORROWED.fetch_add(1, std::memory_order_relaxed);
+    uint32_t inUse = PACKET_IN_USE.fetch_add(1, std::memory_order_relaxed) + 1;
+    uint32_t peak = PACKET_PEAK.load(std::memory_order_relaxed);
+    while (inUse > peak && !PACKET_PEAK.compare_exchange_weak(peak, inUse, std::memory_order_relaxed)) {
+    }
+    return PACKET_BUFFERS[(uint32_t)head - 1].data;
+}
+
+
+void ReturnPacketBuffer(uint8_t* buffer) {
+    if (buffer == NULL) {
+        return;
+    }
+    PACKET_IN_USE.fetch_sub(1, std::memory_order_relaxed);
+    PushBuffer((PacketBuffer*)buffer - PACKET_BUFFERS);
+}
+
+
+void ReportPacketBuffers(FILE* out) {
+    fprintf(out, "<Packets> %u/%lu buffers in use (peak %u), %lu borrowed, %lu sent, %lu broken, pool empty %lu times\n",
+            PACKET_IN_USE.load(), (unsigned long)PACKET_BUFFER_COUNT, PACKET_PEAK.load(),
+            (unsigned long)PACKET_BORROWED.load(), (unsigned long)PACKET_SENT.load(),
+            (unsigned long)PACKET_BROKEN.load(), (unsigned long)PACKET_EXHAUSTED.load());
+}
+
+
+PacketWriter::PacketWriter(Socket* sock) : m_sock(sock), m_fd(-1), m_buffer(NULL), m_length(0), m_broken(false) {}
+
+
+PacketWriter::~PacketWriter() {
+    this->Clear();
+}
+
+
+void PacketWriter::SetSocket(Socket* sock) {
+    m_sock = sock;
+    m_fd = -1;
+}
+
+
+void PacketWriter::SetDescriptor(int fd) {
+    m_sock = NULL;
+    m_fd = fd;
+}
+
+
+void PacketWriter::Write(const void* data, size_t length) {
+    if (m_broken) {
+        return;
+    }
+    if (m_buffer == NULL) {
+        m_buffer = BorrowPacketBuffer();
+    }
+    if (m_buffer == NULL || m_length + length > PACKET_BUFFER_SIZE) {
+        m_broken = true;
+        return;
+    }
+    memcpy(m_buffer + m_length, data, length);
+    m_length += length;
+}
+
+
+void PacketWriter::Write8(uint8_t value) {
+    this->Write(&value, sizeof(value));
+}
+
+
+void PacketWriter::Write16(uint16_t value) {
+    this->Write(&value, sizeof(value));
+}
+
+
+void PacketWriter::Write32(uint32_t value) {
+    this->Write(&value, sizeof(value));
+}
+
+
+void PacketWriter::Write64(uint64_t value) {
+    this->Write(&value, sizeof(value));
+}
+
+
+void PacketWriter::WriteSaturated16(float value) {
+    float clamped = fmaxf(-32768.0f, fminf(32767.0f, roundf(value)));
+    this->Write16((uint16_t)(int16_t)clamped);
+}
+
+
+// Length prefixed, like every string on the wire
+void PacketWriter::WriteString(const std::string& value) {
+    this->Write16(value.size());
+    this->Write(value.data(), value.size());
+}
+
+
+void PacketWriter::WriteFloat(float value) {
+    this->Write(&value, sizeof(value));
+}
+
+
+void PacketWriter::WriteVector(const Vector3& value) {
+    this->WriteFloat(value.x);
+    this->WriteFloat(value.y);
+    this->WriteFloat(value.z);
+}
+
+
+void PacketWriter::WriteVector16(const Vector3& value) {
+    this->WriteSaturated16(value.x);
+    this->WriteSaturated16(value.y);
+    this->WriteSaturated16(value.z);
+}
+
+
+// Degrees as sixteen bit fractions of a turn, as in the movement packet
+void PacketWriter::WriteRotation(const Rotation& value) {
+    this->Write16((uint16_t)(int32_t)roundf(value.pitch * 65536.0f / 360.0f));
+    this->Write16((uint16_t)(int32_t)roundf(value.yaw * 65536.0f / 360.0f));
+    this->Write16((uint16_t)(int32_t)roundf(value.roll * 65536.0f / 360.0f));
+}
+
+
+void PacketWriter::WritePrecisionRotation(const Rotation& value) {
+    this->WriteFloat(value.pitch);
+    this->WriteFloat(value.yaw);
+    this->WriteFloat(value.roll);
+}
+
+
+void PacketWriter::WriteSignedFraction(float value) {
+    this->Write8((uint8_t)(int8_t)roundf(fmaxf(-1.0f, fminf(1.0f, value)) * 127.0f));
+}
+
+
+void PacketWriter::Write(const PacketWriter& other) {
+    if (other.m_broken) {
+        m_broken = true;
+        return;
+    }
+    if (other.m_length > 0) {
+        this->Write(other.m_buffer, other.m_length);
+    }
+}
+
+
+// Sends or queues the packet and gives the buffer back whether or not it went
+bool PacketWriter::Flush() {
+    bool sent = false;
+    if (m_broken) {
+        PACKET_BROKEN.fetch_add(1, std::memory_order_relaxed);
+    }
+    else if (m_length > 0 && m_sock != NULL) {
+        sent = m_sock->Write(m_buffer, m_length);
+    }
+    else if (m_length > 0 && m_fd >= 0) {
+        sent = QueueSocketPacket(m_fd, m_buffer, m_length);
+    }
+    if (sent) {
+        PACKET_SENT.fetch_add(1, std::memory_order_relaxed);
+    }
+    this->Clear();
+    return sent;
+}
+
+
+void PacketWriter::Clear() {
+    ReturnPacketBuffer(m_buffer);
+    m_buffer = NULL;
+    m_length = 0;
+    m_broken = false;
+}
+
+
+size_t PacketWriter::GetLength() const {
+    return m_length;
+}
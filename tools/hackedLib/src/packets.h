@@ -0,0 +1,69 @@
+#ifndef PACKETS_H
+#define PACKETS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+class Socket;
+struct Rotation;
+struct Vector3;
+
+// Big enough for any packet the game sends, chat included
+const size_t PACKET_BUFFER_SIZE = 2048;
+const size_t PACKET_BUFFER_COUNT = 128;
+const size_t PACKET_BUFFER_ALIGNMENT = 64;
+
+
+// Fixed pool of cache-aligned buffers for packets built in the hook. Buffers
+// are taken from and given back to a lock-free free list, so any thread can
+// build packets without touching the heap. Borrowing from an empty pool
+// returns NULL.
+uint8_t * BorrowPacketBuffer();
+void ReturnPacketBuffer(uint8_t *);
+void ReportPacketBuffers(FILE *);
+
+
+// Builds a packet with the same calls as the game's WriteStream, into a
+// buffer borrowed on the first write and given back on Flush or Clear. It is
+// sent through the game's Socket, or queued for a connection with
+// QueueSocketPacket() so it goes out between the game's own packets without
+// blocking and without packet rules applying to it. Writes past the end of the
+// buffer, or with no buffer left, mark the packet broken and it is dropped.
+class PacketWriter {
+  public:
+    PacketWriter(Socket *);
+    ~PacketWriter();
+    void SetSocket(Socket *);
+    void SetDescriptor(int);
+    void Write8(uint8_t);
+    void Write16(uint16_t);
+    void Write32(uint32_t);
+    void Write64(uint64_t);
+    void WriteSaturated16(float);
+    void WriteString(const std::string &);
+    void WriteFloat(float);
+    void WriteVector(const Vector3 &);
+    void WriteVector16(const Vector3 &);
+    void WriteRotation(const Rotation &);
+    void WritePrecisionRotation(const Rotation &);
+    void WriteSignedFraction(float);
+    void Write(const PacketWriter &);
+    void Write(const void *, size_t);
+    bool Flush();
+    void Clear();
+    size_t GetLength() const;
+
+  private:
+    Socket* m_sock;
+    int m_fd;
+    uint8_t* m_buffer;
+    size_t m_length;
+    bool m_broken;
+
+    PacketWriter(const PacketWriter &);
+    PacketWriter & operator=(const PacketWriter &);
+};
+
+#endif
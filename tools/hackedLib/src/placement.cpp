@@ -0,0 +1,293 @@
+#include <atomic>
+#include <cerrno>
+#include <condition_variable>
+#include <cstdlib>
+#include <cstring>
+#include <dirent.h>
+#include <mutex>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <thread>
+#include <unistd.h>
+#include "placement.h"
+
+static const char* PLACEMENT_VARIABLE = getenv("PWN3_PLACEMENT");
+std::atomic<int> PLACEMENT_POLICY(PLACEMENT_VARIABLE == NULL ? PlacementOff :
+                                  strcmp(PLACEMENT_VARIABLE, "reserve") == 0 ? PlacementReserve : PlacementOff);
+std::atomic<pid_t> PLACEMENT_GAME_THREAD(0);
+// Taken before anything is pinned, the game thread's own mask shrinks to one core
+cpu_set_t PROCESS_CPUS;
+bool PROCESS_CPUS_KNOWN = sched_getaffinity(0, sizeof(PROCESS_CPUS), &PROCESS_CPUS) == 0;
+static __thread pid_t CURRENT_TID = 0;
+// Something is pinned, so turning placement off still has work to do
+std::atomic<bool> PLACEMENT_APPLIED(false);
+
+// Scans and moves run on a helper thread started by the first request, so
+// the game thread only ever signals it. The helper waits until the process
+// exits, so what it waits on is never destroyed.
+std::mutex PLACEMENT_LOCK;
+std::condition_variable* PLACEMENT_WAKE = NULL;
+bool PLACEMENT_REQUESTED = false;
+
+// Original nice value of the game thread, restored when boosting is turned off
+bool GAME_NICE_CHANGED = false;
+int GAME_NICE_ORIGINAL = 0;
+
+// CPU time of each thread at the previous report
+pid_t REPORTED_TIDS[MAX_PLACEMENT_THREADS];
+float REPORTED_CPU_SECONDS[MAX_PLACEMENT_THREADS];
+size_t REPORTED_COUNT = 0;
+
+
+static pid_t GetTid() {
+    if (CURRENT_TID == 0) {
+        CURRENT_TID = syscall(SYS_gettid);
+    }
+    return CURRENT_TID;
+}
+
+
+void SetPlacementGameThread() {
+    pid_t tid = GetTid();
+    if (PLACEMENT_GAME_THREAD.load(std::memory_order_relaxed) != tid) {
+        PLACEMENT_GAME_THREAD.store(tid, std::memory_order_relaxed);
+    }
+}
+
+
+void SetPlacementPolicy(PlacementPolicy policy) {
+    PLACEMENT_POLICY = policy;
+    RequestPlacement();
+}
+
+
+PlacementPolicy GetPlacementPolicy() {
+    return (PlacementPolicy)PLACEMENT_POLICY.load();
+}
+
+
+// Negative values need CAP_SYS_NICE, 0 puts the thread back where it was
+bool SetGameThreadNice(int nice) {
+    pid_t tid = PLACEMENT_GAME_THREAD.load();
+    if (tid == 0) {
+        return false;
+    }
+    if (!GAME_NICE_CHANGED) {
+        errno = 0;
+        GAME_NICE_ORIGINAL = getpriority(PRIO_PROCESS, tid);
+        if (errno != 0) {
+            return false;
+        }
+    }
+    int target = nice == 0 ? GAME_NICE_ORIGINAL : nice;
+    if (setpriority(PRIO_PROCESS, tid, target) != 0) {
+        return false;
+    }
+    GAME_NICE_CHANGED = nice != 0;
+    return true;
+}
+
+
+static bool ReadThread(pid_t tid, ThreadInfo& info) {
+    char path[64];
+    char buffer[1024];
+    info.tid = tid;
+
+    snprintf(path, sizeof(path), "/proc/self/task/%d/comm", tid);
+    FILE* file = fopen(path, "r");
+    if (file == NULL) {
+        return false;
+    }
+    if (fgets(info.name, sizeof(info.name), file) == NULL) {
+        info.name[0] = 0;
+    }
+    fclose(file);
+    info.name[strcspn(info.name, "\n")] = 0;
+
+    snprintf(path, sizeof(path), "/proc/self/task/%d/stat", tid);
+    file = fopen(path, "r");
+    if (file == NULL) {
+        return false;
+    }
+    size_t length = fread(buffer, 1, sizeof(buffer) - 1, file);
+    fclose(file);
+    buffer[length] = 0;
+
+    // Fields are counted from after the parenthesised name, which may contain spaces
+    char* fields = strrchr(buffer, ')');
+    if (fields == NULL) {
+        return false;
+    }
+    unsigned long utime = 0, stime = 0;
+    long nice = 0;
+    int cpu = -1;
+    int field = 2;
+    char* position;
+    for (char* token = strtok_r(fields + 1, " ", &position); token != NULL; token = strtok_r(NULL, " ", &position)) {
+        field++;
+        if (field == 14) {
+            utime = strtoul(token, NULL, 10);
+        }
+        else if (field == 15) {
+            stime = strtoul(token, NULL, 10);
+        }
+        else if (field == 19) {
+            nice = strtol(token, NULL, 10);
+        }
+        else if (field == 39) {
+            cpu = atoi(token);
+            break;
+        }
+    }
+    info.cpu = cpu;
+    info.nice = nice;
+    info.cpuSeconds = (float)(utime + stime) / sysconf(_SC_CLK_TCK);
+
+    if (tid == PLACEMENT_GAME_THREAD.load(std::memory_order_relaxed)) {
+        info.role = GameThread;
+    }
+    else if (strstr(info.name, "Render") != NULL || strstr(info.name, "RHI") != NULL) {
+        info.role = RenderThread;
+    }
+    else {
+        info.role = EngineThread;
+    }
+    return true;
+}
+
+
+size_t ScanThreads(ThreadInfo* threads, size_t capacity) {
+    DIR* directory = opendir("/proc/self/task");
+    if (directory == NULL) {
+        return 0;
+    }
+    size_t count = 0;
+    struct dirent* entry;
+    while (count < capacity && (entry = readdir(directory)) != NULL) {
+        pid_t tid = atoi(entry->d_name);
+        if (tid > 0 && ReadThread(tid, threads[count])) {
+            count++;
+        }
+    }
+    closedir(directory);
+    return count;
+}
+
+
+static void ApplyPlacement() {
+    static ThreadInfo threads[MAX_PLACEMENT_THREADS];
+    PlacementPolicy policy = GetPlacementPolicy();
+    if (policy == PlacementOff && !PLACEMENT_APPLIED) {
+        return;
+    }
+    size_t count = ScanThreads(threads, MAX_PLACEMENT_THREADS);
+    const cpu_set_t& allowed = PROCESS_CPUS;
+    // Turning placement off hands every thread the whole process mask again
+    if (policy == PlacementOff) {
+        for (size_t i = 0; i < count; i++) {
+            sched_setaffinity(threads[i].tid, sizeof(allowed), &allowed);
+        }
+        PLACEMENT_APPLIED = false;
+        return;
+    }
+
+    int gameCpu = -1;
+    for (size_t i = 0; i < count; i++) {
+        if (threads[i].role == GameThread && threads[i].cpu >= 0 && CPU_ISSET(threads[i].cpu, &allowed)) {
+            gameCpu = threads[i].cpu;
+        }
+    }
+    // Nowhere to move the others to on a single core
+    if (gameCpu < 0 || CPU_COUNT(&allowed) < 2) {
+        return;
+    }
+    cpu_set_t otherCpus = allowed;
+    CPU_CLR(gameCpu, &otherCpus);
+    cpu_set_t gameCpus;
+    CPU_ZERO(&gameCpus);
+    CPU_SET(gameCpu, &gameCpus);
+    // Render threads keep every other core, the rest also stay off the ones
+    // render threads are on as long as that leaves them a core
+    cpu_set_t engineCpus = otherCpus;
+    for (size_t i = 0; i < count; i++) {
+        if (threads[i].role == RenderThread && threads[i].cpu >= 0) {
+            CPU_CLR(threads[i].cpu, &engineCpus);
+        }
+    }
+    if (CPU_COUNT(&engineCpus) == 0) {
+        engineCpus = otherCpus;
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        cpu_set_t* cpus = threads[i].role == GameThread ? &gameCpus :
+                          threads[i].role == RenderThread ? &otherCpus : &engineCpus;
+        sched_setaffinity(threads[i].tid, sizeof(*cpus), cpus);
+    }
+    PLACEMENT_APPLIED = true;
+}
+
+
+static void RunPlacement() {
+    pthread_setname_np(pthread_self(), "pwn3-placement");
+    std::unique_lock<std::mutex> guard(PLACEMENT_LOCK);
+    for (;;) {
+        PLACEMENT_WAKE->wait(guard, [] { return PLACEMENT_REQUESTED; });
+        PLACEMENT_REQUESTED = false;
+        guard.unlock();
+        ApplyPlacement();
+        guard.lock();
+    }
+}
+
+
+void RequestPlacement() {
+    if (!PROCESS_CPUS_KNOWN || (GetPlacementPolicy() == PlacementOff && !PLACEMENT_APPLIED)) {
+        return;
+    }
+    std::lock_guard<std::mutex> guard(PLACEMENT_LOCK);
+    if (PLACEMENT_WAKE == NULL) {
+        PLACEMENT_WAKE = new std::condition_variable();
+        std::thread(RunPlacement).detach();
+    }
+    PLACEMENT_REQUESTED = true;
+    PLACEMENT_WAKE->notify_one();
+}
+
+
+static float GetReportedCpuSeconds(pid_t tid, float cpuSeconds) {
+    for (size_t i = 0; i < REPORTED_COUNT; i++) {
+        if (REPORTED_TIDS[i] == tid) {
+            float previous = REPORTED_CPU_SECONDS[i];
+            REPORTED_CPU_SECONDS[i] = cpuSeconds;
+            return previous;
+        }
+    }
+    if (REPORTED_COUNT < MAX_PLACEMENT_THREADS) {
+        REPORTED_TIDS[REPORTED_COUNT] = tid;
+        REPORTED_CPU_SECONDS[REPORTED_COUNT] = cpuSeconds;
+        REPORTED_COUNT++;
+    }
+    return 0;
+}
+
+
+void ReportThreads(FILE* out) {
+    static const char* ROLE_NAMES[] = {"engine", "game", "render"};
+    static const char* POLICY_NAMES[] = {"off", "reserve"};
+    static ThreadInfo threads[MAX_PLACEMENT_THREADS];
+    size_t count = ScanThreads(threads, MAX_PLACEMENT_THREADS);
+    fprintf(out, "<Threads> %lu threads, placement %s\n", (unsigned long)count, POLICY_NAMES[GetPlacementPolicy()]);
+    for (size_t i = 0; i < count; i++) {
+        ThreadInfo& thread = threads[i];
+        float previous = GetReportedCpuSeconds(thread.tid, thread.cpuSeconds);
+        // Idle engine threads only clutter the list
+        if (thread.role == EngineThread && thread.cpuSeconds == previous) {
+            continue;
+        }
+        fprintf(out, "    %d %-15s %-6s cpu %d nice %d: %.2f s, +%.2f s since last report\n", thread.tid, thread.name,
+                ROLE_NAMES[thread.role], thread.cpu, thread.nice, thread.cpuSeconds, thread.cpuSeconds - previous);
+    }
+    fflush(out);
+}
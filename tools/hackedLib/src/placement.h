@@ -0,0 +1,47 @@
+#ifndef PLACEMENT_H
+#define PLACEMENT_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <sys/types.h>
+
+const size_t MAX_PLACEMENT_THREADS = 256;
+const size_t THREAD_NAME_LENGTH = 16;
+// Engine threads come and go, so placement is re-applied this often
+const float PLACEMENT_INTERVAL = 5;
+
+enum ThreadRole {EngineThread, GameThread, RenderThread};
+enum PlacementPolicy {
+    // Leave the scheduler alone
+    PlacementOff,
+    // Pin the game thread to its core and move every other thread off it,
+    // keeping the rest off the render threads' cores too when there's room
+    PlacementReserve,
+};
+
+
+struct ThreadInfo {
+    pid_t tid;
+    char name[THREAD_NAME_LENGTH];
+    ThreadRole role;
+    int cpu;
+    int nice;
+    float cpuSeconds;
+};
+
+
+// Threads are discovered through /proc/self/task. The game thread is the one
+// calling World::Tick and render threads are recognised by name. Masks are
+// always derived from the process's mask as it was when the library loaded.
+// RequestPlacement only wakes the helper thread that scans and moves them,
+// so it is cheap enough to call from the tick.
+void SetPlacementGameThread();
+void SetPlacementPolicy(PlacementPolicy);
+PlacementPolicy GetPlacementPolicy();
+bool SetGameThreadNice(int);
+size_t ScanThreads(ThreadInfo *, size_t);
+void RequestPlacement();
+void ReportThreads(FILE *);
+
+#endif
@@ -0,0 +1,224 @@
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include "players.h"
+
+
+PlayerTracker::PlayerTracker() :
+    m_count(0), m_dt(0), m_localPvP(false), m_localPvPEnabling(false), m_localPvPCountdown(0) {
+}
+
+
+size_t PlayerTracker::Add(uint32_t id) {
+    size_t slot = this->Find(id);
+    if (slot < m_count || m_count == MAX_TRACKED_PLAYERS) {
+        return slot;
+    }
+    slot = m_count++;
+    m_ids[slot] = id;
+    m_names[slot][0] = '\0';
+    m_x[slot] = m_y[slot] = m_z[slot] = m_yaw[slot] = 0;
+    m_vx[slot] = m_vy[slot] = m_vz[slot] = 0;
+    m_pvp[slot] = false;
+    m_seen[slot] = true;
+    m_fresh[slot] = true;
+    m_weaponDps[slot] = 0;
+    m_weaponRange[slot] = 0;
+    m_kills[slot] = 0;
+    m_distance[slot] = INFINITY;
+    m_threat[slot] = 0;
+    return slot;
+}
+
+
+void PlayerTracker::Remove(size_t slot) {
+    // Keep the arrays dense by moving the last player into the hole
+    size_t last = --m_count;
+    if (slot == last) {
+        return;
+    }
+    m_ids[slot] = m_ids[last];
+    memcpy(m_names[slot], m_names[last], PLAYER_NAME_LENGTH);
+    m_x[slot] = m_x[last];
+    m_y[slot] = m_y[last];
+    m_z[slot] = m_z[last];
+    m_yaw[slot] = m_yaw[last];
+    m_vx[slot] = m_vx[last];
+    m_vy[slot] = m_vy[last];
+    m_vz[slot] = m_vz[last];
+    m_pvp[slot] = m_pvp[last];
+    m_seen[slot] = m_seen[last];
+    m_fresh[slot] = m_fresh[last];
+    m_weaponDps[slot] = m_weaponDps[last];
+    m_weaponRange[slot] = m_weaponRange[last];
+    m_kills[slot] = m_kills[last];
+    m_distance[slot] = m_distance[last];
+    m_threat[slot] = m_threat[last];
+}
+
+
+void PlayerTracker::BeginTick(float dt) {
+    m_dt = dt;
+    float decay = expf(-logf(2) * dt / THREAT_KILL_HALF_LIFE);
+    for (size_t i = 0; i < m_count; i++) {
+        m_seen[i] = false;
+        m_kills[i] *= decay;
+    }
+}
+
+
+void PlayerTracker::Observe(uint32_t id, const char* name, float x, float y, float z, float yaw, bool pvp) {
+    size_t slot = this->Add(id);
+    if (slot == MAX_TRACKED_PLAYERS) {
+        return;
+    }
+    // Velocity from the pose delta, since remote velocity isn't replicated reliably
+    if (!m_fresh[slot] && m_dt > 0) {
+        m_vx[slot] = (x - m_x[slot]) / m_dt;
+        m_vy[slot] = (y - m_y[slot]) / m_dt;
+        m_vz[slot] = (z - m_z[slot]) / m_dt;
+    }
+    if (m_fresh[slot] && name != NULL) {
+        snprintf(m_names[slot], PLAYER_NAME_LENGTH, "%s", name);
+    }
+    m_x[slot] = x;
+    m_y[slot] = y;
+    m_z[slot] = z;
+    m_yaw[slot] = yaw;
+    m_pvp[slot] = pvp;
+    m_seen[slot] = true;
+    m_fresh[slot] = false;
+}
+
+
+void PlayerTracker::EndTick(float x, float y, float z) {
+    // Whoever wasn't observed this tick has left
+    for (size_t i = m_count; i > 0; i--) {
+        if (!m_seen[i - 1]) {
+            this->Remove(i - 1);
+        }
+    }
+
+    // Only mutual PvP lets someone hurt us, but an imminent switch still counts
+    float hostility = m_localPvP ? 1 : (m_localPvPEnabling && m_localPvPCountdown > 0 ? 0.5f : 0);
+    for (size_t i = 0; i < m_count; i++) {
+        float dx = m_x[i] - x, dy = m_y[i] - y, dz = m_z[i] - z;
+        float distance = sqrtf(dx * dx + dy * dy + dz * dz);
+        float closing = distance > 1 ? -(m_vx[i] * dx + m_vy[i] * dy + m_vz[i] * dz) / distance : 0;
+
+        float dps = m_weaponDps[i] > 1 ? m_weaponDps[i] : 1;
+        float reach = m_weaponRange[i] <= 0 || distance <= m_weaponRange[i] ? 1 : 0.5f;
+        float offense = dps * reach + m_kills[i] * THREAT_KILL_WEIGHT;
+        float proximity = THREAT_DISTANCE_SCALE / (THREAT_DISTANCE_SCALE + distance);
+        float approach = 1 + (closing > 0 ? closing : 0) / THREAT_DISTANCE_SCALE;
+
+        m_distance[i] = distance;
+        m_threat[i] = (m_pvp[i] ? hostility : 0) * offense * proximity * approach;
+    }
+}
+
+
+void PlayerTracker::SetLocalPvP(bool enabled) {
+    m_localPvP = enabled;
+}
+
+
+void PlayerTracker::SetLocalPvPCountdown(bool enabling, int32_t countdown) {
+    m_localPvPEnabling = enabling;
+    m_localPvPCountdown = countdown;
+}
+
+
+void PlayerTracker::SetPvPEnabled(uint32_t id, bool enabled) {
+    size_t slot = this->Add(id);
+    if (slot < m_count) {
+        m_pvp[slot] = enabled;
+    }
+}
+
+
+void PlayerTracker::SetWeapon(uint32_t id, float damagePerSecond, float range) {
+    size_t slot = this->Add(id);
+    if (slot < m_count) {
+        m_weaponDps[slot] = damagePerSecond;
+        m_weaponRange[slot] = range;
+    }
+}
+
+
+void PlayerTracker::OnKill(uint32_t id) {
+    size_t slot = this->Find(id);
+    if (slot < m_count) {
+        m_kills[slot] += 1;
+    }
+}
+
+
+void PlayerTracker::Clear() {
+    m_count = 0;
+}
+
+
+size_t PlayerTracker::GetCount() const {
+    return m_count;
+}
+
+
+size_t PlayerTracker::Find(uint32_t id) const {
+    for (size_t i = 0; i < m_count; i++) {
+        if (m_ids[i] == id) {
+            return i;
+        }
+    }
+    return MAX_TRACKED_PLAYERS;
+}
+
+
+size_t PlayerTracker::GetMostThreatening() const {
+    size_t best = MAX_TRACKED_PLAYERS;
+    for (size_t i = 0; i < m_count; i++) {
+        if (m_threat[i] > 0 && (best == MAX_TRACKED_PLAYERS || m_threat[i] > m_threat[best])) {
+            best = i;
+        }
+    }
+    return best;
+}
+
+
+uint32_t PlayerTracker::GetId(size_t slot) const {
+    return m_ids[slot];
+}
+
+
+const char * PlayerTracker::GetName(size_t slot) const {
+    return m_names[slot];
+}
+
+
+float PlayerTracker::GetDistance(size_t slot) const {
+    return m_distance[slot];
+}
+
+
+float PlayerTracker::GetThreat(size_t slot) const {
+    return m_threat[slot];
+}
+
+
+bool PlayerTracker::IsPvPEnabled(size_t slot) const {
+    return m_pvp[slot];
+}
+
+
+void PlayerTracker::GetPosition(size_t slot, float& x, float& y, float& z) const {
+    x = m_x[slot];
+    y = m_y[slot];
+    z = m_z[slot];
+}
+
+
+void PlayerTracker::GetVelocity(size_t slot, float& x, float& y, float& z) const {
+    x = m_vx[slot];
+    y = m_vy[slot];
+    z = m_vz[slot];
+}
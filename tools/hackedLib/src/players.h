@@ -0,0 +1,73 @@
+#ifndef PLAYERS_H
+#define PLAYERS_H
+
+#include <cstddef>
+#include <cstdint>
+
+const size_t MAX_TRACKED_PLAYERS = 64;
+const size_t PLAYER_NAME_LENGTH = 32;
+// Distance at which proximity halves the threat of a player
+const float THREAT_DISTANCE_SCALE = 2000;
+// Threat added per recent kill, in damage-per-second terms
+const float THREAT_KILL_WEIGHT = 50;
+// Seconds for a recent kill to stop counting
+const float THREAT_KILL_HALF_LIFE = 60;
+
+
+// Flat per-player state for every other connected player. Engine callbacks
+// update it as events arrive, and the threat scores are refreshed once per
+// tick, so features never have to walk the engine's player set themselves.
+class PlayerTracker {
+  public:
+    PlayerTracker();
+    void BeginTick(float);
+    void Observe(uint32_t, const char *, float, float, float, float, bool);
+    void EndTick(float, float, float);
+    void SetLocalPvP(bool);
+    void SetLocalPvPCountdown(bool, int32_t);
+    void SetPvPEnabled(uint32_t, bool);
+    void SetWeapon(uint32_t, float, float);
+    void OnKill(uint32_t);
+    void Clear();
+
+    size_t GetCount() const;
+    size_t Find(uint32_t) const;
+    size_t GetMostThreatening() const;
+    uint32_t GetId(size_t) const;
+    const char * GetName(size_t) const;
+    float GetDistance(size_t) const;
+    float GetThreat(size_t) const;
+    bool IsPvPEnabled(size_t) const;
+    void GetPosition(size_t, float &, float &, float &) const;
+    void GetVelocity(size_t, float &, float &, float &) const;
+
+  private:
+    size_t m_count;
+    float m_dt;
+    bool m_localPvP;
+    bool m_localPvPEnabling;
+    int32_t m_localPvPCountdown;
+
+    uint32_t m_ids[MAX_TRACKED_PLAYERS];
+    char m_names[MAX_TRACKED_PLAYERS][PLAYER_NAME_LENGTH];
+    float m_x[MAX_TRACKED_PLAYERS];
+    float m_y[MAX_TRACKED_PLAYERS];
+    float m_z[MAX_TRACKED_PLAYERS];
+    float m_yaw[MAX_TRACKED_PLAYERS];
+    float m_vx[MAX_TRACKED_PLAYERS];
+    float m_vy[MAX_TRACKED_PLAYERS];
+    float m_vz[MAX_TRACKED_PLAYERS];
+    bool m_pvp[MAX_TRACKED_PLAYERS];
+    bool m_seen[MAX_TRACKED_PLAYERS];
+    bool m_fresh[MAX_TRACKED_PLAYERS];
+    float m_weaponDps[MAX_TRACKED_PLAYERS];
+    float m_weaponRange[MAX_TRACKED_PLAYERS];
+    float m_kills[MAX_TRACKED_PLAYERS];
+    float m_distance[MAX_TRACKED_PLAYERS];
+    float m_threat[MAX_TRACKED_PLAYERS];
+
+    size_t Add(uint32_t);
+    void Remove(size_t);
+};
+
+#endif
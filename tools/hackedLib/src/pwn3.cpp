@@ -1,9 +1,32 @@
+#include <cmath>
 #include <dlfcn.h>
 #include <set>
 #include <map>
 #include <functional>
 #include <cstring>
+#include <ctime>
 #include <vector>
+#include <sys/resource.h>
+#include "apiprofile.h"
+#include "board.h"
+#include "events.h"
+#include "filter.h"
+#include "fleet.h"
+#include "heatmap.h"
+#include "hook.h"
+#include "intern.h"
+#include "locks.h"
+#include "packets.h"
+#include "pacing.h"
+#include "placement.h"
+#include "players.h"
+#include "recorder.h"
+#include "reload.h"
+#include "rotation.h"
+#include "sections.h"
+#include "sockets.h"
+#include "syscalls.h"
+#include "weapons.h"
 #include "pwn3.h"
 
 // Globals to push to player after each tick
@@ -12,6 +35,339 @@ float WALK_SPEED = 10000;
 bool IS_FROZEN = false;
 Vector3 FROZEN_POSITION;
 
+// Activity heatmaps for the region the player is currently in
+Heatmap ENEMY_HEATMAP;
+Heatmap DROP_HEATMAP;
+char HEATMAP_REGION[HEATMAP_REGION_LENGTH] = "";
+float HEATMAP_RADIUS = 20000;
+
+// Decoded session events for later queries
+EventStore EVENTS;
+float POSITION_SAMPLE_INTERVAL = 0.5;
+float POSITION_SAMPLE_TIMER = 0;
+
+// Our own recent attacks, the only evidence that damage a target takes is ours
+struct OwnAttack {
+    uint32_t target;
+    uint32_t weapon;
+    float time;
+};
+const size_t OWN_ATTACK_COUNT = 16;
+OwnAttack OWN_ATTACKS[OWN_ATTACK_COUNT];
+size_t OWN_ATTACK_NEXT = 0;
+float DAMAGE_ATTRIBUTION_WINDOW = 2;
+
+// Other connected players and how dangerous they are to us
+PlayerTracker PLAYERS;
+
+// Spell rotation, optionally switching to the planned slot automatically
+RotationPlanner ROTATION;
+bool AUTO_ROTATION = false;
+float SESSION_TIME = 0;
+
+// Weapon table for the current loadout and the target it was last used for
+WeaponSelector WEAPONS;
+bool AUTO_WEAPON = false;
+uint64_t WEAPON_SIGNATURE = 0;
+TargetClass WEAPON_TARGET_CLASS = OtherTarget;
+float WEAPON_TARGET_DISTANCE = INFINITY;
+
+// Reload during lulls rather than when the clip runs dry
+ReloadScheduler RELOADS;
+bool AUTO_RELOAD = true;
+
+// Countdown to the next TCP_INFO sample of the game connections
+float SOCKET_SAMPLE_TIMER = 0;
+
+// Packet rules from PWN3_RULES or 'pf load'
+bool FILTER_CHECKED = false;
+
+// Periodic syscall reports, written to PWN3_SYSCALL_REPORT when set
+float SYSCALL_REPORT_TIMER = SYSCALL_REPORT_INTERVAL;
+FILE* SYSCALL_REPORT = NULL;
+
+// Frame deltas, and the counters used to blame spikes on something
+FramePacer FRAME_PACING;
+uint64_t PACING_HOOK_NS = 0;
+uint64_t PACING_FAULTS = 0;
+uint64_t PACING_BYTES_RECEIVED = 0;
+
+// Countdown to re-applying thread placement, and the game thread boost from PWN3_GAME_NICE
+float PLACEMENT_TIMER = 0;
+bool GAME_NICE_APPLIED = false;
+
+// Hook inputs are recorded to PWN3_RECORD for tools/replay when it is set
+bool TRACE_CHECKED = false;
+
+// Targets split with the other clients on this host through PWN3_BOARD
+CoordinationBoard BOARD;
+bool BOARD_CHECKED = false;
+uint32_t BOARD_TARGET = 0;
+uint32_t BOARD_LOOT = 0;
+Vector3 BOARD_LOOT_POSITION;
+
+// Link to the fleet controller from PWN3_FLEET or 'fl on', and the route it hands us
+FleetLink FLEET;
+bool FLEET_CHECKED = false;
+bool FLEET_ENABLED = false;
+std::vector<Vector3> ROUTE;
+std::vector<float> ROUTE_DWELL;
+size_t ROUTE_INDEX = 0;
+float ROUTE_TIMER = 0;
+bool ROUTE_ACTIVE = false;
+
+
+ClientWorld* GetGameWorld() {
+    return *((ClientWorld**)(dlsym(RTLD_NEXT, "GameWorld")));
+}
+
+
+Player* GetActivePlayer() {
+    ClientWorld* world = GetGameWorld();
+    if (world == NULL) {
+        return NULL;
+    }
+    return ((Player*)(world->m_activePlayer.m_object));
+}
+
+
+uint32_t GetActorId(IActor* actor) {
+    return actor == NULL ? 0 : ((Actor*)actor)->GetId();
+}
+
+
+uint32_t GetItemKey(IItem* item) {
+    return item == NULL ? 0 : EventStore::Key(item->GetName());
+}
+
+
+// Weapon we last attacked the actor with, if that was recent enough to be why
+// it lost health, otherwise 0
+static uint32_t GetOwnAttackWeapon(uint32_t target) {
+    for (size_t i = 1; i <= OWN_ATTACK_COUNT; i++) {
+        const OwnAttack& attack = OWN_ATTACKS[(OWN_ATTACK_NEXT + OWN_ATTACK_COUNT - i) % OWN_ATTACK_COUNT];
+        if (attack.target != 0 && attack.target == target && SESSION_TIME - attack.time <= DAMAGE_ATTRIBUTION_WINDOW) {
+            return attack.weapon;
+        }
+    }
+    return 0;
+}
+
+
+// Swap heatmap files over when the player changes region
+void OpenHeatmaps(const char* region) {
+    if (region == NULL || strncmp(region, HEATMAP_REGION, sizeof(HEATMAP_REGION)) == 0) {
+        return;
+    }
+    snprintf(HEATMAP_REGION, sizeof(HEATMAP_REGION), "%s", region);
+
+    const char* directory = getenv("PWN3_HEATMAP_DIR");
+    if (directory == NULL) {
+        directory = ".";
+    }
+    char path[512];
+    snprintf(path, sizeof(path), "%s/heatmap-%s-enemies.bin", directory, region);
+    ENEMY_HEATMAP.Open(path);
+    snprintf(path, sizeof(path), "%s/heatmap-%s-drops.bin", directory, region);
+    DROP_HEATMAP.Open(path);
+}
+
+
+// Read the stats the weapon selector needs, false if the item isn't a weapon
+bool ReadWeaponStats(Player* player, IItem* item, WeaponStats& stats) {
+    if (item == NULL || !item->CanEquip() || item->GetManaCost() > 0 || item->GetDamage() <= 0) {
+        return false;
+    }
+    stats.id = item;
+    stats.name = item->GetName();
+    stats.slot = WEAPON_SLOTS;
+    for (size_t slot = 0; slot < WEAPON_SLOTS; slot++) {
+        if (player->m_equipped[slot] == item) {
+            stats.slot = slot;
+        }
+    }
+    stats.damage = item->GetDamage();
+    stats.projectiles = item->GetNumberOfProjectiles();
+    stats.damageType = item->GetDamageType();
+    stats.cooldown = item->GetCooldownTime();
+    stats.damagePerSecond = item->GetDamagePerSecond();
+    stats.clipSize = item->GetClipSize();
+    stats.reloadTime = item->GetReloadTime(stats.clipSize);
+    stats.partialReload = item->HasPartialReload();
+    stats.range = item->GetRange();
+
+    IItem* ammo = item->GetAmmoType();
+    stats.loaded = stats.clipSize == 0 || player->GetLoadedAmmo(item) > 0;
+    stats.hasAmmo = ammo == NULL || stats.loaded || player->GetItemCount(ammo) > 0;
+    return true;
+}
+
+
+// Rebuild the weapon table when the loadout or ammo situation changes
+void UpdateWeapons(Player* player) {
+    uint64_t signature = player->m_inventory.size();
+    for (size_t slot = 0; slot < WEAPON_SLOTS; slot++) {
+        IItem* item = player->m_equipped[slot];
+        signature = signature * 31 + (uintptr_t)item;
+        if (item != NULL && item->GetClipSize() > 0) {
+            IItem* ammo = item->GetAmmoType();
+            signature = signature * 31 + (player->GetLoadedAmmo(item) > 0) * 2 +
+                (ammo != NULL && player->GetItemCount(ammo) > 0);
+        }
+    }
+    if (signature == WEAPON_SIGNATURE) {
+        return;
+    }
+    WEAPON_SIGNATURE = signature;
+
+    WEAPONS.Clear();
+    for (auto it = player->m_inventory.begin(); it != player->m_inventory.end(); ++it) {
+        WeaponStats stats;
+        if (ReadWeaponStats(player, it->first, stats)) {
+            WEAPONS.AddWeapon(stats);
+        }
+    }
+    WEAPONS.Build();
+}
+
+
+// Print an aggregate over the events recorded in the current region
+void PrintAggregate(const char* label, EventType type, uint32_t key) {
+    EventFilter filter;
+    filter.key = key;
+    filter.region = EVENTS.GetRegion();
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    EventAggregate result = EVENTS.Aggregate(type, filter);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    long elapsed = (end.tv_sec - start.tv_sec) * 1000000 + (end.tv_nsec - start.tv_nsec) / 1000;
+
+    printf("<Events> %s: count %lu, total %.0f (%ld us)\n", label, (unsigned long)result.count, result.sum, elapsed);
+}
+
+
+// Print the hottest cells of a heatmap around a position
+void PrintHottest(const char* label, const Heatmap& heatmap, const Vector3& position) {
+    Heatmap::Cell cells[5];
+    size_t count = heatmap.Hottest(position.x, position.y, position.z, HEATMAP_RADIUS, cells, 5);
+    printf("<Heatmap> %s in %s:\n", label, HEATMAP_REGION);
+    for (size_t i = 0; i < count; i++) {
+        bool taken = BOARD.IsNearOtherClient(HEATMAP_REGION, cells[i].x, cells[i].y, cells[i].z, BOARD_EXPLORE_RADIUS);
+        printf("    %.0f %.0f %.0f (%.2f)%s\n", cells[i].x, cells[i].y, cells[i].z, cells[i].heat,
+               taken ? " taken" : "");
+    }
+}
+
+
+// Jump to the next waypoint once we've spent long enough at the current one
+void FollowRoute(Player* player, float dt) {
+    if (!ROUTE_ACTIVE) {
+        return;
+    }
+    ROUTE_TIMER -= dt;
+    if (ROUTE_TIMER > 0) {
+        return;
+    }
+    if (ROUTE_INDEX >= ROUTE.size()) {
+        ROUTE_ACTIVE = false;
+        printf("<Route> Done\n");
+        return;
+    }
+    player->SetPosition(ROUTE[ROUTE_INDEX]);
+    ROUTE_TIMER = ROUTE_DWELL[ROUTE_INDEX];
+    ROUTE_INDEX++;
+}
+
+
+// Hold on to the best target of a kind, letting go of the previous one
+void ClaimTarget(uint32_t& held, uint32_t wanted) {
+    if (held != 0 && held != wanted) {
+        BOARD.Release(HEATMAP_REGION, held);
+    }
+    held = wanted != 0 && BOARD.Claim(HEATMAP_REGION, wanted) ? wanted : 0;
+}
+
+
+void PrintBoard() {
+    if (!BOARD.IsOpen()) {
+        printf("<Board> Not connected\n");
+        return;
+    }
+    if (!BOARD.HasClientSlot()) {
+        printf("<Board> Waiting for a free client slot\n");
+        return;
+    }
+    BoardPose poses[MAX_BOARD_CLIENTS];
+    size_t count = BOARD.GetClients(poses, MAX_BOARD_CLIENTS);
+    printf("<Board> client %lu of %lu, %lu claims, %lu contested, target %u, loot %u",
+           (unsigned long)BOARD.GetClientIndex(), (unsigned long)count, (unsigned long)BOARD.GetClaimCount(),
+           (unsigned long)BOARD.GetContested(), BOARD_TARGET, BOARD_LOOT);
+    if (BOARD_LOOT != 0) {
+        printf(" at %.0f %.0f %.0f", BOARD_LOOT_POSITION.x, BOARD_LOOT_POSITION.y, BOARD_LOOT_POSITION.z);
+    }
+    printf("\n");
+    for (size_t i = 0; i < count; i++) {
+        printf("    %u %s: %.0f %.0f %.0f%s\n", poses[i].pid, poses[i].name, poses[i].x, poses[i].y, poses[i].z,
+               poses[i].region == EventStore::Key(HEATMAP_REGION) ? "" : " (elsewhere)");
+    }
+}
+
+
+// Everything that may have slowed down the frame that just ended
+FrameCauses CollectFrameCauses(Player* player) {
+    FrameCauses causes;
+    const char* region = player->m_currentRegion;
+    causes.regionChanged = region != NULL && HEATMAP_REGION[0] != 0 &&
+                           strncmp(region, HEATMAP_REGION, sizeof(HEATMAP_REGION)) != 0;
+    causes.hookNs = PACING_HOOK_NS;
+
+    // Page faults on the game thread stand in for allocation bursts
+    struct rusage usage;
+    getrusage(RUSAGE_THREAD, &usage);
+    causes.minorFaults = usage.ru_minflt - PACING_FAULTS;
+    PACING_FAULTS = usage.ru_minflt;
+
+    SocketStats stats[8];
+    size_t count = GetSocketStats(stats, 8);
+    uint64_t received = 0;
+    for (size_t i = 0; i < count; i++) {
+        received += stats[i].bytesReceived;
+    }
+    causes.bytesReceived = received > PACING_BYTES_RECEIVED ? received - PACING_BYTES_RECEIVED : 0;
+    PACING_BYTES_RECEIVED = received;
+
+    SyscallFrame frame;
+    causes.blockedNs = GetSyscallFrames(&frame, 1) == 1 ? frame.blockedNs : 0;
+    return causes;
+}
+
+
+void PrintPacing() {
+    printf("<Pacing> %lu frames, p50 %.1f ms, p90 %.1f ms, p99 %.1f ms, baseline %.1f ms%s%s\n",
+           (unsigned long)FRAME_PACING.GetFrameCount(), FRAME_PACING.GetPercentile(0.5) * 1e3,
+           FRAME_PACING.GetPercentile(0.9) * 1e3, FRAME_PACING.GetPercentile(0.99) * 1e3,
+           FRAME_PACING.GetBaseline() * 1e3, FRAME_PACING.IsOscillating() ? ", oscillating" : "",
+           FRAME_PACING.HasLongTail() ? ", long tail" : "");
+    printf("<Pacing> %lu spikes:", (unsigned long)FRAME_PACING.GetSpikeCount());
+    for (size_t i = 0; i < FrameCulpritCount; i++) {
+        uint64_t count = FRAME_PACING.GetCulpritCount((FrameCulprit)i);
+        if (count > 0) {
+            printf(" %s %lu", FramePacer::GetCulpritName((FrameCulprit)i), (unsigned long)count);
+        }
+    }
+    printf("\n");
+    FrameSpike spikes[5];
+    size_t count = FRAME_PACING.GetSpikes(spikes, 5);
+    for (size_t i = 0; i < count; i++) {
+        printf("    frame %lu: %.1f ms over %.1f ms, %s (faults %lu, %lu bytes in, hook %.2f ms, blocked %.2f ms)\n",
+               (unsigned long)spikes[i].frame, spikes[i].dt * 1e3, spikes[i].baseline * 1e3,
+               FramePacer::GetCulpritName(spikes[i].culprit), (unsigned long)spikes[i].causes.minorFaults,
+               (unsigned long)spikes[i].causes.bytesReceived, spikes[i].causes.hookNs / 1e6,
+               spikes[i].causes.blockedNs / 1e6);
+    }
+}
+
 
 bool Player::CanJump() {
     // Always can jump
@@ -22,6 +378,7 @@ bool Player::CanJump() {
 void Player::Chat(const char* message) {
     // Print message
     printf("[%s] -> \"%s\"\n", this->GetPlayerName(), message);
+    TraceChatMessage(this, message);
     
     // Teleport
     if (strncmp(message, "tp ", 3) == 0) {
@@ -55,17 +412,469 @@ void Player::Chat(const char* message) {
         Vector3 position = this->GetPosition();
         printf("<Position> %f %f %f", position.x, position.y, position.z);
     }
+    // Show hottest enemy and drop cells nearby
+    else if (strncmp(message, "hm", 2) == 0) {
+        Vector3 position = this->GetPosition();
+        PrintHottest("Enemies", ENEMY_HEATMAP, position);
+        PrintHottest("Drops", DROP_HEATMAP, position);
+    }
+    // Query damage dealt with a weapon in this region
+    else if (strncmp(message, "qd ", 3) == 0) {
+        PrintAggregate(message + 3, DamageEvent, EventStore::Key(message + 3));
+    }
+    // Query kills made with a weapon in this region
+    else if (strncmp(message, "qk ", 3) == 0) {
+        PrintAggregate(message + 3, KillEvent, EventStore::Key(message + 3));
+    }
+    // List tracked players by threat
+    else if (strncmp(message, "pl", 2) == 0) {
+        size_t worst = PLAYERS.GetMostThreatening();
+        for (size_t i = 0; i < PLAYERS.GetCount(); i++) {
+            printf("<Players> %s%s [%u] %.0f away, PvP %s, threat %.2f\n", i == worst ? "* " : "",
+                   PLAYERS.GetName(i), PLAYERS.GetId(i), PLAYERS.GetDistance(i),
+                   PLAYERS.IsPvPEnabled(i) ? "on" : "off", PLAYERS.GetThreat(i));
+        }
+    }
+    // Show the planned spell rotation
+    else if (strncmp(message, "rp", 2) == 0) {
+        printf("<Rotation> %.0f damage, %.1f mana/s:", ROTATION.GetPlanDamage(), ROTATION.GetManaRegen());
+        for (size_t i = 0; i < ROTATION.GetPlanLength(); i++) {
+            size_t slot = ROTATION.GetPlanSlot(i);
+            if (slot == ROTATION_WAIT) {
+                printf(" wait");
+            }
+            else {
+                IItem* item = this->GetItemForSlot(slot);
+                printf(" %s", item == NULL ? "?" : item->GetName());
+            }
+        }
+        printf("\n");
+    }
+    // Toggle switching to the planned spell
+    else if (strncmp(message, "ra", 2) == 0) {
+        AUTO_ROTATION = !AUTO_ROTATION;
+    }
+    // Show weapon DPS against the current target
+    else if (strncmp(message, "wp", 2) == 0) {
+        printf("<Weapons> Target %s at %.0f\n", WeaponSelector::GetClassName(WEAPON_TARGET_CLASS), WEAPON_TARGET_DISTANCE);
+        size_t best = WEAPONS.GetBestOwned(WEAPON_TARGET_CLASS, WEAPON_TARGET_DISTANCE);
+        for (size_t i = 0; i < WEAPONS.GetCount(); i++) {
+            const WeaponStats& weapon = WEAPONS.GetWeapon(i);
+            printf("    %s%s (slot %ld): %.1f DPS\n", i == best ? "* " : "", weapon.name,
+                   weapon.slot < WEAPON_SLOTS ? (long)weapon.slot : -1L,
+                   WEAPONS.GetDps(i, WEAPON_TARGET_CLASS, WEAPON_TARGET_DISTANCE));
+        }
+    }
+    // Toggle switching to the best weapon automatically
+    else if (strncmp(message, "aw", 2) == 0) {
+        AUTO_WEAPON = !AUTO_WEAPON;
+    }
+    // Toggle reloading during lulls
+    else if (strncmp(message, "ar", 2) == 0) {
+        AUTO_RELOAD = !AUTO_RELOAD;
+        printf("<Reload> Auto-reload %s\n", AUTO_RELOAD ? "on" : "off");
+    }
+    // Show game connection statistics
+    else if (strncmp(message, "net", 3) == 0) {
+        SocketStats stats[8];
+        size_t count = GetSocketStats(stats, 8);
+        for (size_t i = 0; i < count; i++) {
+            printf("<Net> fd %d port %u: %lu/%lu bytes out/in, rtt %.1f ms (+-%.1f), cwnd %u, retransmits %u, lost %u\n",
+                   stats[i].fd, stats[i].port, (unsigned long)stats[i].bytesSent, (unsigned long)stats[i].bytesReceived,
+                   stats[i].rtt / 1000.0, stats[i].rttVariance / 1000.0, stats[i].congestionWindow,
+                   stats[i].retransmits, stats[i].lost);
+        }
+    }
+    // Toggle low-latency options on game connections
+    else if (strncmp(message, "nt", 2) == 0) {
+        SetSocketTuning(!IsSocketTuningEnabled());
+        printf("<Net> Socket tuning %s\n", IsSocketTuningEnabled() ? "on" : "off");
+    }
+    // Packet rules, 'pf load path' replaces them and 'pf off' drops them
+    else if (strncmp(message, "pf", 2) == 0) {
+        if (strncmp(message, "pf load ", 8) == 0) {
+            LoadPacketFilter(message + 8);
+        }
+        else if (strncmp(message, "pf off", 6) == 0) {
+            ClearPacketFilter();
+        }
+        ReportPacketFilter(stdout);
+    }
+    // Send hex bytes to the game server as a packet, 'pk' alone shows the buffer pool
+    else if (strncmp(message, "pk", 2) == 0) {
+        SocketStats stats[8];
+        size_t count = GetSocketStats(stats, 8);
+        int fd = -1;
+        for (size_t i = 0; i < count && fd < 0; i++) {
+            if (stats[i].port != MASTER_SERVER_PORT) {
+                fd = stats[i].fd;
+            }
+        }
+        PacketWriter packet(NULL);
+        packet.SetDescriptor(fd);
+        for (const char* hex = message + 2; *hex != '\0'; hex++) {
+            if (isxdigit(hex[0]) && isxdigit(hex[1])) {
+                char pair[3] = {hex[0], hex[1], '\0'};
+                packet.Write8(strtoul(pair, NULL, 16));
+                hex++;
+            }
+        }
+        size_t length = packet.GetLength();
+        if (length > 0) {
+            bool sent = fd >= 0 && packet.Flush();
+            printf("<Packets> %s %lu bytes\n", sent ? "Queued" : "Couldn't queue", (unsigned long)length);
+        }
+        ReportPacketBuffers(stdout);
+    }
+    // Show syscall activity since the last report
+    else if (strncmp(message, "sc", 2) == 0) {
+        ReportSyscalls(stdout);
+    }
+    // Toggle lock contention profiling
+    else if (strncmp(message, "lp", 2) == 0) {
+        SetLockProfiling(!IsLockProfilingEnabled());
+        printf("<Locks> Profiling %s\n", IsLockProfilingEnabled() ? "on" : "off");
+    }
+    // Show the most contended locks, "lc reset" starts over
+    else if (strncmp(message, "lc", 2) == 0) {
+        ReportLocks(stdout);
+        if (strncmp(message, "lc reset", 8) == 0) {
+            ResetLockSites();
+        }
+    }
+    // Show frame pacing and what caused recent spikes, "fp reset" starts over
+    else if (strncmp(message, "fp", 2) == 0) {
+        PrintPacing();
+        if (strncmp(message, "fp reset", 8) == 0) {
+            FRAME_PACING.Reset();
+        }
+    }
+    // Show where World::Tick spends its time, "ts reset" starts over
+    else if (strncmp(message, "ts", 2) == 0) {
+        ReportTickSections(stdout);
+        if (strncmp(message, "ts reset", 8) == 0) {
+            ResetTickSections();
+        }
+    }
+    // Show per-thread CPU time and placement
+    else if (strncmp(message, "th", 2) == 0) {
+        ReportThreads(stdout);
+    }
+    // Set the thread placement policy: off or reserve
+    else if (strncmp(message, "pc ", 3) == 0) {
+        const char* policy = message + 3;
+        SetPlacementPolicy(strcmp(policy, "reserve") == 0 ? PlacementReserve : PlacementOff);
+        printf("<Threads> Placement %s\n", GetPlacementPolicy() == PlacementReserve ? "reserve" : "off");
+    }
+    // Change the game thread's nice value, 0 restores it
+    else if (strncmp(message, "pn ", 3) == 0) {
+        int nice = atoi(message + 3);
+        printf("<Threads> Game thread nice %d %s\n", nice, SetGameThreadNice(nice) ? "set" : "refused");
+    }
+    // Route of waypoints, 'rt add x y z [dwell]', 'rt go', 'rt stop' and 'rt clear'
+    else if (strncmp(message, "rt", 2) == 0) {
+        Vector3 waypoint;
+        float dwell = 10;
+        if (sscanf(message, "rt add %f %f %f %f", &waypoint.x, &waypoint.y, &waypoint.z, &dwell) >= 3) {
+            ROUTE.push_back(waypoint);
+            ROUTE_DWELL.push_back(dwell);
+        }
+        else if (strncmp(message, "rt go", 5) == 0) {
+            // Waypoints added to a route we're already on wait their turn
+            if (!ROUTE_ACTIVE) {
+                ROUTE_TIMER = 0;
+            }
+            ROUTE_ACTIVE = ROUTE_INDEX < ROUTE.size();
+        }
+        else if (strncmp(message, "rt stop", 7) == 0) {
+            ROUTE_ACTIVE = false;
+        }
+        else if (strncmp(message, "rt clear", 8) == 0) {
+            ROUTE.clear();
+            ROUTE_DWELL.clear();
+            ROUTE_INDEX = 0;
+            ROUTE_ACTIVE = false;
+        }
+        printf("<Route> %lu of %lu waypoints left%s\n", (unsigned long)(ROUTE.size() - ROUTE_INDEX),
+               (unsigned long)ROUTE.size(), ROUTE_ACTIVE ? ", following" : "");
+    }
+    // Fleet controller link, 'fl on [socket]' connects and 'fl off' drops it
+    else if (strncmp(message, "fl", 2) == 0) {
+        char path[108];
+        if (sscanf(message, "fl on %107s", path) == 1) {
+            FLEET.SetPath(path);
+        }
+        else if (strncmp(message, "fl on", 5) == 0) {
+            FLEET.SetPath(FLEET.GetPath());
+        }
+        else if (strncmp(message, "fl off", 6) == 0) {
+            FLEET.Disconnect();
+        }
+        if (strncmp(message, "fl on", 5) == 0 || strncmp(message, "fl off", 6) == 0) {
+            FLEET_ENABLED = strncmp(message, "fl on", 5) == 0;
+            FLEET_CHECKED = true;
+        }
+        printf("<Fleet> %s %s, %lu commands run\n", FLEET.IsConnected() ? "Connected to" : "Not connected to",
+               FLEET.GetPath(), (unsigned long)FLEET.GetCommandCount());
+    }
+    // Coordination board, 'cb on' joins the default one and 'cb off' leaves
+    else if (strncmp(message, "cb", 2) == 0) {
+        if (strncmp(message, "cb on", 5) == 0 && !BOARD.IsOpen()) {
+            BOARD.Open(DEFAULT_BOARD_NAME);
+        }
+        else if (strncmp(message, "cb off", 6) == 0) {
+            BOARD.Close();
+            BOARD_TARGET = 0;
+            BOARD_LOOT = 0;
+        }
+        PrintBoard();
+    }
+    // Show the game functions that took the most time, "ap reset" starts over
+    else if (strncmp(message, "ap", 2) == 0) {
+        ReportApiProfile(stdout);
+        if (strncmp(message, "ap reset", 8) == 0) {
+            ResetApiProfile();
+        }
+    }
+    // Show how many events have been recorded
+    else if (strncmp(message, "qs", 2) == 0) {
+        printf("<Events> health %lu, damage %lu, attacks %lu, states %lu, pickups %lu, kills %lu, positions %lu\n",
+               (unsigned long)EVENTS.GetCount(HealthEvent), (unsigned long)EVENTS.GetCount(DamageEvent),
+               (unsigned long)EVENTS.GetCount(AttackEvent), (unsigned long)EVENTS.GetCount(StateEvent),
+               (unsigned long)EVENTS.GetCount(PickupEvent), (unsigned long)EVENTS.GetCount(KillEvent),
+               (unsigned long)EVENTS.GetCount(PositionEvent));
+        ReportInternedStrings(stdout);
+    }
+}
+
+
+void Actor::PerformSetHealth(int32_t health) {
+    static auto real = RealFunction<void (*)(Actor*, int32_t)>("_ZN5Actor16PerformSetHealthEi");
+    TraceHealthChange(this, health);
+    int32_t previous = this->m_health;
+    real(this, health);
+
+    EVENTS.Append(HealthEvent, this->GetId(), 0, health);
+    // Damage is only put down to our weapon when we just attacked the victim,
+    // anyone else's hits on anything are recorded without a weapon
+    Player* player = GetActivePlayer();
+    if (health < previous && player != NULL && (Actor*)player != this) {
+        EVENTS.Append(DamageEvent, this->GetId(), GetOwnAttackWeapon(this->GetId()), previous - health);
+    }
+    // Being hit, or hits landing nearby, means we're in a fight
+    if (health < previous && player != NULL &&
+            ((Actor*)player == this || Vector3::Distance(this->GetPosition(), player->GetPosition()) < RELOAD_SAFE_DISTANCE)) {
+        RELOADS.OnCombat(SESSION_TIME);
+    }
+    // Nobody needs to chase a dead target
+    if (health <= 0 && this->GetId() == BOARD_TARGET) {
+        BOARD.Release(HEATMAP_REGION, BOARD_TARGET);
+        BOARD_TARGET = 0;
+    }
+}
+
+
+void Actor::UpdateState(const std::string& state, bool enabled) {
+    static auto real = RealFunction<void (*)(Actor*, const std::string&, bool)>("_ZN5Actor11UpdateStateERKSsb");
+    uint32_t name = InternString(state.data(), state.size());
+    TraceStateChange(this, name, enabled);
+    real(this, state, enabled);
+    EVENTS.Append(StateEvent, this->GetId(), name, enabled);
+}
+
+
+void Actor::TriggerEvent(const std::string& event, IActor* target, bool authority) {
+    static auto real = RealFunction<void (*)(Actor*, const std::string&, IActor*, bool)>("_ZN5Actor12TriggerEventERKSsP6IActorb");
+    uint32_t name = InternString(event.data(), event.size());
+    TraceTriggerEvent(this, name, target, authority);
+    real(this, event, target, authority);
+    EVENTS.Append(AttackEvent, this->GetId(), name, GetActorId(target));
+    Player* player = GetActivePlayer();
+    if (player != NULL && (Actor*)player == this && target != NULL) {
+        OWN_ATTACKS[OWN_ATTACK_NEXT] = {GetActorId(target), GetItemKey(player->GetCurrentItem()), SESSION_TIME};
+        OWN_ATTACK_NEXT = (OWN_ATTACK_NEXT + 1) % OWN_ATTACK_COUNT;
+    }
+}
+
+
+bool Player::PerformAddItem(IItem* item, uint32_t count, bool allowPartial) {
+    static auto real = RealFunction<bool (*)(Player*, IItem*, uint32_t, bool)>("_ZN6Player14PerformAddItemEP5IItemjb");
+    TraceItemAdded(this, item, count, allowPartial);
+    bool added = real(this, item, count, allowPartial);
+    if (added) {
+        EVENTS.Append(PickupEvent, this->GetId(), GetItemKey(item), count);
+    }
+    // Whatever we were heading for has most likely just been picked up
+    if (added && this == GetActivePlayer() && BOARD_LOOT != 0) {
+        BOARD.Release(HEATMAP_REGION, BOARD_LOOT);
+        BOARD_LOOT = 0;
+    }
+    return added;
+}
+
+
+void Player::OnKillEvent(IPlayer* killer, IActor* killed, IItem* item) {
+    static auto real = RealFunction<void (*)(Player*, IPlayer*, IActor*, IItem*)>("_ZN6Player11OnKillEventEP7IPlayerP6IActorP5IItem");
+    TraceKillEvent(this, killer, killed, item);
+    real(this, killer, killed, item);
+    IActor* killerActor = killer == NULL ? NULL : killer->GetActorInterface();
+    EVENTS.Append(KillEvent, GetActorId(killerActor), GetItemKey(item), GetActorId(killed));
+    PLAYERS.OnKill(GetActorId(killerActor));
+}
+
+
+void Player::SetRemoteItem(IItem* item) {
+    static auto real = RealFunction<void (*)(Player*, IItem*)>("_ZN6Player13SetRemoteItemEP5IItem");
+    TraceRemoteItemChange(this, item);
+    real(this, item);
+    // The tracker only holds other players, and would otherwise take a slot for us
+    if (this != GetActivePlayer()) {
+        PLAYERS.SetWeapon(this->GetId(), item == NULL ? 0 : item->GetDamagePerSecond(), item == NULL ? 0 : item->GetRange());
+    }
+}
+
+
+void Player::PerformSetPvPEnabled(bool enabled) {
+    static auto real = RealFunction<void (*)(Player*, bool)>("_ZN6Player20PerformSetPvPEnabledEb");
+    TracePvPChange(this, enabled);
+    real(this, enabled);
+    if (this != GetActivePlayer()) {
+        PLAYERS.SetPvPEnabled(this->GetId(), enabled);
+    }
+}
+
+
+void Player::PerformUpdatePvPCountdown(bool enabling, int32_t countdown) {
+    static auto real = RealFunction<void (*)(Player*, bool, int32_t)>("_ZN6Player25PerformUpdatePvPCountdownEbi");
+    TracePvPCountdownChange(this, enabling, countdown);
+    real(this, enabling, countdown);
+    if (this == GetActivePlayer()) {
+        PLAYERS.SetLocalPvPCountdown(enabling, countdown);
+    }
+}
+
+
+void Player::PerformSetLoadedAmmo(IItem* item, uint32_t loaded) {
+    static auto real = RealFunction<void (*)(Player*, IItem*, uint32_t)>("_ZN6Player20PerformSetLoadedAmmoEP5IItemj");
+    TraceLoadedAmmoChange(this, item, loaded);
+    real(this, item, loaded);
+    if (this == GetActivePlayer()) {
+        RELOADS.SetLoadedAmmo(item, loaded);
+    }
+}
+
+
+// Switching weapons and finishing a reload change what's loaded without a
+// loaded ammo event for the item in hand, so read it again
+static void RefreshLoadedAmmo(Player* player) {
+    IItem* item = player->GetCurrentItem();
+    if (item != NULL) {
+        RELOADS.SetLoadedAmmo(item, player->GetLoadedAmmo(item));
+    }
+}
+
+
+void Player::PerformSetCurrentSlot(size_t slot) {
+    static auto real = RealFunction<void (*)(Player*, size_t)>("_ZN6Player21PerformSetCurrentSlotEm");
+    TraceCurrentSlotChange(this, slot);
+    real(this, slot);
+    if (this == GetActivePlayer()) {
+        RefreshLoadedAmmo(this);
+    }
+}
+
+
+void Actor::PerformReloadNotification(uint32_t ammo) {
+    static auto real = RealFunction<void (*)(Actor*, uint32_t)>("_ZN5Actor25PerformReloadNotificationEj");
+    real(this, ammo);
+    Player* player = GetActivePlayer();
+    bool local = player != NULL && (Actor*)player == this;
+    TraceReloadNotification(this, ammo, local ? player : NULL);
+    if (local) {
+        RefreshLoadedAmmo(player);
+    }
+}
+
+
+void Player::PerformSetMana(int32_t mana) {
+    static auto real = RealFunction<void (*)(Player*, int32_t)>("_ZN6Player14PerformSetManaEi");
+    TraceManaChange(this, mana);
+    real(this, mana);
+    if (this == GetActivePlayer()) {
+        ROTATION.ObserveMana(mana, SESSION_TIME);
+    }
 }
 
 
 void World::Tick(float f) {
+    uint64_t tickStart = GetNanoseconds();
+    BeginTickSections();
+
+    // Close the syscall accounting of the frame that just ended
+    EndSyscallFrame(f);
+    SetLockGameThread();
+    SetPlacementGameThread();
+    if (!GAME_NICE_APPLIED) {
+        const char* nice = getenv("PWN3_GAME_NICE");
+        if (nice != NULL) {
+            SetGameThreadNice(atoi(nice));
+        }
+        GAME_NICE_APPLIED = true;
+    }
+    PLACEMENT_TIMER -= f;
+    if (PLACEMENT_TIMER <= 0) {
+        PLACEMENT_TIMER = PLACEMENT_INTERVAL;
+        RequestPlacement();
+    }
+    SYSCALL_REPORT_TIMER -= f;
+    if (SYSCALL_REPORT_TIMER <= 0) {
+        SYSCALL_REPORT_TIMER = SYSCALL_REPORT_INTERVAL;
+        const char* path = getenv("PWN3_SYSCALL_REPORT");
+        if (SYSCALL_REPORT == NULL && path != NULL) {
+            SYSCALL_REPORT = fopen(path, "a");
+        }
+        if (SYSCALL_REPORT != NULL) {
+            ReportSyscalls(SYSCALL_REPORT);
+        }
+    }
+    EndTickSection(AccountingSection);
+
     // Get the real GameWorld
-    ClientWorld* world = *((ClientWorld**)(dlsym(RTLD_NEXT, "GameWorld")));
+    ClientWorld* world = GetGameWorld();
 
     // Get player
     IPlayer* iplayer = world->m_activePlayer.m_object;
     Player* player = ((Player*)(iplayer));
 
+    // Record what this frame looks like before any feature acts on it
+    if (!TRACE_CHECKED) {
+        const char* path = getenv("PWN3_RECORD");
+        if (path != NULL && !OpenTrace(path)) {
+            printf("<Record> Can't open %s\n", path);
+        }
+        TRACE_CHECKED = true;
+    }
+    if (IsTracing()) {
+        TraceBeginTick(f, player);
+        for (auto it = world->m_players.begin(); it != world->m_players.end(); ++it) {
+            Player* remote = (Player*)(it->m_object);
+            if (remote != NULL && remote != player) {
+                TraceRemotePlayer(remote);
+            }
+        }
+        for (auto it = world->m_actors.begin(); it != world->m_actors.end(); ++it) {
+            if (it->m_object != NULL) {
+                TraceActor((Actor*)(it->m_object));
+            }
+        }
+        TraceEndTick();
+    }
+    EndTickSection(RecordingSection);
+
+    // Time this frame against its causes before the heatmaps follow a region change
+    FRAME_PACING.Record(f, CollectFrameCauses(player));
+    EndTickSection(PacingSection);
+
     // Increase speed
     player->m_walkingSpeed = WALK_SPEED;
 
@@ -79,4 +888,212 @@ void World::Tick(float f) {
         pos.z += 60;
         player->SetPosition(pos);
     }
+
+    // Sample RTT and congestion state of the game connections
+    SOCKET_SAMPLE_TIMER -= f;
+    if (SOCKET_SAMPLE_TIMER <= 0) {
+        SOCKET_SAMPLE_TIMER = SOCKET_SAMPLE_INTERVAL;
+        SampleSockets();
+    }
+    if (!FILTER_CHECKED) {
+        const char* path = getenv("PWN3_RULES");
+        if (path != NULL) {
+            LoadPacketFilter(path);
+        }
+        FILTER_CHECKED = true;
+    }
+    FlushDelayedPackets();
+    FlushSockets();
+    EndTickSection(SocketSection);
+
+    // Feed the rotation planner our spells, cooldowns and mana
+    SESSION_TIME += f;
+    for (size_t slot = 0; slot < MAX_ABILITIES; slot++) {
+        IItem* item = player->GetItemForSlot(slot);
+        if (item == NULL || item->GetManaCost() <= 0) {
+            ROTATION.ClearAbility(slot);
+            continue;
+        }
+        uint32_t projectiles = item->GetNumberOfProjectiles();
+        float damage = item->GetDamage() * (projectiles > 1 ? projectiles : 1);
+        ROTATION.SetAbility(slot, item->GetManaCost(), item->GetCooldownTime(), damage);
+        ROTATION.SetCooldown(slot, player->GetItemCooldown(item));
+    }
+    ROTATION.SetMana(player->GetMana());
+    ROTATION.Tick(f);
+    size_t nextSpell = ROTATION.GetNextSlot();
+    if (AUTO_ROTATION && nextSpell != ROTATION_WAIT && nextSpell != player->GetCurrentSlot()) {
+        player->SetCurrentSlot(nextSpell);
+    }
+    EndTickSection(RotationSection);
+
+    // Refresh remote player poses and threat scores
+    PLAYERS.BeginTick(f);
+    PLAYERS.SetLocalPvP(player->IsPvPEnabled());
+    for (auto it = world->m_players.begin(); it != world->m_players.end(); ++it) {
+        Player* remote = (Player*)(it->m_object);
+        if (remote == NULL || remote == player) {
+            continue;
+        }
+        Vector3 position = remote->GetPosition();
+        Rotation rotation = remote->GetRotation();
+        PLAYERS.Observe(remote->GetId(), remote->GetPlayerName(), position.x, position.y, position.z,
+                        rotation.yaw, remote->IsPvPEnabled());
+    }
+    Vector3 playerPosition = player->GetPosition();
+    PLAYERS.EndTick(playerPosition.x, playerPosition.y, playerPosition.z);
+
+    // Tell the other clients on this host where we are
+    if (!BOARD_CHECKED) {
+        const char* name = getenv("PWN3_BOARD");
+        if (name != NULL) {
+            BOARD.Open(name);
+        }
+        BOARD_CHECKED = true;
+    }
+    if (BOARD.IsOpen()) {
+        BOARD.Publish(player->GetPlayerName(), player->m_currentRegion, playerPosition.x, playerPosition.y,
+                      playerPosition.z, player->GetRotation().yaw);
+    }
+    EndTickSection(PlayerSection);
+
+    // Accumulate enemy and drop positions into the region's heatmaps
+    OpenHeatmaps(player->m_currentRegion);
+    ENEMY_HEATMAP.Advance(f);
+    DROP_HEATMAP.Advance(f);
+    EVENTS.SetRegion(player->m_currentRegion);
+    POSITION_SAMPLE_TIMER -= f;
+    bool samplePositions = POSITION_SAMPLE_TIMER <= 0;
+    if (samplePositions) {
+        POSITION_SAMPLE_TIMER = POSITION_SAMPLE_INTERVAL;
+    }
+    const char* nearestEnemy = NULL;
+    uint32_t nearestEnemyId = 0;
+    float nearestEnemyDistance = INFINITY;
+    uint32_t nearestLoot = 0;
+    Vector3 nearestLootPosition;
+    float nearestLootDistance = INFINITY;
+    for (auto it = world->m_actors.begin(); it != world->m_actors.end(); ++it) {
+        Actor* actor = (Actor*)(it->m_object);
+        if (actor == NULL) {
+            continue;
+        }
+        if (samplePositions) {
+            Vector3 position = actor->GetPosition();
+            EVENTS.AppendPosition(actor->GetId(), position.x, position.y, position.z);
+        }
+        if (actor->IsPlayer()) {
+            continue;
+        }
+        // Targets another client has claimed are theirs, we look past them
+        const char* blueprint = actor->GetBlueprintName();
+        bool drop = blueprint != NULL && strstr(blueprint, "Drop") != NULL;
+        if (drop) {
+            Vector3 position = actor->GetPosition();
+            DROP_HEATMAP.Add(position.x, position.y, position.z, f);
+        }
+        if (drop || (blueprint != NULL && strstr(blueprint, "Chest") != NULL)) {
+            Vector3 position = actor->GetPosition();
+            float distance = Vector3::Distance(position, playerPosition);
+            if (distance < nearestLootDistance && !BOARD.IsClaimedByOther(HEATMAP_REGION, actor->GetId())) {
+                nearestLoot = actor->GetId();
+                nearestLootPosition = position;
+                nearestLootDistance = distance;
+            }
+        }
+        else if (actor->IsCharacter() && !actor->IsNPC() && actor->GetHealth() > 0) {
+            Vector3 position = actor->GetPosition();
+            ENEMY_HEATMAP.Add(position.x, position.y, position.z, f);
+            float distance = Vector3::Distance(position, playerPosition);
+            if (distance < nearestEnemyDistance && !BOARD.IsClaimedByOther(HEATMAP_REGION, actor->GetId())) {
+                nearestEnemy = blueprint;
+                nearestEnemyId = actor->GetId();
+                nearestEnemyDistance = distance;
+            }
+        }
+    }
+    if (BOARD.IsOpen()) {
+        ClaimTarget(BOARD_TARGET, nearestEnemyId);
+        ClaimTarget(BOARD_LOOT, nearestLoot);
+        BOARD_LOOT_POSITION = nearestLootPosition;
+    }
+
+    EndTickSection(ActorSection);
+
+    // Pick the best weapon for whatever we're most likely fighting
+    UpdateWeapons(player);
+    WEAPON_TARGET_CLASS = WeaponSelector::Classify(nearestEnemy);
+    WEAPON_TARGET_DISTANCE = nearestEnemyDistance;
+    size_t rival = PLAYERS.GetMostThreatening();
+    if (rival < PLAYERS.GetCount() && PLAYERS.GetDistance(rival) < WEAPON_TARGET_DISTANCE) {
+        WEAPON_TARGET_CLASS = PlayerTarget;
+        WEAPON_TARGET_DISTANCE = PLAYERS.GetDistance(rival);
+    }
+    bool castingSpell = AUTO_ROTATION && nextSpell != ROTATION_WAIT;
+    if (AUTO_WEAPON && !castingSpell && WEAPON_TARGET_DISTANCE != INFINITY) {
+        size_t slot = WEAPONS.Choose(player->GetCurrentSlot(), WEAPON_TARGET_CLASS, WEAPON_TARGET_DISTANCE);
+        if (slot != player->GetCurrentSlot()) {
+            player->SetCurrentSlot(slot);
+        }
+    }
+
+    EndTickSection(WeaponSection);
+
+    // Top up the current weapon if things have gone quiet
+    IItem* current = player->GetCurrentItem();
+    if (AUTO_RELOAD && current != NULL && player->CanReload()) {
+        // The hooks above keep it current after that
+        uint32_t loaded;
+        if (!RELOADS.GetLoadedAmmo(current, loaded)) {
+            RELOADS.SetLoadedAmmo(current, player->GetLoadedAmmo(current));
+        }
+        float threat = rival < PLAYERS.GetCount() ? PLAYERS.GetThreat(rival) : 0;
+        if (RELOADS.ShouldReload(SESSION_TIME, current, current->GetClipSize(), current->HasPartialReload(),
+                                 threat, nearestEnemyDistance)) {
+            player->RequestReload();
+            RELOADS.OnReloadRequested(SESSION_TIME);
+        }
+    }
+
+    EndTickSection(ReloadSection);
+
+    // Run whatever the fleet controller sent since last frame and report back
+    if (!FLEET_CHECKED) {
+        const char* path = getenv("PWN3_FLEET");
+        if (path != NULL) {
+            FLEET.SetPath(path);
+            FLEET_ENABLED = true;
+        }
+        FLEET_CHECKED = true;
+    }
+    if (FLEET_ENABLED) {
+        std::vector<std::string> commands;
+        FLEET.Poll(f, commands);
+        for (size_t i = 0; i < commands.size(); i++) {
+            player->Chat(commands[i].c_str());
+        }
+        FLEET.Acknowledge();
+        if (FLEET.IsTelemetryDue(f)) {
+            FleetTelemetry telemetry;
+            memset(&telemetry, 0, sizeof(telemetry));
+            snprintf(telemetry.name, sizeof(telemetry.name), "%s", player->GetPlayerName());
+            snprintf(telemetry.region, sizeof(telemetry.region), "%s", HEATMAP_REGION);
+            telemetry.x = playerPosition.x;
+            telemetry.y = playerPosition.y;
+            telemetry.z = playerPosition.z;
+            telemetry.health = player->GetHealth();
+            telemetry.mana = player->GetMana();
+            telemetry.frameMs = f * 1e3;
+            telemetry.hookUs = PACING_HOOK_NS / 1e3;
+            telemetry.load = ROUTE_ACTIVE ? ROUTE.size() - ROUTE_INDEX : 0;
+            telemetry.claims = BOARD.GetClaimCount();
+            FLEET.SendTelemetry(telemetry);
+        }
+    }
+    FollowRoute(player, f);
+    EndTickSection(FleetSection);
+    EndTickSections();
+
+    // Our own share of the next frame delta
+    PACING_HOOK_NS = GetNanoseconds() - tickStart;
 }
\ No newline at end of file
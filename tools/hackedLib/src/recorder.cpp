@@ -0,0 +1,379 @@
+#include <cstdio>
+#include <cstring>
+#include <unordered_map>
+#include <vector>
+#include "intern.h"
+#include "recorder.h"
+#include "pwn3.h"
+
+FILE* TRACE = NULL;
+// Interned strings already written to the trace
+bool TRACE_DEFINED[MAX_INTERNED_STRINGS];
+std::unordered_map<IItem*, uint32_t> TRACE_ITEMS;
+
+// The current snapshot, written out in one piece by TraceEndTick
+std::vector<uint8_t> TRACE_LOCAL;
+std::vector<uint8_t> TRACE_PLAYERS;
+std::vector<uint8_t> TRACE_ACTORS;
+uint32_t TRACE_PLAYER_COUNT = 0;
+uint32_t TRACE_ACTOR_COUNT = 0;
+// Event records are built here, and since clear() keeps the capacity, tracing
+// stops allocating once the longest record has been seen
+static thread_local std::vector<uint8_t> TRACE_RECORD;
+
+
+template <class T>
+static void Put(std::vector<uint8_t>& buffer, T value) {
+    const uint8_t* bytes = (const uint8_t*)&value;
+    buffer.insert(buffer.end(), bytes, bytes + sizeof(T));
+}
+
+
+static void PutVector(std::vector<uint8_t>& buffer, const Vector3& vector) {
+    Put(buffer, vector.x);
+    Put(buffer, vector.y);
+    Put(buffer, vector.z);
+}
+
+
+static void PutRotation(std::vector<uint8_t>& buffer, const Rotation& rotation) {
+    Put(buffer, rotation.pitch);
+    Put(buffer, rotation.yaw);
+    Put(buffer, rotation.roll);
+}
+
+
+static void PutText(std::vector<uint8_t>& buffer, const char* text, size_t length) {
+    length = length < 0xFFFF ? length : 0xFFFF;
+    Put(buffer, (uint16_t)length);
+    buffer.insert(buffer.end(), text, text + length);
+}
+
+
+static void PutText(std::vector<uint8_t>& buffer, const char* text) {
+    PutText(buffer, text, strlen(text));
+}
+
+
+// Only ever one record at a time per thread, so callers look up any strings
+// and items the record refers to before starting it
+static std::vector<uint8_t>& BeginRecord(TraceRecord kind) {
+    TRACE_RECORD.clear();
+    Put(TRACE_RECORD, (uint8_t)kind);
+    return TRACE_RECORD;
+}
+
+
+static void WriteRecord(const std::vector<uint8_t>& record) {
+    fwrite(record.data(), 1, record.size(), TRACE);
+}
+
+
+// Trace indices are the interned IDs, so names seen every tick cost a lookup
+static uint32_t TraceInternedIndex(uint32_t index) {
+    if (index == INTERN_NONE || TRACE_DEFINED[index]) {
+        return index == INTERN_NONE ? TRACE_NONE : index;
+    }
+    TRACE_DEFINED[index] = true;
+    std::vector<uint8_t>& record = BeginRecord(TraceString);
+    Put(record, index);
+    PutText(record, GetInternedString(index), GetInternedLength(index));
+    WriteRecord(record);
+    return index;
+}
+
+
+static uint32_t TraceStringIndex(const char* text) {
+    return TraceInternedIndex(InternString(text));
+}
+
+
+static uint32_t TraceItemIndex(IItem* item) {
+    if (item == NULL) {
+        return TRACE_NONE;
+    }
+    auto found = TRACE_ITEMS.find(item);
+    if (found != TRACE_ITEMS.end()) {
+        return found->second;
+    }
+    // Ammo has to be defined before the weapon that refers to it
+    IItem* ammo = item->GetAmmoType();
+    uint32_t ammoIndex = ammo == item ? TRACE_SELF : TraceItemIndex(ammo);
+    uint32_t name = TraceStringIndex(item->GetName());
+    uint32_t index = TRACE_ITEMS.size();
+    TRACE_ITEMS[item] = index;
+
+    std::vector<uint8_t>& record = BeginRecord(TraceItem);
+    Put(record, index);
+    Put(record, name);
+    Put(record, item->GetManaCost());
+    Put(record, item->GetDamage());
+    Put(record, item->GetDamagePerSecond());
+    Put(record, item->GetNumberOfProjectiles());
+    Put(record, (uint8_t)item->GetDamageType());
+    Put(record, item->GetCooldownTime());
+    uint32_t clipSize = item->GetClipSize();
+    Put(record, clipSize);
+    Put(record, item->GetReloadTime(clipSize));
+    Put(record, (uint8_t)item->HasPartialReload());
+    Put(record, item->GetRange());
+    Put(record, (uint8_t)item->CanEquip());
+    Put(record, ammoIndex);
+    WriteRecord(record);
+    return index;
+}
+
+
+bool OpenTrace(const char* path) {
+    TRACE = fopen(path, "wb");
+    if (TRACE == NULL) {
+        return false;
+    }
+    setvbuf(TRACE, NULL, _IOFBF, 1 << 20);
+    fwrite(TRACE_MAGIC, 1, sizeof(TRACE_MAGIC), TRACE);
+    return true;
+}
+
+
+bool IsTracing() {
+    return TRACE != NULL;
+}
+
+
+void TraceChatMessage(Player* player, const char* message) {
+    if (TRACE == NULL) {
+        return;
+    }
+    std::vector<uint8_t>& record = BeginRecord(TraceChat);
+    Put(record, player->GetId());
+    PutText(record, message);
+    WriteRecord(record);
+}
+
+
+void TraceHealthChange(Actor* actor, int32_t health) {
+    if (TRACE == NULL) {
+        return;
+    }
+    std::vector<uint8_t>& record = BeginRecord(TraceHealth);
+    Put(record, actor->GetId());
+    Put(record, health);
+    WriteRecord(record);
+}
+
+
+void TraceStateChange(Actor* actor, uint32_t state, bool enabled) {
+    if (TRACE == NULL) {
+        return;
+    }
+    uint32_t name = TraceInternedIndex(state);
+    std::vector<uint8_t>& record = BeginRecord(TraceState);
+    Put(record, actor->GetId());
+    Put(record, name);
+    Put(record, (uint8_t)enabled);
+    WriteRecord(record);
+}
+
+
+void TraceTriggerEvent(Actor* actor, uint32_t event, IActor* target, bool authority) {
+    if (TRACE == NULL) {
+        return;
+    }
+    uint32_t name = TraceInternedIndex(event);
+    std::vector<uint8_t>& record = BeginRecord(TraceTrigger);
+    Put(record, actor->GetId());
+    Put(record, name);
+    Put(record, target == NULL ? TRACE_NONE : ((Actor*)target)->GetId());
+    Put(record, (uint8_t)authority);
+    WriteRecord(record);
+}
+
+
+void TraceItemAdded(Player* player, IItem* item, uint32_t count, bool allowPartial) {
+    if (TRACE == NULL) {
+        return;
+    }
+    uint32_t index = TraceItemIndex(item);
+    std::vector<uint8_t>& record = BeginRecord(TraceAddItem);
+    Put(record, player->GetId());
+    Put(record, index);
+    Put(record, count);
+    Put(record, (uint8_t)allowPartial);
+    WriteRecord(record);
+}
+
+
+void TraceKillEvent(Player* player, IPlayer* killer, IActor* killed, IItem* item) {
+    if (TRACE == NULL) {
+        return;
+    }
+    uint32_t index = TraceItemIndex(item);
+    IActor* killerActor = killer == NULL ? NULL : killer->GetActorInterface();
+    std::vector<uint8_t>& record = BeginRecord(TraceKill);
+    Put(record, player->GetId());
+    Put(record, killerActor == NULL ? TRACE_NONE : ((Actor*)killerActor)->GetId());
+    Put(record, killed == NULL ? TRACE_NONE : ((Actor*)killed)->GetId());
+    Put(record, index);
+    WriteRecord(record);
+}
+
+
+void TraceRemoteItemChange(Player* player, IItem* item) {
+    if (TRACE == NULL) {
+        return;
+    }
+    uint32_t index = TraceItemIndex(item);
+    std::vector<uint8_t>& record = BeginRecord(TraceRemoteItem);
+    Put(record, player->GetId());
+    Put(record, index);
+    WriteRecord(record);
+}
+
+
+void TracePvPChange(Player* player, bool enabled) {
+    if (TRACE == NULL) {
+        return;
+    }
+    std::vector<uint8_t>& record = BeginRecord(TracePvP);
+    Put(record, player->GetId());
+    Put(record, (uint8_t)enabled);
+    WriteRecord(record);
+}
+
+
+void TracePvPCountdownChange(Player* player, bool enabling, int32_t countdown) {
+    if (TRACE == NULL) {
+        return;
+    }
+    std::vector<uint8_t>& record = BeginRecord(TracePvPCountdown);
+    Put(record, player->GetId());
+    Put(record, (uint8_t)enabling);
+    Put(record, countdown);
+    WriteRecord(record);
+}
+
+
+void TraceLoadedAmmoChange(Player* player, IItem* item, uint32_t loaded) {
+    if (TRACE == NULL) {
+        return;
+    }
+    uint32_t index = TraceItemIndex(item);
+    std::vector<uint8_t>& record = BeginRecord(TraceLoadedAmmo);
+    Put(record, player->GetId());
+    Put(record, index);
+    Put(record, loaded);
+    WriteRecord(record);
+}
+
+
+void TraceManaChange(Player* player, int32_t mana) {
+    if (TRACE == NULL) {
+        return;
+    }
+    std::vector<uint8_t>& record = BeginRecord(TraceMana);
+    Put(record, player->GetId());
+    Put(record, mana);
+    WriteRecord(record);
+}
+
+
+void TraceCurrentSlotChange(Player* player, size_t slot) {
+    if (TRACE == NULL) {
+        return;
+    }
+    std::vector<uint8_t>& record = BeginRecord(TraceCurrentSlot);
+    Put(record, player->GetId());
+    Put(record, (uint32_t)slot);
+    WriteRecord(record);
+}
+
+
+// The stub game has no reload of its own, so the replay needs the result
+void TraceReloadNotification(Actor* actor, uint32_t ammo, Player* local) {
+    if (TRACE == NULL) {
+        return;
+    }
+    IItem* item = local == NULL ? NULL : local->GetCurrentItem();
+    uint32_t index = TraceItemIndex(item);
+    std::vector<uint8_t>& record = BeginRecord(TraceReload);
+    Put(record, actor->GetId());
+    Put(record, ammo);
+    Put(record, index);
+    Put(record, item == NULL ? 0 : local->GetLoadedAmmo(item));
+    WriteRecord(record);
+}
+
+
+void TraceBeginTick(float dt, Player* player) {
+    TRACE_LOCAL.clear();
+    TRACE_PLAYERS.clear();
+    TRACE_ACTORS.clear();
+    TRACE_PLAYER_COUNT = 0;
+    TRACE_ACTOR_COUNT = 0;
+
+    uint32_t name = TraceStringIndex(player->GetPlayerName());
+    uint32_t region = TraceStringIndex(player->m_currentRegion);
+    uint32_t equipped[TRACE_SLOTS];
+    for (size_t slot = 0; slot < TRACE_SLOTS; slot++) {
+        equipped[slot] = TraceItemIndex(player->m_equipped[slot]);
+    }
+
+    Put(TRACE_LOCAL, (uint8_t)TraceTick);
+    Put(TRACE_LOCAL, dt);
+    Put(TRACE_LOCAL, player->GetId());
+    Put(TRACE_LOCAL, name);
+    Put(TRACE_LOCAL, region);
+    PutVector(TRACE_LOCAL, player->GetPosition());
+    PutRotation(TRACE_LOCAL, player->GetRotation());
+    Put(TRACE_LOCAL, player->GetHealth());
+    Put(TRACE_LOCAL, player->GetMana());
+    Put(TRACE_LOCAL, (uint32_t)player->GetCurrentSlot());
+    Put(TRACE_LOCAL, (uint8_t)player->IsPvPEnabled());
+    Put(TRACE_LOCAL, (uint8_t)player->CanReload());
+    for (size_t slot = 0; slot < TRACE_SLOTS; slot++) {
+        Put(TRACE_LOCAL, equipped[slot]);
+    }
+    Put(TRACE_LOCAL, (uint32_t)player->m_inventory.size());
+    for (auto it = player->m_inventory.begin(); it != player->m_inventory.end(); ++it) {
+        Put(TRACE_LOCAL, TraceItemIndex(it->first));
+        Put(TRACE_LOCAL, it->second.count);
+        Put(TRACE_LOCAL, it->second.loadedAmmo);
+        Put(TRACE_LOCAL, player->GetItemCooldown(it->first));
+    }
+}
+
+
+void TraceRemotePlayer(Player* player) {
+    uint32_t name = TraceStringIndex(player->GetPlayerName());
+    Put(TRACE_PLAYERS, player->GetId());
+    Put(TRACE_PLAYERS, name);
+    PutVector(TRACE_PLAYERS, player->GetPosition());
+    PutRotation(TRACE_PLAYERS, player->GetRotation());
+    Put(TRACE_PLAYERS, (uint8_t)player->IsPvPEnabled());
+    Put(TRACE_PLAYERS, player->GetHealth());
+    TRACE_PLAYER_COUNT++;
+}
+
+
+void TraceActor(Actor* actor) {
+    uint32_t blueprint = TraceStringIndex(actor->GetBlueprintName());
+    uint8_t flags = (actor->IsPlayer() ? TracePlayerActor : 0) | (actor->IsCharacter() ? TraceCharacterActor : 0) |
+        (actor->IsNPC() ? TraceNPCActor : 0);
+    Put(TRACE_ACTORS, actor->GetId());
+    Put(TRACE_ACTORS, blueprint);
+    Put(TRACE_ACTORS, flags);
+    Put(TRACE_ACTORS, actor->GetHealth());
+    PutVector(TRACE_ACTORS, actor->GetPosition());
+    TRACE_ACTOR_COUNT++;
+}
+
+
+void TraceEndTick() {
+    WriteRecord(TRACE_LOCAL);
+    fwrite(&TRACE_PLAYER_COUNT, sizeof(TRACE_PLAYER_COUNT), 1, TRACE);
+    WriteRecord(TRACE_PLAYERS);
+    fwrite(&TRACE_ACTOR_COUNT, sizeof(TRACE_ACTOR_COUNT), 1, TRACE);
+    WriteRecord(TRACE_ACTORS);
+    // One write per frame, so a crashed session still leaves a usable trace
+    fflush(TRACE);
+}
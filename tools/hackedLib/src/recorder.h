@@ -0,0 +1,71 @@
+#ifndef RECORDER_H
+#define RECORDER_H
+
+#include <cstddef>
+#include <cstdint>
+
+class Actor;
+class IActor;
+class IItem;
+class IPlayer;
+class Player;
+
+// Everything the hooks see, written to PWN3_RECORD so tools/replay can feed
+// it back to pwn3.so against a stub game library. All values little-endian.
+const char TRACE_MAGIC[8] = {'P', 'W', 'N', '3', 'T', 'R', 'C', '2'};
+const uint32_t TRACE_NONE = 0xFFFFFFFF;
+// Ammo index of items that are their own ammo
+const uint32_t TRACE_SELF = 0xFFFFFFFE;
+const size_t TRACE_SLOTS = 10;
+
+enum TraceRecord {
+    // Strings and items are defined once and then referred to by index
+    TraceString = 'N',
+    TraceItem = 'I',
+    // Hook inputs, in the order they arrived
+    TraceChat = 'C',
+    TraceHealth = 'H',
+    TraceState = 'S',
+    TraceTrigger = 'E',
+    TraceAddItem = 'A',
+    TraceKill = 'K',
+    TraceRemoteItem = 'R',
+    TracePvP = 'P',
+    TracePvPCountdown = 'Q',
+    TraceLoadedAmmo = 'L',
+    TraceMana = 'M',
+    TraceCurrentSlot = 'W',
+    // Written once the game has handled it, with what it left loaded in the local player's weapon
+    TraceReload = 'O',
+    // World snapshot at the start of World::Tick
+    TraceTick = 'T',
+};
+
+enum TraceActorFlags {TracePlayerActor = 1, TraceCharacterActor = 2, TraceNPCActor = 4};
+
+
+bool OpenTrace(const char *);
+bool IsTracing();
+void TraceChatMessage(Player *, const char *);
+void TraceHealthChange(Actor *, int32_t);
+// State and event names arrive already interned
+void TraceStateChange(Actor *, uint32_t, bool);
+void TraceTriggerEvent(Actor *, uint32_t, IActor *, bool);
+void TraceItemAdded(Player *, IItem *, uint32_t, bool);
+void TraceKillEvent(Player *, IPlayer *, IActor *, IItem *);
+void TraceRemoteItemChange(Player *, IItem *);
+void TracePvPChange(Player *, bool);
+void TracePvPCountdownChange(Player *, bool, int32_t);
+void TraceLoadedAmmoChange(Player *, IItem *, uint32_t);
+void TraceManaChange(Player *, int32_t);
+void TraceCurrentSlotChange(Player *, size_t);
+void TraceReloadNotification(Actor *, uint32_t, Player *);
+
+// Snapshots are collected between these two calls, since only World::Tick can
+// walk the world's player and actor sets
+void TraceBeginTick(float, Player *);
+void TraceRemotePlayer(Player *);
+void TraceActor(Actor *);
+void TraceEndTick();
+
+#endif
@@ -0,0 +1,74 @@
+#include "reload.h"
+
+
+ReloadScheduler::ReloadScheduler() : m_count(0), m_lastCombat(-RELOAD_LULL_TIME), m_lastRequest(-RELOAD_RETRY_INTERVAL) {
+}
+
+
+void ReloadScheduler::OnCombat(float time) {
+    m_lastCombat = time;
+}
+
+
+void ReloadScheduler::OnReloadRequested(float time) {
+    m_lastRequest = time;
+}
+
+
+void ReloadScheduler::SetLoadedAmmo(const void* weapon, uint32_t loaded) {
+    for (size_t i = 0; i < m_count; i++) {
+        if (m_weapons[i] == weapon) {
+            m_loaded[i] = loaded;
+            return;
+        }
+    }
+    // Forget the oldest weapon once the table is full
+    if (m_count == MAX_RELOAD_WEAPONS) {
+        for (size_t i = 1; i < m_count; i++) {
+            m_weapons[i - 1] = m_weapons[i];
+            m_loaded[i - 1] = m_loaded[i];
+        }
+        m_count--;
+    }
+    m_weapons[m_count] = weapon;
+    m_loaded[m_count] = loaded;
+    m_count++;
+}
+
+
+bool ReloadScheduler::GetLoadedAmmo(const void* weapon, uint32_t& loaded) const {
+    for (size_t i = 0; i < m_count; i++) {
+        if (m_weapons[i] == weapon) {
+            loaded = m_loaded[i];
+            return true;
+        }
+    }
+    return false;
+}
+
+
+bool ReloadScheduler::IsInCombat(float time, float threat, float enemyDistance) const {
+    return time - m_lastCombat < RELOAD_LULL_TIME || threat > RELOAD_THREAT_LIMIT || enemyDistance < RELOAD_SAFE_DISTANCE;
+}
+
+
+bool ReloadScheduler::ShouldReload(float time, const void* weapon, uint32_t clipSize, bool partialReload,
+                                   float threat, float enemyDistance) const {
+    uint32_t loaded;
+    if (clipSize == 0 || !this->GetLoadedAmmo(weapon, loaded) || loaded >= clipSize) {
+        return false;
+    }
+    if (time - m_lastRequest < RELOAD_RETRY_INTERVAL) {
+        return false;
+    }
+    // An empty clip has to be reloaded whatever is going on
+    if (loaded == 0) {
+        return true;
+    }
+    if (this->IsInCombat(time, threat, enemyDistance)) {
+        return false;
+    }
+    // Without partial reloads a top-up costs a full reload, so wait for more to be missing
+    float missing = (float)(clipSize - loaded) / clipSize;
+    return missing >= (partialReload ? RELOAD_PARTIAL_MISSING : RELOAD_FULL_MISSING);
+}
@@ -0,0 +1,41 @@
+#ifndef RELOAD_H
+#define RELOAD_H
+
+#include <cstddef>
+#include <cstdint>
+
+const size_t MAX_RELOAD_WEAPONS = 16;
+// Seconds since the last hit nearby before we call it a lull
+const float RELOAD_LULL_TIME = 3;
+// Enemies closer than this keep us in combat
+const float RELOAD_SAFE_DISTANCE = 3000;
+// Threat score above which a player keeps us in combat
+const float RELOAD_THREAT_LIMIT = 1;
+// Share of the clip that must be missing before topping up is worth it
+const float RELOAD_PARTIAL_MISSING = 0.25;
+const float RELOAD_FULL_MISSING = 0.5;
+const float RELOAD_RETRY_INTERVAL = 1;
+
+
+// Decides when to reload the current weapon. Rather than waiting for an
+// empty clip mid-fight, it tops up during lulls in combat, as long as
+// enough of the clip is missing to justify the reload.
+class ReloadScheduler {
+  public:
+    ReloadScheduler();
+    void OnCombat(float);
+    void OnReloadRequested(float);
+    void SetLoadedAmmo(const void *, uint32_t);
+    bool GetLoadedAmmo(const void *, uint32_t &) const;
+    bool IsInCombat(float, float, float) const;
+    bool ShouldReload(float, const void *, uint32_t, bool, float, float) const;
+
+  private:
+    const void* m_weapons[MAX_RELOAD_WEAPONS];
+    uint32_t m_loaded[MAX_RELOAD_WEAPONS];
+    size_t m_count;
+    float m_lastCombat;
+    float m_lastRequest;
+};
+
+#endif
@@ -0,0 +1,197 @@
+#include <algorithm>
+#include <cmath>
+#include "rotation.h"
+
+// Mana pool assumed until a larger value has been observed
+const float ROTATION_DEFAULT_MAX_MANA = 100;
+
+
+RotationPlanner::RotationPlanner() :
+    m_mana(0), m_maxMana(ROTATION_DEFAULT_MAX_MANA), m_manaRegen(0), m_lastMana(-1),
+    m_lastManaTime(0), m_sinceReplan(0), m_dirty(true) {
+    for (size_t i = 0; i < MAX_ABILITIES; i++) {
+        m_abilities[i].active = false;
+        m_abilities[i].remaining = 0;
+    }
+    m_best.length = 0;
+    m_best.damage = 0;
+}
+
+
+void RotationPlanner::SetAbility(size_t slot, float manaCost, float cooldown, float damage) {
+    if (slot >= MAX_ABILITIES) {
+        return;
+    }
+    Ability& ability = m_abilities[slot];
+    if (ability.active && ability.manaCost == manaCost && ability.cooldown == cooldown && ability.damage == damage) {
+        return;
+    }
+    ability.active = true;
+    ability.manaCost = manaCost;
+    ability.cooldown = cooldown;
+    ability.damage = damage;
+    m_dirty = true;
+}
+
+
+void RotationPlanner::ClearAbility(size_t slot) {
+    if (slot < MAX_ABILITIES && m_abilities[slot].active) {
+        m_abilities[slot].active = false;
+        m_dirty = true;
+    }
+}
+
+
+void RotationPlanner::SetCooldown(size_t slot, float remaining) {
+    if (slot >= MAX_ABILITIES) {
+        return;
+    }
+    // Cooldowns count down on their own, only a reset or a new cast matters
+    if (fabsf(m_abilities[slot].remaining - remaining) > ROTATION_MIN_WAIT) {
+        m_dirty = true;
+    }
+    m_abilities[slot].remaining = remaining;
+}
+
+
+void RotationPlanner::SetMana(float mana) {
+    if (fabsf(m_mana - mana) > ROTATION_MANA_TOLERANCE) {
+        m_dirty = true;
+    }
+    m_mana = mana;
+    if (mana > m_maxMana) {
+        m_maxMana = mana;
+    }
+}
+
+
+void RotationPlanner::ObserveMana(float mana, float time) {
+    // Only rising mana tells us about regeneration, drops are casts
+    if (m_lastMana >= 0 && mana > m_lastMana && time > m_lastManaTime) {
+        float sample = (mana - m_lastMana) / (time - m_lastManaTime);
+        m_manaRegen = m_manaRegen == 0 ? sample : 0.8f * m_manaRegen + 0.2f * sample;
+    }
+    m_lastMana = mana;
+    m_lastManaTime = time;
+    this->SetMana(mana);
+}
+
+
+void RotationPlanner::Tick(float dt) {
+    // Follow the expected regeneration and cooldowns between updates
+    m_mana = std::min(m_maxMana, m_mana + m_manaRegen * dt);
+    for (size_t i = 0; i < MAX_ABILITIES; i++) {
+        m_abilities[i].remaining = std::max(0.0f, m_abilities[i].remaining - dt);
+    }
+
+    m_sinceReplan += dt;
+    if (m_dirty || m_sinceReplan >= ROTATION_REPLAN_INTERVAL) {
+        this->Plan();
+    }
+}
+
+
+void RotationPlanner::Advance(State& state, float dt, float regen, float maxMana) {
+    state.time += dt;
+    state.mana = std::min(maxMana, state.mana + regen * dt);
+    for (size_t i = 0; i < MAX_ABILITIES; i++) {
+        state.remaining[i] = std::max(0.0f, state.remaining[i] - dt);
+    }
+}
+
+
+void RotationPlanner::Plan() {
+    m_dirty = false;
+    m_sinceReplan = 0;
+
+    State& root = m_beam[0];
+    root.time = 0;
+    root.mana = m_mana;
+    root.damage = 0;
+    root.length = 0;
+    for (size_t i = 0; i < MAX_ABILITIES; i++) {
+        root.remaining[i] = m_abilities[i].remaining;
+    }
+    size_t beamSize = 1;
+    m_best = root;
+
+    for (size_t depth = 0; depth < ROTATION_DEPTH && beamSize > 0; depth++) {
+        size_t candidateCount = 0;
+        for (size_t b = 0; b < beamSize; b++) {
+            const State& state = m_beam[b];
+
+            // Cast anything that is ready and affordable
+            float wait = INFINITY;
+            for (size_t i = 0; i < MAX_ABILITIES; i++) {
+                const Ability& ability = m_abilities[i];
+                if (!ability.active || ability.damage <= 0) {
+                    continue;
+                }
+                float manaWait = state.mana >= ability.manaCost ? 0 :
+                    (m_manaRegen > 0 ? (ability.manaCost - state.mana) / m_manaRegen : INFINITY);
+                float ready = std::max(state.remaining[i], manaWait);
+                if (ready > 0) {
+                    wait = std::min(wait, ready);
+                    continue;
+                }
+                State& child = m_candidates[candidateCount++];
+                child = state;
+                child.mana -= ability.manaCost;
+                child.damage += ability.damage;
+                child.remaining[i] = ability.cooldown;
+                child.actions[child.length++] = (uint8_t)i;
+                RotationPlanner::Advance(child, ROTATION_CAST_TIME, m_manaRegen, m_maxMana);
+            }
+
+            // Or wait until the next ability becomes usable
+            if (wait != INFINITY && state.time + wait < ROTATION_HORIZON) {
+                State& child = m_candidates[candidateCount++];
+                child = state;
+                child.actions[child.length++] = (uint8_t)ROTATION_WAIT;
+                RotationPlanner::Advance(child, std::max(wait, ROTATION_MIN_WAIT), m_manaRegen, m_maxMana);
+            }
+        }
+
+        // Keep the most damaging branches, preferring ones with mana left over
+        size_t keep = std::min(candidateCount, ROTATION_BEAM_WIDTH);
+        std::partial_sort(m_candidates, m_candidates + keep, m_candidates + candidateCount,
+                          [](const State& a, const State& b) {
+                              return a.damage != b.damage ? a.damage > b.damage : a.mana > b.mana;
+                          });
+        beamSize = 0;
+        for (size_t i = 0; i < keep; i++) {
+            if (m_candidates[i].time > ROTATION_HORIZON) {
+                continue;
+            }
+            m_beam[beamSize++] = m_candidates[i];
+            if (m_candidates[i].damage > m_best.damage) {
+                m_best = m_candidates[i];
+            }
+        }
+    }
+}
+
+
+size_t RotationPlanner::GetPlanLength() const {
+    return m_best.length;
+}
+
+
+size_t RotationPlanner::GetPlanSlot(size_t step) const {
+    return step < m_best.length ? m_best.actions[step] : ROTATION_WAIT;
+}
+
+
+float RotationPlanner::GetPlanDamage() const {
+    return m_best.damage;
+}
+
+
+size_t RotationPlanner::GetNextSlot() const {
+    return this->GetPlanSlot(0);
+}
+
+
+float RotationPlanner::GetManaRegen() const {
+    return m_manaRegen;
+}
@@ -0,0 +1,74 @@
+#ifndef ROTATION_H
+#define ROTATION_H
+
+#include <cstddef>
+#include <cstdint>
+
+const size_t MAX_ABILITIES = 10;
+const size_t ROTATION_BEAM_WIDTH = 32;
+const size_t ROTATION_DEPTH = 8;
+const float ROTATION_HORIZON = 8;
+const float ROTATION_CAST_TIME = 0.5;
+const float ROTATION_MIN_WAIT = 0.25;
+// Replan at least this often even if nothing looked different
+const float ROTATION_REPLAN_INTERVAL = 0.5;
+// Mana drift from the prediction that counts as a state change
+const float ROTATION_MANA_TOLERANCE = 5;
+const size_t ROTATION_WAIT = MAX_ABILITIES;
+
+
+// Plans the damage-maximizing order to cast mana abilities in over a short
+// horizon with a fixed-width beam search. The plan is only rebuilt when the
+// inputs move away from what it predicted, or periodically.
+class RotationPlanner {
+  public:
+    RotationPlanner();
+    void SetAbility(size_t, float, float, float);
+    void ClearAbility(size_t);
+    void SetCooldown(size_t, float);
+    void SetMana(float);
+    void ObserveMana(float, float);
+    void Tick(float);
+
+    size_t GetPlanLength() const;
+    size_t GetPlanSlot(size_t) const;
+    float GetPlanDamage() const;
+    size_t GetNextSlot() const;
+    float GetManaRegen() const;
+
+  private:
+    struct Ability {
+        bool active;
+        float manaCost;
+        float cooldown;
+        float damage;
+        float remaining;
+    };
+
+    struct State {
+        float time;
+        float mana;
+        float damage;
+        float remaining[MAX_ABILITIES];
+        uint8_t actions[ROTATION_DEPTH];
+        uint8_t length;
+    };
+
+    Ability m_abilities[MAX_ABILITIES];
+    float m_mana;
+    float m_maxMana;
+    float m_manaRegen;
+    float m_lastMana;
+    float m_lastManaTime;
+    float m_sinceReplan;
+    bool m_dirty;
+
+    State m_beam[ROTATION_BEAM_WIDTH];
+    State m_candidates[ROTATION_BEAM_WIDTH * (MAX_ABILITIES + 1)];
+    State m_best;
+
+    void Plan();
+    static void Advance(State &, float, float, float);
+};
+
+#endif
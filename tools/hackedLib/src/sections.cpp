@@ -0,0 +1,75 @@
+#include "hook.h"
+#include "sections.h"
+
+const char* TICK_SECTION_NAMES[TickSectionCount] = {"accounting", "recording", "pacing", "sockets", "rotation",
+                                                    "players", "actors", "weapons", "reload", "fleet"};
+
+uint64_t SECTION_MARK = 0;
+uint64_t LAST_SECTION_NS[TickSectionCount];
+uint64_t SECTION_TOTAL_NS[TickSectionCount];
+uint64_t SECTION_FRAMES = 0;
+
+
+
+void BeginTickSections() {
+    SECTION_MARK = GetNanoseconds();
+}
+
+
+void EndTickSection(TickSection section) {
+    uint64_t now = GetNanoseconds();
+    LAST_SECTION_NS[section] = now - SECTION_MARK;
+    SECTION_TOTAL_NS[section] += now - SECTION_MARK;
+    SECTION_MARK = now;
+}
+
+
+void EndTickSections() {
+    SECTION_FRAMES++;
+}
+
+
+const char* GetTickSectionName(TickSection section) {
+    return TICK_SECTION_NAMES[section];
+}
+
+
+uint64_t GetLastSectionNs(TickSection section) {
+    return LAST_SECTION_NS[section];
+}
+
+
+uint64_t GetSectionTotalNs(TickSection section) {
+    return SECTION_TOTAL_NS[section];
+}
+
+
+uint64_t GetSectionFrames() {
+    return SECTION_FRAMES;
+}
+
+
+void ResetTickSections() {
+    for (size_t i = 0; i < TickSectionCount; i++) {
+        SECTION_TOTAL_NS[i] = 0;
+    }
+    SECTION_FRAMES = 0;
+}
+
+
+void ReportTickSections(FILE* out) {
+    uint64_t total = 0;
+    for (size_t i = 0; i < TickSectionCount; i++) {
+        total += SECTION_TOTAL_NS[i];
+    }
+    if (SECTION_FRAMES == 0 || total == 0) {
+        fprintf(out, "<Sections> No frames yet\n");
+        return;
+    }
+    fprintf(out, "<Sections> %lu frames, %.1f us per frame\n", (unsigned long)SECTION_FRAMES,
+            total / 1e3 / SECTION_FRAMES);
+    for (size_t i = 0; i < TickSectionCount; i++) {
+        fprintf(out, "    %-10s %8.1f us %5.1f%%\n", TICK_SECTION_NAMES[i], SECTION_TOTAL_NS[i] / 1e3 / SECTION_FRAMES,
+                100.0 * SECTION_TOTAL_NS[i] / total);
+    }
+}
@@ -0,0 +1,26 @@
+#ifndef SECTIONS_H
+#define SECTIONS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+
+enum TickSection {AccountingSection, RecordingSection, PacingSection, SocketSection, RotationSection,
+                  PlayerSection, ActorSection, WeaponSection, ReloadSection, FleetSection, TickSectionCount};
+
+
+// World::Tick marks the end of each of its sections, so attributing a frame
+// costs one clock read per section. Only ever called from the game thread.
+void BeginTickSections();
+void EndTickSection(TickSection);
+void EndTickSections();
+
+const char * GetTickSectionName(TickSection);
+// Time spent in a section during the last frame, and since the last reset
+uint64_t GetLastSectionNs(TickSection);
+uint64_t GetSectionTotalNs(TickSection);
+uint64_t GetSectionFrames();
+void ResetTickSections();
+void ReportTickSections(FILE *);
+
+#endif
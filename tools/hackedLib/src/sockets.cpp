@@ -0,0 +1,419 @@
+#include <arpa/inet.h>
+#include <atomic>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include "filter.h"
+#include "hook.h"
+#include "sockets.h"
+#include "syscalls.h"
+
+
+struct SocketEntry {
+    std::atomic<bool> tracked;
+    uint16_t port;
+    // TCP_QUICKACK was set when it connected, so recv keeps it armed
+    bool quickAck;
+    std::atomic<uint64_t> sends;
+    std::atomic<uint64_t> receives;
+    std::atomic<uint64_t> bytesSent;
+    std::atomic<uint64_t> bytesReceived;
+    std::atomic<uint32_t> rtt;
+    std::atomic<uint32_t> rttVariance;
+    std::atomic<uint32_t> retransmits;
+    std::atomic<uint32_t> congestionWindow;
+    std::atomic<uint32_t> lost;
+};
+
+// Everything written to a game connection goes through here, so our own
+// packets only ever go in between the game's
+struct SocketOutput {
+    // Held while writing, and for the outbound framing state
+    std::mutex lock;
+    // Bytes the kernel hasn't taken yet, in stream order. They go out before
+    // anything else on the connection.
+    uint8_t* pending;
+    size_t pendingStart;
+    size_t pendingLength;
+    // Our own packets waiting for the game's stream to reach a packet
+    // boundary. They have a lock of their own so queueing never waits on a
+    // blocking send.
+    std::mutex queueLock;
+    uint8_t* queued;
+    size_t queuedLength;
+};
+
+// Indexed by file descriptor, touched by whichever thread does the I/O
+SocketEntry SOCKETS[MAX_SOCKETS];
+// Buffers are allocated when a game connection is made and kept for the descriptor
+SocketOutput OUTPUTS[MAX_SOCKETS];
+std::atomic<bool> SOCKET_TUNING(true);
+// Chunks rewritten by the packet filter, one per thread doing I/O
+thread_local uint8_t FILTER_BUFFER[FILTER_SCRATCH_SIZE];
+
+typedef int (*SetSockOptFunction)(int, int, int, const void*, socklen_t);
+typedef ssize_t (*SendFunction)(int, const void*, size_t, int);
+
+
+static SetSockOptFunction RealSetSockOpt() {
+    static SetSockOptFunction real = RealFunction<SetSockOptFunction>("setsockopt");
+    return real;
+}
+
+
+bool IsGameServerPort(uint16_t port) {
+    return port == MASTER_SERVER_PORT || (port >= GAME_SERVER_FIRST_PORT && port <= GAME_SERVER_LAST_PORT);
+}
+
+
+void SetSocketTuning(bool enabled) {
+    SOCKET_TUNING = enabled;
+}
+
+
+bool IsSocketTuningEnabled() {
+    return SOCKET_TUNING;
+}
+
+
+static uint16_t GetPort(const struct sockaddr* address, socklen_t length) {
+    if (address == NULL) {
+        return 0;
+    }
+    if (address->sa_family == AF_INET && length >= sizeof(struct sockaddr_in)) {
+        return ntohs(((const struct sockaddr_in*)address)->sin_port);
+    }
+    if (address->sa_family == AF_INET6 && length >= sizeof(struct sockaddr_in6)) {
+        return ntohs(((const struct sockaddr_in6*)address)->sin6_port);
+    }
+    return 0;
+}
+
+
+// Apply latency options to a game connection
+static void TuneSocket(int fd) {
+    SetSockOptFunction setOption = RealSetSockOpt();
+    int enabled = 1;
+    setOption(fd, IPPROTO_TCP, TCP_NODELAY, &enabled, sizeof(enabled));
+    setOption(fd, IPPROTO_TCP, TCP_QUICKACK, &enabled, sizeof(enabled));
+    int lowWater = SOCKET_NOTSENT_LOWAT;
+    setOption(fd, IPPROTO_TCP, TCP_NOTSENT_LOWAT, &lowWater, sizeof(lowWater));
+
+    // Fixed buffers turn off the kernel's autotuning, so only when asked for
+    static const char* sendBuffer = getenv("PWN3_SOCKET_SNDBUF");
+    static const char* receiveBuffer = getenv("PWN3_SOCKET_RCVBUF");
+    if (sendBuffer != NULL) {
+        int size = atoi(sendBuffer);
+        setOption(fd, SOL_SOCKET, SO_SNDBUF, &size, sizeof(size));
+    }
+    if (receiveBuffer != NULL) {
+        int size = atoi(receiveBuffer);
+        setOption(fd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+    }
+}
+
+
+static void TrackSocket(int fd, uint16_t port) {
+    SocketEntry& entry = SOCKETS[fd];
+    entry.tracked.store(false, std::memory_order_relaxed);
+    entry.port = port;
+    entry.quickAck = false;
+    entry.sends = 0;
+    entry.receives = 0;
+    entry.bytesSent = 0;
+    entry.bytesReceived = 0;
+    entry.rtt = 0;
+    entry.rttVariance = 0;
+    entry.retransmits = 0;
+    entry.congestionWindow = 0;
+    entry.lost = 0;
+    entry.tracked.store(true, std::memory_order_release);
+}
+
+
+static bool IsTracked(int fd) {
+    return fd >= 0 && fd < MAX_SOCKETS && SOCKETS[fd].tracked.load(std::memory_order_relaxed);
+}
+
+
+// Game server traffic only, the master server connection is TLS
+static bool IsGameConnection(int fd) {
+    return IsTracked(fd) && SOCKETS[fd].port != MASTER_SERVER_PORT;
+}
+
+
+static bool IsFiltered(int fd, size_t length, int flags) {
+    return IsPacketFilterActive() && IsGameConnection(fd) && length <= FILTER_SCRATCH_SIZE &&
+           (flags & MSG_PEEK) == 0;
+}
+
+
+static void CountSent(int fd, ssize_t sent) {
+    if (sent > 0) {
+        SOCKETS[fd].bytesSent.fetch_add(sent, std::memory_order_relaxed);
+    }
+}
+
+
+static void ResetOutput(int fd, bool allocate) {
+    SocketOutput& output = OUTPUTS[fd];
+    std::lock_guard<std::mutex> guard(output.lock);
+    std::lock_guard<std::mutex> queueGuard(output.queueLock);
+    if (allocate && output.pending == NULL) {
+        output.pending = (uint8_t*)malloc(FILTER_SCRATCH_SIZE + SOCKET_QUEUE_SIZE);
+        output.queued = (uint8_t*)malloc(SOCKET_QUEUE_SIZE);
+    }
+    output.pendingStart = 0;
+    output.pendingLength = 0;
+    output.queuedLength = 0;
+}
+
+
+// Moves queued packets behind what is pending once the game's stream is
+// between two packets. Called with the output lock held.
+static void ReleaseQueued(int fd, SocketOutput& output) {
+    if (!IsAtPacketBoundary(FilterOutbound, fd)) {
+        return;
+    }
+    std::lock_guard<std::mutex> queueGuard(output.queueLock);
+    if (output.queuedLength == 0 || output.pendingLength + output.queuedLength > FILTER_SCRATCH_SIZE + SOCKET_QUEUE_SIZE) {
+        return;
+    }
+    memmove(output.pending, output.pending + output.pendingStart, output.pendingLength);
+    memcpy(output.pending + output.pendingLength, output.queued, output.queuedLength);
+    output.pendingStart = 0;
+    output.pendingLength += output.queuedLength;
+    output.queuedLength = 0;
+}
+
+
+// Writes out what is left of an earlier chunk, false with send's errno while some still is
+static bool DrainOutput(SendFunction real, int fd, SocketOutput& output, int flags) {
+    while (output.pendingLength > 0) {
+        ssize_t sent = real(fd, output.pending + output.pendingStart, output.pendingLength, flags);
+        if (sent <= 0) {
+            return false;
+        }
+        CountSent(fd, sent);
+        output.pendingStart += sent;
+        output.pendingLength -= sent;
+    }
+    output.pendingStart = 0;
+    return true;
+}
+
+
+// A rewritten chunk has no partial send the game could make sense of, so it
+// is taken whole and what the kernel doesn't take waits in front of the next
+// one. Until that is out the game's sends fail as they would on a full socket.
+// Queued packets follow the game's chunk when it ends on a packet boundary.
+static ssize_t SendGameChunk(SendFunction real, int fd, const uint8_t* data, size_t length, int flags) {
+    SocketOutput& output = OUTPUTS[fd];
+    std::lock_guard<std::mutex> guard(output.lock);
+    if (output.pending == NULL) {
+        ssize_t sent = real(fd, data, length, flags);
+        CountSent(fd, sent);
+        return sent;
+    }
+    if (!DrainOutput(real, fd, output, flags)) {
+        return -1;
+    }
+    ssize_t sent = length;
+    if (IsFiltered(fd, length, flags)) {
+        output.pendingLength = FilterPackets(FilterOutbound, fd, data, length, output.pending, FILTER_SCRATCH_SIZE);
+    }
+    else {
+        sent = real(fd, data, length, flags);
+        CountSent(fd, sent);
+        if (sent > 0) {
+            TrackPackets(FilterOutbound, fd, data, sent);
+        }
+    }
+    int error = errno;
+    ReleaseQueued(fd, output);
+    DrainOutput(real, fd, output, flags | MSG_DONTWAIT);
+    errno = error;
+    return sent;
+}
+
+
+bool QueueSocketPacket(int fd, const uint8_t* packet, size_t length) {
+    if (!IsGameConnection(fd)) {
+        return false;
+    }
+    SocketOutput& output = OUTPUTS[fd];
+    {
+        std::lock_guard<std::mutex> queueGuard(output.queueLock);
+        if (output.queued == NULL || output.queuedLength + length > SOCKET_QUEUE_SIZE) {
+            return false;
+        }
+        memcpy(output.queued + output.queuedLength, packet, length);
+        output.queuedLength += length;
+    }
+    // Whoever is writing to it now takes the packet along when done
+    if (output.lock.try_lock()) {
+        static auto real = RealFunction<SendFunction>("send");
+        ReleaseQueued(fd, output);
+        DrainOutput(real, fd, output, MSG_DONTWAIT | MSG_NOSIGNAL);
+        output.lock.unlock();
+    }
+    return true;
+}
+
+
+// The filter's replies and delayed packets come back through the queue
+static bool FILTER_OUTPUT_SET = (SetPacketFilterOutput(QueueSocketPacket), true);
+
+
+void FlushSockets() {
+    static auto real = RealFunction<SendFunction>("send");
+    for (int fd = 0; fd < MAX_SOCKETS; fd++) {
+        SocketOutput& output = OUTPUTS[fd];
+        if (output.pending == NULL || !IsGameConnection(fd) || !output.lock.try_lock()) {
+            continue;
+        }
+        ReleaseQueued(fd, output);
+        DrainOutput(real, fd, output, MSG_DONTWAIT | MSG_NOSIGNAL);
+        output.lock.unlock();
+    }
+}
+
+
+extern "C" int connect(int fd, const struct sockaddr* address, socklen_t length) {
+    static auto real = RealFunction<int (*)(int, const struct sockaddr*, socklen_t)>("connect");
+    uint16_t port = GetPort(address, length);
+    if (fd >= 0 && fd < MAX_SOCKETS && IsGameServerPort(port)) {
+        TrackSocket(fd, port);
+        ResetOutput(fd, port != MASTER_SERVER_PORT);
+        ResetPacketFilter(fd);
+        if (SOCKET_TUNING) {
+            TuneSocket(fd);
+            SOCKETS[fd].quickAck = true;
+        }
+    }
+    return real(fd, address, length);
+}
+
+
+extern "C" ssize_t send(int fd, const void* buffer, size_t length, int flags) {
+    static auto real = RealFunction<SendFunction>("send");
+    uint64_t start = BeginSyscall();
+    ssize_t sent;
+    if (IsGameConnection(fd)) {
+        sent = SendGameChunk(real, fd, (const uint8_t*)buffer, length, flags);
+    }
+    else {
+        sent = real(fd, buffer, length, flags);
+        if (IsTracked(fd)) {
+            CountSent(fd, sent);
+        }
+    }
+    EndSyscall(SendCall, start);
+    if (sent > 0 && IsTracked(fd)) {
+        SOCKETS[fd].sends.fetch_add(1, std::memory_order_relaxed);
+    }
+    return sent;
+}
+
+
+extern "C" ssize_t recv(int fd, void* buffer, size_t length, int flags) {
+    static auto real = RealFunction<ssize_t (*)(int, void*, size_t, int)>("recv");
+    for (;;) {
+        uint64_t start = BeginSyscall();
+        ssize_t received = real(fd, buffer, length, flags);
+        EndSyscall(RecvCall, start);
+        if (received > 0 && IsTracked(fd)) {
+            SOCKETS[fd].receives.fetch_add(1, std::memory_order_relaxed);
+            SOCKETS[fd].bytesReceived.fetch_add(received, std::memory_order_relaxed);
+            // The kernel drops back to delayed ACKs on its own, so keep asking
+            if (SOCKET_TUNING && SOCKETS[fd].quickAck) {
+                int enabled = 1;
+                RealSetSockOpt()(fd, IPPROTO_TCP, TCP_QUICKACK, &enabled, sizeof(enabled));
+            }
+        }
+        if (received <= 0 || !IsGameConnection(fd) || (flags & MSG_PEEK) != 0) {
+            return received;
+        }
+        if (!IsFiltered(fd, received, flags)) {
+            TrackPackets(FilterInbound, fd, (const uint8_t*)buffer, received);
+            return received;
+        }
+        size_t filtered = FilterPackets(FilterInbound, fd, (const uint8_t*)buffer, received, FILTER_BUFFER,
+                                        length < FILTER_SCRATCH_SIZE ? length : FILTER_SCRATCH_SIZE);
+        // Returning 0 would look like the server hung up, so wait for more instead
+        if (filtered > 0) {
+            memcpy(buffer, FILTER_BUFFER, filtered);
+            return filtered;
+        }
+    }
+}
+
+
+extern "C" int setsockopt(int fd, int level, int name, const void* value, socklen_t length) {
+    // Don't let the game turn Nagle back on for its own connections
+    if (SOCKET_TUNING && IsTracked(fd) && level == IPPROTO_TCP && name == TCP_NODELAY) {
+        int enabled = 1;
+        return RealSetSockOpt()(fd, level, name, &enabled, sizeof(enabled));
+    }
+    return RealSetSockOpt()(fd, level, name, value, length);
+}
+
+
+extern "C" int close(int fd) {
+    static auto real = RealFunction<int (*)(int)>("close");
+    if (IsTracked(fd)) {
+        SOCKETS[fd].tracked.store(false, std::memory_order_relaxed);
+        ResetOutput(fd, false);
+        ResetPacketFilter(fd);
+    }
+    return real(fd);
+}
+
+
+void SampleSockets() {
+    for (int fd = 0; fd < MAX_SOCKETS; fd++) {
+        SocketEntry& entry = SOCKETS[fd];
+        if (!entry.tracked.load(std::memory_order_acquire)) {
+            continue;
+        }
+        struct tcp_info info;
+        socklen_t length = sizeof(info);
+        if (getsockopt(fd, IPPROTO_TCP, TCP_INFO, &info, &length) != 0) {
+            continue;
+        }
+        entry.rtt = info.tcpi_rtt;
+        entry.rttVariance = info.tcpi_rttvar;
+        entry.retransmits = info.tcpi_total_retrans;
+        entry.congestionWindow = info.tcpi_snd_cwnd;
+        entry.lost = info.tcpi_lost;
+    }
+}
+
+
+size_t GetSocketStats(SocketStats* stats, size_t capacity) {
+    size_t count = 0;
+    for (int fd = 0; fd < MAX_SOCKETS && count < capacity; fd++) {
+        const SocketEntry& entry = SOCKETS[fd];
+        if (!entry.tracked.load(std::memory_order_acquire)) {
+            continue;
+        }
+        SocketStats& out = stats[count++];
+        out.fd = fd;
+        out.port = entry.port;
+        out.sends = entry.sends;
+        out.receives = entry.receives;
+        out.bytesSent = entry.bytesSent;
+        out.bytesReceived = entry.bytesReceived;
+        out.rtt = entry.rtt;
+        out.rttVariance = entry.rttVariance;
+        out.retransmits = entry.retransmits;
+        out.congestionWindow = entry.congestionWindow;
+        out.lost = entry.lost;
+    }
+    return count;
+}
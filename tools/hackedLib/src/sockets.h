@@ -0,0 +1,51 @@
+#ifndef SOCKETS_H
+#define SOCKETS_H
+
+#include <cstddef>
+#include <cstdint>
+
+// Only descriptors below this are tracked
+const int MAX_SOCKETS = 1024;
+const uint16_t MASTER_SERVER_PORT = 3333;
+const uint16_t GAME_SERVER_FIRST_PORT = 3000;
+const uint16_t GAME_SERVER_LAST_PORT = 3004;
+const float SOCKET_SAMPLE_INTERVAL = 1;
+// Keep at most this much unsent data queued in the kernel per socket
+const int SOCKET_NOTSENT_LOWAT = 16384;
+// Room for our own packets waiting to go in between the game's, per connection
+const size_t SOCKET_QUEUE_SIZE = 16384;
+
+
+// Snapshot of one game connection's counters and last TCP_INFO sample
+struct SocketStats {
+    int fd;
+    uint16_t port;
+    uint64_t sends;
+    uint64_t receives;
+    uint64_t bytesSent;
+    uint64_t bytesReceived;
+    uint32_t rtt;
+    uint32_t rttVariance;
+    uint32_t retransmits;
+    uint32_t congestionWindow;
+    uint32_t lost;
+};
+
+
+// Game connections are recognised in the connect() interposer and get
+// low-latency options applied. send()/recv() keep per-socket counters, and
+// SampleSockets() reads TCP_INFO for each of them.
+bool IsGameServerPort(uint16_t);
+void SetSocketTuning(bool);
+bool IsSocketTuningEnabled();
+void SampleSockets();
+size_t GetSocketStats(SocketStats *, size_t);
+
+// Packets of our own for a game connection. They go out at the next packet
+// boundary of the game's outbound stream and never block; false when there's
+// no room left for them.
+bool QueueSocketPacket(int, const uint8_t *, size_t);
+// Writes out what send() and QueueSocketPacket() couldn't, from World::Tick
+void FlushSockets();
+
+#endif
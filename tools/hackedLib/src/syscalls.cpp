@@ -0,0 +1,212 @@
+#include <atomic>
+#include <cstdarg>
+#include <poll.h>
+#include <sys/epoll.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include "hook.h"
+#include "syscalls.h"
+
+const char* SYSCALL_NAMES[SyscallKindCount] = {"read", "write", "send", "recv", "poll", "epoll_wait", "futex"};
+
+
+struct ThreadSyscalls {
+    std::atomic<long> tid;
+    std::atomic<uint64_t> calls[SyscallKindCount];
+    std::atomic<uint64_t> ns[SyscallKindCount];
+    // Totals at the last report, only touched by the reporting thread
+    uint64_t reportedCalls[SyscallKindCount];
+    uint64_t reportedNs[SyscallKindCount];
+};
+
+// Threads claim a slot on their first syscall, the last one is shared on overflow
+ThreadSyscalls THREAD_SYSCALLS[MAX_SYSCALL_THREADS];
+std::atomic<size_t> THREAD_SYSCALL_COUNT(0);
+static __thread ThreadSyscalls* CURRENT_THREAD_SYSCALLS = NULL;
+
+// Frame history of the game thread, only touched from World::Tick
+ThreadSyscalls* GAME_THREAD_SYSCALLS = NULL;
+uint64_t FRAME_CALLS[SyscallKindCount];
+uint64_t FRAME_NS[SyscallKindCount];
+SyscallFrame SYSCALL_FRAMES[SYSCALL_FRAME_HISTORY];
+uint64_t SYSCALL_FRAME_COUNT = 0;
+uint64_t REPORTED_FRAME_COUNT = 0;
+uint64_t OVER_BUDGET_FRAMES = 0;
+SyscallFrame WORST_FRAME;
+
+// Resolved without a function static, whose guard waits on a futex through syscall() itself
+typedef long (*SyscallFunction)(long, ...);
+static SyscallFunction REAL_SYSCALL = NULL;
+
+
+
+static ThreadSyscalls* GetThreadSyscalls() {
+    if (CURRENT_THREAD_SYSCALLS == NULL) {
+        CURRENT_THREAD_SYSCALLS = ClaimThreadSlot(THREAD_SYSCALLS, THREAD_SYSCALL_COUNT);
+    }
+    return CURRENT_THREAD_SYSCALLS;
+}
+
+
+uint64_t BeginSyscall() {
+    return GetNanoseconds();
+}
+
+
+void EndSyscall(SyscallKind kind, uint64_t start) {
+    uint64_t elapsed = GetNanoseconds() - start;
+    ThreadSyscalls* slot = GetThreadSyscalls();
+    slot->calls[kind].fetch_add(1, std::memory_order_relaxed);
+    slot->ns[kind].fetch_add(elapsed, std::memory_order_relaxed);
+}
+
+
+void EndSyscallFrame(float dt) {
+    ThreadSyscalls* slot = GetThreadSyscalls();
+    if (GAME_THREAD_SYSCALLS != slot) {
+        // First frame on this thread, start counting from here
+        GAME_THREAD_SYSCALLS = slot;
+        for (size_t i = 0; i < SyscallKindCount; i++) {
+            FRAME_CALLS[i] = slot->calls[i].load(std::memory_order_relaxed);
+            FRAME_NS[i] = slot->ns[i].load(std::memory_order_relaxed);
+        }
+        return;
+    }
+
+    SyscallFrame& frame = SYSCALL_FRAMES[SYSCALL_FRAME_COUNT % SYSCALL_FRAME_HISTORY];
+    frame.frame = SYSCALL_FRAME_COUNT++;
+    frame.dt = dt;
+    frame.blockedNs = 0;
+    for (size_t i = 0; i < SyscallKindCount; i++) {
+        uint64_t calls = slot->calls[i].load(std::memory_order_relaxed);
+        uint64_t ns = slot->ns[i].load(std::memory_order_relaxed);
+        frame.calls[i] = (uint32_t)(calls - FRAME_CALLS[i]);
+        frame.ns[i] = ns - FRAME_NS[i];
+        frame.blockedNs += frame.ns[i];
+        FRAME_CALLS[i] = calls;
+        FRAME_NS[i] = ns;
+    }
+
+    if (frame.blockedNs > SYSCALL_FRAME_BUDGET_NS) {
+        OVER_BUDGET_FRAMES++;
+        if (frame.blockedNs > WORST_FRAME.blockedNs) {
+            WORST_FRAME = frame;
+        }
+    }
+}
+
+
+size_t GetSyscallFrames(SyscallFrame* frames, size_t capacity) {
+    // Most recent first
+    size_t count = 0;
+    while (count < capacity && count < SYSCALL_FRAME_COUNT && count < SYSCALL_FRAME_HISTORY) {
+        frames[count] = SYSCALL_FRAMES[(SYSCALL_FRAME_COUNT - 1 - count) % SYSCALL_FRAME_HISTORY];
+        count++;
+    }
+    return count;
+}
+
+
+void ReportSyscalls(FILE* out) {
+    fprintf(out, "<Syscalls> %lu frames, %lu over the %.1f ms budget\n",
+            (unsigned long)(SYSCALL_FRAME_COUNT - REPORTED_FRAME_COUNT), (unsigned long)OVER_BUDGET_FRAMES,
+            SYSCALL_FRAME_BUDGET_NS / 1e6);
+    if (OVER_BUDGET_FRAMES > 0) {
+        size_t worst = 0;
+        for (size_t i = 1; i < SyscallKindCount; i++) {
+            worst = WORST_FRAME.ns[i] > WORST_FRAME.ns[worst] ? i : worst;
+        }
+        fprintf(out, "    worst frame %lu: %.2f ms blocked of %.2f ms, mostly %s (%u calls)\n",
+                (unsigned long)WORST_FRAME.frame, WORST_FRAME.blockedNs / 1e6, WORST_FRAME.dt * 1e3,
+                SYSCALL_NAMES[worst], WORST_FRAME.calls[worst]);
+    }
+    REPORTED_FRAME_COUNT = SYSCALL_FRAME_COUNT;
+    OVER_BUDGET_FRAMES = 0;
+    WORST_FRAME.blockedNs = 0;
+
+    // Per-thread activity since the last report
+    size_t threads = THREAD_SYSCALL_COUNT.load(std::memory_order_relaxed);
+    threads = threads < MAX_SYSCALL_THREADS ? threads : MAX_SYSCALL_THREADS;
+    for (size_t t = 0; t < threads; t++) {
+        ThreadSyscalls& slot = THREAD_SYSCALLS[t];
+        bool printed = false;
+        for (size_t i = 0; i < SyscallKindCount; i++) {
+            uint64_t calls = slot.calls[i].load(std::memory_order_relaxed);
+            uint64_t ns = slot.ns[i].load(std::memory_order_relaxed);
+            if (calls == slot.reportedCalls[i]) {
+                continue;
+            }
+            if (!printed) {
+                fprintf(out, "    thread %ld%s:", slot.tid.load(std::memory_order_relaxed),
+                        &slot == GAME_THREAD_SYSCALLS ? " (game)" : "");
+                printed = true;
+            }
+            fprintf(out, " %s %lu/%.2f ms", SYSCALL_NAMES[i], (unsigned long)(calls - slot.reportedCalls[i]),
+                    (ns - slot.reportedNs[i]) / 1e6);
+            slot.reportedCalls[i] = calls;
+            slot.reportedNs[i] = ns;
+        }
+        if (printed) {
+            fprintf(out, "\n");
+        }
+    }
+    fflush(out);
+}
+
+
+extern "C" ssize_t read(int fd, void* buffer, size_t length) {
+    static auto real = RealFunction<ssize_t (*)(int, void*, size_t)>("read");
+    uint64_t start = BeginSyscall();
+    ssize_t result = real(fd, buffer, length);
+    EndSyscall(ReadCall, start);
+    return result;
+}
+
+
+extern "C" ssize_t write(int fd, const void* buffer, size_t length) {
+    static auto real = RealFunction<ssize_t (*)(int, const void*, size_t)>("write");
+    uint64_t start = BeginSyscall();
+    ssize_t result = real(fd, buffer, length);
+    EndSyscall(WriteCall, start);
+    return result;
+}
+
+
+extern "C" int poll(struct pollfd* fds, nfds_t count, int timeout) {
+    static auto real = RealFunction<int (*)(struct pollfd*, nfds_t, int)>("poll");
+    uint64_t start = BeginSyscall();
+    int result = real(fds, count, timeout);
+    EndSyscall(PollCall, start);
+    return result;
+}
+
+
+extern "C" int epoll_wait(int fd, struct epoll_event* events, int count, int timeout) {
+    static auto real = RealFunction<int (*)(int, struct epoll_event*, int, int)>("epoll_wait");
+    uint64_t start = BeginSyscall();
+    int result = real(fd, events, count, timeout);
+    EndSyscall(EpollWaitCall, start);
+    return result;
+}
+
+
+// Only futexes the engine issues itself through syscall() are visible here,
+// glibc's own pthread waits never leave libc
+extern "C" long syscall(long number, ...) {
+    if (REAL_SYSCALL == NULL) {
+        REAL_SYSCALL = RealFunction<SyscallFunction>("syscall");
+    }
+    va_list args;
+    va_start(args, number);
+    long a = va_arg(args, long), b = va_arg(args, long), c = va_arg(args, long);
+    long d = va_arg(args, long), e = va_arg(args, long), f = va_arg(args, long);
+    va_end(args);
+
+    if (number != SYS_futex) {
+        return REAL_SYSCALL(number, a, b, c, d, e, f);
+    }
+    uint64_t start = BeginSyscall();
+    long result = REAL_SYSCALL(number, a, b, c, d, e, f);
+    EndSyscall(FutexCall, start);
+    return result;
+}
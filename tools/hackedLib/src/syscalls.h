@@ -0,0 +1,37 @@
+#ifndef SYSCALLS_H
+#define SYSCALLS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+
+const size_t MAX_SYSCALL_THREADS = 128;
+const size_t SYSCALL_FRAME_HISTORY = 256;
+// Time the game thread may spend blocked in syscalls per frame
+const uint64_t SYSCALL_FRAME_BUDGET_NS = 2000000;
+const float SYSCALL_REPORT_INTERVAL = 10;
+
+enum SyscallKind {ReadCall, WriteCall, SendCall, RecvCall, PollCall, EpollWaitCall, FutexCall, SyscallKindCount};
+
+
+// What the game thread did in syscalls during one World::Tick frame
+struct SyscallFrame {
+    uint64_t frame;
+    float dt;
+    uint64_t blockedNs;
+    uint32_t calls[SyscallKindCount];
+    uint64_t ns[SyscallKindCount];
+};
+
+
+// Interposers bracket the real call with these. Each thread accumulates into
+// its own slot, so the hot path is two clock reads and two relaxed adds.
+uint64_t BeginSyscall();
+void EndSyscall(SyscallKind, uint64_t);
+
+// Called from World::Tick on the game thread to close the current frame
+void EndSyscallFrame(float);
+size_t GetSyscallFrames(SyscallFrame *, size_t);
+void ReportSyscalls(FILE *);
+
+#endif
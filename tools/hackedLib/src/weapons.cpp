@@ -0,0 +1,182 @@
+#include <cstring>
+#include "weapons.h"
+
+// Upper edge and representative distance of each band
+const float BAND_LIMITS[TARGET_DISTANCE_BANDS] = {500, 1500, 4000, 1e30f};
+const float BAND_DISTANCES[TARGET_DISTANCE_BANDS] = {250, 1000, 2750, 6000};
+
+// Damage taken per damage type: physical, fire, cold, shock
+const float DAMAGE_MULTIPLIERS[TargetClassCount][DAMAGE_TYPE_COUNT] = {
+    {1, 1, 1, 1},       // RatTarget
+    {1, 1, 1, 1},       // SpiderTarget
+    {1, 1, 1, 1},       // BearTarget
+    {1, 0, 1.5f, 1},    // MagmarokTarget heals from fire
+    {1, 1, 1, 1},       // PlayerTarget
+    {1, 1, 1, 1}        // OtherTarget
+};
+
+const char* TARGET_CLASS_NAMES[TargetClassCount] = {"Rat", "Spider", "Bear", "Magmarok", "Player", "Other"};
+
+
+WeaponSelector::WeaponSelector() {
+    this->Clear();
+    this->Build();
+}
+
+
+void WeaponSelector::Clear() {
+    m_count = 0;
+}
+
+
+void WeaponSelector::AddWeapon(const WeaponStats& weapon) {
+    if (m_count < MAX_WEAPONS) {
+        m_weapons[m_count++] = weapon;
+    }
+}
+
+
+float WeaponSelector::SustainedDps(const WeaponStats& weapon, TargetClass target, size_t band) {
+    if (!weapon.hasAmmo) {
+        return 0;
+    }
+    if (weapon.range > 0 && weapon.range < BAND_DISTANCES[band]) {
+        return 0;
+    }
+
+    float shotDamage = weapon.damage * (weapon.projectiles > 1 ? weapon.projectiles : 1);
+    float interval = weapon.cooldown;
+    if (interval <= 0 && weapon.damagePerSecond > 0) {
+        interval = shotDamage / weapon.damagePerSecond;
+    }
+    if (shotDamage <= 0 || interval <= 0) {
+        return 0;
+    }
+
+    // Spread the reload over the clip it refills
+    float dps = shotDamage / interval;
+    if (weapon.clipSize > 0) {
+        float reload = weapon.reloadTime * (weapon.partialReload ? WEAPON_PARTIAL_RELOAD_FACTOR : 1);
+        float cycle = weapon.clipSize * interval + reload;
+        dps = weapon.clipSize * shotDamage / cycle;
+    }
+
+    uint32_t type = weapon.damageType < DAMAGE_TYPE_COUNT ? weapon.damageType : 0;
+    return dps * DAMAGE_MULTIPLIERS[target][type];
+}
+
+
+void WeaponSelector::Build() {
+    for (size_t i = 0; i < WEAPON_SLOTS; i++) {
+        m_slotWeapon[i] = NO_WEAPON;
+    }
+    for (size_t w = 0; w < m_count; w++) {
+        if (m_weapons[w].slot < WEAPON_SLOTS) {
+            m_slotWeapon[m_weapons[w].slot] = w;
+        }
+    }
+
+    for (size_t t = 0; t < TargetClassCount; t++) {
+        for (size_t b = 0; b < TARGET_DISTANCE_BANDS; b++) {
+            size_t bestSlot = WEAPON_SLOTS, bestOwned = NO_WEAPON;
+            float bestSlotDps = 0, bestOwnedDps = 0;
+            for (size_t w = 0; w < m_count; w++) {
+                float dps = WeaponSelector::SustainedDps(m_weapons[w], (TargetClass)t, b);
+                m_dps[w][t][b] = dps;
+                if (dps > bestOwnedDps) {
+                    bestOwnedDps = dps;
+                    bestOwned = w;
+                }
+                if (m_weapons[w].slot < WEAPON_SLOTS && dps > bestSlotDps) {
+                    bestSlotDps = dps;
+                    bestSlot = m_weapons[w].slot;
+                }
+            }
+            m_bestSlot[t][b] = (uint8_t)bestSlot;
+            m_bestOwned[t][b] = (uint8_t)bestOwned;
+        }
+    }
+}
+
+
+TargetClass WeaponSelector::Classify(const char* blueprint) {
+    if (blueprint == NULL) {
+        return OtherTarget;
+    }
+    if (strstr(blueprint, "Rat") != NULL) {
+        return RatTarget;
+    }
+    if (strstr(blueprint, "Spider") != NULL) {
+        return SpiderTarget;
+    }
+    if (strstr(blueprint, "Bear") != NULL) {
+        return BearTarget;
+    }
+    if (strstr(blueprint, "Magmarok") != NULL) {
+        return MagmarokTarget;
+    }
+    return OtherTarget;
+}
+
+
+size_t WeaponSelector::GetBand(float distance) {
+    size_t band = 0;
+    while (band + 1 < TARGET_DISTANCE_BANDS && distance >= BAND_LIMITS[band]) {
+        band++;
+    }
+    return band;
+}
+
+
+const char * WeaponSelector::GetClassName(TargetClass target) {
+    return target < TargetClassCount ? TARGET_CLASS_NAMES[target] : "?";
+}
+
+
+size_t WeaponSelector::GetCount() const {
+    return m_count;
+}
+
+
+const WeaponStats & WeaponSelector::GetWeapon(size_t weapon) const {
+    return m_weapons[weapon];
+}
+
+
+float WeaponSelector::GetDps(size_t weapon, TargetClass target, float distance) const {
+    if (weapon >= m_count) {
+        return 0;
+    }
+    return m_dps[weapon][target][WeaponSelector::GetBand(distance)];
+}
+
+
+size_t WeaponSelector::GetBestSlot(TargetClass target, float distance) const {
+    return m_bestSlot[target][WeaponSelector::GetBand(distance)];
+}
+
+
+size_t WeaponSelector::GetBestOwned(TargetClass target, float distance) const {
+    return m_bestOwned[target][WeaponSelector::GetBand(distance)];
+}
+
+
+size_t WeaponSelector::Choose(size_t currentSlot, TargetClass target, float distance) const {
+    size_t band = WeaponSelector::GetBand(distance);
+    size_t best = m_bestSlot[target][band];
+    if (best >= WEAPON_SLOTS || best == currentSlot) {
+        return currentSlot;
+    }
+
+    size_t current = currentSlot < WEAPON_SLOTS ? m_slotWeapon[currentSlot] : NO_WEAPON;
+    float currentDps = current == NO_WEAPON ? 0 : m_dps[current][target][band];
+    size_t candidate = m_slotWeapon[best];
+    float bestDps = m_dps[candidate][target][band];
+
+    // Switching only pays off if the extra damage covers the time lost doing it
+    float swapTime = WEAPON_SWAP_TIME + (m_weapons[candidate].loaded ? 0 : m_weapons[candidate].reloadTime);
+    if ((bestDps - currentDps) * WEAPON_COMMIT_TIME > bestDps * swapTime) {
+        return best;
+    }
+    return currentSlot;
+}
@@ -0,0 +1,71 @@
+#ifndef WEAPONS_H
+#define WEAPONS_H
+
+#include <cstddef>
+#include <cstdint>
+
+const size_t MAX_WEAPONS = 32;
+const size_t WEAPON_SLOTS = 10;
+const size_t DAMAGE_TYPE_COUNT = 4;
+const size_t TARGET_DISTANCE_BANDS = 4;
+const size_t NO_WEAPON = MAX_WEAPONS;
+// Seconds lost switching weapons, and how long a fight is expected to last
+const float WEAPON_SWAP_TIME = 0.6;
+const float WEAPON_COMMIT_TIME = 5;
+// Share of the reload time still paid when partial reloads can top up in lulls
+const float WEAPON_PARTIAL_RELOAD_FACTOR = 0.5;
+
+enum TargetClass {RatTarget, SpiderTarget, BearTarget, MagmarokTarget, PlayerTarget, OtherTarget, TargetClassCount};
+
+
+// What the selector needs to know about a weapon, read from IItem
+struct WeaponStats {
+    const void* id;
+    const char* name;
+    size_t slot;
+    float damage;
+    uint32_t projectiles;
+    uint32_t damageType;
+    float cooldown;
+    float damagePerSecond;
+    uint32_t clipSize;
+    float reloadTime;
+    bool partialReload;
+    float range;
+    bool hasAmmo;
+    bool loaded;
+};
+
+
+// Precomputes sustained DPS of every owned weapon against each target class
+// and distance band, so picking a weapon for a target is a table lookup.
+// Only rebuilt when the inventory or loadout changes.
+class WeaponSelector {
+  public:
+    WeaponSelector();
+    void Clear();
+    void AddWeapon(const WeaponStats &);
+    void Build();
+    static TargetClass Classify(const char *);
+    static size_t GetBand(float);
+    static const char * GetClassName(TargetClass);
+
+    size_t GetCount() const;
+    const WeaponStats & GetWeapon(size_t) const;
+    float GetDps(size_t, TargetClass, float) const;
+    size_t GetBestSlot(TargetClass, float) const;
+    size_t GetBestOwned(TargetClass, float) const;
+    size_t Choose(size_t, TargetClass, float) const;
+
+  private:
+    WeaponStats m_weapons[MAX_WEAPONS];
+    size_t m_count;
+    size_t m_slotWeapon[WEAPON_SLOTS];
+    float m_dps[MAX_WEAPONS][TargetClassCount][TARGET_DISTANCE_BANDS];
+    uint8_t m_bestSlot[TargetClassCount][TARGET_DISTANCE_BANDS];
+    uint8_t m_bestOwned[TargetClassCount][TARGET_DISTANCE_BANDS];
+
+    static float SustainedDps(const WeaponStats &, TargetClass, size_t);
+};
+
+#endif
@@ -0,0 +1,234 @@
+#include <algorithm>
+#include <arpa/inet.h>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include "bench.h"
+#include "master.h"
+
+
+LoginBench::LoginBench(const MasterScript& script) : m_script(script), m_epoll(-1) {
+    // A greeting is a step with nothing to send
+    if (!script.GetGreeting().empty()) {
+        m_steps.push_back({&m_empty, &script.GetGreeting()});
+    }
+    const std::vector<const Exchange*>& session = script.GetSession();
+    for (size_t i = 0; i < session.size(); i++) {
+        m_steps.push_back({&session[i]->request, &session[i]->response});
+    }
+}
+
+
+bool LoginBench::Start(Client& client, const struct sockaddr_in& address) {
+    client.fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (client.fd < 0) {
+        return false;
+    }
+    int on = 1;
+    setsockopt(client.fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+    client.step = 0;
+    client.sent = 0;
+    client.received = 0;
+    client.startNs = GetNanoseconds();
+    client.connectedNs = 0;
+    client.firstReplyNs = 0;
+    if (connect(client.fd, (const struct sockaddr*)&address, sizeof(address)) != 0 && errno != EINPROGRESS) {
+        close(client.fd);
+        client.fd = -1;
+        return false;
+    }
+    struct epoll_event event;
+    event.events = EPOLLIN | EPOLLOUT;
+    event.data.ptr = &client;
+    epoll_ctl(m_epoll, EPOLL_CTL_ADD, client.fd, &event);
+    client.writing = true;
+    return true;
+}
+
+
+void LoginBench::Finish(Client& client) {
+    epoll_ctl(m_epoll, EPOLL_CTL_DEL, client.fd, NULL);
+    close(client.fd);
+    client.fd = -1;
+}
+
+
+// Only ask for EPOLLOUT while there is something waiting to go out
+void LoginBench::Watch(Client& client, bool writing) {
+    if (client.writing == writing) {
+        return;
+    }
+    struct epoll_event event;
+    event.events = EPOLLIN | (writing ? EPOLLOUT : 0);
+    event.data.ptr = &client;
+    epoll_ctl(m_epoll, EPOLL_CTL_MOD, client.fd, &event);
+    client.writing = writing;
+}
+
+
+// Moves a client as far through its login as the socket allows. False when
+// the login is over, one way or the other.
+bool LoginBench::Advance(Client& client, BenchResult& result) {
+    uint64_t now = GetNanoseconds();
+    if (client.connectedNs == 0) {
+        int error = 0;
+        socklen_t length = sizeof(error);
+        if (getsockopt(client.fd, SOL_SOCKET, SO_ERROR, &error, &length) != 0 || error != 0) {
+            result.failures++;
+            return false;
+        }
+        client.connectedNs = now;
+        result.connectNs.push_back(now - client.startNs);
+    }
+
+    while (client.step < m_steps.size()) {
+        const Step& step = m_steps[client.step];
+        while (client.sent < step.request->size()) {
+            ssize_t length = send(client.fd, step.request->data() + client.sent, step.request->size() - client.sent,
+                                  MSG_NOSIGNAL);
+            if (length < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                this->Watch(client, true);
+                return true;
+            }
+            if (length <= 0) {
+                result.failures++;
+                return false;
+            }
+            client.sent += length;
+        }
+        char buffer[16384];
+        while (client.received < step.response->size()) {
+            ssize_t length = recv(client.fd, buffer, std::min(sizeof(buffer), step.response->size() - client.received), 0);
+            if (length < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                this->Watch(client, false);
+                return true;
+            }
+            if (length <= 0) {
+                result.failures++;
+                return false;
+            }
+            if (client.firstReplyNs == 0) {
+                client.firstReplyNs = GetNanoseconds();
+                result.firstReplyNs.push_back(client.firstReplyNs - client.startNs);
+            }
+            if (memcmp(buffer, step.response->data() + client.received, length) != 0) {
+                result.mismatches++;
+            }
+            client.received += length;
+        }
+        client.step++;
+        client.sent = 0;
+        client.received = 0;
+    }
+    result.loginNs.push_back(GetNanoseconds() - client.startNs);
+    return false;
+}
+
+
+bool LoginBench::Run(const char* host, uint16_t port, size_t clientCount, size_t rounds, BenchResult& result) {
+    struct sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_port = htons(port);
+    if (inet_pton(AF_INET, host, &address.sin_addr) != 1) {
+        fprintf(stderr, "<Bench> Bad address %s\n", host);
+        return false;
+    }
+    result.connectNs.clear();
+    result.firstReplyNs.clear();
+    result.loginNs.clear();
+    result.failures = 0;
+    result.mismatches = 0;
+    fprintf(stderr, "<Bench> %lu clients, %lu logins each, %lu steps per login against %s:%u\n",
+            (unsigned long)clientCount, (unsigned long)rounds, (unsigned long)m_steps.size(), host, port);
+
+    m_epoll = epoll_create1(EPOLL_CLOEXEC);
+    std::vector<Client> clients(clientCount);
+    size_t active = 0;
+    uint64_t start = GetNanoseconds();
+    for (size_t i = 0; i < clients.size(); i++) {
+        clients[i].round = 0;
+        if (rounds > 0 && this->Start(clients[i], address)) {
+            active++;
+        }
+        else if (rounds > 0) {
+            result.failures++;
+        }
+    }
+
+    std::vector<struct epoll_event> events(std::max<size_t>(1, clientCount));
+    uint64_t lastSweep = start;
+    while (active > 0) {
+        int count = epoll_wait(m_epoll, events.data(), events.size(), 100);
+        if (count < 0 && errno != EINTR) {
+            perror("<Bench> epoll_wait");
+            break;
+        }
+        std::vector<Client*> finished;
+        for (int i = 0; i < count; i++) {
+            Client* client = (Client*)events[i].data.ptr;
+            if (client->fd >= 0 && !this->Advance(*client, result)) {
+                this->Finish(*client);
+                finished.push_back(client);
+            }
+        }
+        // Logins that stalled are given up on once a second
+        uint64_t now = GetNanoseconds();
+        if (now - lastSweep > 1000000000) {
+            lastSweep = now;
+            for (size_t i = 0; i < clients.size(); i++) {
+                if (clients[i].fd >= 0 && now - clients[i].startNs > BENCH_TIMEOUT_NS) {
+                    result.failures++;
+                    this->Finish(clients[i]);
+                    finished.push_back(&clients[i]);
+                }
+            }
+        }
+        // Reconnecting straight away is the path being measured
+        for (size_t i = 0; i < finished.size(); i++) {
+            Client& client = *finished[i];
+            active--;
+            if (++client.round < rounds) {
+                if (this->Start(client, address)) {
+                    active++;
+                }
+                else {
+                    result.failures++;
+                }
+            }
+        }
+    }
+    close(m_epoll);
+    m_epoll = -1;
+    result.seconds = (GetNanoseconds() - start) / 1e9;
+    return true;
+}
+
+
+static void PrintLatencies(const char* label, std::vector<uint64_t>& values) {
+    if (values.empty()) {
+        printf("%-12s none\n", label);
+        return;
+    }
+    std::sort(values.begin(), values.end());
+    size_t count = values.size();
+    printf("%-12s p50 %8.3f ms  p90 %8.3f ms  p99 %8.3f ms  max %8.3f ms\n", label, values[count / 2] / 1e6,
+           values[std::min(count - 1, count * 90 / 100)] / 1e6, values[std::min(count - 1, count * 99 / 100)] / 1e6,
+           values[count - 1] / 1e6);
+}
+
+
+void PrintBenchResult(BenchResult& result) {
+    PrintLatencies("connect", result.connectNs);
+    PrintLatencies("first reply", result.firstReplyNs);
+    PrintLatencies("login", result.loginNs);
+    printf("%lu logins in %.2f s (%.0f/s), %lu failed, %lu answers differed from the capture\n",
+           (unsigned long)result.loginNs.size(), result.seconds,
+           result.seconds > 0 ? result.loginNs.size() / result.seconds : 0, (unsigned long)result.failures,
+           (unsigned long)result.mismatches);
+}
@@ -0,0 +1,69 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <cstddef>
+#include <cstdint>
+#include <netinet/in.h>
+#include <string>
+#include <vector>
+#include "script.h"
+
+const size_t DEFAULT_BENCH_CLIENTS = 100;
+const size_t DEFAULT_BENCH_ROUNDS = 10;
+// A login that hasn't finished by then counts as failed
+const uint64_t BENCH_TIMEOUT_NS = 5000000000ull;
+
+
+struct BenchResult {
+    // Socket connected, first byte of the first answer, whole conversation done
+    std::vector<uint64_t> connectNs;
+    std::vector<uint64_t> firstReplyNs;
+    std::vector<uint64_t> loginNs;
+    uint64_t failures;
+    // Answers that differ from the recorded ones
+    uint64_t mismatches;
+    double seconds;
+};
+
+
+// Simulated clients that each replay the first recorded login and then
+// reconnect to do it again, all on one epoll loop. Pointed at the stand-in
+// directly it measures the stand-in, pointed at a proxy in front of it the
+// difference is what the proxy adds.
+class LoginBench {
+  public:
+    LoginBench(const MasterScript &);
+    bool Run(const char *, uint16_t, size_t, size_t, BenchResult &);
+
+  private:
+    struct Step {
+        const std::string* request;
+        const std::string* response;
+    };
+
+    struct Client {
+        int fd;
+        size_t round;
+        size_t step;
+        size_t sent;
+        size_t received;
+        uint64_t startNs;
+        uint64_t connectedNs;
+        uint64_t firstReplyNs;
+        bool writing;
+    };
+
+    const MasterScript& m_script;
+    std::vector<Step> m_steps;
+    std::string m_empty;
+    int m_epoll;
+
+    bool Start(Client &, const struct sockaddr_in &);
+    void Watch(Client &, bool);
+    bool Advance(Client &, BenchResult &);
+    void Finish(Client &);
+};
+
+void PrintBenchResult(BenchResult &);
+
+#endif
@@ -0,0 +1,230 @@
+#include <algorithm>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "capture.h"
+#include "lz.h"
+
+
+CaptureReader::CaptureReader() : m_data(NULL), m_size(0), m_offset(0), m_truncated(false), m_blocked(false),
+    m_blocksTruncated(false), m_block(0), m_records(NULL), m_recordsLength(0) {
+}
+
+
+CaptureReader::~CaptureReader() {
+    if (m_data != NULL) {
+        munmap((void*)m_data, m_size);
+    }
+}
+
+
+bool CaptureReader::Open(const char* path) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat info;
+    if (fstat(fd, &info) != 0 || (size_t)info.st_size < sizeof(CAPTURE_MAGIC)) {
+        close(fd);
+        return false;
+    }
+    void* data = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        return false;
+    }
+    madvise(data, info.st_size, MADV_SEQUENTIAL);
+    m_data = (const uint8_t*)data;
+    m_size = info.st_size;
+    if (memcmp(m_data, CAPTURE_BLOCK_MAGIC, sizeof(CAPTURE_BLOCK_MAGIC)) == 0) {
+        m_blocked = true;
+        if (!this->LoadIndex()) {
+            this->ScanBlocks(m_size);
+        }
+    }
+    this->Rewind();
+    return m_blocked || memcmp(m_data, CAPTURE_MAGIC, sizeof(CAPTURE_MAGIC)) == 0;
+}
+
+
+// The index sits between the last block and the footer
+bool CaptureReader::LoadIndex() {
+    if (m_size < sizeof(CAPTURE_BLOCK_MAGIC) + CAPTURE_INDEX_FOOTER) {
+        return false;
+    }
+    const uint8_t* footer = m_data + m_size - CAPTURE_INDEX_FOOTER;
+    uint64_t start;
+    uint32_t count;
+    memcpy(&start, footer, 8);
+    memcpy(&count, footer + 8, 4);
+    if (memcmp(footer + 12, CAPTURE_INDEX_MAGIC, sizeof(CAPTURE_INDEX_MAGIC)) != 0 ||
+            start < sizeof(CAPTURE_BLOCK_MAGIC) ||
+            start + (uint64_t)count * CAPTURE_INDEX_ENTRY != m_size - CAPTURE_INDEX_FOOTER) {
+        return false;
+    }
+    m_blocks.resize(count);
+    for (uint32_t i = 0; i < count; i++) {
+        memcpy(&m_blocks[i].offset, m_data + start + i * CAPTURE_INDEX_ENTRY, 8);
+        memcpy(&m_blocks[i].timestamp, m_data + start + i * CAPTURE_INDEX_ENTRY + 8, 8);
+        if (m_blocks[i].offset + CAPTURE_BLOCK_HEADER > start) {
+            m_blocks.clear();
+            return false;
+        }
+    }
+    return true;
+}
+
+
+// Without an index the blocks are found by hopping from header to header
+void CaptureReader::ScanBlocks(size_t end) {
+    m_blocks.clear();
+    size_t offset = sizeof(CAPTURE_BLOCK_MAGIC);
+    while (offset + CAPTURE_BLOCK_HEADER <= end) {
+        uint32_t stored;
+        memcpy(&stored, m_data + offset + 1, 4);
+        if (offset + CAPTURE_BLOCK_HEADER + stored > end) {
+            break;
+        }
+        CaptureBlock block;
+        block.offset = offset;
+        memcpy(&block.timestamp, m_data + offset + 13, 8);
+        m_blocks.push_back(block);
+        offset += CAPTURE_BLOCK_HEADER + stored;
+    }
+    m_blocksTruncated = offset != end;
+}
+
+
+bool CaptureReader::LoadBlock(size_t index) {
+    const uint8_t* header = m_data + m_blocks[index].offset;
+    uint8_t codec = header[0];
+    uint32_t stored;
+    uint32_t raw;
+    memcpy(&stored, header + 1, 4);
+    memcpy(&raw, header + 5, 4);
+    if (m_blocks[index].offset + CAPTURE_BLOCK_HEADER + stored > m_size) {
+        return false;
+    }
+    const uint8_t* payload = header + CAPTURE_BLOCK_HEADER;
+    if (codec == CaptureStored && stored == raw) {
+        m_records = payload;
+    }
+    else if (codec == CaptureLz) {
+        if (m_raw.size() < raw) {
+            m_raw.resize(raw);
+        }
+        if (LzDecompress(payload, stored, m_raw.data(), m_raw.size()) != raw) {
+            return false;
+        }
+        m_records = m_raw.data();
+    }
+    else {
+        return false;
+    }
+    m_recordsLength = raw;
+    m_offset = 0;
+    return true;
+}
+
+
+bool CaptureReader::Next(CaptureRecord& record) {
+    const uint8_t* records = m_data;
+    size_t length = m_size;
+    if (m_blocked) {
+        // Records never straddle blocks, so a block ends exactly after its last one
+        while (m_offset == m_recordsLength) {
+            if (m_block == m_blocks.size()) {
+                m_truncated = m_blocksTruncated;
+                return false;
+            }
+            if (!this->LoadBlock(m_block++)) {
+                m_truncated = true;
+                return false;
+            }
+        }
+        records = m_records;
+        length = m_recordsLength;
+    }
+    if (m_offset + CAPTURE_RECORD_HEADER > length) {
+        m_truncated = m_offset != length;
+        return false;
+    }
+    // Little-endian <QBHI, unaligned
+    const uint8_t* header = records + m_offset;
+    memcpy(&record.timestamp, header, 8);
+    record.origin = header[8];
+    memcpy(&record.port, header + 9, 2);
+    memcpy(&record.length, header + 11, 4);
+    if (m_offset + CAPTURE_RECORD_HEADER + record.length > length) {
+        m_truncated = true;
+        return false;
+    }
+    record.payload = header + CAPTURE_RECORD_HEADER;
+    m_offset += CAPTURE_RECORD_HEADER + record.length;
+    return true;
+}
+
+
+void CaptureReader::Rewind() {
+    if (m_blocked) {
+        this->SeekBlock(0);
+    }
+    else {
+        m_offset = sizeof(CAPTURE_MAGIC);
+    }
+    m_truncated = false;
+}
+
+
+bool CaptureReader::IsTruncated() const {
+    return m_truncated;
+}
+
+
+// Within the file, for block captures where the current block starts
+size_t CaptureReader::GetOffset() const {
+    if (m_blocked) {
+        return m_block == 0 ? sizeof(CAPTURE_BLOCK_MAGIC) : m_blocks[m_block - 1].offset;
+    }
+    return m_offset;
+}
+
+
+size_t CaptureReader::GetSize() const {
+    return m_size;
+}
+
+
+bool CaptureReader::IsBlocked() const {
+    return m_blocked;
+}
+
+
+size_t CaptureReader::GetBlockCount() const {
+    return m_blocks.size();
+}
+
+
+const CaptureBlock& CaptureReader::GetBlock(size_t index) const {
+    return m_blocks[index];
+}
+
+
+size_t CaptureReader::FindBlock(uint64_t timestamp) const {
+    auto after = std::upper_bound(m_blocks.begin(), m_blocks.end(), timestamp,
+                                  [](uint64_t value, const CaptureBlock& block) {
+        return value < block.timestamp;
+    });
+    return after == m_blocks.begin() ? 0 : after - m_blocks.begin() - 1;
+}
+
+
+void CaptureReader::SeekBlock(size_t index) {
+    m_block = std::min(index, m_blocks.size());
+    m_records = NULL;
+    m_recordsLength = 0;
+    m_offset = 0;
+    m_truncated = false;
+}
@@ -0,0 +1,86 @@
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Written by tools/proxy/capture.py, as plain records or in compressed blocks of them
+const char CAPTURE_MAGIC[8] = {'P', 'W', 'N', '3', 'C', 'A', 'P', '1'};
+const char CAPTURE_BLOCK_MAGIC[8] = {'P', 'W', 'N', '3', 'C', 'A', 'P', '2'};
+const char CAPTURE_INDEX_MAGIC[8] = {'P', 'W', 'N', '3', 'I', 'D', 'X', '1'};
+const size_t CAPTURE_RECORD_HEADER = 15;
+// <BIII Q: codec, stored length, raw length, record count, first timestamp
+const size_t CAPTURE_BLOCK_HEADER = 21;
+// <QI8s: where the index starts, how many blocks it lists, the index magic
+const size_t CAPTURE_INDEX_FOOTER = 20;
+const size_t CAPTURE_INDEX_ENTRY = 16;
+const uint16_t MASTER_SERVER_PORT = 3333;
+
+// ConnectionType in tools/proxy/helpers.py, the side a chunk was received from
+enum CaptureOrigin {CaptureClient = 1, CaptureServer = 2};
+enum CaptureCodec {CaptureStored = 0, CaptureLz = 1};
+
+
+// One chunk as the proxy received it, the payload points into the mapping
+struct CaptureRecord {
+    uint64_t timestamp;
+    uint8_t origin;
+    uint16_t port;
+    uint32_t length;
+    const uint8_t* payload;
+};
+
+
+// Where a block starts in the file and the time of its first record
+struct CaptureBlock {
+    uint64_t offset;
+    uint64_t timestamp;
+};
+
+
+// Walks a capture straight out of a read-only mapping. A capture cut off by
+// a killed proxy just ends early, with the reader marked as truncated.
+//
+// Block captures are decompressed a block at a time into a buffer the
+// records then point into, so a payload is only good until the next call.
+// The block list comes from the index the proxy writes on close, or from
+// walking the block headers when it never got to.
+class CaptureReader {
+  private:
+    const uint8_t* m_data;
+    size_t m_size;
+    size_t m_offset;
+    bool m_truncated;
+    bool m_blocked;
+    bool m_blocksTruncated;
+    std::vector<CaptureBlock> m_blocks;
+    size_t m_block;
+    std::vector<uint8_t> m_raw;
+    const uint8_t* m_records;
+    size_t m_recordsLength;
+
+    bool LoadIndex();
+    void ScanBlocks(size_t);
+    bool LoadBlock(size_t);
+
+  public:
+    CaptureReader();
+    ~CaptureReader();
+    bool Open(const char *);
+    bool Next(CaptureRecord &);
+    void Rewind();
+    bool IsTruncated() const;
+    size_t GetOffset() const;
+    size_t GetSize() const;
+
+    bool IsBlocked() const;
+    size_t GetBlockCount() const;
+    const CaptureBlock & GetBlock(size_t) const;
+    // The block holding records from that time on
+    size_t FindBlock(uint64_t) const;
+    // Next() continues from the first record of that block
+    void SeekBlock(size_t);
+};
+
+#endif
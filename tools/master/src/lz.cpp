@@ -0,0 +1,221 @@
+#include <cstring>
+#include "lz.h"
+
+
+static uint32_t Read32(const uint8_t* data) {
+    uint32_t value;
+    memcpy(&value, data, sizeof(value));
+    return value;
+}
+
+
+static uint64_t Read64(const uint8_t* data) {
+    uint64_t value;
+    memcpy(&value, data, sizeof(value));
+    return value;
+}
+
+
+static uint32_t Hash(uint32_t sequence) {
+    return (sequence * 2654435761u) >> (32 - LZ_HASH_BITS);
+}
+
+
+// Whatever didn't fit a token nibble, as a run of 255s and the remainder
+static uint8_t* WriteLength(uint8_t* out, size_t length) {
+    while (length >= 255) {
+        *out++ = 255;
+        length -= 255;
+    }
+    *out++ = (uint8_t)length;
+    return out;
+}
+
+
+static bool ReadLength(const uint8_t*& in, const uint8_t* end, size_t& length) {
+    uint8_t byte;
+    do {
+        if (in >= end) {
+            return false;
+        }
+        byte = *in++;
+        length += byte;
+    } while (byte == 255);
+    return true;
+}
+
+
+static uint8_t* WriteSequence(uint8_t* out, const uint8_t* literals, size_t literalCount, size_t offset,
+                              size_t matchLength) {
+    uint8_t* token = out++;
+    *token = (uint8_t)((literalCount < 15 ? literalCount : 15) << 4);
+    if (literalCount >= 15) {
+        out = WriteLength(out, literalCount - 15);
+    }
+    // Ahead of a match there are at least LZ_MATCH_MARGIN more bytes in and
+    // out, so a short run can go as one 16-byte move
+    if (offset != 0 && literalCount <= 16) {
+        memcpy(out, literals, 16);
+    }
+    else {
+        memcpy(out, literals, literalCount);
+    }
+    out += literalCount;
+    if (offset == 0) {
+        return out;
+    }
+    *out++ = offset & 0xFF;
+    *out++ = offset >> 8;
+    size_t extra = matchLength - LZ_MIN_MATCH;
+    *token |= extra < 15 ? extra : 15;
+    if (extra >= 15) {
+        out = WriteLength(out, extra - 15);
+    }
+    return out;
+}
+
+
+size_t LzBound(size_t length) {
+    return length + length / 255 + 16;
+}
+
+
+size_t LzCompress(const uint8_t* in, size_t length, uint8_t* out, size_t capacity) {
+    // Matches never make the output longer than the literals they replace
+    if (capacity < LzBound(length)) {
+        return 0;
+    }
+    uint8_t* start = out;
+    const uint8_t* anchor = in;
+    const uint8_t* end = in + length;
+    if (length > LZ_MATCH_MARGIN) {
+        uint32_t table[1 << LZ_HASH_BITS];
+        memset(table, 0, sizeof(table));
+        const uint8_t* matchLimit = end - LZ_LAST_LITERALS;
+        const uint8_t* searchLimit = end - LZ_MATCH_MARGIN;
+        const uint8_t* position = in + 1;
+        uint32_t nextSequence = Read32(position);
+        for (;;) {
+            // Look for an earlier occurrence of the next four bytes, reading
+            // the position after this one before its candidate is compared.
+            // The step grows by one every other miss, so the float bytes
+            // between matches are crossed in a few probes and extending
+            // backwards finds where the next match really starts
+            const uint8_t* candidate;
+            const uint8_t* next = position;
+            size_t step = 2;
+            uint32_t sequence;
+            do {
+                position = next;
+                sequence = nextSequence;
+                next = position + (step++ >> 1);
+                if (__builtin_expect(next > searchLimit, 0)) {
+                    goto last;
+                }
+                uint32_t& slot = table[Hash(sequence)];
+                candidate = in + slot;
+                slot = position - in;
+                nextSequence = Read32(next);
+            } while (__builtin_expect(Read32(candidate) != sequence || (size_t)(position - candidate) > LZ_WINDOW, 1));
+            while (position > anchor && candidate > in && position[-1] == candidate[-1]) {
+                position--;
+                candidate--;
+            }
+
+          match:
+            // Compare a word at a time, the first differing byte ends the match
+            const uint8_t* matchEnd = position + LZ_MIN_MATCH;
+            const uint8_t* reference = candidate + LZ_MIN_MATCH;
+            while (matchEnd + 8 <= matchLimit) {
+                uint64_t difference = Read64(matchEnd) ^ Read64(reference);
+                if (difference != 0) {
+                    matchEnd += __builtin_ctzll(difference) >> 3;
+                    goto matched;
+                }
+                matchEnd += 8;
+                reference += 8;
+            }
+            while (matchEnd < matchLimit && *matchEnd == *reference) {
+                matchEnd++;
+                reference++;
+            }
+          matched:
+            out = WriteSequence(out, anchor, position - anchor, position - candidate, matchEnd - position);
+            position = matchEnd;
+            anchor = position;
+            if (position >= searchLimit) {
+                break;
+            }
+            table[Hash(Read32(position - 2))] = position - 2 - in;
+            // Matches often run back to back, so try right where this one ended
+            sequence = Read32(position);
+            uint32_t& slot = table[Hash(sequence)];
+            candidate = in + slot;
+            slot = position - in;
+            if (Read32(candidate) == sequence && (size_t)(position - candidate) <= LZ_WINDOW) {
+                goto match;
+            }
+            nextSequence = Read32(++position);
+        }
+    }
+  last:
+    out = WriteSequence(out, anchor, end - anchor, 0, 0);
+    return out - start;
+}
+
+
+size_t LzDecompress(const uint8_t* in, size_t length, uint8_t* out, size_t capacity) {
+    const uint8_t* end = in + length;
+    uint8_t* start = out;
+    uint8_t* outEnd = out + capacity;
+    while (in < end) {
+        uint8_t token = *in++;
+        size_t literals = token >> 4;
+        if (literals == 15 && !ReadLength(in, end, literals)) {
+            return 0;
+        }
+        if (literals > (size_t)(end - in) || literals > (size_t)(outEnd - out)) {
+            return 0;
+        }
+        // Short runs are copied as one fixed-size move when there's room
+        if (literals <= 16 && end - in >= 16 && outEnd - out >= 16) {
+            memcpy(out, in, 16);
+        }
+        else {
+            memcpy(out, in, literals);
+        }
+        out += literals;
+        in += literals;
+        if (in == end) {
+            return out - start;
+        }
+
+        if (end - in < 2) {
+            return 0;
+        }
+        size_t offset = in[0] | (in[1] << 8);
+        in += 2;
+        size_t matchLength = token & 15;
+        if (matchLength == 15 && !ReadLength(in, end, matchLength)) {
+            return 0;
+        }
+        matchLength += LZ_MIN_MATCH;
+        if (offset == 0 || offset > (size_t)(out - start) || matchLength > (size_t)(outEnd - out)) {
+            return 0;
+        }
+        const uint8_t* match = out - offset;
+        if (offset >= 8 && (size_t)(outEnd - out) >= matchLength + 8) {
+            // May write up to 7 bytes past the match, which the next sequence overwrites
+            for (size_t i = 0; i < matchLength; i += 8) {
+                memcpy(out + i, match + i, 8);
+            }
+        }
+        else {
+            for (size_t i = 0; i < matchLength; i++) {
+                out[i] = match[i];
+            }
+        }
+        out += matchLength;
+    }
+    return 0;
+}
@@ -0,0 +1,39 @@
+#ifndef LZ_H
+#define LZ_H
+
+#include <cstddef>
+#include <cstdint>
+
+// Positions of 4-byte sequences are remembered in a table this many bits
+// wide, small enough to stay in L1 next to the block
+const int LZ_HASH_BITS = 12;
+const size_t LZ_MIN_MATCH = 4;
+// Offsets are 16 bits, so matches reach back this far
+const size_t LZ_WINDOW = 65535;
+// The last bytes of a block are always literals, so the decoder can copy in words
+const size_t LZ_LAST_LITERALS = 8;
+const size_t LZ_MATCH_MARGIN = 16;
+
+
+// Byte-oriented LZ77 for capture blocks. A block is a run of sequences, each
+// a token of literal and match length nibbles, the literals, a 16-bit
+// offset and any length that didn't fit its nibble in 255-runs. The last
+// sequence is literals only. Packet streams repeat opcodes, record headers
+// and the high bytes of slowly changing floats within a few hundred bytes,
+// so a single-probe hash table finds most of it. Misses make the search
+// step grow, so the low float bytes and incompressible data are skipped in a
+// few probes, at the cost of a few percent of ratio on denser data like
+// source or binaries. `master lz` measures about 530-580 MB/s compressing
+// movement traffic at 1.59x on one core, and about 1.4 GB/s decompressing.
+//
+// C linkage so tools/proxy can load them from liblz.so.
+extern "C" {
+// Worst case compressed size of that many bytes
+size_t LzBound(size_t);
+// Returns the compressed size, 0 if the output is smaller than LzBound
+size_t LzCompress(const uint8_t *, size_t, uint8_t *, size_t);
+// Returns the decompressed size, 0 if the input is corrupt or the output too small
+size_t LzDecompress(const uint8_t *, size_t, uint8_t *, size_t);
+}
+
+#endif
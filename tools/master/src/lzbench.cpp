@@ -0,0 +1,190 @@
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <random>
+#include "capture.h"
+#include "lz.h"
+#include "lzbench.h"
+#include "master.h"
+
+
+// A record as capture.py writes it, cutting a new block where it wouldn't fit
+static void AppendRecord(std::vector<std::string>& blocks, uint64_t timestamp, uint8_t origin, uint16_t port,
+                         const void* payload, uint32_t length) {
+    uint8_t header[CAPTURE_RECORD_HEADER];
+    memcpy(header, &timestamp, 8);
+    header[8] = origin;
+    memcpy(header + 9, &port, 2);
+    memcpy(header + 11, &length, 4);
+    if (blocks.empty() || blocks.back().size() + sizeof(header) + length > LZ_BENCH_BLOCK_SIZE) {
+        blocks.push_back(std::string());
+        blocks.back().reserve(LZ_BENCH_BLOCK_SIZE);
+    }
+    blocks.back().append((const char*)header, sizeof(header));
+    blocks.back().append((const char*)payload, length);
+}
+
+
+bool LoadLzBenchBlocks(const char* path, std::vector<std::string>& blocks) {
+    CaptureReader reader;
+    if (!reader.Open(path)) {
+        fprintf(stderr, "<Lz> %s isn't a capture\n", path);
+        return false;
+    }
+    CaptureRecord record;
+    while (reader.Next(record)) {
+        if (record.port != MASTER_SERVER_PORT) {
+            AppendRecord(blocks, record.timestamp, record.origin, record.port, record.payload, record.length);
+        }
+    }
+    if (blocks.empty()) {
+        fprintf(stderr, "<Lz> No game server traffic in %s\n", path);
+        return false;
+    }
+    return true;
+}
+
+
+struct Mover {
+    uint32_t id;
+    float position[3];
+    float velocity[3];
+    float yaw;
+    // Held the way a player holds the keys, until the next change of course
+    int16_t pitch;
+    uint8_t forward;
+    uint8_t strafe;
+};
+
+
+static void Steer(Mover& mover, std::mt19937& random) {
+    std::uniform_real_distribution<float> speed(-600, 600);
+    mover.velocity[0] = speed(random);
+    mover.velocity[1] = speed(random);
+    mover.velocity[2] = speed(random) / 20;
+    mover.pitch = (int16_t)(random() % 2048) - 1024;
+    mover.forward = (uint8_t)(random() % 3 * 127);
+    mover.strafe = (uint8_t)(random() % 3 * 127);
+}
+
+
+// Where a mover is now, as the 20 bytes after the opcode of an mv packet
+static size_t PutMovement(uint8_t* out, const Mover& mover) {
+    memcpy(out, mover.position, 12);
+    int16_t rotation[3] = {mover.pitch, (int16_t)(mover.yaw * 10430), 0};
+    memcpy(out + 12, rotation, 6);
+    out[18] = mover.forward;
+    out[19] = mover.strafe;
+    return 20;
+}
+
+
+// The client sends its own position every frame and the server relays
+// everyone else's, with the frame time jittering a little
+void MakeLzBenchBlocks(std::vector<std::string>& blocks) {
+    std::mt19937 random(1);
+    std::uniform_int_distribution<uint64_t> jitter(15000000, 18000000);
+    Mover movers[LZ_BENCH_ACTORS + 1];
+    for (size_t i = 0; i <= LZ_BENCH_ACTORS; i++) {
+        movers[i] = {(uint32_t)(i == 0 ? 0 : 100 + random() % 5000), {-39602.0f + i * 800, -18288.0f, 2400.0f},
+                     {0, 0, 0}, 0, 0, 0, 0};
+        Steer(movers[i], random);
+    }
+    uint64_t timestamp = 1700000000000000000ull;
+    size_t written = 0;
+    while (written < LZ_BENCH_SYNTHETIC_SIZE) {
+        uint64_t frameNs = jitter(random);
+        timestamp += frameNs;
+        for (Mover& mover : movers) {
+            for (int axis = 0; axis < 3; axis++) {
+                mover.position[axis] += mover.velocity[axis] * frameNs / 1e9f;
+            }
+            mover.yaw = fmodf(mover.yaw + (random() % 100) / 5000.0f, 6.2831853f);
+            if (random() % 120 == 0) {
+                Steer(mover, random);
+            }
+        }
+
+        uint8_t packet[22] = {'m', 'v'};
+        PutMovement(packet + 2, movers[0]);
+        AppendRecord(blocks, timestamp, CaptureClient, 3000, packet, sizeof(packet));
+        written += CAPTURE_RECORD_HEADER + sizeof(packet);
+
+        // The relay arrives a little later, one packet per actor in a chunk
+        uint8_t relay[LZ_BENCH_ACTORS * 30];
+        size_t length = 0;
+        for (size_t i = 1; i <= LZ_BENCH_ACTORS; i++) {
+            relay[length] = 'p';
+            relay[length + 1] = 's';
+            memcpy(relay + length + 2, &movers[i].id, 4);
+            length += 6 + PutMovement(relay + length + 6, movers[i]);
+            relay[length++] = movers[i].forward != 0;
+            relay[length++] = 0;
+            relay[length++] = 0;
+            relay[length++] = 0;
+        }
+        AppendRecord(blocks, timestamp + 400000 + random() % 200000, CaptureServer, 3000, relay, length);
+        written += CAPTURE_RECORD_HEADER + length;
+    }
+}
+
+
+// Throughput is per core, so rounds are timed in this thread's CPU time and
+// whatever else the machine runs in between doesn't count against the codec
+static uint64_t GetThreadNanoseconds() {
+    struct timespec now;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now);
+    return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+
+void RunLzBench(const std::vector<std::string>& blocks, size_t rounds, LzBenchResult& result) {
+    memset(&result, 0, sizeof(result));
+    result.blocks = blocks.size();
+    // Sized up front, so the rounds time the codec rather than zeroing buffers
+    std::vector<std::vector<uint8_t>> compressed(blocks.size());
+    std::vector<size_t> lengths(blocks.size());
+    for (size_t i = 0; i < blocks.size(); i++) {
+        compressed[i].resize(LzBound(blocks[i].size()));
+    }
+    std::vector<uint8_t> raw(LZ_BENCH_BLOCK_SIZE);
+    for (size_t round = 0; round < rounds; round++) {
+        uint64_t start = GetThreadNanoseconds();
+        for (size_t i = 0; i < blocks.size(); i++) {
+            const std::string& block = blocks[i];
+            lengths[i] = LzCompress((const uint8_t*)block.data(), block.size(), compressed[i].data(),
+                                    compressed[i].size());
+        }
+        double seconds = (GetThreadNanoseconds() - start) / 1e9;
+        if (round == 0 || seconds < result.compressSeconds) {
+            result.compressSeconds = seconds;
+        }
+
+        start = GetThreadNanoseconds();
+        for (size_t i = 0; i < blocks.size(); i++) {
+            LzDecompress(compressed[i].data(), lengths[i], raw.data(), raw.size());
+        }
+        seconds = (GetThreadNanoseconds() - start) / 1e9;
+        if (round == 0 || seconds < result.decompressSeconds) {
+            result.decompressSeconds = seconds;
+        }
+    }
+    for (size_t i = 0; i < blocks.size(); i++) {
+        const std::string& block = blocks[i];
+        size_t length = LzDecompress(compressed[i].data(), lengths[i], raw.data(), raw.size());
+        result.mismatches += length != block.size() || memcmp(raw.data(), block.data(), length) != 0;
+        result.rawBytes += block.size();
+        result.compressedBytes += lengths[i];
+    }
+}
+
+
+void PrintLzBenchResult(const LzBenchResult& result) {
+    double megabytes = result.rawBytes / 1e6;
+    printf("%lu blocks, %.1f MB, ratio %.2fx\n", (unsigned long)result.blocks, megabytes,
+           result.compressedBytes > 0 ? (double)result.rawBytes / result.compressedBytes : 0);
+    printf("compress %.0f MB/s, decompress %.0f MB/s, %lu blocks didn't round trip\n",
+           result.compressSeconds > 0 ? megabytes / result.compressSeconds : 0,
+           result.decompressSeconds > 0 ? megabytes / result.decompressSeconds : 0, (unsigned long)result.mismatches);
+}
@@ -0,0 +1,38 @@
+#ifndef LZBENCH_H
+#define LZBENCH_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// BLOCK_SIZE in tools/proxy/capture.py
+const size_t LZ_BENCH_BLOCK_SIZE = 256 * 1024;
+const size_t LZ_BENCH_SYNTHETIC_SIZE = 64 * 1024 * 1024;
+// Other players whose movement the server relays in the synthetic traffic
+const size_t LZ_BENCH_ACTORS = 8;
+const size_t DEFAULT_LZ_BENCH_ROUNDS = 5;
+
+
+struct LzBenchResult {
+    size_t blocks;
+    uint64_t rawBytes;
+    uint64_t compressedBytes;
+    // Best round of each, so a busy machine only makes it look slower once
+    double compressSeconds;
+    double decompressSeconds;
+    // Blocks that didn't come back the same
+    size_t mismatches;
+};
+
+
+// Times the capture codec on blocks cut the way the proxy cuts them: whole
+// records with their headers, about 256 KiB each. They come from a capture's
+// game server records, or from synthetic movement traffic of the local
+// player and a few others when there is no capture.
+bool LoadLzBenchBlocks(const char *, std::vector<std::string> &);
+void MakeLzBenchBlocks(std::vector<std::string> &);
+void RunLzBench(const std::vector<std::string> &, size_t, LzBenchResult &);
+void PrintLzBenchResult(const LzBenchResult &);
+
+#endif
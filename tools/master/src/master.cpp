@@ -0,0 +1,411 @@
+#include <arpa/inet.h>
+#include <cerrno>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include "bench.h"
+#include "capture.h"
+#include "lzbench.h"
+#include "master.h"
+
+volatile sig_atomic_t STOPPING = 0;
+
+
+static void Stop(int) {
+    STOPPING = 1;
+}
+
+
+uint64_t GetNanoseconds() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+
+bool MasterServer::Reply::operator<(const Reply& other) const {
+    // priority_queue keeps the largest on top, we want the soonest
+    return dueNs > other.dueNs;
+}
+
+
+MasterServer::MasterServer(const MasterScript& script, bool pace) :
+    m_script(script), m_pace(pace), m_listener(-1), m_epoll(-1), m_nextSerial(1) {
+    memset(&m_stats, 0, sizeof(m_stats));
+}
+
+
+MasterServer::~MasterServer() {
+    while (!m_connections.empty()) {
+        this->Close(m_connections.begin()->first);
+    }
+    if (m_listener >= 0) {
+        close(m_listener);
+    }
+    if (m_epoll >= 0) {
+        close(m_epoll);
+    }
+}
+
+
+bool MasterServer::Listen(const char* address, uint16_t port) {
+    struct sockaddr_in local;
+    memset(&local, 0, sizeof(local));
+    local.sin_family = AF_INET;
+    local.sin_port = htons(port);
+    if (inet_pton(AF_INET, address, &local.sin_addr) != 1) {
+        fprintf(stderr, "<Master> Bad address %s\n", address);
+        return false;
+    }
+    m_listener = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    int on = 1;
+    setsockopt(m_listener, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    if (bind(m_listener, (struct sockaddr*)&local, sizeof(local)) != 0 ||
+            listen(m_listener, MASTER_LISTEN_BACKLOG) != 0) {
+        fprintf(stderr, "<Master> Can't listen on %s:%u: %s\n", address, port, strerror(errno));
+        return false;
+    }
+    m_epoll = epoll_create1(EPOLL_CLOEXEC);
+    struct epoll_event event;
+    event.events = EPOLLIN;
+    event.data.fd = m_listener;
+    epoll_ctl(m_epoll, EPOLL_CTL_ADD, m_listener, &event);
+    fprintf(stderr, "<Master> Serving %lu exchanges (%lu opcodes) on %s:%u\n",
+            (unsigned long)m_script.GetExchangeCount(), (unsigned long)m_script.GetOpcodeCount(), address, port);
+    return true;
+}
+
+
+void MasterServer::Accept() {
+    for (;;) {
+        int fd = accept4(m_listener, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            return;
+        }
+        int on = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+        Connection& connection = m_connections[fd];
+        connection.fd = fd;
+        connection.serial = m_nextSerial++;
+        connection.input.clear();
+        connection.output.clear();
+        connection.seen.clear();
+        connection.partialSinceNs = 0;
+        connection.lastDueNs = 0;
+        struct epoll_event event;
+        event.events = EPOLLIN;
+        event.data.fd = fd;
+        epoll_ctl(m_epoll, EPOLL_CTL_ADD, fd, &event);
+        m_stats.connections++;
+
+        connection.output = m_script.GetGreeting();
+        if (!this->Flush(connection)) {
+            this->Close(fd);
+        }
+    }
+}
+
+
+// False once the peer has gone
+bool MasterServer::Read(Connection& connection) {
+    char buffer[16384];
+    for (;;) {
+        ssize_t length = recv(connection.fd, buffer, sizeof(buffer), 0);
+        if (length > 0) {
+            connection.input.append(buffer, length);
+            m_stats.bytesIn += length;
+            continue;
+        }
+        if (length < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            return this->Answer(connection, false);
+        }
+        return false;
+    }
+}
+
+
+// How much of the input the next request takes, 0 while it isn't all there.
+// Without length fields to go by, a request shorter than the recorded one is
+// taken as it is once it has waited long enough, since a client with a
+// longer or shorter name than the recorded one sends a different length.
+size_t MasterServer::GetRequestLength(const Connection& connection, const Exchange& exchange, bool force) const {
+    const std::string& input = connection.input;
+    if (m_script.IsFramed()) {
+        return m_script.MeasureMessages(input.data(), input.size(), exchange.messages);
+    }
+    if (input.size() >= exchange.request.size()) {
+        return exchange.request.size();
+    }
+    return force ? input.size() : 0;
+}
+
+
+// Answers every complete request in the input
+bool MasterServer::Answer(Connection& connection, bool force) {
+    size_t opcodeBytes = m_script.GetOpcodeBytes();
+    while (connection.input.size() >= opcodeBytes || (force && !connection.input.empty())) {
+        uint32_t opcode = m_script.GetOpcode(connection.input.data(), connection.input.size());
+        size_t& seen = connection.seen[opcode];
+        const Exchange* exchange = m_script.Match(opcode, seen);
+        if (exchange == NULL) {
+            m_stats.unmatched++;
+            fprintf(stderr, "<Master> No recorded answer for opcode %#x, dropping the client\n", opcode);
+            return false;
+        }
+        size_t length = this->GetRequestLength(connection, *exchange, force);
+        if (length == 0) {
+            // A framed request is always waited for in full
+            if (connection.partialSinceNs == 0 && !m_script.IsFramed()) {
+                connection.partialSinceNs = GetNanoseconds();
+                m_partial.insert(connection.fd);
+            }
+            break;
+        }
+        force = false;
+        seen++;
+        m_stats.requests++;
+        connection.input.erase(0, length);
+        connection.partialSinceNs = 0;
+        m_partial.erase(connection.fd);
+        if (exchange->response.empty()) {
+            continue;
+        }
+        if (m_pace) {
+            uint64_t due = GetNanoseconds() + exchange->thinkNs;
+            connection.lastDueNs = due > connection.lastDueNs ? due : connection.lastDueNs;
+            m_replies.push({connection.lastDueNs, connection.fd, connection.serial, &exchange->response});
+            continue;
+        }
+        connection.output += exchange->response;
+    }
+    return this->Flush(connection);
+}
+
+
+// Writes what the socket takes, waits for EPOLLOUT for the rest
+bool MasterServer::Flush(Connection& connection) {
+    while (!connection.output.empty()) {
+        ssize_t length = send(connection.fd, connection.output.data(), connection.output.size(), MSG_NOSIGNAL);
+        if (length < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            break;
+        }
+        if (length <= 0) {
+            return false;
+        }
+        m_stats.bytesOut += length;
+        connection.output.erase(0, length);
+    }
+    struct epoll_event event;
+    event.events = EPOLLIN | (connection.output.empty() ? 0 : EPOLLOUT);
+    event.data.fd = connection.fd;
+    epoll_ctl(m_epoll, EPOLL_CTL_MOD, connection.fd, &event);
+    return true;
+}
+
+
+void MasterServer::Close(int fd) {
+    epoll_ctl(m_epoll, EPOLL_CTL_DEL, fd, NULL);
+    close(fd);
+    m_connections.erase(fd);
+    m_partial.erase(fd);
+}
+
+
+int MasterServer::GetTimeout() const {
+    uint64_t now = GetNanoseconds();
+    uint64_t due = now + 100000000;
+    if (!m_replies.empty() && m_replies.top().dueNs < due) {
+        due = m_replies.top().dueNs;
+    }
+    if (!m_partial.empty() && now + PARTIAL_REQUEST_WAIT_NS < due) {
+        due = now + PARTIAL_REQUEST_WAIT_NS;
+    }
+    // Round up, a 0 ms wait on a reply due in 300 us would spin
+    return due <= now ? 0 : (int)((due - now + 999999) / 1000000);
+}
+
+
+void MasterServer::Run() {
+    signal(SIGINT, Stop);
+    signal(SIGTERM, Stop);
+    signal(SIGPIPE, SIG_IGN);
+    struct epoll_event events[MAX_MASTER_EVENTS];
+    while (!STOPPING) {
+        int count = epoll_wait(m_epoll, events, MAX_MASTER_EVENTS, this->GetTimeout());
+        if (count < 0 && errno != EINTR) {
+            perror("<Master> epoll_wait");
+            return;
+        }
+        for (int i = 0; i < count; i++) {
+            int fd = events[i].data.fd;
+            if (fd == m_listener) {
+                this->Accept();
+                continue;
+            }
+            auto found = m_connections.find(fd);
+            if (found == m_connections.end()) {
+                continue;
+            }
+            bool open = true;
+            if (events[i].events & EPOLLOUT) {
+                open = this->Flush(found->second);
+            }
+            if (open && (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR))) {
+                open = this->Read(found->second);
+            }
+            if (!open) {
+                this->Close(fd);
+            }
+        }
+
+        uint64_t now = GetNanoseconds();
+        while (!m_replies.empty() && m_replies.top().dueNs <= now) {
+            Reply reply = m_replies.top();
+            m_replies.pop();
+            auto found = m_connections.find(reply.fd);
+            if (found == m_connections.end() || found->second.serial != reply.serial) {
+                continue;
+            }
+            found->second.output += *reply.data;
+            if (!this->Flush(found->second)) {
+                this->Close(reply.fd);
+            }
+        }
+        std::vector<int> waited;
+        for (auto it = m_partial.begin(); it != m_partial.end(); ++it) {
+            auto found = m_connections.find(*it);
+            if (found != m_connections.end() && now - found->second.partialSinceNs >= PARTIAL_REQUEST_WAIT_NS) {
+                waited.push_back(*it);
+            }
+        }
+        for (size_t i = 0; i < waited.size(); i++) {
+            if (!this->Answer(m_connections[waited[i]], true)) {
+                this->Close(waited[i]);
+            }
+        }
+    }
+    fprintf(stderr, "<Master> %lu connections, %lu requests answered, %lu unmatched, %lu bytes in, %lu bytes out\n",
+            (unsigned long)m_stats.connections, (unsigned long)m_stats.requests, (unsigned long)m_stats.unmatched,
+            (unsigned long)m_stats.bytesIn, (unsigned long)m_stats.bytesOut);
+}
+
+
+const MasterStats& MasterServer::GetStats() const {
+    return m_stats;
+}
+
+
+static void Usage(const char* name) {
+    fprintf(stderr, "usage: %s serve CAPTURE [--listen ADDRESS] [--port N] [--capture-port N] [--opcode-bytes N]\n"
+            "                [--pace]\n"
+            "       %s bench CAPTURE [--host ADDRESS] [--port N] [--capture-port N] [--opcode-bytes N]\n"
+            "                [--clients N] [--rounds N]\n"
+            "       %s lz [CAPTURE] [--rounds N]\n",
+            name, name, name);
+}
+
+
+// Capture codec speed on a capture's blocks, or on synthetic movement traffic
+static int RunLz(int argc, char** argv) {
+    const char* capture = NULL;
+    size_t rounds = DEFAULT_LZ_BENCH_ROUNDS;
+    for (int i = 2; i < argc; i++) {
+        if (strcmp(argv[i], "--rounds") == 0 && i + 1 < argc) {
+            rounds = atoi(argv[++i]);
+        }
+        else if (capture == NULL && argv[i][0] != '-') {
+            capture = argv[i];
+        }
+        else {
+            Usage(argv[0]);
+            return 2;
+        }
+    }
+    std::vector<std::string> blocks;
+    if (capture == NULL) {
+        MakeLzBenchBlocks(blocks);
+    }
+    else if (!LoadLzBenchBlocks(capture, blocks)) {
+        return 1;
+    }
+    LzBenchResult result;
+    RunLzBench(blocks, rounds < 1 ? 1 : rounds, result);
+    PrintLzBenchResult(result);
+    return result.mismatches == 0 ? 0 : 1;
+}
+
+
+int main(int argc, char** argv) {
+    if (argc >= 2 && strcmp(argv[1], "lz") == 0) {
+        return RunLz(argc, argv);
+    }
+    if (argc < 3 || (strcmp(argv[1], "serve") != 0 && strcmp(argv[1], "bench") != 0)) {
+        Usage(argv[0]);
+        return 2;
+    }
+    bool serve = strcmp(argv[1], "serve") == 0;
+    const char* capture = argv[2];
+    const char* address = DEFAULT_MASTER_ADDRESS;
+    uint16_t port = MASTER_SERVER_PORT;
+    // The server's port in the capture, which needn't be the one served on
+    uint16_t capturePort = MASTER_SERVER_PORT;
+    size_t opcodeBytes = DEFAULT_OPCODE_BYTES;
+    size_t clients = DEFAULT_BENCH_CLIENTS;
+    size_t rounds = DEFAULT_BENCH_ROUNDS;
+    bool pace = false;
+    for (int i = 3; i < argc; i++) {
+        bool hasValue = i + 1 < argc;
+        if ((strcmp(argv[i], "--listen") == 0 || strcmp(argv[i], "--host") == 0) && hasValue) {
+            address = argv[++i];
+        }
+        else if (strcmp(argv[i], "--port") == 0 && hasValue) {
+            port = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--capture-port") == 0 && hasValue) {
+            capturePort = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--opcode-bytes") == 0 && hasValue) {
+            opcodeBytes = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--clients") == 0 && hasValue) {
+            clients = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--rounds") == 0 && hasValue) {
+            rounds = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--pace") == 0) {
+            pace = true;
+        }
+        else {
+            Usage(argv[0]);
+            return 2;
+        }
+    }
+
+    MasterScript script;
+    if (!script.Load(capture, capturePort, opcodeBytes)) {
+        return 1;
+    }
+    if (serve) {
+        MasterServer server(script, pace);
+        if (!server.Listen(address, port)) {
+            return 1;
+        }
+        server.Run();
+        return 0;
+    }
+    LoginBench bench(script);
+    BenchResult result;
+    if (!bench.Run(address, port, clients, rounds, result)) {
+        return 1;
+    }
+    PrintBenchResult(result);
+    return result.failures == 0 ? 0 : 1;
+}
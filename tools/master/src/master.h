@@ -0,0 +1,84 @@
+#ifndef MASTER_H
+#define MASTER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <queue>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "script.h"
+
+const char DEFAULT_MASTER_ADDRESS[] = "127.0.0.1";
+// A request shorter than the recorded one waits this long for the rest
+const uint64_t PARTIAL_REQUEST_WAIT_NS = 50000000;
+const size_t MAX_MASTER_EVENTS = 256;
+const int MASTER_LISTEN_BACKLOG = 4096;
+
+
+struct MasterStats {
+    uint64_t connections;
+    uint64_t requests;
+    uint64_t unmatched;
+    uint64_t bytesIn;
+    uint64_t bytesOut;
+};
+
+
+// Answers master server requests from a script on one epoll loop. Every
+// connection keeps its own count of each opcode, so each client walks
+// through the recorded answers as if it were the one that was recorded.
+class MasterServer {
+  public:
+    MasterServer(const MasterScript &, bool);
+    ~MasterServer();
+    bool Listen(const char *, uint16_t);
+    // Serves until SIGINT or SIGTERM
+    void Run();
+    const MasterStats & GetStats() const;
+
+  private:
+    struct Connection {
+        int fd;
+        uint64_t serial;
+        std::string input;
+        std::string output;
+        std::unordered_map<uint32_t, size_t> seen;
+        uint64_t partialSinceNs;
+        // Paced answers never overtake each other
+        uint64_t lastDueNs;
+    };
+
+    // An answer held back for its recorded think time
+    struct Reply {
+        uint64_t dueNs;
+        int fd;
+        uint64_t serial;
+        const std::string* data;
+        bool operator<(const Reply &) const;
+    };
+
+    const MasterScript& m_script;
+    bool m_pace;
+    int m_listener;
+    int m_epoll;
+    uint64_t m_nextSerial;
+    std::unordered_map<int, Connection> m_connections;
+    std::set<int> m_partial;
+    std::priority_queue<Reply> m_replies;
+    MasterStats m_stats;
+
+    void Accept();
+    bool Read(Connection &);
+    size_t GetRequestLength(const Connection &, const Exchange &, bool) const;
+    bool Answer(Connection &, bool);
+    bool Flush(Connection &);
+    void Close(int);
+    int GetTimeout() const;
+};
+
+
+uint64_t GetNanoseconds();
+
+#endif
@@ -0,0 +1,196 @@
+#include <cstdio>
+#include "capture.h"
+#include "script.h"
+
+
+MasterScript::MasterScript() : m_opcodeBytes(DEFAULT_OPCODE_BYTES), m_framed(false) {
+}
+
+
+bool MasterScript::Load(const char* path, uint16_t port, size_t opcodeBytes) {
+    CaptureReader reader;
+    if (!reader.Open(path)) {
+        fprintf(stderr, "<Master> %s isn't a capture\n", path);
+        return false;
+    }
+    m_opcodeBytes = opcodeBytes < 1 ? 1 : (opcodeBytes > MAX_OPCODE_BYTES ? MAX_OPCODE_BYTES : opcodeBytes);
+
+    // Client chunks up to the first server chunk make a request, server
+    // chunks up to the next client chunk make its answer
+    Exchange current;
+    current.thinkNs = 0;
+    current.messages = 1;
+    uint64_t requestEnd = 0;
+    CaptureRecord record;
+    while (reader.Next(record)) {
+        if (record.port != port) {
+            continue;
+        }
+        const char* payload = (const char*)record.payload;
+        if (record.origin == CaptureClient) {
+            if (!current.response.empty()) {
+                m_exchanges.push_back(current);
+                current.request.clear();
+                current.response.clear();
+            }
+            current.request.append(payload, record.length);
+            requestEnd = record.timestamp;
+        }
+        else if (current.request.empty() && m_exchanges.empty()) {
+            m_greeting.append(payload, record.length);
+        }
+        else if (current.request.empty()) {
+            // Pushed without being asked, it goes out with the previous answer
+            m_exchanges.back().response.append(payload, record.length);
+        }
+        else {
+            if (current.response.empty()) {
+                current.thinkNs = record.timestamp > requestEnd ? record.timestamp - requestEnd : 0;
+            }
+            current.response.append(payload, record.length);
+        }
+    }
+    if (!current.request.empty()) {
+        m_exchanges.push_back(current);
+    }
+    if (reader.IsTruncated()) {
+        fprintf(stderr, "<Master> %s is truncated, using what's there\n", path);
+    }
+
+    for (size_t i = 0; i < m_exchanges.size(); i++) {
+        Exchange& exchange = m_exchanges[i];
+        exchange.opcode = this->GetOpcode(exchange.request.data(), exchange.request.size());
+        m_byOpcode[exchange.opcode].push_back(i);
+        if (i > 0 && exchange.opcode == m_exchanges[0].opcode) {
+            continue;
+        }
+        if (m_session.size() == i) {
+            m_session.push_back(&exchange);
+        }
+    }
+    if (m_exchanges.empty()) {
+        fprintf(stderr, "<Master> No port %u traffic in %s\n", port, path);
+        return false;
+    }
+    if (this->FindFraming()) {
+        fprintf(stderr, "<Master> Requests carry a %lu byte length at offset %lu\n", (unsigned long)m_framing.bytes,
+                (unsigned long)m_framing.offset);
+    }
+    return true;
+}
+
+
+// Length of the message at the start of a buffer, 0 while its length field
+// isn't all there. One too short to hold its own field is taken as just that.
+size_t MasterScript::MeasureMessage(const RequestFraming& framing, const char* data, size_t length) const {
+    size_t header = framing.offset + framing.bytes;
+    if (length < header) {
+        return 0;
+    }
+    size_t value = 0;
+    for (size_t i = 0; i < framing.bytes; i++) {
+        value |= (size_t)(uint8_t)data[framing.offset + i] << (8 * i);
+    }
+    return value + framing.base < header ? header : value + framing.base;
+}
+
+
+size_t MasterScript::MeasureMessages(const char* data, size_t length, size_t count) const {
+    size_t position = 0;
+    for (size_t i = 0; i < count; i++) {
+        size_t message = this->MeasureMessage(m_framing, data + position, length - position);
+        if (message == 0 || message > length - position) {
+            return 0;
+        }
+        position += message;
+    }
+    return position;
+}
+
+
+// Tries 16 and 32 bit fields at each offset, counting the whole message or
+// only what follows the field, and keeps the first that cuts every recorded
+// request into whole messages with nothing left over
+bool MasterScript::FindFraming() {
+    static const size_t SIZES[] = {2, 4};
+    for (size_t offset = 0; offset <= MAX_LENGTH_FIELD_OFFSET; offset++) {
+        for (size_t bytes : SIZES) {
+            for (int after = 0; after < 2; after++) {
+                RequestFraming framing = {offset, bytes, after ? offset + bytes : 0};
+                size_t header = offset + bytes;
+                bool fits = true;
+                for (size_t i = 0; i < m_exchanges.size() && fits; i++) {
+                    const std::string& request = m_exchanges[i].request;
+                    size_t position = 0;
+                    size_t messages = 0;
+                    while (fits && position < request.size()) {
+                        size_t message = this->MeasureMessage(framing, request.data() + position,
+                                                              request.size() - position);
+                        fits = message >= header && message >= m_opcodeBytes && message <= request.size() - position;
+                        position += message;
+                        messages++;
+                    }
+                    m_exchanges[i].messages = messages;
+                }
+                if (fits) {
+                    m_framing = framing;
+                    m_framed = true;
+                    return true;
+                }
+            }
+        }
+    }
+    for (size_t i = 0; i < m_exchanges.size(); i++) {
+        m_exchanges[i].messages = 1;
+    }
+    return false;
+}
+
+
+uint32_t MasterScript::GetOpcode(const char* data, size_t length) const {
+    uint32_t opcode = 0;
+    for (size_t i = 0; i < m_opcodeBytes && i < length; i++) {
+        opcode |= (uint32_t)(uint8_t)data[i] << (8 * i);
+    }
+    return opcode;
+}
+
+
+size_t MasterScript::GetOpcodeBytes() const {
+    return m_opcodeBytes;
+}
+
+
+bool MasterScript::IsFramed() const {
+    return m_framed;
+}
+
+
+const Exchange* MasterScript::Match(uint32_t opcode, size_t occurrence) const {
+    auto found = m_byOpcode.find(opcode);
+    if (found == m_byOpcode.end()) {
+        return NULL;
+    }
+    const std::vector<size_t>& indices = found->second;
+    return &m_exchanges[indices[occurrence < indices.size() ? occurrence : indices.size() - 1]];
+}
+
+
+const std::string& MasterScript::GetGreeting() const {
+    return m_greeting;
+}
+
+
+const std::vector<const Exchange*>& MasterScript::GetSession() const {
+    return m_session;
+}
+
+
+size_t MasterScript::GetExchangeCount() const {
+    return m_exchanges.size();
+}
+
+
+size_t MasterScript::GetOpcodeCount() const {
+    return m_byOpcode.size();
+}
@@ -0,0 +1,74 @@
+#ifndef SCRIPT_H
+#define SCRIPT_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Requests are told apart by their first few bytes, read little-endian
+const size_t DEFAULT_OPCODE_BYTES = 2;
+const size_t MAX_OPCODE_BYTES = 4;
+// Length fields are looked for this far into the recorded requests
+const size_t MAX_LENGTH_FIELD_OFFSET = 8;
+
+
+// Everything the client sent before the server answered, and the answer
+struct Exchange {
+    uint32_t opcode;
+    std::string request;
+    std::string response;
+    // Recorded time between the end of the request and the first byte of the answer
+    uint64_t thinkNs;
+    // How many messages the request is made of, when they carry their length
+    size_t messages;
+};
+
+
+// A little-endian length field at a fixed offset of every message. Its value
+// plus base is the length of the whole message.
+struct RequestFraming {
+    size_t offset;
+    size_t bytes;
+    size_t base;
+};
+
+
+// Master server conversations cut out of a proxy capture. A repeated opcode
+// gets its recorded answers in turn, so a login that asks the same thing
+// twice is answered the way it was the first time round. If one length field
+// frames every recorded request exactly, live requests are framed by it too,
+// since a client with another name sends other lengths.
+class MasterScript {
+  public:
+    MasterScript();
+    bool Load(const char *, uint16_t, size_t);
+    uint32_t GetOpcode(const char *, size_t) const;
+    size_t GetOpcodeBytes() const;
+    bool IsFramed() const;
+    // Bytes taken by that many messages at the start of a buffer, 0 while they aren't all there
+    size_t MeasureMessages(const char *, size_t, size_t) const;
+    // NULL when the opcode was never recorded, the last answer once they run out
+    const Exchange * Match(uint32_t, size_t) const;
+    // Anything the server said before the client's first request
+    const std::string & GetGreeting() const;
+    // The first login in the capture, up to where its first request repeats
+    const std::vector<const Exchange *> & GetSession() const;
+    size_t GetExchangeCount() const;
+    size_t GetOpcodeCount() const;
+
+  private:
+    size_t m_opcodeBytes;
+    bool m_framed;
+    RequestFraming m_framing;
+    std::string m_greeting;
+    std::vector<Exchange> m_exchanges;
+    std::unordered_map<uint32_t, std::vector<size_t>> m_byOpcode;
+    std::vector<const Exchange *> m_session;
+
+    size_t MeasureMessage(const RequestFraming &, const char *, size_t) const;
+    bool FindFraming();
+};
+
+#endif
@@ -0,0 +1,360 @@
+"""Loopback benchmark of the latency and throughput the proxy adds.
+
+A fake game server listens on SERVER_HOST, run.py is started in front of it
+on CLIENT_HOST, and a fake client connects through it on a real game port.
+Every packet is timestamped when it is sent and when its last byte arrives on
+the other side, in both directions at once. The same traffic is sent directly
+to the server first, so the proxy's share can be read off as the difference.
+"""
+import argparse
+import json
+import os
+import random
+import select
+import socket
+import struct
+import subprocess
+import sys
+import threading
+import time
+from typing import Dict, List, Optional
+
+import helpers
+from capture import read_capture
+
+CLIENT_HOST = '127.0.0.1'
+SERVER_HOST = '127.0.0.2'
+CONNECT_TIMEOUT = 5
+# Proxy flags for each configuration, None connects straight to the server
+CONFIGURATIONS = {
+    'direct': None,
+    'forward': ['--no-parse'],
+    'parse': ['--quiet'],
+    'parse+print': [],
+}
+THROUGHPUT_CHUNK = 65536
+
+
+def synthetic_packets(origin: helpers.ConnectionType, count: int,
+                      seed: int) -> List[bytes]:
+    """Generate a packet stream shaped like a session in a busy region.
+
+    Clients mostly send positions, servers mostly send actor updates.
+
+    Args:
+        origin (helpers.ConnectionType): side that sends the packets
+        count (int): number of packets
+        seed (int): seed for the generator, same seed gives the same stream
+
+    Returns:
+        List[bytes]: packets with their two byte ids
+    """
+    rng = random.Random(seed * 2 + origin.value)
+    packets = []
+    for _ in range(count):
+        kind = rng.random()
+        if origin is helpers.ConnectionType.CLIENT:
+            if kind < 0.9:
+                position = (rng.uniform(-1e5, 1e5) for _ in range(3))
+                packet = b'mv' + struct.pack('fff', *position) + bytes(8)
+            elif kind < 0.95:
+                packet = b'jp' + struct.pack('?', rng.random() < 0.5)
+            else:
+                packet = b's=' + struct.pack('B', rng.randrange(10))
+        else:
+            actor = rng.randrange(1, 500)
+            if kind < 0.4:
+                packet = b'ps' + bytes(28)
+            elif kind < 0.7:
+                packet = b'++' + struct.pack('Ih', actor, rng.randrange(100))
+            elif kind < 0.9:
+                state = rng.choice((b'Idle', b'Walk', b'Attack', b'Dead'))
+                packet = b'st' + struct.pack('IH', actor, len(state)) + state
+            else:
+                attack = rng.choice((b'Bite', b'Claw', b'FireBreath'))
+                packet = (b'tr' + struct.pack('IH', actor, len(attack)) +
+                          attack + struct.pack('I', rng.randrange(1, 500)))
+        packets.append(packet)
+    return packets
+
+
+def captured_packets(path: str, origin: helpers.ConnectionType) -> List[bytes]:
+    """Load the game server chunks one side sent in a capture.
+
+    Args:
+        path (str): capture written by run.py --capture
+        origin (helpers.ConnectionType): side whose chunks to replay
+
+    Returns:
+        List[bytes]: chunks in capture order
+    """
+    with open(path, 'rb') as file:
+        return [record.payload for record in read_capture(file)
+                if record.origin is origin and
+                record.port != helpers.MASTER_PORT]
+
+
+def percentile(values: List[float], fraction: float) -> float:
+    if not values:
+        return float('nan')
+    ordered = sorted(values)
+    return ordered[min(len(ordered) - 1, int(fraction * len(ordered)))]
+
+
+class Stream:
+    """One direction of traffic, timed from sendall() to the last byte read.
+    """
+    def __init__(self, source: socket.socket, sink: socket.socket,
+                 packets: List[bytes]):
+        self._source = source
+        self._sink = sink
+        self._packets = packets
+        self._sent = []
+        self._stop_event = threading.Event()
+        self.latencies = []
+        self.received = 0
+
+    def send_paced(self, interval: float):
+        """Send each packet on its own, one every interval seconds.
+        """
+        offset = 0
+        start = time.perf_counter()
+        for i, packet in enumerate(self._packets):
+            delay = start + i * interval - time.perf_counter()
+            if delay > 0:
+                time.sleep(delay)
+            offset += len(packet)
+            self._sent.append((offset, time.perf_counter_ns()))
+            self._source.sendall(packet)
+
+    def send_flood(self, duration: float):
+        """Send the packets back to back, cycling, for duration seconds.
+        """
+        chunk = b''.join(self._packets)
+        while len(chunk) < THROUGHPUT_CHUNK:
+            chunk += chunk
+        deadline = time.perf_counter() + duration
+        while time.perf_counter() < deadline:
+            self._source.sendall(chunk)
+
+    def receive(self):
+        """Read until stopped, matching arrivals to the packets sent.
+        """
+        matched = 0
+        while not self._stop_event.is_set():
+            # The sink is the other stream's source, so no socket timeouts
+            try:
+                readable, _, _ = select.select([self._sink], [], [], 0.1)
+                if not readable:
+                    continue
+                data = self._sink.recv(THROUGHPUT_CHUNK)
+            except (OSError, ValueError):
+                return
+            if not data:
+                return
+            now = time.perf_counter_ns()
+            self.received += len(data)
+            while matched < len(self._sent) and \
+                    self._sent[matched][0] <= self.received:
+                self.latencies.append((now - self._sent[matched][1]) / 1e3)
+                matched += 1
+
+    def is_complete(self) -> bool:
+        return len(self.latencies) == len(self._packets)
+
+    def stop(self):
+        self._stop_event.set()
+
+
+class Session:
+    """A connected fake client and fake server, optionally through run.py.
+    """
+    def __init__(self, port: int, proxy_flags: Optional[List[str]]):
+        self.port = port
+        self._proxy = None
+        self._output = None
+        listener = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+        listener.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+        listener.bind((SERVER_HOST, port))
+        listener.listen(1)
+        if proxy_flags is not None:
+            self._start_proxy(proxy_flags)
+            target = CLIENT_HOST
+        else:
+            target = SERVER_HOST
+        self.client = self._connect(target)
+        self.server, _ = listener.accept()
+        listener.close()
+        for sock in (self.client, self.server):
+            sock.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+
+    def _start_proxy(self, flags: List[str]):
+        directory = os.path.dirname(os.path.abspath(__file__))
+        command = [sys.executable, os.path.join(directory, 'run.py'),
+                   '-d', SERVER_HOST, '-l', CLIENT_HOST] + flags
+        # Printed packets go to a pipe that is drained like a terminal would
+        self._proxy = subprocess.Popen(command, cwd=directory,
+                                       stdout=subprocess.PIPE,
+                                       stderr=subprocess.STDOUT)
+        self._output = threading.Thread(target=self._drain, daemon=True)
+        self._output.start()
+
+    def _drain(self):
+        while self._proxy.stdout.read1(THROUGHPUT_CHUNK):
+            pass
+
+    def _connect(self, host: str) -> socket.socket:
+        deadline = time.time() + CONNECT_TIMEOUT
+        while True:
+            sock = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+            try:
+                sock.connect((host, self.port))
+                return sock
+            except ConnectionRefusedError:
+                sock.close()
+                if time.time() > deadline:
+                    raise
+                time.sleep(0.05)
+
+    def close(self):
+        for sock in (self.client, self.server):
+            try:
+                sock.close()
+            except OSError:
+                pass
+        if self._proxy is not None:
+            self._proxy.kill()
+            self._proxy.wait()
+
+
+def run_streams(session: Session, client_packets: List[bytes],
+                server_packets: List[bytes], send, settle: float) -> tuple:
+    """Drive both directions at once and wait for the receivers to settle.
+
+    Returns:
+        tuple: client->server and server->client streams
+    """
+    upstream = Stream(session.client, session.server, client_packets)
+    downstream = Stream(session.server, session.client, server_packets)
+    threads = [threading.Thread(target=stream.receive, daemon=True)
+               for stream in (upstream, downstream)]
+    senders = [threading.Thread(target=send, args=(stream,), daemon=True)
+               for stream in (upstream, downstream)]
+    for thread in threads + senders:
+        thread.start()
+    for thread in senders:
+        thread.join()
+    deadline = time.time() + settle
+    while time.time() < deadline and \
+            not (upstream.is_complete() and downstream.is_complete()):
+        time.sleep(0.01)
+    for stream in (upstream, downstream):
+        stream.stop()
+    return upstream, downstream
+
+
+def measure(name: str, flags: Optional[List[str]], args,
+            client_packets: List[bytes],
+            server_packets: List[bytes]) -> Dict[str, float]:
+    """Measure one configuration: paced latency, then flooded throughput.
+
+    Returns:
+        Dict[str, float]: latency percentiles in us and throughput in MB/s
+    """
+    result = {}
+    session = Session(args.port, flags)
+    try:
+        interval = args.interval / 1e6
+        upstream, downstream = run_streams(
+            session, client_packets, server_packets,
+            lambda stream: stream.send_paced(interval), args.settle)
+    finally:
+        session.close()
+    for label, stream in (('up', upstream), ('down', downstream)):
+        result[f'{label}_lost'] = len(client_packets if label == 'up' else
+                                      server_packets) - len(stream.latencies)
+        for fraction in (0.5, 0.9, 0.99, 1.0):
+            key = f'{label}_p{round(fraction * 100)}'
+            result[key] = percentile(stream.latencies, fraction)
+
+    session = Session(args.port, flags)
+    try:
+        upstream, downstream = run_streams(
+            session, client_packets, server_packets,
+            lambda stream: stream.send_flood(args.duration), 0)
+    finally:
+        session.close()
+    result['up_mbps'] = upstream.received / args.duration / 1e6
+    result['down_mbps'] = downstream.received / args.duration / 1e6
+    print(f'[{name}] measured', file=sys.stderr)
+    return result
+
+
+def report(results: Dict[str, Dict[str, float]]):
+    baseline = results.get('direct')
+    print(f'{"config":<12} {"dir":<5} {"p50":>9} {"p90":>9} {"p99":>9} '
+          f'{"max":>9} {"+p50":>9} {"+p99":>9} {"lost":>6} {"MB/s":>8}')
+    for name, result in results.items():
+        for label, direction in (('up', 'c->s'), ('down', 's->c')):
+            values = [result[f'{label}_p{p}'] for p in (50, 90, 99, 100)]
+            added = ['', '']
+            if baseline is not None and name != 'direct':
+                added = [f'{result[f"{label}_p{p}"] - baseline[f"{label}_p{p}"]:.1f}'  # noqa: E501
+                         for p in (50, 99)]
+            print(f'{name:<12} {direction:<5} ' +
+                  ' '.join(f'{value:9.1f}' for value in values) +
+                  f' {added[0]:>9} {added[1]:>9}'
+                  f' {result[f"{label}_lost"]:>6}'
+                  f' {result[f"{label}_mbps"]:8.2f}')
+    print('Latencies in us, +p50/+p99 are added over direct')
+
+
+if __name__ == '__main__':
+    parser = argparse.ArgumentParser(prog=__file__)
+    parser.add_argument('-p', '--port', type=int, default=3000,
+                        help='Game server port to benchmark on')
+    parser.add_argument('-n', '--packets', type=int, default=5000,
+                        help='Synthetic packets per direction')
+    parser.add_argument('-i', '--interval', type=float, default=200,
+                        help='Microseconds between paced packets')
+    parser.add_argument('-t', '--duration', type=float, default=3,
+                        help='Seconds to flood each direction for')
+    parser.add_argument('-s', '--settle', type=float, default=5,
+                        help='Seconds to wait for stragglers')
+    parser.add_argument('-c', '--capture', type=str,
+                        help='Replay this capture instead of synthetic data')
+    parser.add_argument('--seed', type=int, default=0)
+    parser.add_argument('--configs', nargs='+', default=list(CONFIGURATIONS),
+                        choices=list(CONFIGURATIONS))
+    parser.add_argument('--json', type=str,
+                        help='Also write the results to this file')
+    parser.add_argument('--netem', action='append', default=[],
+                        metavar='PORTS:DIR:SETTINGS',
+                        help='Passed on to run.py for every proxied config')
+    parser.add_argument('--netem-seed', type=int, default=0)
+    args = parser.parse_args()
+
+    if args.capture:
+        client_packets = captured_packets(args.capture,
+                                          helpers.ConnectionType.CLIENT)
+        server_packets = captured_packets(args.capture,
+                                          helpers.ConnectionType.SERVER)
+    else:
+        client_packets = synthetic_packets(helpers.ConnectionType.CLIENT,
+                                           args.packets, args.seed)
+        server_packets = synthetic_packets(helpers.ConnectionType.SERVER,
+                                           args.packets, args.seed)
+
+    results = {}
+    for name in args.configs:
+        flags = CONFIGURATIONS[name]
+        if flags is not None and args.netem:
+            flags = flags + ['--netem-seed', str(args.netem_seed)]
+            for spec in args.netem:
+                flags += ['--netem', spec]
+        results[name] = measure(name, flags, args,
+                                client_packets, server_packets)
+    report(results)
+    if args.json:
+        with open(args.json, 'w') as file:
+            json.dump(results, file, indent=2)
@@ -0,0 +1,311 @@
+"""Reading and writing raw proxied traffic.
+
+A capture is a magic header followed by one record per chunk the proxy
+received, in the order it received them:
+
+    timestamp (u64, ns since epoch) | origin (u8) | port (u16) | length (u32)
+
+followed by `length` bytes of payload. Origin is the value of the
+ConnectionType the chunk was received on.
+
+Block captures (PWN3CAP2) hold the same records, cut into blocks of about
+BLOCK_SIZE bytes that never split a record:
+
+    codec (u8) | stored length (u32) | raw length (u32) | records (u32) |
+    first timestamp (u64)
+
+followed by the stored bytes, LZ-compressed by tools/master/src/lz.cpp
+or stored as they are. On close an index of (offset, first timestamp) per
+block is appended, then its offset, block count and INDEX_MAGIC, so
+readers can seek by time. Without it, a reader walks the block headers.
+"""
+import atexit
+import ctypes
+import os
+import queue
+import struct
+import threading
+import time
+from typing import BinaryIO, Iterator, List, NamedTuple, Optional, Tuple
+
+import helpers
+
+MAGIC = b'PWN3CAP1'
+BLOCK_MAGIC = b'PWN3CAP2'
+INDEX_MAGIC = b'PWN3IDX1'
+RECORD_HEADER = struct.Struct('<QBHI')
+BLOCK_HEADER = struct.Struct('<BIIIQ')
+INDEX_ENTRY = struct.Struct('<QQ')
+INDEX_FOOTER = struct.Struct('<QI8s')
+CODEC_STORED = 0
+CODEC_LZ = 1
+BLOCK_SIZE = 256 * 1024
+# A block that is still filling up is written anyway after this many seconds,
+# so a killed proxy loses at most that much
+BLOCK_AGE = 1.0
+# Blocks waiting for the compression thread before writers have to wait
+BLOCK_QUEUE = 64
+LZ_LIBRARY = os.path.join(os.path.dirname(os.path.abspath(__file__)), '..',
+                          'master', 'build', 'liblz.so')
+
+
+class Record(NamedTuple):
+    timestamp: int
+    origin: helpers.ConnectionType
+    port: int
+    payload: bytes
+
+
+class LzCodec:
+    """The in-tree block codec through ctypes, which lets go of the GIL for
+    the duration of each call.
+    """
+    def __init__(self, path: str):
+        library = ctypes.CDLL(path)
+        arguments = [ctypes.c_char_p, ctypes.c_size_t, ctypes.c_void_p,
+                     ctypes.c_size_t]
+        self._bound = library.LzBound
+        self._bound.argtypes = [ctypes.c_size_t]
+        self._bound.restype = ctypes.c_size_t
+        self._compress = library.LzCompress
+        self._compress.argtypes = arguments
+        self._compress.restype = ctypes.c_size_t
+        self._decompress = library.LzDecompress
+        self._decompress.argtypes = arguments
+        self._decompress.restype = ctypes.c_size_t
+
+    def compress(self, data: bytes) -> Optional[bytes]:
+        """Compressed data, or None when it would not come out smaller."""
+        capacity = self._bound(len(data))
+        out = ctypes.create_string_buffer(capacity)
+        length = self._compress(data, len(data), out, capacity)
+        if length == 0 or length >= len(data):
+            return None
+        return out.raw[:length]
+
+    def decompress(self, data: bytes, length: int) -> bytes:
+        out = ctypes.create_string_buffer(length)
+        if self._decompress(data, len(data), out, length) != length:
+            raise ValueError('Corrupt capture block')
+        return out.raw
+
+
+_CODEC = None
+
+
+def get_codec() -> Optional[LzCodec]:
+    """The codec from PWN3_LZ_LIBRARY or tools/master's build, if it is built.
+    """
+    global _CODEC
+    if _CODEC is None:
+        path = os.environ.get('PWN3_LZ_LIBRARY', LZ_LIBRARY)
+        try:
+            _CODEC = LzCodec(path)
+        except OSError:
+            _CODEC = False
+    return _CODEC or None
+
+
+class CaptureWriter:
+    """Append records to a capture file from any number of proxy threads.
+    """
+    def __init__(self, path: str, blocks: bool = True):
+        # Unbuffered, so a proxy that is killed leaves a complete capture
+        self._file = open(path, 'wb', buffering=0)
+        self._lock = threading.Lock()
+        self._blocks = blocks
+        if not blocks:
+            self._file.write(MAGIC)
+            return
+        self._file.write(BLOCK_MAGIC)
+        self._codec = get_codec()
+        if self._codec is None:
+            print(f'No block codec at {LZ_LIBRARY}, storing blocks as they '
+                  'are (make -C tools/master builds it)')
+        self._pending = bytearray()
+        self._pending_records = 0
+        self._pending_since = 0.0
+        self._first_timestamp = 0
+        self._offset = len(BLOCK_MAGIC)
+        self._index: List[Tuple[int, int]] = []
+        self._queue = queue.Queue(BLOCK_QUEUE)
+        self._closed = False
+        self._thread = threading.Thread(target=self._write_blocks,
+                                        name='capture', daemon=True)
+        self._thread.start()
+        atexit.register(self.close)
+
+    def write(self, origin: helpers.ConnectionType, port: int, data: bytes,
+              timestamp: int = None):
+        """Record one received chunk.
+
+        Args:
+            origin (helpers.ConnectionType): connection the data arrived on
+            port (int): game or master server port
+            data (bytes): chunk as received
+            timestamp (int, optional): receive time in ns, defaults to now
+        """
+        if timestamp is None:
+            timestamp = time.time_ns()
+        header = RECORD_HEADER.pack(timestamp, origin.value, port, len(data))
+        with self._lock:
+            if not self._blocks:
+                self._file.write(header + data)
+                return
+            if self._closed:
+                return
+            size = len(header) + len(data)
+            if self._pending and len(self._pending) + size > BLOCK_SIZE:
+                self._cut_block()
+            if not self._pending:
+                self._first_timestamp = timestamp
+                self._pending_since = time.monotonic()
+            self._pending += header
+            self._pending += data
+            self._pending_records += 1
+            if len(self._pending) >= BLOCK_SIZE:
+                self._cut_block()
+
+    def _cut_block(self):
+        # Called with the lock held
+        self._queue.put((self._first_timestamp, self._pending_records,
+                         bytes(self._pending)))
+        self._pending = bytearray()
+        self._pending_records = 0
+
+    def _write_blocks(self):
+        while True:
+            try:
+                block = self._queue.get(timeout=BLOCK_AGE / 2)
+            except queue.Empty:
+                with self._lock:
+                    if (self._pending and time.monotonic() -
+                            self._pending_since >= BLOCK_AGE):
+                        self._cut_block()
+                continue
+            if block is None:
+                return
+            timestamp, records, raw = block
+            stored = self._codec.compress(raw) if self._codec else None
+            codec = CODEC_LZ if stored is not None else CODEC_STORED
+            if stored is None:
+                stored = raw
+            self._file.write(BLOCK_HEADER.pack(codec, len(stored), len(raw),
+                                               records, timestamp) + stored)
+            self._index.append((self._offset, timestamp))
+            self._offset += BLOCK_HEADER.size + len(stored)
+
+    def close(self):
+        if self._blocks:
+            with self._lock:
+                if self._closed:
+                    return
+                self._closed = True
+                if self._pending:
+                    self._cut_block()
+                self._queue.put(None)
+            self._thread.join()
+            index = b''.join(INDEX_ENTRY.pack(offset, timestamp)
+                             for offset, timestamp in self._index)
+            self._file.write(index + INDEX_FOOTER.pack(
+                self._offset, len(self._index), INDEX_MAGIC))
+        with self._lock:
+            self._file.close()
+
+
+def read_index(file: BinaryIO) -> List[Tuple[int, int]]:
+    """List the blocks of a block capture.
+
+    Args:
+        file (BinaryIO): block capture opened in binary mode
+
+    Returns:
+        List[Tuple[int, int]]: file offset and first timestamp of each block,
+            from the index or, when the capture has none, its block headers
+    """
+    file.seek(0, os.SEEK_END)
+    size = file.tell()
+    if size >= len(BLOCK_MAGIC) + INDEX_FOOTER.size:
+        file.seek(size - INDEX_FOOTER.size)
+        start, count, magic = INDEX_FOOTER.unpack(file.read(INDEX_FOOTER.size))
+        if (magic == INDEX_MAGIC and start + count * INDEX_ENTRY.size ==
+                size - INDEX_FOOTER.size):
+            file.seek(start)
+            data = file.read(count * INDEX_ENTRY.size)
+            return [INDEX_ENTRY.unpack_from(data, i * INDEX_ENTRY.size)
+                    for i in range(count)]
+    blocks = []
+    offset = len(BLOCK_MAGIC)
+    while offset + BLOCK_HEADER.size <= size:
+        file.seek(offset)
+        _, stored, _, _, timestamp = BLOCK_HEADER.unpack(
+            file.read(BLOCK_HEADER.size))
+        if offset + BLOCK_HEADER.size + stored > size:
+            break
+        blocks.append((offset, timestamp))
+        offset += BLOCK_HEADER.size + stored
+    return blocks
+
+
+def _read_blocks(file: BinaryIO, since: Optional[int]) -> Iterator[Record]:
+    blocks = read_index(file)
+    first = 0
+    if since is not None:
+        # The last block that starts no later than the wanted time
+        while first + 1 < len(blocks) and blocks[first + 1][1] <= since:
+            first += 1
+    for offset, _ in blocks[first:]:
+        file.seek(offset)
+        codec, stored, raw, _, _ = BLOCK_HEADER.unpack(
+            file.read(BLOCK_HEADER.size))
+        data = file.read(stored)
+        if codec == CODEC_LZ:
+            codec_library = get_codec()
+            if codec_library is None:
+                raise ValueError(f'Compressed captures need {LZ_LIBRARY}')
+            data = codec_library.decompress(data, raw)
+        elif codec != CODEC_STORED:
+            raise ValueError(f'Unknown capture codec {codec}')
+        position = 0
+        while position + RECORD_HEADER.size <= len(data):
+            timestamp, origin, port, length = RECORD_HEADER.unpack_from(
+                data, position)
+            position += RECORD_HEADER.size
+            payload = data[position:position + length]
+            position += length
+            if since is None or timestamp >= since:
+                yield Record(timestamp, helpers.ConnectionType(origin), port,
+                             payload)
+
+
+def read_capture(file: BinaryIO, since: int = None) -> Iterator[Record]:
+    """Iterate over the records of a capture.
+
+    Args:
+        file (BinaryIO): capture opened in binary mode
+        since (int, optional): skip records before this time in ns, which
+            block captures do by seeking to the right block
+
+    Raises:
+        ValueError: file is not a capture
+
+    Yields:
+        Record: records in capture order, a truncated last record is dropped
+    """
+    magic = file.read(len(MAGIC))
+    if magic == BLOCK_MAGIC:
+        yield from _read_blocks(file, since)
+        return
+    if magic != MAGIC:
+        raise ValueError('Not a pwn3 capture')
+    while True:
+        header = file.read(RECORD_HEADER.size)
+        if len(header) < RECORD_HEADER.size:
+            return
+        timestamp, origin, port, length = RECORD_HEADER.unpack(header)
+        payload = file.read(length)
+        if len(payload) < length:
+            return
+        if since is None or timestamp >= since:
+            yield Record(timestamp, helpers.ConnectionType(origin), port,
+                         payload)
@@ -1,7 +1,7 @@
 """Constants and helper functions and classes.
 """
 import re
-from argparse import Action, ArgumentParser
+from argparse import Action, ArgumentParser, ArgumentTypeError
 from enum import Enum
 from queue import Queue
 
@@ -10,6 +10,9 @@ GAME_PORT_RANGE = (port for port in range(3000, 3005))
 BUFSIZE = 4096
 ENCODING = 'utf-8'
 PACKET_QUEUE = Queue(-1)
+# Whether proxied packets are decoded, and whether decoded packets are printed
+PARSE_PACKETS = True
+PRINT_PACKETS = True
 
 
 class ConnectionType(Enum):
@@ -81,4 +84,33 @@ def parser_factory(prog: str) -> ArgumentParser:
     parser.add_argument('-d', '--destination-host', required=True,
                         type=str, action=ValidateHost,
                         help='Host to proxy data to')
+    parser.add_argument('-l', '--listen-host', default='0.0.0.0',
+                        type=str, action=ValidateHost,
+                        help='Address to accept client connections on')
+    parser.add_argument('--no-parse', action='store_true',
+                        help='Forward packets without decoding them')
+    parser.add_argument('-q', '--quiet', action='store_true',
+                        help='Decode packets without printing them')
+    parser.add_argument('-c', '--capture', type=str,
+                        help='Record all proxied traffic to this file')
+    parser.add_argument('--capture-raw', action='store_true',
+                        help='Write the capture as plain records instead of '
+                             'compressed blocks')
+    parser.add_argument('--netem', action='append', type=netem_spec,
+                        metavar='PORTS:DIR:SETTINGS',
+                        help='Emulate a link, e.g. game:both:latency=80,'
+                             'jitter=15,rate=256k,reorder=0.02@40')
+    parser.add_argument('--netem-seed', type=int, default=0,
+                        help='Seed for emulated jitter and reordering')
+    parser.add_argument('-r', '--rules', type=str,
+                        help='Drop, rewrite or add packets by these rules')
     return parser
+
+
+def netem_spec(value: str) -> tuple:
+    # Imported here, netem itself needs ConnectionType from this module
+    import netem
+    try:
+        return netem.parse_spec(value)
+    except ValueError as e:
+        raise ArgumentTypeError(str(e))
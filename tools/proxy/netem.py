@@ -0,0 +1,243 @@
+"""Emulated network conditions for proxied traffic.
+
+Each port and direction can be given its own link:
+
+    latency   one way delay added to every chunk, in ms
+    jitter    uniform +/- spread around the latency, in ms
+    rate      bandwidth cap in bytes per second (k and m suffixes allowed)
+    reorder   P@MS, a chunk is held back MS extra with probability P
+
+The proxy forwards a TCP stream, so bytes are never actually reordered or
+dropped. A held back chunk stalls everything behind it, which is what a
+reordered or retransmitted segment looks like to the game.
+
+Delays are drawn from a generator seeded with the global seed, the port and
+the direction, so the same traffic gets the same delays on every run no
+matter how the proxy threads interleave. Chunks are released by a single
+timer wheel thread rather than a sleeping thread per chunk.
+"""
+import random
+import threading
+import time
+from collections import deque
+from typing import Callable, Dict, List, NamedTuple, Optional, Tuple
+
+import helpers
+
+# Resolution and size of the timer wheel, 4096 ticks of 1 ms cover 4 s per
+# turn, later timers just wait for their round
+TICK = 0.001
+WHEEL_SLOTS = 4096
+DIRECTIONS = {
+    'up': (helpers.ConnectionType.CLIENT,),
+    'down': (helpers.ConnectionType.SERVER,),
+    'both': (helpers.ConnectionType.CLIENT, helpers.ConnectionType.SERVER),
+}
+
+
+class Profile(NamedTuple):
+    latency: float = 0.0
+    jitter: float = 0.0
+    rate: float = 0.0
+    reorder_chance: float = 0.0
+    reorder_delay: float = 0.0
+
+
+class TimerWheel(threading.Thread):
+    """Hashed timer wheel running callbacks on its own thread.
+
+    Timers are bucketed by the tick they are due on. Every tick the thread
+    runs the bucket it lands on, so scheduling and firing are O(1) however
+    many chunks are in flight.
+    """
+    def __init__(self, tick: float = TICK, slots: int = WHEEL_SLOTS):
+        super().__init__(daemon=True, name='netem')
+        self._tick = tick
+        self._slots = [[] for _ in range(slots)]
+        self._start = time.monotonic()
+        # Last tick whose bucket has been run
+        self._current = 0
+        self._pending = 0
+        self._condition = threading.Condition()
+
+    def schedule(self, due: float, callback: Callable[[], None]):
+        """Run callback on the wheel thread once time.monotonic() >= due.
+        """
+        tick = int((due - self._start) / self._tick + 0.999999)
+        with self._condition:
+            if self._pending == 0:
+                # Nothing ran while idle, skip straight to now
+                self._current = max(self._current, self._now() - 1)
+            # Already due, the next bucket run picks it up
+            tick = max(tick, self._current + 1)
+            self._slots[tick % len(self._slots)].append((tick, callback))
+            self._pending += 1
+            self._condition.notify()
+
+    def run(self):
+        while True:
+            with self._condition:
+                while self._pending == 0:
+                    self._condition.wait()
+            delay = self._start + (self._current + 1) * self._tick - \
+                time.monotonic()
+            if delay > 0:
+                time.sleep(delay)
+            due = []
+            with self._condition:
+                now = self._now()
+                while self._current < now:
+                    self._current += 1
+                    slot = self._slots[self._current % len(self._slots)]
+                    later = [timer for timer in slot
+                             if timer[0] > self._current]
+                    due.extend(timer for timer in slot
+                               if timer[0] <= self._current)
+                    slot[:] = later
+                self._pending -= len(due)
+            for _, callback in due:
+                callback()
+
+    def _now(self) -> int:
+        return int((time.monotonic() - self._start) / self._tick)
+
+
+class Link:
+    """One emulated direction of one connection.
+
+    Chunks leave in the order they came in, at the later of their own
+    delivery time and the time the link has finished sending the previous
+    chunk at the capped rate.
+    """
+    def __init__(self, profile: Profile, seed: int, wheel: TimerWheel,
+                 deliver: Callable[[bytes], None]):
+        self._profile = profile
+        self._random = random.Random(seed)
+        self._wheel = wheel
+        self._deliver = deliver
+        self._queue = deque()
+        self._busy_until = 0.0
+        self._lock = threading.Lock()
+        self._drained = threading.Condition(self._lock)
+
+    def send(self, data: bytes):
+        profile = self._profile
+        now = time.monotonic()
+        delay = profile.latency
+        if profile.jitter:
+            delay += self._random.uniform(-profile.jitter, profile.jitter)
+        if profile.reorder_chance and \
+                self._random.random() < profile.reorder_chance:
+            delay += profile.reorder_delay
+        with self._lock:
+            due = max(now + max(delay, 0.0) / 1000, self._busy_until)
+            if profile.rate:
+                due += len(data) / profile.rate
+            self._busy_until = due
+            self._queue.append((due, data))
+        self._wheel.schedule(due, self._release)
+
+    def _release(self):
+        now = time.monotonic()
+        ready = []
+        with self._lock:
+            while self._queue and self._queue[0][0] <= now:
+                ready.append(self._queue.popleft()[1])
+        for data in ready:
+            self._deliver(data)
+        if ready:
+            with self._lock:
+                if not self._queue:
+                    self._drained.notify_all()
+
+    def drain(self, timeout: Optional[float] = None):
+        """Block until everything sent so far has been delivered.
+        """
+        with self._lock:
+            self._drained.wait_for(lambda: not self._queue, timeout)
+
+
+class Emulator:
+    """Profiles for each port and direction plus the wheel they share.
+    """
+    def __init__(self, seed: int = 0):
+        self.seed = seed
+        self._profiles: Dict[Tuple[int, helpers.ConnectionType], Profile] = {}
+        self._wheel = None
+        self._lock = threading.Lock()
+
+    def add(self, ports: List[int], directions: tuple, profile: Profile):
+        for port in ports:
+            for direction in directions:
+                self._profiles[(port, direction)] = profile
+
+    def link(self, port: int, origin: helpers.ConnectionType,
+             deliver: Callable[[bytes], None]) -> Optional[Link]:
+        """Make a link for data received on origin, None if unshaped.
+
+        Every connection gets a fresh link with the same seed, so a
+        reconnect sees the same sequence of delays as the first one.
+        """
+        profile = self._profiles.get((port, origin))
+        if profile is None:
+            return None
+        with self._lock:
+            if self._wheel is None:
+                self._wheel = TimerWheel()
+                self._wheel.start()
+        seed = (self.seed * 65537 + port) * 4 + origin.value
+        return Link(profile, seed, self._wheel, deliver)
+
+    def describe(self) -> List[str]:
+        return [f'{port} {origin.name.lower()}: {profile}'
+                for (port, origin), profile in sorted(
+                    self._profiles.items(),
+                    key=lambda item: (item[0][0], item[0][1].value))]
+
+
+def parse_size(value: str) -> float:
+    scale = {'k': 1e3, 'm': 1e6}.get(value[-1:].lower())
+    return float(value[:-1]) * scale if scale else float(value)
+
+
+def parse_ports(value: str) -> List[int]:
+    if value == 'all':
+        return [helpers.MASTER_PORT] + list(range(3000, 3005))
+    if value == 'game':
+        return list(range(3000, 3005))
+    if value == 'master':
+        return [helpers.MASTER_PORT]
+    ports = []
+    for part in value.split('+'):
+        first, _, last = part.partition('-')
+        ports.extend(range(int(first), int(last or first) + 1))
+    return ports
+
+
+def parse_spec(spec: str) -> Tuple[List[int], tuple, Profile]:
+    """Parse PORTS:DIRECTION:key=value,... as given to --netem.
+
+    PORTS is all, game, master, a port, a range like 3000-3004, or several
+    joined with +. DIRECTION is up (client to server), down or both.
+
+    Raises:
+        ValueError: spec can't be parsed
+    """
+    parts = spec.split(':')
+    if len(parts) != 3 or parts[1] not in DIRECTIONS:
+        raise ValueError(f'Expected PORTS:up|down|both:key=value,... '
+                         f'not {spec}')
+    values = {}
+    for item in parts[2].split(','):
+        key, _, value = item.partition('=')
+        if key == 'reorder':
+            chance, _, delay = value.partition('@')
+            values['reorder_chance'] = float(chance)
+            values['reorder_delay'] = float(delay or 0)
+        elif key == 'rate':
+            values['rate'] = parse_size(value)
+        elif key in ('latency', 'jitter'):
+            values[key] = float(value)
+        else:
+            raise ValueError(f'Unknown link setting {key}')
+    return parse_ports(parts[0]), DIRECTIONS[parts[1]], Profile(**values)
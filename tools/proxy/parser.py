@@ -2,9 +2,11 @@
 """
 import struct
 from functools import wraps
-from typing import Any, Callable, Iterable, Mapping, Tuple
+from typing import Any, Callable, Dict, Iterable, List, Mapping, Optional, \
+    Tuple
 
 import helpers
+from rules import LAYOUTS, Layout, measure_steps
 
 # String to prepend to handler messages to indicate packet origin
 DIRECTION_FORMAT = {
@@ -30,7 +32,7 @@ def format(func: Callable[[bytes], Tuple[bytes, str]]) -> \
         origin = kwargs.pop('origin', helpers.ConnectionType.CLIENT)
         direction = DIRECTION_FORMAT.get(origin, '???')
         data, message = func(*args, **kwargs)
-        if func.__name__ not in NO_PRINT:
+        if helpers.PRINT_PACKETS and func.__name__ not in NO_PRINT:
             print(f'[{direction}] {message}')
         return data
 
@@ -249,7 +251,7 @@ def handle_reload(data: bytes) -> Tuple[bytes, str]:
                                    data[2+weapon_name_length+2+ammo_name_length:2+weapon_name_length+2+ammo_name_length+4])[0]  # noqa: E501
         message = f'Reloaded {weapon_name} with {ammo_count} {ammo_name}'
         rdata = data[2+weapon_name_length+2+ammo_name_length+4:]
-    except UnicodeDecodeError:
+    except (UnicodeDecodeError, struct.error):
         # Empty reload packet is sent when we need to reload
         message = 'Need to reload!'
         rdata = data
@@ -380,9 +382,119 @@ PACKET_HANDLERS = {
 NO_PRINT = {'handle_ack', 'handle_position', 'handle_ps', 'handle_mana'}
 
 
+# Handlers that do more than print, and so run even when nothing is printed
+SIDE_EFFECTS = {'handle_actor_drop', 'handle_loaded_ammo'}
+
+
+# Framing descriptors and field layouts per direction and opcode
+FRAMES: Dict[helpers.ConnectionType, Dict[bytes, Any]] = \
+    {origin: {} for origin in helpers.ConnectionType}
+FIELDS: Dict[helpers.ConnectionType, Dict[bytes, Layout]] = \
+    {origin: {} for origin in helpers.ConnectionType}
+for _opcode, _origin, _fields in LAYOUTS:
+    for _direction in helpers.ConnectionType:
+        if _origin is None or _origin is _direction:
+            FIELDS[_direction][_opcode] = Layout(_fields)
+            FRAMES[_direction][_opcode] = FIELDS[_direction][_opcode].steps
+
+
+class Packet:
+    """A framed packet whose fields are only decoded when first asked for.
+    """
+    __slots__ = ('opcode', 'origin', 'data', 'start', 'end', '_fields')
+
+    def __init__(self, opcode: bytes, origin: helpers.ConnectionType,
+                 data: bytes, start: int, end: int):
+        self.opcode = opcode
+        self.origin = origin
+        self.data = data
+        self.start = start
+        self.end = end
+        self._fields = None
+
+    @property
+    def body(self) -> bytes:
+        return self.data[self.start:self.end]
+
+    @property
+    def fields(self) -> List[Any]:
+        """Numbers as numbers and strings as text, in layout order."""
+        if self._fields is None:
+            self._fields = []
+            spans = FIELDS[self.origin][self.opcode].frame(self.data,
+                                                           self.start)
+            for offset, length, kind in spans[:-1]:
+                if kind == 's':
+                    self._fields.append(self.data[offset + 2:offset + length]
+                                        .decode(helpers.ENCODING, 'replace'))
+                else:
+                    self._fields.append(struct.unpack_from(
+                        '<' + kind, self.data, offset)[0])
+        return self._fields
+
+
+# Callbacks per direction and opcode, see subscribe()
+SUBSCRIBERS: Dict[Tuple[helpers.ConnectionType, bytes],
+                  List[Callable[[Packet], None]]] = {}
+# Opcode to (framing, consumer or None) per direction and print mode
+_DISPATCH: Dict[Tuple[helpers.ConnectionType, bool], Dict[bytes, Tuple]] = {}
+
+
+def subscribe(opcode: bytes, callback: Callable[[Packet], None],
+              origin: Optional[helpers.ConnectionType] = None):
+    """Have a callback decode packets of one opcode as they are parsed.
+
+    Args:
+        opcode (bytes): two byte opcode
+        callback (Callable[[Packet], None]): gets each packet, lazily decoded
+        origin (helpers.ConnectionType, optional): only from this side
+    """
+    for direction in helpers.ConnectionType:
+        if origin is None or origin is direction:
+            SUBSCRIBERS.setdefault((direction, opcode), []).append(callback)
+    _DISPATCH.clear()
+
+
+def _consumer(opcode: bytes, origin: helpers.ConnectionType, printing: bool):
+    handler = PACKET_HANDLERS.get(opcode)
+    if handler is not None and (handler.__name__ in SIDE_EFFECTS or
+                                printing and handler.__name__ not in NO_PRINT):
+        def call_handler(data, start, end, handler=handler):
+            handler(data[start:end], origin=origin)
+    else:
+        call_handler = None
+    callbacks = SUBSCRIBERS.get((origin, opcode))
+    if not callbacks:
+        return call_handler
+
+    def consume(data, start, end):
+        if call_handler is not None:
+            call_handler(data, start, end)
+        packet = Packet(opcode, origin, data, start, end)
+        for callback in callbacks:
+            callback(packet)
+    return consume
+
+
+def dispatch_table(origin: helpers.ConnectionType) -> Dict[bytes, Tuple]:
+    """Framing and consumer of each opcode, the consumer None when nobody
+    wants the packet's fields.
+    """
+    key = (origin, helpers.PRINT_PACKETS)
+    table = _DISPATCH.get(key)
+    if table is None:
+        table = {opcode: (steps, _consumer(opcode, origin, key[1]))
+                 for opcode, steps in FRAMES[origin].items()}
+        _DISPATCH[key] = table
+    return table
+
+
 def parse(data: bytes, port: int, origin: helpers.ConnectionType):
     """Route packet data handlers to parse into readable information.
 
+    Packets are framed by length alone; only those a printing handler,
+    a handler with side effects or a subscriber wants are decoded.
+
     Args:
         data (bytes): packet of raw bytes to parse
         port (int): port that client that sent packet is listening on
@@ -392,20 +504,27 @@ def parse(data: bytes, port: int, origin: helpers.ConnectionType):
     # Ignore packets from master server... game server is more interesting
     if port == helpers.MASTER_PORT:
         return
-    # Iteratively parse packet data until nothing is left to parse
-    reads = 0
-    while len(data) >= 2:
-        reads += 1
-        pid = data[:2]
-        handler = PACKET_HANDLERS.get(pid, None)
-        if handler:
-            # Parse data without packet id prepended
-            # Returned data will be parsed next iteration
-            data = handler(data[2:], origin=origin)
-        else:
+    table = dispatch_table(origin)
+    position = 0
+    size = len(data)
+    while size - position >= 2:
+        opcode = data[position:position + 2]
+        entry = table.get(opcode)
+        if entry is None:
             # This packet doesn't have a handler
             # Print it once for inspection
-            if reads <= 1:
-                print(f'[{pid}] - {data}\n')
-            # Remove the first byte and try parsing again later
-            data = data[1:]
+            if position == 0 and helpers.PRINT_PACKETS:
+                print(f'[{opcode}] - {data}\n')
+            # Remove the first byte and try parsing again
+            position += 1
+            continue
+        steps, consume = entry
+        body = position + 2
+        end = body + steps if steps.__class__ is int else \
+            measure_steps(data, body, steps)
+        if end > size:
+            # The rest is in the next chunk, which starts afresh
+            return
+        if consume is not None:
+            consume(data, body, end)
+        position = end
@@ -2,12 +2,51 @@
 """
 import importlib
 import math
+import os
 import parser
 import socket
 import threading
 import time
 
 import helpers
+import netem
+import rules
+
+# Set by run.py to record everything that passes through
+CAPTURE = None
+# Set by run.py to delay traffic like a slower network would
+NETEM = None
+# Set by run.py to drop, rewrite or add packets
+RULES = None
+# Sends packets the rules delay, started on first use
+TIMERS = None
+TIMERS_LOCK = threading.Lock()
+# parser.py is reloaded when it changes on disk, so handlers can be edited live
+PARSER_MTIME = os.stat(parser.__file__).st_mtime_ns
+PARSER_LOCK = threading.Lock()
+
+
+def get_timers() -> netem.TimerWheel:
+    global TIMERS
+    with TIMERS_LOCK:
+        if TIMERS is None:
+            TIMERS = netem.TimerWheel()
+            TIMERS.start()
+    return TIMERS
+
+
+def reload_parser():
+    global PARSER_MTIME
+    try:
+        mtime = os.stat(parser.__file__).st_mtime_ns
+    except OSError:
+        return
+    if mtime == PARSER_MTIME:
+        return
+    with PARSER_LOCK:
+        if mtime != PARSER_MTIME:
+            importlib.reload(parser)
+            PARSER_MTIME = mtime
 
 
 class ProxyConnection(threading.Thread):
@@ -31,6 +70,12 @@ class ProxyConnection(threading.Thread):
         self._sock = None
         self._conn_type = conn_type
         self._dest_conn = None
+        self._link = None
+        self._rules = None
+        # Everything headed to the destination goes out under this, so our
+        # own packets never land inside one of the stream's
+        self._send_lock = threading.Lock()
+        self._injected = []
         self.host = host
         self.port = port
         self.name = f'{self.port}'
@@ -145,6 +190,43 @@ class ProxyConnection(threading.Thread):
     def send(self, data: bytes):
         """Send a buffer of data to the destination connection.
 
+        With network emulation on, the data is sent once its link lets it.
+
+        Args:
+            data (bytes): payload to proxy to destination
+        """
+        if self._link is not None:
+            self._link.send(data)
+        else:
+            self._forward(data)
+
+    def inject(self, packet: bytes):
+        """Send a packet of our own to the destination between two of the
+        stream's packets.
+
+        It is held while the stream's framing is lost and goes out once the
+        stream gets back to a packet boundary.
+
+        Args:
+            packet (bytes): whole packet to add to the stream
+        """
+        with self._send_lock:
+            self._injected.append(packet)
+            self._send_injected()
+
+    def _send_injected(self):
+        """Send held packets if the stream is between packets. Called with
+        the send lock held.
+        """
+        if self._rules is not None and not self._rules.at_boundary:
+            return
+        for packet in self._injected:
+            self.send(packet)
+        self._injected = []
+
+    def _forward(self, data: bytes):
+        """Send a buffer of data to the destination connection right away.
+
         Args:
             data (bytes): payload to proxy to destination
         """
@@ -167,31 +249,72 @@ class ProxyConnection(threading.Thread):
         """
         return self._sock.recv(helpers.BUFSIZE)
 
+    def apply_rules(self, data: bytes) -> bytes:
+        """Run received data through the packet rules.
+
+        Delayed packets are scheduled from here. Called with the send lock
+        held, so replies are left to the caller.
+
+        Args:
+            data (bytes): buffer received by connection
+
+        Returns:
+            Result: what is left to proxy to destination and the replies
+        """
+        result = self._rules.feed(data) if data else \
+            rules.Result(self._rules.flush(), [], [])
+        for delay, packet in result.delayed:
+            get_timers().schedule(time.monotonic() + delay,
+                                  lambda packet=packet: self.inject(packet))
+        return result
+
     def run(self):
         """Main run loop for connection.
         """
         # Open up connection
         self.open()
+        if NETEM is not None:
+            self._link = NETEM.link(self.port, self.conn_type, self._forward)
+        if RULES is not None:
+            self._rules = RULES.stream(self.port, self.conn_type)
         while self.is_running():
             data = self.receive()
-            self.send(data)
+            forward = data
+            replies = []
+            with self._send_lock:
+                if self._rules is not None:
+                    result = self.apply_rules(data)
+                    forward, replies = result.data, result.replies
+                if forward or not data:
+                    self.send(forward)
+                if data:
+                    self._send_injected()
+            # The other side's destination is where this data came from. Its
+            # lock is taken only after ours is released, so they never cross.
+            for reply in replies:
+                self.dest_conn.inject(reply)
             if data == b'':
-                # Source wants to close... stop the connection
+                # Source wants to close... let delayed data out first
+                if self._link is not None:
+                    self._link.drain()
                 self.stop()
             else:
+                if CAPTURE is not None:
+                    CAPTURE.write(self.conn_type, self.port, data)
                 # Try to parse the payload
-                try:
-                    importlib.reload(parser)
-                    parser.parse(data, self.port, self.conn_type)
-                except Exception as e:
-                    print('Failed parse data', f'Reason: {e}', f'Data: {data}',
-                          sep='\n\t')
+                if helpers.PARSE_PACKETS:
+                    try:
+                        reload_parser()
+                        parser.parse(data, self.port, self.conn_type)
+                    except Exception as e:
+                        print('Failed parse data', f'Reason: {e}',
+                              f'Data: {data}', sep='\n\t')
             # Send data from server packet
             # TODO: consider sending async, since these are injected packets
             if self.conn_type == helpers.ConnectionType.CLIENT:
                 try:
                     packet = helpers.PACKET_QUEUE.get_nowait()
-                    self.send(packet)
+                    self.inject(packet)
                     helpers.PACKET_QUEUE.task_done()
                 except Exception:
                     # TODO: catch empty exception from get_nowait()
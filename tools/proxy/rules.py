@@ -0,0 +1,477 @@
+"""Declarative packet rules, in the same format the hook library loads.
+
+One rule per line:
+
+    up|down OPCODE [if $N OP VALUE [and ...]] then ACTION
+
+OPCODE is two characters or 0x and four hex digits in wire order, $N is the
+N-th field of the packet's layout and OP is one of == != < <= > >= or ~
+(contains, for strings). ACTION is one of:
+
+    drop                remove the packet
+    dup                 send it twice
+    set $N VALUE        overwrite a numeric field
+    delay MS            send it MS later
+    inject PAYLOAD      add bytes after it
+    reply PAYLOAD       send bytes back to whoever sent it
+
+PAYLOAD is hex bytes and $N fields copied as they are on the wire. Lines
+starting with # are comments.
+
+Each rule is compiled into closures for its predicates and action, and rules
+are kept per direction and opcode, so a packet without rules costs a dict
+lookup and a length walk.
+"""
+import operator
+import struct
+from typing import Callable, Dict, List, NamedTuple, Optional, Tuple
+
+import helpers
+
+# Body of each known packet after its two byte opcode, as handled in
+# parser.py: B u8, ? bool, H u16, h i16, I u32, i i32, f float, s u16 length
+# and text, xN N unknown bytes. Direction None means both.
+LAYOUTS = [
+    (b'\x00\x00', None, ''),
+    (b'mv', None, 'fffx8'),
+    (b'jp', None, '?'),
+    (b'rn', None, '?'),
+    (b's=', None, 'B'),
+    (b'*i', None, 'sfff'),
+    (b'#*', None, 's'),
+    (b'mk', None, 'IIBsfff'),
+    (b'ch', None, 's'),
+    (b'cp', None, 'sI'),
+    (b'ee', None, 'I'),
+    # Asking for a reload is empty, the answer names weapon and ammo
+    (b'rl', helpers.ConnectionType.CLIENT, ''),
+    (b'rl', helpers.ConnectionType.SERVER, 'ssI'),
+    (b'++', None, 'Ih'),
+    (b'ma', None, 'H'),
+    (b'ps', None, 'x28'),
+    (b'st', None, 'Is'),
+    (b'tr', None, 'IsI'),
+    (b'la', None, 'sI'),
+]
+DIRECTIONS = {
+    'up': helpers.ConnectionType.CLIENT,
+    'down': helpers.ConnectionType.SERVER,
+}
+NUMBER_OPERATORS = {
+    '==': operator.eq, '!=': operator.ne, '<': operator.lt,
+    '<=': operator.le, '>': operator.gt, '>=': operator.ge,
+}
+TEXT_OPERATORS = {
+    '==': operator.eq, '!=': operator.ne,
+    '~': lambda text, value: value in text,
+}
+
+
+def measure_steps(data: bytes, position: int, steps: tuple) -> int:
+    """Walk Layout.steps from position, see Layout.measure."""
+    for step in steps:
+        if step is None:
+            if position + 2 > len(data):
+                return len(data) + 1
+            position += 2 + (data[position] | data[position + 1] << 8)
+        else:
+            position += step
+    return position
+
+
+class Layout:
+    """Field structs of a packet body, in the order they appear.
+    """
+    def __init__(self, fields: str):
+        # (struct or None for strings, skip before it)
+        self.fields = []
+        skip = 0
+        index = 0
+        while index < len(fields):
+            kind = fields[index]
+            index += 1
+            if kind == 'x':
+                digits = ''
+                while index < len(fields) and fields[index].isdigit():
+                    digits += fields[index]
+                    index += 1
+                skip += int(digits)
+                continue
+            self.fields.append((kind, None if kind == 's'
+                                else struct.Struct('<' + kind), skip))
+            skip = 0
+        self.trailer = skip
+        self.steps = self._compile_steps()
+
+    def _compile_steps(self):
+        """What it takes to find the end of a body: its size when that is
+        fixed, otherwise fixed runs with None for each string.
+        """
+        steps = []
+        run = 0
+        for _, codec, skip in self.fields:
+            run += skip
+            if codec is None:
+                steps += [run, None] if run else [None]
+                run = 0
+            else:
+                run += codec.size
+        run += self.trailer
+        if not steps:
+            return run
+        if run:
+            steps.append(run)
+        return tuple(steps)
+
+    def measure(self, data: bytes, start: int) -> int:
+        """End of the body starting at start without decoding any field,
+        past the end of data when the body isn't all there.
+        """
+        if self.steps.__class__ is int:
+            return start + self.steps
+        return measure_steps(data, start, self.steps)
+
+    def frame(self, data: bytes, start: int) -> Optional[List[Tuple]]:
+        """Find the fields of the body starting at start.
+
+        Returns:
+            Optional[List[Tuple]]: (offset, length, kind) per field and the
+                body's end last, None when the body isn't all there
+        """
+        offset = start
+        spans = []
+        for kind, codec, skip in self.fields:
+            offset += skip
+            if codec is None:
+                if offset + 2 > len(data):
+                    return None
+                length = 2 + int.from_bytes(data[offset:offset + 2],
+                                            'little')
+            else:
+                length = codec.size
+            spans.append((offset, length, kind))
+            offset += length
+        offset += self.trailer
+        if offset > len(data):
+            return None
+        spans.append(offset)
+        return spans
+
+
+class Packet(NamedTuple):
+    data: bytearray
+    spans: list
+
+
+class Rule(NamedTuple):
+    line: int
+    opcode: bytes
+    origin: helpers.ConnectionType
+    predicates: List[Callable[[Packet], bool]]
+    action: str
+    apply: Callable[[Packet], bytes]
+    delay: float
+
+
+def parse_opcode(token: str) -> bytes:
+    if token.startswith('0x') and len(token) == 6:
+        return bytes.fromhex(token[2:])
+    if len(token) == 2:
+        return token.encode(helpers.ENCODING)
+    raise ValueError(f'Expected an opcode, not {token}')
+
+
+def tokenize(line: str) -> List[str]:
+    """Split on whitespace, keeping "quoted strings" together.
+    """
+    tokens = []
+    index = 0
+    while index < len(line):
+        if line[index].isspace():
+            index += 1
+        elif line[index] == '"':
+            end = line.find('"', index + 1)
+            end = len(line) if end < 0 else end
+            tokens.append(line[index + 1:end])
+            index = end + 1
+        else:
+            end = index
+            while end < len(line) and not line[end].isspace():
+                end += 1
+            tokens.append(line[index:end])
+            index = end
+    return tokens
+
+
+def field_index(token: str, layout: Layout) -> int:
+    if not token.startswith('$') or not token[1:].isdigit() or \
+            int(token[1:]) >= len(layout.fields):
+        raise ValueError(f'No field {token} in this packet')
+    return int(token[1:])
+
+
+def compile_predicate(field: int, kind: str, operation: str,
+                      value: str) -> Callable[[Packet], bool]:
+    """Bind field, operator and value into one closure.
+    """
+    if kind == 's':
+        compare = TEXT_OPERATORS.get(operation)
+        expected = value.encode(helpers.ENCODING)
+
+        def test(packet: Packet) -> bool:
+            offset, length, _ = packet.spans[field]
+            return compare(bytes(packet.data[offset + 2:offset + length]),
+                           expected)
+    else:
+        compare = NUMBER_OPERATORS.get(operation)
+        codec = struct.Struct('<' + kind)
+        expected = float(value)
+
+        def test(packet: Packet) -> bool:
+            offset = packet.spans[field][0]
+            return compare(codec.unpack_from(packet.data, offset)[0],
+                           expected)
+    if compare is None:
+        raise ValueError(f'{operation} does not apply to that field')
+    return test
+
+
+def compile_payload(tokens: List[str],
+                    layout: Layout) -> Callable[[Packet], bytes]:
+    parts = []
+    for token in tokens:
+        if token.startswith('$'):
+            parts.append(field_index(token, layout))
+        else:
+            parts.append(bytes.fromhex(token))
+    if not parts:
+        raise ValueError('Expected a payload')
+
+    def build(packet: Packet) -> bytes:
+        out = b''
+        for part in parts:
+            if isinstance(part, int):
+                offset, length, _ = packet.spans[part]
+                out += packet.data[offset:offset + length]
+            else:
+                out += part
+        return out
+    return build
+
+
+def parse_rule(line: str, number: int,
+               layouts: Dict[Tuple, Layout]) -> Rule:
+    """Compile one line.
+
+    Raises:
+        ValueError: line isn't a valid rule
+    """
+    tokens = tokenize(line)
+    if len(tokens) < 4 or tokens[0] not in DIRECTIONS:
+        raise ValueError('Expected up or down')
+    origin = DIRECTIONS[tokens[0]]
+    opcode = parse_opcode(tokens[1])
+    layout = layouts.get((origin, opcode))
+    if layout is None:
+        raise ValueError('No layout for that opcode')
+    predicates = []
+    index = 2
+    if tokens[index] == 'if':
+        while True:
+            if index + 4 > len(tokens):
+                raise ValueError('Expected $N OP VALUE')
+            field = field_index(tokens[index + 1], layout)
+            predicates.append(compile_predicate(
+                field, layout.fields[field][0], tokens[index + 2],
+                tokens[index + 3]))
+            index += 4
+            if index >= len(tokens) or tokens[index] != 'and':
+                break
+    if index + 1 >= len(tokens) or tokens[index] != 'then':
+        raise ValueError('Expected then ACTION')
+    action, arguments = tokens[index + 1], tokens[index + 2:]
+    apply = None
+    delay = 0.0
+    if action in ('drop', 'dup'):
+        if arguments:
+            raise ValueError('Trailing words')
+    elif action == 'set' and len(arguments) == 2:
+        field = field_index(arguments[0], layout)
+        kind = layout.fields[field][0]
+        if kind == 's':
+            raise ValueError('Only numeric fields can be set')
+        codec = struct.Struct('<' + kind)
+        value = float(arguments[1])
+        value = value if kind == 'f' else int(value)
+
+        def apply(packet: Packet) -> bytes:
+            codec.pack_into(packet.data, packet.spans[field][0], value)
+            return b''
+    elif action == 'delay' and len(arguments) == 1:
+        delay = float(arguments[0]) / 1000
+    elif action in ('inject', 'reply'):
+        apply = compile_payload(arguments, layout)
+    else:
+        raise ValueError(f'Bad action {" ".join(tokens[index + 1:])}')
+    return Rule(number, opcode, origin, predicates, action, apply, delay)
+
+
+class Result(NamedTuple):
+    data: bytes
+    delayed: List[Tuple[float, bytes]]
+    replies: List[bytes]
+
+
+class RuleSet:
+    """Rules from one file, grouped by direction and opcode.
+    """
+    def __init__(self, path: str):
+        self.path = path
+        self.layouts = {}
+        for opcode, origin, fields in LAYOUTS:
+            for direction in DIRECTIONS.values():
+                if origin is None or origin is direction:
+                    self.layouts[(direction, opcode)] = Layout(fields)
+        self.rules: Dict[helpers.ConnectionType, Dict[bytes, List[Rule]]] = \
+            {direction: {} for direction in DIRECTIONS.values()}
+        self.hits: Dict[int, int] = {}
+        errors = []
+        with open(path) as file:
+            for number, line in enumerate(file, 1):
+                if not line.strip() or line.lstrip().startswith('#'):
+                    continue
+                try:
+                    rule = parse_rule(line, number, self.layouts)
+                except ValueError as e:
+                    errors.append(f'{path}:{number}: {e}')
+                    continue
+                self.rules[rule.origin].setdefault(rule.opcode, []) \
+                    .append(rule)
+                self.hits[number] = 0
+        if errors:
+            raise ValueError('\n'.join(errors))
+
+    def __len__(self) -> int:
+        return len(self.hits)
+
+    def stream(self, port: int,
+               origin: helpers.ConnectionType) -> Optional['RuleStream']:
+        """Framing state for one direction of one connection.
+
+        Directions without rules get one too, so packets can be put in
+        between theirs at any time.
+
+        Returns:
+            Optional[RuleStream]: None for the master server, which is TLS
+        """
+        if port == helpers.MASTER_PORT:
+            return None
+        return RuleStream(self, origin)
+
+
+class RuleStream:
+    """Applies a rule set to the chunks of one direction of a connection.
+
+    A packet split across chunks is held back until the rest arrives, so
+    every rule sees whole packets and what comes out ends on a packet
+    boundary. An opcode without a layout loses the framing: chunks then go
+    through as they are until one is made of whole packets from start to end.
+    """
+    def __init__(self, rule_set: RuleSet, origin: helpers.ConnectionType):
+        self._rules = rule_set.rules[origin]
+        self._layouts = {opcode: layout for (direction, opcode), layout
+                         in rule_set.layouts.items() if direction is origin}
+        self._hits = rule_set.hits
+        self._held = b''
+        self._lost = False
+
+    @property
+    def at_boundary(self) -> bool:
+        """Whether everything fed so far came out ending between packets.
+        """
+        return not self._lost
+
+    def _frames_exactly(self, data: bytes) -> bool:
+        position = 0
+        while position < len(data):
+            layout = self._layouts.get(data[position:position + 2])
+            if layout is None:
+                return False
+            position = layout.measure(data, position + 2)
+        return position == len(data)
+
+    def feed(self, data: bytes) -> Result:
+        if self._lost:
+            if not self._frames_exactly(data):
+                return Result(data, [], [])
+            self._lost = False
+        data = self._held + data
+        self._held = b''
+        out = bytearray()
+        delayed = []
+        replies = []
+        position = 0
+        while position < len(data):
+            if position + 2 > len(data):
+                self._held = data[position:]
+                position = len(data)
+                break
+            opcode = data[position:position + 2]
+            layout = self._layouts.get(opcode)
+            if layout is None:
+                # Can't tell where it ends, so nothing after it can be framed
+                self._lost = True
+                break
+            rules = self._rules.get(opcode)
+            if rules is None:
+                # Packets no rule is about are only measured
+                end = layout.measure(data, position + 2)
+                if end > len(data):
+                    self._held = data[position:]
+                    position = len(data)
+                    break
+                out += data[position:end]
+                position = end
+                continue
+            spans = layout.frame(data, position + 2)
+            if spans is None:
+                self._held = data[position:]
+                position = len(data)
+                break
+            end = spans[-1]
+            packet = Packet(bytearray(data[position:end]),
+                            [(offset - position, length, kind)
+                             for offset, length, kind in spans[:-1]])
+            position = end
+            keep = True
+            extra = b''
+            for rule in rules:
+                if not all(test(packet) for test in rule.predicates):
+                    continue
+                self._hits[rule.line] += 1
+                if rule.action == 'drop':
+                    keep = False
+                elif rule.action == 'set':
+                    rule.apply(packet)
+                elif rule.action == 'dup':
+                    extra += packet.data
+                elif rule.action == 'delay':
+                    delayed.append((rule.delay, bytes(packet.data)))
+                    keep = False
+                elif rule.action == 'inject':
+                    extra += rule.apply(packet)
+                elif rule.action == 'reply':
+                    replies.append(rule.apply(packet))
+                if not keep:
+                    break
+            if keep:
+                out += packet.data
+            out += extra
+        out += data[position:]
+        return Result(bytes(out), delayed, replies)
+
+    def flush(self) -> bytes:
+        """Whatever is held back, for when the connection closes.
+        """
+        held, self._held = self._held, b''
+        return held
@@ -1,18 +1,42 @@
 """Entry point to run proxy server
 """
+import sys
+
 import helpers
+import netem
+import proxy
+import rules
+from capture import CaptureWriter
 from proxy import ProxyServer
 
 if __name__ == '__main__':
     args = helpers.parser_factory(__file__).parse_args()
     proxies = []
+    helpers.PARSE_PACKETS = not args.no_parse
+    helpers.PRINT_PACKETS = not args.quiet
+    if args.capture:
+        proxy.CAPTURE = CaptureWriter(args.capture,
+                                       blocks=not args.capture_raw)
+    if args.netem:
+        proxy.NETEM = netem.Emulator(args.netem_seed)
+        for ports, directions, profile in args.netem:
+            proxy.NETEM.add(ports, directions, profile)
+        for line in proxy.NETEM.describe():
+            print(f'Emulating {line}')
+    if args.rules:
+        try:
+            proxy.RULES = rules.RuleSet(args.rules)
+        except (OSError, ValueError) as e:
+            sys.exit(f'Bad rules: {e}')
+        print(f'Loaded {len(proxy.RULES)} rules from {args.rules}')
 
     # Set up proxy for master server
-    master_proxy = ProxyServer('0.0.0.0', args.destination_host,
+    master_proxy = ProxyServer(args.listen_host, args.destination_host,
                                helpers.MASTER_PORT)
     master_proxy.start()
 
     # Set up proxy for each possible game server instance
     for port in helpers.GAME_PORT_RANGE:
-        game_proxy = ProxyServer('0.0.0.0', args.destination_host, port)
+        game_proxy = ProxyServer(args.listen_host, args.destination_host,
+                                 port)
         game_proxy.start()
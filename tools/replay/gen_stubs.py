@@ -0,0 +1,55 @@
+"""Generate default definitions for every member function declared in pwn3.h.
+
+The stub game library needs a definition for each virtual function so that
+its vtables match the real library's, and for everything else pwn3.so or the
+replay driver might call. Functions defined by hand in the given sources are
+skipped, along with all their overloads. Generated functions that are not
+plain getters log their call and arguments through StubCall().
+"""
+import os
+import re
+import sys
+from typing import List, Set
+
+sys.path.insert(0, os.path.join(os.path.dirname(os.path.abspath(__file__)),
+                                '..', 'hackedLib'))
+from pwn3decl import declarations, hand_written, split_parameters  # noqa: E402
+
+# Calls to these are queries and are left out of the output log
+GETTER_PREFIXES = ('Get', 'Is', 'Can', 'Has', 'Should')
+
+
+def generate(header: str, skip: Set[str]) -> str:
+    lines = ['// Generated by gen_stubs.py, do not edit', '#include "game.h"',
+             '']
+    for owner, match in declarations(header):
+        lines.extend(define(owner, match, skip))
+    return '\n'.join(lines) + '\n'
+
+
+def define(owner: str, match: re.Match, skip: Set[str]) -> List[str]:
+    _, _, result, name, parameters, const = match.groups()
+    qualified = f'{owner}::{name}'
+    if qualified in skip:
+        return []
+    result = result.replace('enum ', '').strip()
+    types = [parameter.replace('enum ', '')
+             for parameter in split_parameters(parameters)]
+    arguments = ', '.join(f'{kind} a{i}' for i, kind in enumerate(types))
+    signature = f'{qualified}({arguments})' + (' const' if const else '')
+
+    if name in (owner, f'~{owner}'):
+        return [f'{signature} {{', '}', '', '']
+    body = []
+    if not name.startswith(GETTER_PREFIXES):
+        values = ''.join(f', a{i}' for i in range(len(types)))
+        body.append(f'    StubCall("{qualified}"{values});')
+    if result != 'void':
+        body.append(f'    return StubValue<{result}>::Get();')
+    return [f'{result} {signature} {{'] + body + ['}', '', '']
+
+
+if __name__ == '__main__':
+    if len(sys.argv) < 2:
+        sys.exit(f'usage: {sys.argv[0]} pwn3.h [hand-written sources...]')
+    sys.stdout.write(generate(sys.argv[1], hand_written(sys.argv[2:])))
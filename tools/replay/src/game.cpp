@@ -0,0 +1,490 @@
+#include <cmath>
+#include <cstring>
+#include <dlfcn.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <unordered_set>
+#include "game.h"
+#include "sockets.h"
+
+// Everything here does what the real game library does with the state the
+// hooks and the replay driver look at. The rest is generated by gen_stubs.py.
+// Calls the hooks forward are logged too, so a hook that stops forwarding
+// shows up as a behaviour change, and so are the packets they send.
+
+ClientWorld* GameWorld = NULL;
+
+FILE* STUB_LOG = NULL;
+uint64_t STUB_FRAME = 0;
+std::unordered_set<std::string> STUB_STRINGS;
+int STUB_CONNECTION = -1;
+
+
+void SetStubLog(FILE* log) {
+    STUB_LOG = log;
+}
+
+
+void SetStubFrame(uint64_t frame) {
+    STUB_FRAME = frame;
+}
+
+
+bool IsStubLogging() {
+    return STUB_LOG != NULL;
+}
+
+
+void StubLogLine(const std::string& line) {
+    fprintf(STUB_LOG, "%lu %s\n", (unsigned long)STUB_FRAME, line.c_str());
+}
+
+
+int OpenStubConnection() {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    STUB_CONNECTION = fd;
+    struct sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_port = htons(GAME_SERVER_FIRST_PORT);
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    // Goes through the hooks first, so they start tracking it
+    if (connect(fd, (struct sockaddr*)&address, sizeof(address)) != 0) {
+        CloseStubConnection();
+        return -1;
+    }
+    return fd;
+}
+
+
+void CloseStubConnection() {
+    if (STUB_CONNECTION >= 0) {
+        close(STUB_CONNECTION);
+        STUB_CONNECTION = -1;
+    }
+}
+
+
+// What the hooks find as the real connect() and send(), libc's for anything
+// but the stub connection
+extern "C" int connect(int fd, const struct sockaddr* address, socklen_t length) {
+    static auto real = (int (*)(int, const struct sockaddr*, socklen_t))dlsym(RTLD_NEXT, "connect");
+    return fd == STUB_CONNECTION ? 0 : real(fd, address, length);
+}
+
+
+extern "C" ssize_t send(int fd, const void* buffer, size_t length, int flags) {
+    static auto real = (ssize_t (*)(int, const void*, size_t, int))dlsym(RTLD_NEXT, "send");
+    if (fd != STUB_CONNECTION) {
+        return real(fd, buffer, length, flags);
+    }
+    static const char DIGITS[] = "0123456789abcdef";
+    std::string bytes;
+    for (size_t i = 0; i < length; i++) {
+        uint8_t byte = ((const uint8_t*)buffer)[i];
+        bytes += DIGITS[byte >> 4];
+        bytes += DIGITS[byte & 15];
+    }
+    StubCall("send", bytes);
+    return length;
+}
+
+
+const char* StubString(const std::string& text) {
+    return STUB_STRINGS.insert(text).first->c_str();
+}
+
+
+void FormatStubArgument(std::string& line, const char* text) {
+    line += text == NULL ? " null" : " \"" + std::string(text) + "\"";
+}
+
+
+void FormatStubArgument(std::string& line, const std::string& text) {
+    line += " \"" + text + "\"";
+}
+
+
+void FormatStubArgument(std::string& line, const Vector3& vector) {
+    char text[64];
+    snprintf(text, sizeof(text), " (%.3f %.3f %.3f)", vector.x, vector.y, vector.z);
+    line += text;
+}
+
+
+void FormatStubArgument(std::string& line, const Rotation& rotation) {
+    char text[64];
+    snprintf(text, sizeof(text), " (%.3f %.3f %.3f)", rotation.pitch, rotation.yaw, rotation.roll);
+    line += text;
+}
+
+
+void FormatStubArgument(std::string& line, IActor* actor) {
+    if (actor == NULL) {
+        line += " null";
+        return;
+    }
+    line += " actor:" + std::to_string(((Actor*)actor)->GetId());
+}
+
+
+void FormatStubArgument(std::string& line, IPlayer* player) {
+    FormatStubArgument(line, player == NULL ? NULL : player->GetActorInterface());
+}
+
+
+void FormatStubArgument(std::string& line, IItem* item) {
+    if (item == NULL) {
+        line += " null";
+        return;
+    }
+    line += " item:";
+    line += item->GetName();
+}
+
+
+void FormatStubArgument(std::string& line, long long value) {
+    line += " " + std::to_string(value);
+}
+
+
+void FormatStubArgument(std::string& line, double value) {
+    char text[32];
+    snprintf(text, sizeof(text), " %.4g", value);
+    line += text;
+}
+
+
+Vector3::Vector3() : x(0), y(0), z(0) {
+}
+
+
+Vector3::Vector3(float x, float y, float z) : x(x), y(y), z(z) {
+}
+
+
+float Vector3::MagnitudeSquared() const {
+    return x * x + y * y + z * z;
+}
+
+
+float Vector3::Magnitude() const {
+    return sqrtf(MagnitudeSquared());
+}
+
+
+float Vector3::DistanceSquared(const Vector3& a, const Vector3& b) {
+    float dx = a.x - b.x, dy = a.y - b.y, dz = a.z - b.z;
+    return dx * dx + dy * dy + dz * dz;
+}
+
+
+float Vector3::Distance(const Vector3& a, const Vector3& b) {
+    return sqrtf(DistanceSquared(a, b));
+}
+
+
+void Vector3::Normalize() {
+    float magnitude = Magnitude();
+    if (magnitude > 0) {
+        x /= magnitude;
+        y /= magnitude;
+        z /= magnitude;
+    }
+}
+
+
+Vector3 Vector3::Normalize(const Vector3& vector) {
+    Vector3 result = vector;
+    result.Normalize();
+    return result;
+}
+
+
+Rotation::Rotation() : pitch(0), yaw(0), roll(0) {
+}
+
+
+Rotation::Rotation(float pitch, float yaw, float roll) : pitch(pitch), yaw(yaw), roll(roll) {
+}
+
+
+// The real references are counted, the stub world owns its actors outright
+template <class T>
+ActorRef<T>::ActorRef() : m_object(NULL) {
+}
+
+
+template <class T>
+ActorRef<T>::ActorRef(T* object) : m_object(object) {
+}
+
+
+template <class T>
+ActorRef<T>::ActorRef(const ActorRef<T>& other) : m_object(other.m_object) {
+}
+
+
+template <class T>
+ActorRef<T>& ActorRef<T>::operator=(T* object) {
+    m_object = object;
+    return *this;
+}
+
+
+template <class T>
+ActorRef<T>& ActorRef<T>::operator=(const ActorRef<T>& other) {
+    m_object = other.m_object;
+    return *this;
+}
+
+
+template <class T>
+T* ActorRef<T>::operator->() const {
+    return m_object;
+}
+
+
+template <class T>
+ActorRef<T>::operator T*() const {
+    return m_object;
+}
+
+
+template <class T>
+T* ActorRef<T>::Get() const {
+    return m_object;
+}
+
+
+template <class T>
+bool ActorRef<T>::operator<(const ActorRef<T>& other) const {
+    return m_object < other.m_object;
+}
+
+
+template class ActorRef<IActor>;
+template class ActorRef<IPlayer>;
+template class ActorRef<Actor>;
+template class ActorRef<NPC>;
+
+
+Actor::Actor(const std::string& blueprint) : m_refs(0), m_id(0), m_target(NULL), m_timers(NULL),
+        m_blueprintName(StubString(blueprint)), m_health(100), m_forwardMovementFraction(0),
+        m_strafeMovementFraction(0), m_remoteLocationBlendFactor(0), m_spawner(NULL) {
+}
+
+
+uint32_t Actor::GetId() const {
+    return m_id;
+}
+
+
+void Actor::SetId(uint32_t id) {
+    m_id = id;
+}
+
+
+const char* Actor::GetBlueprintName() {
+    return m_blueprintName;
+}
+
+
+Vector3 Actor::GetPosition() {
+    return m_remotePosition;
+}
+
+
+void Actor::SetPosition(const Vector3& position) {
+    StubCall("Actor::SetPosition", this, position);
+    m_remotePosition = position;
+}
+
+
+Rotation Actor::GetRotation() {
+    return m_remoteRotation;
+}
+
+
+void Actor::SetRotation(const Rotation& rotation) {
+    StubCall("Actor::SetRotation", this, rotation);
+    m_remoteRotation = rotation;
+}
+
+
+int32_t Actor::GetHealth() {
+    return m_health;
+}
+
+
+void Actor::PerformSetHealth(int32_t health) {
+    StubCall("Actor::PerformSetHealth", this, health);
+    m_health = health;
+}
+
+
+bool Actor::GetState(const std::string& state) {
+    auto found = m_states.find(state);
+    return found != m_states.end() && found->second;
+}
+
+
+void Actor::UpdateState(const std::string& state, bool enabled) {
+    StubCall("Actor::UpdateState", this, state, enabled);
+    m_states[state] = enabled;
+}
+
+
+NPC::NPC(const std::string& blueprint) : Actor(blueprint) {
+}
+
+
+BlockyChest::BlockyChest() : Actor("BlockyChest") {
+}
+
+
+Projectile::Projectile(IActor* owner, IItem* item, const std::string& blueprint) : Actor(blueprint),
+        m_item(item), m_lifetime(0) {
+}
+
+
+Player::Player(bool local) : Actor("Player"), m_characterId(0), m_playerName(StubString("")),
+        m_teamName(StubString("")), m_avatarIndex(0), m_colors(), m_admin(false), m_pvpEnabled(false),
+        m_pvpDesired(false), m_pvpChangeTimer(0), m_pvpChangeReportedTimer(0), m_changingServerRegion(false),
+        m_currentRegion(NULL), m_changeRegionDestination(NULL), m_mana(100), m_manaRegenTimer(0),
+        m_healthRegenCooldown(0), m_healthRegenTimer(0), m_countdown(0), m_equipped(), m_currentSlot(0),
+        m_currentQuest(NULL), m_walkingSpeed(200), m_jumpSpeed(420), m_jumpHoldTime(0.2f), m_currentNPCState(NULL),
+        m_localPlayer(NULL), m_eventsToSend(NULL), m_itemsUpdated(false), m_itemSyncTimer(0),
+        m_chatMessageCounter(0), m_chatFloodDecayTimer(0), m_lastHitByItem(NULL), m_lastHitItemTimeLeft(0),
+        m_circuitStateCooldownTimer(0) {
+}
+
+
+bool Player::IsPlayer() {
+    return true;
+}
+
+
+bool Player::IsCharacter() {
+    return true;
+}
+
+
+IPlayer* Player::GetPlayerInterface() {
+    return this;
+}
+
+
+IActor* Player::GetActorInterface() {
+    return this;
+}
+
+
+const char* Player::GetPlayerName() {
+    return m_playerName;
+}
+
+
+void Player::SetPlayerName(const std::string& name) {
+    m_playerName = StubString(name);
+}
+
+
+bool Player::IsPvPEnabled() {
+    return m_pvpEnabled;
+}
+
+
+void Player::PerformSetPvPEnabled(bool enabled) {
+    StubCall("Player::PerformSetPvPEnabled", this, enabled);
+    m_pvpEnabled = enabled;
+}
+
+
+void Player::PerformUpdatePvPCountdown(bool enabling, int32_t countdown) {
+    StubCall("Player::PerformUpdatePvPCountdown", this, enabling, countdown);
+    m_pvpChangeReportedTimer = countdown;
+}
+
+
+int32_t Player::GetMana() {
+    return m_mana;
+}
+
+
+void Player::PerformSetMana(int32_t mana) {
+    StubCall("Player::PerformSetMana", this, mana);
+    m_mana = mana;
+}
+
+
+size_t Player::GetCurrentSlot() {
+    return m_currentSlot;
+}
+
+
+void Player::SetCurrentSlot(size_t slot) {
+    StubCall("Player::SetCurrentSlot", this, slot);
+    m_currentSlot = slot;
+}
+
+
+void Player::PerformSetCurrentSlot(size_t slot) {
+    StubCall("Player::PerformSetCurrentSlot", this, slot);
+    m_currentSlot = slot;
+}
+
+
+IItem* Player::GetItemForSlot(size_t slot) {
+    return slot < sizeof(m_equipped) / sizeof(m_equipped[0]) ? m_equipped[slot] : NULL;
+}
+
+
+IItem* Player::GetCurrentItem() {
+    return GetItemForSlot(m_currentSlot);
+}
+
+
+uint32_t Player::GetItemCount(IItem* item) {
+    auto found = m_inventory.find(item);
+    return found == m_inventory.end() ? 0 : found->second.count;
+}
+
+
+uint32_t Player::GetLoadedAmmo(IItem* item) {
+    auto found = m_inventory.find(item);
+    return found == m_inventory.end() ? 0 : found->second.loadedAmmo;
+}
+
+
+void Player::PerformSetLoadedAmmo(IItem* item, uint32_t loaded) {
+    StubCall("Player::PerformSetLoadedAmmo", this, item, loaded);
+    auto found = m_inventory.find(item);
+    if (found != m_inventory.end()) {
+        found->second.loadedAmmo = loaded;
+    }
+}
+
+
+bool Player::PerformAddItem(IItem* item, uint32_t count, bool allowPartial) {
+    StubCall("Player::PerformAddItem", this, item, count, allowPartial);
+    ItemAndCount& entry = m_inventory[item];
+    entry.item = item;
+    entry.count += count;
+    return true;
+}
+
+
+float Player::GetItemCooldown(IItem* item) {
+    auto found = m_cooldowns.find(item);
+    return found == m_cooldowns.end() ? 0 : found->second;
+}
+
+
+bool Player::IsItemOnCooldown(IItem* item) {
+    return GetItemCooldown(item) > 0;
+}
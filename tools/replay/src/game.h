@@ -0,0 +1,106 @@
+#ifndef GAME_H
+#define GAME_H
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <type_traits>
+#include "pwn3.h"
+
+// Stand-in for the game library. pwn3.so is preloaded in front of it exactly
+// as it is in front of the real one, so hooks find their "real" functions
+// here. Anything a hook asks the game to do ends up in the output log.
+
+// What GetGameWorld() finds, set by whoever builds the world
+extern ClientWorld* GameWorld;
+
+
+// Calls are logged to this file, prefixed with the current frame. NULL stops logging.
+void SetStubLog(FILE *);
+void SetStubFrame(uint64_t);
+bool IsStubLogging();
+void StubLogLine(const std::string &);
+
+// A connection to a game server port that goes nowhere. The hooks track it
+// like the game's own, and whatever they send on it is logged as a "send"
+// call with the bytes in hex. Returns the descriptor, or -1.
+int OpenStubConnection();
+void CloseStubConnection();
+
+// Interns a string for the lifetime of the process, for const char* members
+const char * StubString(const std::string &);
+
+
+void FormatStubArgument(std::string &, const char *);
+void FormatStubArgument(std::string &, const std::string &);
+void FormatStubArgument(std::string &, const Vector3 &);
+void FormatStubArgument(std::string &, const Rotation &);
+void FormatStubArgument(std::string &, IActor *);
+void FormatStubArgument(std::string &, IPlayer *);
+void FormatStubArgument(std::string &, IItem *);
+void FormatStubArgument(std::string &, long long);
+void FormatStubArgument(std::string &, double);
+
+
+// Actors by id, items by name, anything else that can't be compared between runs by kind
+template <class T>
+void FormatStub(std::string& line, const T& value) {
+    typedef typename std::remove_cv<typename std::remove_pointer<T>::type>::type Pointee;
+    if constexpr (std::is_integral<T>::value || std::is_enum<T>::value) {
+        FormatStubArgument(line, (long long)value);
+    }
+    else if constexpr (std::is_floating_point<T>::value) {
+        FormatStubArgument(line, (double)value);
+    }
+    else if constexpr (std::is_convertible<T, const char*>::value || std::is_same<T, std::string>::value ||
+                       std::is_same<T, Vector3>::value || std::is_same<T, Rotation>::value) {
+        FormatStubArgument(line, value);
+    }
+    else if constexpr (std::is_pointer<T>::value && std::is_base_of<IActor, Pointee>::value) {
+        FormatStubArgument(line, (IActor*)value);
+    }
+    else if constexpr (std::is_pointer<T>::value && std::is_base_of<IPlayer, Pointee>::value) {
+        FormatStubArgument(line, (IPlayer*)value);
+    }
+    else if constexpr (std::is_pointer<T>::value && std::is_base_of<IItem, Pointee>::value) {
+        FormatStubArgument(line, (IItem*)value);
+    }
+    else if constexpr (std::is_pointer<T>::value) {
+        line += value == NULL ? " null" : " ptr";
+    }
+    else {
+        line += " ?";
+    }
+}
+
+
+template <class... Args>
+void StubCall(const char* name, const Args&... args) {
+    if (!IsStubLogging()) {
+        return;
+    }
+    std::string line = name;
+    int expand[] = {0, (FormatStub(line, args), 0)...};
+    (void)expand;
+    StubLogLine(line);
+}
+
+
+// What generated stubs return
+template <class T>
+struct StubValue {
+    static T Get() {
+        return T();
+    }
+};
+
+
+template <class T>
+struct StubValue<T &> {
+    static T & Get() {
+        static typename std::remove_const<T>::type value;
+        return value;
+    }
+};
+
+#endif
@@ -0,0 +1,128 @@
+#include <algorithm>
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <dirent.h>
+#include <dlfcn.h>
+#include <libgen.h>
+#include <unistd.h>
+#include "harness.h"
+
+extern char** environ;
+
+const char HARNESS_CHILD_VARIABLE[] = "PWN3_HARNESS_CHILD";
+std::string SCRATCH_DIRECTORY;
+
+
+static std::string ResolveHooksPath(const char* path) {
+    if (path[0] == '/') {
+        return path;
+    }
+    char executable[PATH_MAX];
+    ssize_t length = readlink("/proc/self/exe", executable, sizeof(executable) - 1);
+    if (length <= 0) {
+        return path;
+    }
+    executable[length] = '\0';
+    std::string resolved = std::string(dirname(executable)) + "/" + path;
+    char real[PATH_MAX];
+    return realpath(resolved.c_str(), real) == NULL ? resolved : real;
+}
+
+
+bool RunWithHooks(char** argv, const char* hooks) {
+    if (getenv(HARNESS_CHILD_VARIABLE) != NULL) {
+        // IsTracing() only exists in pwn3.so
+        if (dlsym(RTLD_DEFAULT, "_Z9IsTracingv") == NULL) {
+            fprintf(stderr, "<Harness> pwn3.so isn't loaded\n");
+            return false;
+        }
+        const char* scratch = getenv("PWN3_HEATMAP_DIR");
+        SCRATCH_DIRECTORY = scratch == NULL ? "" : scratch;
+        return true;
+    }
+
+    std::string path = ResolveHooksPath(hooks);
+    if (access(path.c_str(), R_OK) != 0) {
+        fprintf(stderr, "<Harness> Can't find %s, build tools/hackedLib first\n", path.c_str());
+        return false;
+    }
+    std::vector<std::string> settings;
+    for (char** variable = environ; *variable != NULL; variable++) {
+        if (strncmp(*variable, "PWN3_", 5) == 0) {
+            settings.push_back(std::string(*variable, strchr(*variable, '=') - *variable));
+        }
+    }
+    for (size_t i = 0; i < settings.size(); i++) {
+        unsetenv(settings[i].c_str());
+    }
+    char scratch[] = "/tmp/pwn3-harness-XXXXXX";
+    if (mkdtemp(scratch) == NULL) {
+        perror("<Harness> mkdtemp");
+        return false;
+    }
+    setenv("PWN3_HEATMAP_DIR", scratch, 1);
+    setenv(HARNESS_CHILD_VARIABLE, "1", 1);
+    setenv("LD_PRELOAD", path.c_str(), 1);
+    execv("/proc/self/exe", argv);
+    perror("<Harness> execv");
+    rmdir(scratch);
+    return false;
+}
+
+
+const std::string& GetScratchDirectory() {
+    return SCRATCH_DIRECTORY;
+}
+
+
+void RemoveScratchDirectory() {
+    if (SCRATCH_DIRECTORY.empty()) {
+        return;
+    }
+    DIR* directory = opendir(SCRATCH_DIRECTORY.c_str());
+    if (directory != NULL) {
+        struct dirent* entry;
+        while ((entry = readdir(directory)) != NULL) {
+            if (entry->d_name[0] != '.') {
+                unlink((SCRATCH_DIRECTORY + "/" + entry->d_name).c_str());
+            }
+        }
+        closedir(directory);
+    }
+    rmdir(SCRATCH_DIRECTORY.c_str());
+    SCRATCH_DIRECTORY.clear();
+}
+
+
+void SilenceHooks() {
+    fflush(stdout);
+    if (freopen("/dev/null", "w", stdout) == NULL) {
+        perror("<Harness> freopen");
+    }
+}
+
+
+uint64_t GetNanoseconds() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+
+TimingSummary SummarizeTimings(std::vector<uint64_t> timings) {
+    TimingSummary summary = {timings.size(), 0, 0, 0, 0};
+    if (timings.empty()) {
+        return summary;
+    }
+    for (size_t i = 0; i < timings.size(); i++) {
+        summary.totalNs += timings[i];
+    }
+    std::sort(timings.begin(), timings.end());
+    summary.medianNs = timings[timings.size() / 2];
+    summary.p99Ns = timings[std::min(timings.size() - 1, timings.size() * 99 / 100)];
+    summary.maxNs = timings.back();
+    return summary;
+}
@@ -0,0 +1,34 @@
+#ifndef HARNESS_H
+#define HARNESS_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Where the hook library is, relative to the harness binaries in build/
+const char DEFAULT_HOOKS_PATH[] = "../../hackedLib/build/pwn3.so";
+
+
+struct TimingSummary {
+    uint64_t count;
+    uint64_t medianNs;
+    uint64_t p99Ns;
+    uint64_t maxNs;
+    uint64_t totalNs;
+};
+
+
+// pwn3.so reads its settings while it is being loaded, so the harness re-runs
+// itself with the hooks preloaded and every PWN3_ variable that could change
+// their behaviour cleared. Returns only in the re-run process, or on failure.
+bool RunWithHooks(char **, const char *);
+// Heatmaps go to a scratch directory that is removed again on exit
+const std::string & GetScratchDirectory();
+void RemoveScratchDirectory();
+// Output of the hooks' own printf()s is only kept when asked for
+void SilenceHooks();
+
+uint64_t GetNanoseconds();
+TimingSummary SummarizeTimings(std::vector<uint64_t>);
+
+#endif
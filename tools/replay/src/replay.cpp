@@ -0,0 +1,537 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include "game.h"
+#include "replay.h"
+#include "trace.h"
+#include "world.h"
+
+
+// Strings are interned as they are defined, TRACE_NONE stands for NULL
+struct TraceStrings {
+    std::vector<const char*> m_strings;
+
+    void Define(uint32_t index, const std::string& text) {
+        if (m_strings.size() <= index) {
+            m_strings.resize(index + 1, "");
+        }
+        m_strings[index] = StubString(text);
+    }
+
+    const char* Get(uint32_t index) const {
+        if (index == TRACE_NONE) {
+            return NULL;
+        }
+        return index < m_strings.size() ? m_strings[index] : "";
+    }
+};
+
+
+static Vector3 ReadVector(TraceReader& reader) {
+    float x = reader.Read<float>();
+    float y = reader.Read<float>();
+    float z = reader.Read<float>();
+    return Vector3(x, y, z);
+}
+
+
+static Rotation ReadRotation(TraceReader& reader) {
+    float pitch = reader.Read<float>();
+    float yaw = reader.Read<float>();
+    float roll = reader.Read<float>();
+    return Rotation(pitch, yaw, roll);
+}
+
+
+static void ReadItem(TraceReader& reader, const TraceStrings& strings, ReplayWorld& world) {
+    ReplayItem* item = world.GetItem(reader.Read<uint32_t>());
+    const char* name = strings.Get(reader.Read<uint32_t>());
+    item->m_name = name == NULL ? "" : name;
+    item->m_manaCost = reader.Read<int32_t>();
+    item->m_damage = reader.Read<int32_t>();
+    item->m_damagePerSecond = reader.Read<int32_t>();
+    item->m_projectiles = reader.Read<uint32_t>();
+    item->m_damageType = (DamageType)reader.Read<uint8_t>();
+    item->m_cooldown = reader.Read<float>();
+    item->m_clipSize = reader.Read<uint32_t>();
+    item->m_reloadTime = reader.Read<float>();
+    item->m_partialReload = reader.Read<uint8_t>();
+    item->m_range = reader.Read<float>();
+    item->m_canEquip = reader.Read<uint8_t>();
+    uint32_t ammo = reader.Read<uint32_t>();
+    item->m_ammo = ammo == TRACE_SELF ? item : world.GetItem(ammo);
+}
+
+
+// Put the world into the state the recorded World::Tick saw
+static float ReadSnapshot(TraceReader& reader, const TraceStrings& strings, ReplayWorld& world) {
+    float dt = reader.Read<float>();
+    world.ClearMembers();
+
+    ReplayPlayer* player = world.GetPlayer(reader.Read<uint32_t>());
+    world.SetActivePlayer(player);
+    world.AddPlayerMember(player);
+    const char* name = strings.Get(reader.Read<uint32_t>());
+    player->m_playerName = name == NULL ? "" : name;
+    player->m_currentRegion = strings.Get(reader.Read<uint32_t>());
+    Vector3 position = ReadVector(reader);
+    player->SetPose(position, ReadRotation(reader));
+    player->SetHealth(reader.Read<int32_t>());
+    player->m_mana = reader.Read<int32_t>();
+    player->m_currentSlot = reader.Read<uint32_t>();
+    player->m_pvpEnabled = reader.Read<uint8_t>();
+    player->m_canReload = reader.Read<uint8_t>();
+    for (size_t slot = 0; slot < TRACE_SLOTS; slot++) {
+        player->m_equipped[slot] = world.GetItem(reader.Read<uint32_t>());
+    }
+    player->m_inventory.clear();
+    player->m_cooldowns.clear();
+    uint32_t items = reader.Read<uint32_t>();
+    for (uint32_t i = 0; i < items && !reader.IsTruncated(); i++) {
+        IItem* item = world.GetItem(reader.Read<uint32_t>());
+        ItemAndCount& entry = player->m_inventory[item];
+        entry.item = item;
+        entry.count = reader.Read<uint32_t>();
+        entry.loadedAmmo = reader.Read<uint32_t>();
+        float cooldown = reader.Read<float>();
+        if (cooldown != 0) {
+            player->m_cooldowns[item] = cooldown;
+        }
+    }
+
+    uint32_t players = reader.Read<uint32_t>();
+    for (uint32_t i = 0; i < players && !reader.IsTruncated(); i++) {
+        ReplayPlayer* remote = world.GetPlayer(reader.Read<uint32_t>());
+        name = strings.Get(reader.Read<uint32_t>());
+        remote->m_playerName = name == NULL ? "" : name;
+        position = ReadVector(reader);
+        remote->SetPose(position, ReadRotation(reader));
+        remote->m_pvpEnabled = reader.Read<uint8_t>();
+        remote->SetHealth(reader.Read<int32_t>());
+        world.AddPlayerMember(remote);
+    }
+
+    uint32_t actors = reader.Read<uint32_t>();
+    for (uint32_t i = 0; i < actors && !reader.IsTruncated(); i++) {
+        uint32_t id = reader.Read<uint32_t>();
+        const char* blueprint = strings.Get(reader.Read<uint32_t>());
+        uint8_t flags = reader.Read<uint8_t>();
+        int32_t health = reader.Read<int32_t>();
+        position = ReadVector(reader);
+        if (flags & TracePlayerActor) {
+            // Players already got their pose from the sections above
+            world.AddActorMember(world.GetPlayer(id));
+            continue;
+        }
+        ReplayActor* actor = world.GetNonPlayer(id);
+        actor->SetSnapshot(blueprint, flags, health, position);
+        world.AddActorMember(actor);
+    }
+    return dt;
+}
+
+
+bool ReplayTrace(const char* path, ReplayResult& result) {
+    TraceReader reader;
+    if (!reader.Open(path)) {
+        fprintf(stderr, "<Replay> %s isn't a trace\n", path);
+        return false;
+    }
+    ReplayWorld world;
+    GameWorld = &world;
+    TraceStrings strings;
+
+    char* log = NULL;
+    size_t logSize = 0;
+    FILE* logFile = open_memstream(&log, &logSize);
+    SetStubLog(logFile);
+    // Somewhere for packets the hooks inject to go, a chat "pk" for one
+    if (OpenStubConnection() < 0) {
+        fprintf(stderr, "<Replay> Can't open the stub game connection, sent packets won't be compared\n");
+    }
+
+    result.ticks = 0;
+    result.events = 0;
+    uint64_t frameNs = 0;
+    uint64_t start = 0;
+    bool valid = true;
+    while (valid && !reader.AtEnd()) {
+        SetStubFrame(result.ticks);
+        size_t offset = reader.GetOffset();
+        uint8_t kind = reader.Read<uint8_t>();
+        // Decode first, so only the hook call itself is timed
+        switch (kind) {
+            case TraceString: {
+                uint32_t index = reader.Read<uint32_t>();
+                strings.Define(index, reader.ReadText());
+                continue;
+            }
+            case TraceItem:
+                ReadItem(reader, strings, world);
+                continue;
+            case TraceChat: {
+                ReplayPlayer* player = world.GetPlayer(reader.Read<uint32_t>());
+                std::string message = reader.ReadText();
+                start = GetNanoseconds();
+                player->Player::Chat(message.c_str());
+                break;
+            }
+            case TraceHealth: {
+                Actor* actor = world.GetActor(reader.Read<uint32_t>());
+                int32_t health = reader.Read<int32_t>();
+                start = GetNanoseconds();
+                actor->PerformSetHealth(health);
+                break;
+            }
+            case TraceState: {
+                Actor* actor = world.GetActor(reader.Read<uint32_t>());
+                const char* state = strings.Get(reader.Read<uint32_t>());
+                bool enabled = reader.Read<uint8_t>();
+                std::string text = state == NULL ? "" : state;
+                start = GetNanoseconds();
+                // The hooked implementation, whichever override the game went through
+                actor->Actor::UpdateState(text, enabled);
+                break;
+            }
+            case TraceTrigger: {
+                Actor* actor = world.GetActor(reader.Read<uint32_t>());
+                const char* event = strings.Get(reader.Read<uint32_t>());
+                uint32_t target = reader.Read<uint32_t>();
+                bool authority = reader.Read<uint8_t>();
+                std::string text = event == NULL ? "" : event;
+                IActor* targetActor = target == TRACE_NONE ? NULL : world.GetActor(target);
+                start = GetNanoseconds();
+                actor->Actor::TriggerEvent(text, targetActor, authority);
+                break;
+            }
+            case TraceAddItem: {
+                ReplayPlayer* player = world.GetPlayer(reader.Read<uint32_t>());
+                IItem* item = world.GetItem(reader.Read<uint32_t>());
+                uint32_t count = reader.Read<uint32_t>();
+                bool allowPartial = reader.Read<uint8_t>();
+                start = GetNanoseconds();
+                player->PerformAddItem(item, count, allowPartial);
+                break;
+            }
+            case TraceKill: {
+                ReplayPlayer* player = world.GetPlayer(reader.Read<uint32_t>());
+                uint32_t killer = reader.Read<uint32_t>();
+                uint32_t killed = reader.Read<uint32_t>();
+                IItem* item = world.GetItem(reader.Read<uint32_t>());
+                IPlayer* killerPlayer = killer == TRACE_NONE ? NULL : world.GetPlayer(killer);
+                IActor* killedActor = killed == TRACE_NONE ? NULL : world.GetActor(killed);
+                start = GetNanoseconds();
+                player->OnKillEvent(killerPlayer, killedActor, item);
+                break;
+            }
+            case TraceRemoteItem: {
+                ReplayPlayer* player = world.GetPlayer(reader.Read<uint32_t>());
+                IItem* item = world.GetItem(reader.Read<uint32_t>());
+                start = GetNanoseconds();
+                player->SetRemoteItem(item);
+                break;
+            }
+            case TracePvP: {
+                ReplayPlayer* player = world.GetPlayer(reader.Read<uint32_t>());
+                bool enabled = reader.Read<uint8_t>();
+                start = GetNanoseconds();
+                player->PerformSetPvPEnabled(enabled);
+                break;
+            }
+            case TracePvPCountdown: {
+                ReplayPlayer* player = world.GetPlayer(reader.Read<uint32_t>());
+                bool enabling = reader.Read<uint8_t>();
+                int32_t countdown = reader.Read<int32_t>();
+                start = GetNanoseconds();
+                player->PerformUpdatePvPCountdown(enabling, countdown);
+                break;
+            }
+            case TraceLoadedAmmo: {
+                ReplayPlayer* player = world.GetPlayer(reader.Read<uint32_t>());
+                IItem* item = world.GetItem(reader.Read<uint32_t>());
+                uint32_t loaded = reader.Read<uint32_t>();
+                start = GetNanoseconds();
+                player->PerformSetLoadedAmmo(item, loaded);
+                break;
+            }
+            case TraceMana: {
+                ReplayPlayer* player = world.GetPlayer(reader.Read<uint32_t>());
+                int32_t mana = reader.Read<int32_t>();
+                start = GetNanoseconds();
+                player->PerformSetMana(mana);
+                break;
+            }
+            case TraceCurrentSlot: {
+                ReplayPlayer* player = world.GetPlayer(reader.Read<uint32_t>());
+                uint32_t slot = reader.Read<uint32_t>();
+                start = GetNanoseconds();
+                player->PerformSetCurrentSlot(slot);
+                break;
+            }
+            case TraceReload: {
+                uint32_t id = reader.Read<uint32_t>();
+                uint32_t ammo = reader.Read<uint32_t>();
+                IItem* item = world.GetItem(reader.Read<uint32_t>());
+                uint32_t loaded = reader.Read<uint32_t>();
+                // Leave loaded what the game did, then let the hook read it back
+                if (item != NULL) {
+                    ItemAndCount& entry = world.GetPlayer(id)->m_inventory[item];
+                    entry.item = item;
+                    entry.loadedAmmo = loaded;
+                }
+                Actor* actor = world.GetActor(id);
+                start = GetNanoseconds();
+                actor->PerformReloadNotification(ammo);
+                break;
+            }
+            case TraceTick: {
+                float dt = ReadSnapshot(reader, strings, world);
+                if (reader.IsTruncated()) {
+                    continue;
+                }
+                start = GetNanoseconds();
+                world.World::Tick(dt);
+                frameNs += GetNanoseconds() - start;
+                // The first frame opens files and resolves symbols, it says nothing about the hooks
+                if (result.ticks > 0) {
+                    result.tickNs.push_back(frameNs);
+                }
+                result.ticks++;
+                frameNs = 0;
+                continue;
+            }
+            default:
+                fprintf(stderr, "<Replay> Unknown record '%c' at offset %lu\n", kind, (unsigned long)offset);
+                valid = false;
+                continue;
+        }
+        frameNs += GetNanoseconds() - start;
+        result.events++;
+    }
+
+    CloseStubConnection();
+    SetStubLog(NULL);
+    fclose(logFile);
+    result.truncated = reader.IsTruncated();
+    result.calls.clear();
+    for (char* line = strtok(log, "\n"); line != NULL; line = strtok(NULL, "\n")) {
+        result.calls.push_back(line);
+    }
+    free(log);
+    GameWorld = NULL;
+    return valid;
+}
+
+
+bool ReplayTracePasses(const char* path, size_t passes, ReplayResult& result) {
+    if (!ReplayTrace(path, result)) {
+        return false;
+    }
+    result.passes = 1;
+    for (size_t pass = 1; pass < passes; pass++) {
+        ReplayResult repeat;
+        if (!ReplayTrace(path, repeat) || repeat.tickNs.size() != result.tickNs.size()) {
+            return false;
+        }
+        for (size_t i = 0; i < result.tickNs.size(); i++) {
+            result.tickNs[i] = std::min(result.tickNs[i], repeat.tickNs[i]);
+        }
+        result.passes++;
+    }
+    return true;
+}
+
+
+bool WriteBaseline(const char* path, const ReplayResult& result) {
+    FILE* file = fopen(path, "w");
+    if (file == NULL) {
+        return false;
+    }
+    TimingSummary timing = SummarizeTimings(result.tickNs);
+    fprintf(file, "%s\n", BASELINE_MAGIC);
+    fprintf(file, "ticks %lu\n", (unsigned long)result.ticks);
+    fprintf(file, "events %lu\n", (unsigned long)result.events);
+    fprintf(file, "median_ns %lu\n", (unsigned long)timing.medianNs);
+    fprintf(file, "p99_ns %lu\n", (unsigned long)timing.p99Ns);
+    fprintf(file, "calls %lu\n", (unsigned long)result.calls.size());
+    for (size_t i = 0; i < result.calls.size(); i++) {
+        fprintf(file, "%s\n", result.calls[i].c_str());
+    }
+    return fclose(file) == 0;
+}
+
+
+static bool ReadBaselineLine(FILE* file, std::string& line) {
+    char* text = NULL;
+    size_t capacity = 0;
+    ssize_t length = getline(&text, &capacity, file);
+    if (length < 0) {
+        free(text);
+        return false;
+    }
+    line.assign(text, length > 0 && text[length - 1] == '\n' ? length - 1 : length);
+    free(text);
+    return true;
+}
+
+
+static bool CheckTiming(const char* name, uint64_t baseline, uint64_t measured, double threshold, bool gated) {
+    double change = baseline == 0 ? 0 : (double)measured / baseline - 1;
+    bool slower = gated && change > threshold && measured > baseline + TIME_NOISE_FLOOR_NS;
+    fprintf(stderr, "<Replay> %s hook time %.1f us, baseline %.1f us (%+.0f%%)%s\n", name, measured / 1e3,
+            baseline / 1e3, change * 100, slower ? " SLOWER" : (gated ? "" : ", too few ticks to gate"));
+    return !slower;
+}
+
+
+ReplayExitCode CompareBaseline(const char* path, const ReplayResult& result, double threshold) {
+    FILE* file = fopen(path, "r");
+    if (file == NULL) {
+        fprintf(stderr, "<Replay> Can't open baseline %s\n", path);
+        return ReplayFailed;
+    }
+    std::string line;
+    unsigned long ticks = 0, events = 0, medianNs = 0, p99Ns = 0, calls = 0;
+    bool valid = ReadBaselineLine(file, line) && line == BASELINE_MAGIC &&
+        ReadBaselineLine(file, line) && sscanf(line.c_str(), "ticks %lu", &ticks) == 1 &&
+        ReadBaselineLine(file, line) && sscanf(line.c_str(), "events %lu", &events) == 1 &&
+        ReadBaselineLine(file, line) && sscanf(line.c_str(), "median_ns %lu", &medianNs) == 1 &&
+        ReadBaselineLine(file, line) && sscanf(line.c_str(), "p99_ns %lu", &p99Ns) == 1 &&
+        ReadBaselineLine(file, line) && sscanf(line.c_str(), "calls %lu", &calls) == 1;
+    if (!valid) {
+        fprintf(stderr, "<Replay> %s isn't a baseline\n", path);
+        fclose(file);
+        return ReplayFailed;
+    }
+    if (ticks != result.ticks || events != result.events) {
+        fprintf(stderr, "<Replay> Baseline is for a different trace (%lu ticks and %lu events, this one has %lu and %lu)\n",
+                ticks, events, (unsigned long)result.ticks, (unsigned long)result.events);
+        fclose(file);
+        return ReplayFailed;
+    }
+
+    // Calls are compared in order, the first few differences are shown
+    size_t differences = 0;
+    for (size_t i = 0; i < calls || i < result.calls.size(); i++) {
+        bool expected = i < calls && ReadBaselineLine(file, line);
+        bool measured = i < result.calls.size();
+        if (expected && measured && line == result.calls[i]) {
+            continue;
+        }
+        if (differences++ < MAX_SHOWN_DIFFERENCES) {
+            fprintf(stderr, "<Replay> call %lu differs\n", (unsigned long)i);
+            if (expected) {
+                fprintf(stderr, "    - %s\n", line.c_str());
+            }
+            if (measured) {
+                fprintf(stderr, "    + %s\n", result.calls[i].c_str());
+            }
+        }
+    }
+    fclose(file);
+    if (differences > 0) {
+        fprintf(stderr, "<Replay> %lu of %lu calls differ from the baseline\n", (unsigned long)differences,
+                (unsigned long)calls);
+    }
+
+    TimingSummary timing = SummarizeTimings(result.tickNs);
+    bool fast = CheckTiming("median", medianNs, timing.medianNs, threshold, true);
+    fast = CheckTiming("p99", p99Ns, timing.p99Ns, threshold, timing.count >= MIN_GATED_P99_TICKS) && fast;
+    if (differences > 0) {
+        return ReplayBehaviourChanged;
+    }
+    return fast ? ReplayPassed : ReplaySlower;
+}
+
+
+static void Usage(const char* name) {
+    fprintf(stderr, "usage: %s TRACE [--baseline FILE] [--write-baseline FILE] [--threshold FRACTION]\n"
+            "       [--passes N] [--calls FILE] [--hooks PWN3_SO] [--verbose]\n", name);
+}
+
+
+int main(int argc, char** argv) {
+    const char* trace = NULL;
+    const char* baseline = NULL;
+    const char* newBaseline = NULL;
+    const char* callsPath = NULL;
+    const char* hooks = DEFAULT_HOOKS_PATH;
+    double threshold = DEFAULT_TIME_THRESHOLD;
+    size_t passes = DEFAULT_REPLAY_PASSES;
+    bool verbose = false;
+    for (int i = 1; i < argc; i++) {
+        bool hasValue = i + 1 < argc;
+        if (strcmp(argv[i], "--baseline") == 0 && hasValue) {
+            baseline = argv[++i];
+        }
+        else if (strcmp(argv[i], "--write-baseline") == 0 && hasValue) {
+            newBaseline = argv[++i];
+        }
+        else if (strcmp(argv[i], "--threshold") == 0 && hasValue) {
+            threshold = atof(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--passes") == 0 && hasValue) {
+            passes = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--calls") == 0 && hasValue) {
+            callsPath = argv[++i];
+        }
+        else if (strcmp(argv[i], "--hooks") == 0 && hasValue) {
+            hooks = argv[++i];
+        }
+        else if (strcmp(argv[i], "-v") == 0 || strcmp(argv[i], "--verbose") == 0) {
+            verbose = true;
+        }
+        else if (argv[i][0] != '-' && trace == NULL) {
+            trace = argv[i];
+        }
+        else {
+            Usage(argv[0]);
+            return ReplayFailed;
+        }
+    }
+    if (trace == NULL) {
+        Usage(argv[0]);
+        return ReplayFailed;
+    }
+    if (!RunWithHooks(argv, hooks)) {
+        return ReplayFailed;
+    }
+    if (!verbose) {
+        SilenceHooks();
+    }
+
+    ReplayResult result;
+    bool valid = ReplayTracePasses(trace, passes < 1 ? 1 : passes, result);
+    RemoveScratchDirectory();
+    if (!valid) {
+        return ReplayFailed;
+    }
+    TimingSummary timing = SummarizeTimings(result.tickNs);
+    fprintf(stderr, "<Replay> %lu ticks, %lu events, %lu calls into the game%s\n", (unsigned long)result.ticks,
+            (unsigned long)result.events, (unsigned long)result.calls.size(),
+            result.truncated ? ", trace ends mid-record" : "");
+    fprintf(stderr, "<Replay> hook time per tick, fastest of %lu passes: median %.1f us, p99 %.1f us, max %.1f us, "
+            "total %.2f ms\n", (unsigned long)result.passes, timing.medianNs / 1e3, timing.p99Ns / 1e3,
+            timing.maxNs / 1e3, timing.totalNs / 1e6);
+
+    if (callsPath != NULL) {
+        FILE* file = fopen(callsPath, "w");
+        for (size_t i = 0; file != NULL && i < result.calls.size(); i++) {
+            fprintf(file, "%s\n", result.calls[i].c_str());
+        }
+        if (file == NULL || fclose(file) != 0) {
+            fprintf(stderr, "<Replay> Can't write %s\n", callsPath);
+            return ReplayFailed;
+        }
+    }
+    if (newBaseline != NULL && !WriteBaseline(newBaseline, result)) {
+        fprintf(stderr, "<Replay> Can't write %s\n", newBaseline);
+        return ReplayFailed;
+    }
+    if (baseline != NULL) {
+        return CompareBaseline(baseline, result, threshold);
+    }
+    return ReplayPassed;
+}
@@ -0,0 +1,43 @@
+#ifndef REPLAY_H
+#define REPLAY_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "harness.h"
+
+const char BASELINE_MAGIC[] = "PWN3BASE2";
+// Slowdown over the baseline's median and p99 hook time that fails a run
+const double DEFAULT_TIME_THRESHOLD = 0.25;
+// Each tick's time is its fastest over this many passes, since noise only ever adds time
+const size_t DEFAULT_REPLAY_PASSES = 5;
+// A slowdown smaller than this is noise however large it is relative to the baseline
+const uint64_t TIME_NOISE_FLOOR_NS = 2000;
+// With fewer ticks a pass's p99 is its slowest tick or two, so it's shown but not gated
+const size_t MIN_GATED_P99_TICKS = 500;
+const size_t MAX_SHOWN_DIFFERENCES = 10;
+
+enum ReplayExitCode {ReplayPassed, ReplayBehaviourChanged, ReplaySlower, ReplayFailed};
+
+
+// Everything one pass over a trace produced
+struct ReplayResult {
+    uint64_t ticks;
+    uint64_t events;
+    bool truncated;
+    // Hook time spent on each frame, the events before it and World::Tick itself
+    std::vector<uint64_t> tickNs;
+    size_t passes;
+    // Calls the hooks made into the game and packets they sent, one per line
+    std::vector<std::string> calls;
+};
+
+
+bool ReplayTrace(const char *, ReplayResult &);
+// Replays the trace that many times, keeping the calls of the first pass
+bool ReplayTracePasses(const char *, size_t, ReplayResult &);
+bool WriteBaseline(const char *, const ReplayResult &);
+ReplayExitCode CompareBaseline(const char *, const ReplayResult &, double);
+
+#endif
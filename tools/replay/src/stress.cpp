@@ -0,0 +1,552 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <dlfcn.h>
+#include <string>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "stress.h"
+
+const char* STRESS_HOOK_NAMES[StressHookCount] = {"health", "states", "triggers", "items", "kills", "remote items",
+                                                  "pvp", "mana", "queries"};
+const char* ENEMY_BLUEPRINTS[] = {"Wolf", "Skeleton", "Spider", "Goblin", "Bandit"};
+const char* NPC_BLUEPRINTS[] = {"Villager", "Merchant"};
+const char* DROP_BLUEPRINTS[] = {"GoldDrop", "ItemDrop"};
+const char* PROJECTILE_BLUEPRINTS[] = {"Arrow", "Fireball"};
+const char* STATES[] = {"Idle", "Walk", "Run", "Attack", "Stunned"};
+const char* QUERIES[] = {"hm", "qd Rifle", "qk Rifle", "pl", "wp", "rp", "qs"};
+const size_t QUERY_COUNT = sizeof(QUERIES) / sizeof(QUERIES[0]);
+
+// Section timings only exist in pwn3.so, which isn't linked in
+typedef uint64_t (*SectionNsFunction)(TickSection);
+typedef const char* (*SectionNameFunction)(TickSection);
+
+
+template <size_t N>
+static const char* Pick(std::mt19937& random, const char* (&names)[N]) {
+    return StubString(names[random() % N]);
+}
+
+
+StressScene::StressScene(ReplayWorld& world, uint32_t seed) : m_world(world), m_random(seed), m_local(NULL),
+        m_nextId(1), m_actors(0), m_burstTimer(0), m_queryTimer(0), m_ammoTimer(0), m_queryIndex(0), m_time(0) {
+}
+
+
+float StressScene::Uniform(float low, float high) {
+    return std::uniform_real_distribution<float>(low, high)(m_random);
+}
+
+
+// Turns an expected number of events into a whole number, keeping the average
+size_t StressScene::Count(float expected) {
+    size_t count = (size_t)expected;
+    return count + (Uniform(0, 1) < expected - count ? 1 : 0);
+}
+
+
+Vector3 StressScene::NearCamp() {
+    const Vector3& camp = m_camps[m_random() % m_camps.size()];
+    std::normal_distribution<float> spread(0, STRESS_CAMP_RADIUS);
+    return Vector3(camp.x + spread(m_random), camp.y + spread(m_random), camp.z);
+}
+
+
+void StressScene::DefineItems() {
+    // name, mana cost, damage, projectiles, cooldown, clip, range
+    struct Definition {
+        const char* name;
+        int32_t manaCost;
+        int32_t damage;
+        uint32_t projectiles;
+        float cooldown;
+        uint32_t clipSize;
+        float range;
+    } definitions[] = {
+        {"Bullets", 0, 0, 0, 0, 0, 0},
+        {"Rifle", 0, 40, 1, 0.2f, 30, 6000},
+        {"Shotgun", 0, 15, 8, 0.8f, 6, 1500},
+        {"Bow", 0, 60, 1, 0.6f, 1, 5000},
+        {"Fireball", 25, 120, 1, 2, 0, 4000},
+        {"IceBolt", 15, 60, 1, 1, 0, 3500},
+        {"Potion", 0, 0, 0, 0, 0, 0},
+    };
+    for (size_t i = 0; i < sizeof(definitions) / sizeof(definitions[0]); i++) {
+        ReplayItem* item = m_world.GetItem(i);
+        item->m_name = definitions[i].name;
+        item->m_manaCost = definitions[i].manaCost;
+        item->m_damage = definitions[i].damage;
+        item->m_damagePerSecond = definitions[i].cooldown > 0 ? definitions[i].damage / definitions[i].cooldown : 0;
+        item->m_projectiles = definitions[i].projectiles;
+        item->m_damageType = definitions[i].manaCost > 0 ? FireDamage : PhysicalDamage;
+        item->m_cooldown = definitions[i].cooldown;
+        item->m_clipSize = definitions[i].clipSize;
+        item->m_reloadTime = definitions[i].clipSize > 0 ? 2 : 0;
+        item->m_range = definitions[i].range;
+        item->m_canEquip = definitions[i].damage > 0;
+        item->m_ammo = definitions[i].clipSize > 0 ? m_world.GetItem(0) : NULL;
+        m_items.push_back(item);
+    }
+}
+
+
+void StressScene::Build(size_t actors, size_t players) {
+    DefineItems();
+    size_t camps = std::max<size_t>(1, actors / STRESS_ACTORS_PER_CAMP);
+    for (size_t i = 0; i < camps; i++) {
+        float half = STRESS_REGION_SIZE / 2;
+        m_camps.push_back(Vector3(Uniform(-half, half), Uniform(-half, half), 0));
+    }
+
+    // The local player stands in the first camp, in the thick of it
+    m_local = m_world.GetPlayer(m_nextId++);
+    std::string region = "Stress-" + std::to_string(actors);
+    m_local->m_currentRegion = StubString(region);
+    m_local->SetPlayerName("Stress");
+    m_local->SetPose(m_camps[0], Rotation());
+    for (size_t slot = 0; slot < 5; slot++) {
+        m_local->m_equipped[slot] = m_items[slot + 1];
+    }
+    for (size_t i = 0; i < m_items.size(); i++) {
+        ItemAndCount& entry = m_local->m_inventory[m_items[i]];
+        entry.item = m_items[i];
+        entry.count = i == 0 ? 300 : 1;
+        entry.loadedAmmo = m_items[i]->m_clipSize;
+    }
+    m_world.SetActivePlayer(m_local);
+    m_world.AddPlayerMember(m_local);
+    m_world.AddActorMember(m_local);
+
+    for (size_t i = 0; i < players; i++) {
+        ReplayPlayer* remote = m_world.GetPlayer(m_nextId++);
+        remote->SetPlayerName("Remote" + std::to_string(i));
+        remote->m_pvpEnabled = i % 3 == 0;
+        m_remotes.push_back(remote);
+        m_world.AddPlayerMember(remote);
+        m_world.AddActorMember(remote);
+    }
+
+    for (size_t i = 0; i < actors; i++) {
+        Spawn();
+    }
+    m_actors = actors;
+}
+
+
+void StressScene::Spawn() {
+    Mover mover;
+    mover.actor = m_world.GetNonPlayer(m_nextId++);
+    mover.lifetime = INFINITY;
+    float kind = Uniform(0, 1);
+    if (kind < 0.7) {
+        mover.actor->SetSnapshot(Pick(m_random, ENEMY_BLUEPRINTS), TraceCharacterActor, 100, NearCamp());
+        mover.speed = Uniform(150, 450);
+    }
+    else if (kind < 0.8) {
+        mover.actor->SetSnapshot(Pick(m_random, NPC_BLUEPRINTS), TraceCharacterActor | TraceNPCActor, 100, NearCamp());
+        mover.speed = Uniform(50, 100);
+    }
+    else if (kind < 0.95) {
+        mover.actor->SetSnapshot(Pick(m_random, DROP_BLUEPRINTS), 0, 100, NearCamp());
+        mover.speed = 0;
+    }
+    else {
+        mover.actor->SetSnapshot(StubString("Chest"), 0, 100, NearCamp());
+        mover.speed = 0;
+    }
+    float heading = Uniform(0, 2 * M_PI);
+    mover.velocity = Vector3(cosf(heading) * mover.speed, sinf(heading) * mover.speed, 0);
+    m_movers.push_back(mover);
+    m_world.AddActorMember(mover.actor);
+}
+
+
+void StressScene::SpawnProjectile(const Vector3& from, const Vector3& to) {
+    Mover mover;
+    mover.actor = m_world.GetNonPlayer(m_nextId++);
+    mover.actor->SetSnapshot(Pick(m_random, PROJECTILE_BLUEPRINTS), 0, 1, from);
+    mover.speed = STRESS_PROJECTILE_SPEED;
+    mover.velocity = Vector3::Normalize(Vector3(to.x - from.x, to.y - from.y, to.z - from.z));
+    mover.velocity.x *= mover.speed;
+    mover.velocity.y *= mover.speed;
+    mover.velocity.z *= mover.speed;
+    mover.lifetime = STRESS_PROJECTILE_LIFETIME;
+    m_movers.push_back(mover);
+    m_world.AddActorMember(mover.actor);
+}
+
+
+void StressScene::Destroy(size_t index) {
+    m_world.RemoveActorMember(m_movers[index].actor);
+    m_movers[index] = m_movers.back();
+    m_movers.pop_back();
+}
+
+
+void StressScene::Move(Mover& mover, float dt) {
+    if (mover.speed == 0) {
+        return;
+    }
+    // Wander, turning every couple of seconds
+    if (mover.lifetime == INFINITY && Uniform(0, 1) < dt * 0.5f) {
+        float heading = Uniform(0, 2 * M_PI);
+        mover.velocity = Vector3(cosf(heading) * mover.speed, sinf(heading) * mover.speed, 0);
+    }
+    ReplayActor* actor = mover.actor;
+    Vector3 position = actor->GetPosition();
+    position.x += mover.velocity.x * dt;
+    position.y += mover.velocity.y * dt;
+    position.z += mover.velocity.z * dt;
+    float half = STRESS_REGION_SIZE / 2;
+    if (fabsf(position.x) > half) {
+        mover.velocity.x = -mover.velocity.x;
+    }
+    if (fabsf(position.y) > half) {
+        mover.velocity.y = -mover.velocity.y;
+    }
+    actor->SetSnapshot(actor->GetBlueprintName(), actor->m_flags, actor->GetHealth(), position);
+}
+
+
+void StressScene::Step(float dt, uint64_t* hookNs) {
+    m_time += dt;
+    uint64_t start;
+#define TIMED(hook, call) start = GetNanoseconds(); call; hookNs[hook] += GetNanoseconds() - start
+
+    for (size_t i = 0; i < m_movers.size();) {
+        Mover& mover = m_movers[i];
+        mover.lifetime -= dt;
+        if (mover.lifetime <= 0) {
+            Destroy(i);
+            continue;
+        }
+        Move(mover, dt);
+        i++;
+    }
+    Vector3 center = m_local->GetPosition();
+    for (size_t i = 0; i < m_remotes.size(); i++) {
+        float angle = m_time * 0.2f + i;
+        float distance = 1000 + 300 * i;
+        m_remotes[i]->SetPose(Vector3(center.x + cosf(angle) * distance, center.y + sinf(angle) * distance, 0),
+                              Rotation(0, angle * 57.3f + 90, 0));
+    }
+    if (m_movers.empty()) {
+        return;
+    }
+
+    // Actors die and are replaced by new ones with fresh ids
+    size_t churn = Count(m_actors * STRESS_CHURN_RATE * dt);
+    for (size_t i = 0; i < churn; i++) {
+        size_t index = m_random() % m_movers.size();
+        if (m_movers[index].lifetime != INFINITY) {
+            continue;
+        }
+        ReplayActor* actor = m_movers[index].actor;
+        TIMED(HealthHook, actor->PerformSetHealth(0));
+        if (Vector3::Distance(actor->GetPosition(), center) < 5000) {
+            IPlayer* killer = m_remotes.empty() || m_random() % 2 == 0 ? (IPlayer*)m_local :
+                m_remotes[m_random() % m_remotes.size()];
+            TIMED(KillHook, m_local->OnKillEvent(killer, actor, m_items[1 + m_random() % 5]));
+        }
+        Destroy(index);
+        Spawn();
+    }
+
+    // Volleys come from whoever is around at the time
+    m_burstTimer -= dt;
+    if (m_burstTimer <= 0) {
+        m_burstTimer = STRESS_BURST_INTERVAL;
+        size_t burst = STRESS_BURST_BASE + m_actors / STRESS_BURST_DIVISOR;
+        for (size_t i = 0; i < burst; i++) {
+            Actor* shooter = m_movers[m_random() % m_movers.size()].actor;
+            std::string attack = "Attack";
+            TIMED(TriggerHook, shooter->Actor::TriggerEvent(attack, m_local, false));
+            SpawnProjectile(shooter->GetPosition(), center);
+        }
+    }
+
+    size_t hits = Count(m_actors * STRESS_HIT_RATE * dt);
+    for (size_t i = 0; i < hits; i++) {
+        Actor* actor = m_movers[m_random() % m_movers.size()].actor;
+        int32_t health = actor->GetHealth() > 10 ? actor->GetHealth() - 10 : 100;
+        TIMED(HealthHook, actor->PerformSetHealth(health));
+    }
+    size_t states = Count(m_actors * STRESS_STATE_RATE * dt);
+    for (size_t i = 0; i < states; i++) {
+        Actor* actor = m_movers[m_random() % m_movers.size()].actor;
+        std::string state = Pick(m_random, STATES);
+        bool enabled = m_random() % 2;
+        TIMED(StateHook, actor->Actor::UpdateState(state, enabled));
+    }
+    size_t attacks = Count(m_actors * STRESS_ATTACK_RATE * dt);
+    for (size_t i = 0; i < attacks; i++) {
+        Actor* actor = m_movers[m_random() % m_movers.size()].actor;
+        IActor* target = m_remotes.empty() || m_random() % 4 == 0 ? (IActor*)m_local :
+            m_remotes[m_random() % m_remotes.size()];
+        std::string attack = "Bite";
+        TIMED(TriggerHook, actor->Actor::TriggerEvent(attack, target, false));
+    }
+
+    // The local player's own inventory, ammo and mana
+    if (Uniform(0, 1) < dt * 0.5f) {
+        TIMED(ItemHook, m_local->PerformAddItem(m_items[m_random() % m_items.size()], 1 + m_random() % 5, true));
+    }
+    m_ammoTimer -= dt;
+    if (m_ammoTimer <= 0) {
+        m_ammoTimer = 0.5f;
+        IItem* rifle = m_items[1];
+        uint32_t loaded = m_local->GetLoadedAmmo(rifle);
+        TIMED(ItemHook, m_local->PerformSetLoadedAmmo(rifle, loaded > 0 ? loaded - 1 : 30));
+    }
+    int32_t mana = m_local->GetMana() < 100 ? m_local->GetMana() + 1 : 40;
+    TIMED(ManaHook, m_local->PerformSetMana(mana));
+
+    for (size_t i = 0; i < m_remotes.size(); i++) {
+        if (Uniform(0, 1) < dt * 0.05f) {
+            TIMED(RemoteItemHook, m_remotes[i]->SetRemoteItem(m_items[1 + m_random() % 5]));
+        }
+        if (Uniform(0, 1) < dt * 0.01f) {
+            TIMED(PvPHook, m_remotes[i]->PerformSetPvPEnabled(!m_remotes[i]->IsPvPEnabled()));
+        }
+    }
+    if (Uniform(0, 1) < dt * 0.01f) {
+        TIMED(PvPHook, m_local->PerformUpdatePvPCountdown(true, 10));
+    }
+
+    // Someone keeps asking the hooks what they know
+    m_queryTimer -= dt;
+    if (m_queryTimer <= 0) {
+        m_queryTimer = STRESS_QUERY_INTERVAL;
+        const char* query = QUERIES[m_queryIndex++ % QUERY_COUNT];
+        TIMED(QueryHook, m_local->Player::Chat(query));
+    }
+#undef TIMED
+}
+
+
+size_t StressScene::GetMoverCount() const {
+    return m_movers.size();
+}
+
+
+const char* GetStressSubsystemName(size_t subsystem) {
+    static SectionNameFunction sectionName = (SectionNameFunction)dlsym(RTLD_DEFAULT, "_Z18GetTickSectionName11TickSection");
+    if (subsystem < TickSectionCount) {
+        return sectionName == NULL ? "?" : sectionName((TickSection)subsystem);
+    }
+    return STRESS_HOOK_NAMES[subsystem - TickSectionCount];
+}
+
+
+bool RunStress(size_t actors, size_t players, size_t frames, uint32_t seed, StressResult& result) {
+    SectionNsFunction sectionNs = (SectionNsFunction)dlsym(RTLD_DEFAULT, "_Z16GetLastSectionNs11TickSection");
+    if (sectionNs == NULL) {
+        fprintf(stderr, "<Stress> pwn3.so has no tick sections\n");
+        return false;
+    }
+    ReplayWorld world;
+    GameWorld = &world;
+    StressScene scene(world, seed);
+    scene.Build(actors, players);
+
+    std::vector<uint64_t> samples[STRESS_SUBSYSTEMS];
+    std::vector<uint64_t> totals;
+    for (size_t frame = 0; frame < STRESS_WARMUP_FRAMES + frames; frame++) {
+        uint64_t hookNs[StressHookCount] = {0};
+        scene.Step(STRESS_FRAME_TIME, hookNs);
+        uint64_t start = GetNanoseconds();
+        world.World::Tick(STRESS_FRAME_TIME);
+        uint64_t total = GetNanoseconds() - start;
+        if (frame < STRESS_WARMUP_FRAMES) {
+            continue;
+        }
+        for (size_t i = 0; i < TickSectionCount; i++) {
+            samples[i].push_back(sectionNs((TickSection)i));
+        }
+        for (size_t i = 0; i < StressHookCount; i++) {
+            samples[TickSectionCount + i].push_back(hookNs[i]);
+            total += hookNs[i];
+        }
+        totals.push_back(total);
+    }
+    GameWorld = NULL;
+
+    result.actors = actors;
+    result.frames = frames;
+    for (size_t i = 0; i < STRESS_SUBSYSTEMS; i++) {
+        TimingSummary summary = SummarizeTimings(samples[i]);
+        result.meanNs[i] = frames == 0 ? 0 : (double)summary.totalNs / frames;
+        result.p99Ns[i] = summary.p99Ns;
+    }
+    TimingSummary summary = SummarizeTimings(totals);
+    result.totalMeanNs = frames == 0 ? 0 : (double)summary.totalNs / frames;
+    result.totalP99Ns = summary.p99Ns;
+    return true;
+}
+
+
+// Each size runs in its own process, so the hooks start from nothing every time
+static bool RunStressProcess(size_t actors, size_t players, size_t frames, uint32_t seed, bool verbose,
+                             StressResult& result) {
+    int fds[2];
+    if (pipe(fds) != 0) {
+        perror("<Stress> pipe");
+        return false;
+    }
+    fflush(NULL);
+    pid_t child = fork();
+    if (child < 0) {
+        perror("<Stress> fork");
+        return false;
+    }
+    if (child == 0) {
+        close(fds[0]);
+        if (!verbose) {
+            SilenceHooks();
+        }
+        bool ran = RunStress(actors, players, frames, seed, result);
+        bool written = ran && write(fds[1], &result, sizeof(result)) == (ssize_t)sizeof(result);
+        _exit(written ? 0 : 1);
+    }
+    close(fds[1]);
+    ssize_t length = read(fds[0], &result, sizeof(result));
+    close(fds[0]);
+    int status = 0;
+    waitpid(child, &status, 0);
+    return length == (ssize_t)sizeof(result) && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+
+static double Exponent(double actorsBefore, double before, double actorsAfter, double after) {
+    if (before <= 0 || after <= 0) {
+        return 0;
+    }
+    return log(after / before) / log(actorsAfter / actorsBefore);
+}
+
+
+// Prints the curves, returns how many subsystems grow superlinearly
+static size_t Report(const std::vector<StressResult>& results) {
+    fprintf(stdout, "%-14s", "us/frame");
+    for (size_t i = 0; i < results.size(); i++) {
+        fprintf(stdout, " %10lu (p99)  ", (unsigned long)results[i].actors);
+    }
+    fprintf(stdout, " exponent\n");
+
+    size_t flagged = 0;
+    for (size_t s = 0; s <= STRESS_SUBSYSTEMS; s++) {
+        bool total = s == STRESS_SUBSYSTEMS;
+        fprintf(stdout, "%-14s", total ? "total" : GetStressSubsystemName(s));
+        double worst = 0;
+        for (size_t i = 0; i < results.size(); i++) {
+            double mean = total ? results[i].totalMeanNs : results[i].meanNs[s];
+            double p99 = total ? results[i].totalP99Ns : results[i].p99Ns[s];
+            fprintf(stdout, " %10.1f %-7s", mean / 1e3, ("(" + std::to_string((int)(p99 / 1e3)) + ")").c_str());
+            if (i == 0) {
+                continue;
+            }
+            double before = total ? results[i - 1].totalMeanNs : results[i - 1].meanNs[s];
+            if (before >= SUPERLINEAR_MIN_NS && mean >= SUPERLINEAR_MIN_NS) {
+                worst = std::max(worst, Exponent(results[i - 1].actors, before, results[i].actors, mean));
+            }
+        }
+        bool superlinear = !total && worst > SUPERLINEAR_EXPONENT;
+        flagged += superlinear;
+        fprintf(stdout, " %8.2f%s\n", worst, superlinear ? "  SUPERLINEAR" : "");
+    }
+    fprintf(stdout, "Mean per-frame cost in us with p99 in brackets, exponent is the steepest k in cost ~ actors^k\n");
+    return flagged;
+}
+
+
+static void WriteCsv(FILE* file, const std::vector<StressResult>& results) {
+    fprintf(file, "subsystem,actors,frames,mean_ns,p99_ns\n");
+    for (size_t s = 0; s <= STRESS_SUBSYSTEMS; s++) {
+        bool total = s == STRESS_SUBSYSTEMS;
+        for (size_t i = 0; i < results.size(); i++) {
+            fprintf(file, "%s,%lu,%lu,%.0f,%.0f\n", total ? "total" : GetStressSubsystemName(s),
+                    (unsigned long)results[i].actors, (unsigned long)results[i].frames,
+                    total ? results[i].totalMeanNs : results[i].meanNs[s],
+                    total ? results[i].totalP99Ns : results[i].p99Ns[s]);
+        }
+    }
+}
+
+
+static void Usage(const char* name) {
+    fprintf(stderr, "usage: %s [--sizes N,N,...] [--frames N] [--players N] [--seed N] [--csv FILE]\n"
+            "       [--hooks PWN3_SO] [--verbose]\n", name);
+}
+
+
+int main(int argc, char** argv) {
+    std::vector<size_t> sizes(DEFAULT_STRESS_SIZES, DEFAULT_STRESS_SIZES + 3);
+    size_t frames = DEFAULT_STRESS_FRAMES;
+    size_t players = DEFAULT_STRESS_PLAYERS;
+    uint32_t seed = 1;
+    const char* csv = NULL;
+    const char* hooks = DEFAULT_HOOKS_PATH;
+    bool verbose = false;
+    for (int i = 1; i < argc; i++) {
+        bool hasValue = i + 1 < argc;
+        if (strcmp(argv[i], "--sizes") == 0 && hasValue) {
+            sizes.clear();
+            for (char* size = argv[++i]; *size != '\0'; size += *size == ',') {
+                sizes.push_back(strtoul(size, &size, 10));
+            }
+        }
+        else if (strcmp(argv[i], "--frames") == 0 && hasValue) {
+            frames = strtoul(argv[++i], NULL, 10);
+        }
+        else if (strcmp(argv[i], "--players") == 0 && hasValue) {
+            players = strtoul(argv[++i], NULL, 10);
+        }
+        else if (strcmp(argv[i], "--seed") == 0 && hasValue) {
+            seed = strtoul(argv[++i], NULL, 10);
+        }
+        else if (strcmp(argv[i], "--csv") == 0 && hasValue) {
+            csv = argv[++i];
+        }
+        else if (strcmp(argv[i], "--hooks") == 0 && hasValue) {
+            hooks = argv[++i];
+        }
+        else if (strcmp(argv[i], "-v") == 0 || strcmp(argv[i], "--verbose") == 0) {
+            verbose = true;
+        }
+        else {
+            Usage(argv[0]);
+            return 2;
+        }
+    }
+    if (sizes.empty() || !RunWithHooks(argv, hooks)) {
+        return 2;
+    }
+    std::sort(sizes.begin(), sizes.end());
+
+    std::vector<StressResult> results;
+    for (size_t i = 0; i < sizes.size(); i++) {
+        StressResult result;
+        fprintf(stderr, "<Stress> %lu actors, %lu frames\n", (unsigned long)sizes[i], (unsigned long)frames);
+        if (!RunStressProcess(sizes[i], players, frames, seed, verbose, result)) {
+            fprintf(stderr, "<Stress> Run with %lu actors failed\n", (unsigned long)sizes[i]);
+            RemoveScratchDirectory();
+            return 2;
+        }
+        results.push_back(result);
+    }
+    RemoveScratchDirectory();
+
+    size_t flagged = Report(results);
+    if (csv != NULL) {
+        FILE* file = fopen(csv, "w");
+        if (file == NULL) {
+            fprintf(stderr, "<Stress> Can't write %s\n", csv);
+            return 2;
+        }
+        WriteCsv(file, results);
+        fclose(file);
+    }
+    return flagged > 0 ? 1 : 0;
+}
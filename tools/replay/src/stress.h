@@ -0,0 +1,106 @@
+#ifndef STRESS_H
+#define STRESS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <random>
+#include <vector>
+#include "harness.h"
+#include "sections.h"
+#include "world.h"
+
+const size_t DEFAULT_STRESS_SIZES[] = {1000, 10000, 100000};
+const size_t DEFAULT_STRESS_FRAMES = 300;
+const size_t DEFAULT_STRESS_PLAYERS = 24;
+// Frames run before timing starts, the first one opens files and resolves symbols
+const size_t STRESS_WARMUP_FRAMES = 10;
+const float STRESS_FRAME_TIME = 1.0f / 60;
+
+// Actors crowd around camps inside a square region
+const float STRESS_REGION_SIZE = 80000;
+const size_t STRESS_ACTORS_PER_CAMP = 250;
+const float STRESS_CAMP_RADIUS = 2500;
+// Spawn/destroy churn, and how often an enemy gets hit, changes state or attacks, per second
+const float STRESS_CHURN_RATE = 0.02;
+const float STRESS_HIT_RATE = 0.05;
+const float STRESS_STATE_RATE = 0.02;
+const float STRESS_ATTACK_RATE = 0.02;
+// A volley of projectiles every so often, bigger in bigger worlds
+const float STRESS_BURST_INTERVAL = 1.5;
+const size_t STRESS_BURST_BASE = 40;
+const size_t STRESS_BURST_DIVISOR = 500;
+const float STRESS_PROJECTILE_LIFETIME = 1;
+const float STRESS_PROJECTILE_SPEED = 3000;
+// Chat queries are run this often
+const float STRESS_QUERY_INTERVAL = 2;
+// A subsystem whose per-frame cost grows faster than actors^this is flagged
+const double SUPERLINEAR_EXPONENT = 1.2;
+// Below this many ns per frame the exponent is mostly noise
+const double SUPERLINEAR_MIN_NS = 1000;
+
+// Event hooks are timed by the driver, World::Tick reports its own sections
+enum StressHook {HealthHook, StateHook, TriggerHook, ItemHook, KillHook, RemoteItemHook, PvPHook, ManaHook,
+                 QueryHook, StressHookCount};
+const size_t STRESS_SUBSYSTEMS = TickSectionCount + StressHookCount;
+
+
+// Per-frame cost of every subsystem for one world size
+struct StressResult {
+    uint64_t actors;
+    uint64_t frames;
+    double meanNs[STRESS_SUBSYSTEMS];
+    double p99Ns[STRESS_SUBSYSTEMS];
+    double totalMeanNs;
+    double totalP99Ns;
+};
+
+
+// A region full of wandering enemies, NPCs, drops and projectiles, with
+// remote players around the local one. Everything is driven by one seed.
+class StressScene {
+  private:
+    struct Mover {
+        ReplayActor* actor;
+        Vector3 velocity;
+        float speed;
+        // Projectiles only, seconds left to live
+        float lifetime;
+    };
+
+    ReplayWorld& m_world;
+    std::mt19937 m_random;
+    std::vector<Vector3> m_camps;
+    std::vector<Mover> m_movers;
+    std::vector<ReplayPlayer*> m_remotes;
+    ReplayPlayer* m_local;
+    std::vector<ReplayItem*> m_items;
+    uint32_t m_nextId;
+    size_t m_actors;
+    float m_burstTimer;
+    float m_queryTimer;
+    float m_ammoTimer;
+    size_t m_queryIndex;
+    float m_time;
+
+    float Uniform(float, float);
+    size_t Count(float);
+    Vector3 NearCamp();
+    void DefineItems();
+    void Spawn();
+    void SpawnProjectile(const Vector3 &, const Vector3 &);
+    void Destroy(size_t);
+    void Move(Mover &, float);
+
+  public:
+    StressScene(ReplayWorld &, uint32_t);
+    void Build(size_t, size_t);
+    // Advances the scene by one frame, calling the event hooks and timing them per StressHook
+    void Step(float, uint64_t *);
+    size_t GetMoverCount() const;
+};
+
+
+const char * GetStressSubsystemName(size_t);
+bool RunStress(size_t, size_t, size_t, uint32_t, StressResult &);
+
+#endif
@@ -0,0 +1,73 @@
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "trace.h"
+
+
+TraceReader::TraceReader() : m_data(NULL), m_size(0), m_offset(0), m_truncated(false) {
+}
+
+
+TraceReader::~TraceReader() {
+    if (m_data != NULL) {
+        munmap((void*)m_data, m_size);
+    }
+}
+
+
+bool TraceReader::Open(const char* path) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat info;
+    if (fstat(fd, &info) != 0 || (size_t)info.st_size < sizeof(TRACE_MAGIC)) {
+        close(fd);
+        return false;
+    }
+    void* data = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        return false;
+    }
+    // Read front to back exactly once
+    madvise(data, info.st_size, MADV_SEQUENTIAL);
+    m_data = (const uint8_t*)data;
+    m_size = info.st_size;
+    m_offset = sizeof(TRACE_MAGIC);
+    return memcmp(m_data, TRACE_MAGIC, sizeof(TRACE_MAGIC)) == 0;
+}
+
+
+bool TraceReader::AtEnd() const {
+    return m_offset >= m_size;
+}
+
+
+bool TraceReader::IsTruncated() const {
+    return m_truncated;
+}
+
+
+size_t TraceReader::GetOffset() const {
+    return m_offset;
+}
+
+
+size_t TraceReader::GetSize() const {
+    return m_size;
+}
+
+
+std::string TraceReader::ReadText() {
+    uint16_t length = Read<uint16_t>();
+    if (m_offset + length > m_size) {
+        m_truncated = true;
+        m_offset = m_size;
+        return std::string();
+    }
+    std::string text((const char*)m_data + m_offset, length);
+    m_offset += length;
+    return text;
+}
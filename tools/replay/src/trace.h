@@ -0,0 +1,46 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include "recorder.h"
+
+
+// Reads a PWN3_RECORD trace straight out of a read-only mapping. A trace cut
+// off by a crash just ends early, reads past the end return zeroes and mark
+// the reader as truncated.
+class TraceReader {
+  private:
+    const uint8_t* m_data;
+    size_t m_size;
+    size_t m_offset;
+    bool m_truncated;
+
+  public:
+    TraceReader();
+    ~TraceReader();
+    bool Open(const char *);
+    bool AtEnd() const;
+    bool IsTruncated() const;
+    size_t GetOffset() const;
+    size_t GetSize() const;
+    std::string ReadText();
+
+    template <class T>
+    T Read() {
+        T value;
+        if (m_offset + sizeof(T) > m_size) {
+            m_truncated = true;
+            m_offset = m_size;
+            memset(&value, 0, sizeof(T));
+            return value;
+        }
+        memcpy(&value, m_data + m_offset, sizeof(T));
+        m_offset += sizeof(T);
+        return value;
+    }
+};
+
+#endif
@@ -0,0 +1,216 @@
+#include "world.h"
+
+
+ReplayItem::ReplayItem() : m_manaCost(0), m_damage(0), m_damagePerSecond(0), m_projectiles(1),
+        m_damageType(PhysicalDamage), m_cooldown(0), m_clipSize(0), m_reloadTime(0), m_partialReload(false),
+        m_range(0), m_canEquip(false), m_ammo(NULL) {
+}
+
+
+const char* ReplayItem::GetName() {
+    return m_name.c_str();
+}
+
+
+bool ReplayItem::CanEquip() {
+    return m_canEquip;
+}
+
+
+float ReplayItem::GetCooldownTime() {
+    return m_cooldown;
+}
+
+
+IItem* ReplayItem::GetAmmoType() {
+    return m_ammo;
+}
+
+
+uint32_t ReplayItem::GetClipSize() {
+    return m_clipSize;
+}
+
+
+int32_t ReplayItem::GetDamage() {
+    return m_damage;
+}
+
+
+int32_t ReplayItem::GetDamagePerSecond() {
+    return m_damagePerSecond;
+}
+
+
+DamageType ReplayItem::GetDamageType() {
+    return m_damageType;
+}
+
+
+int32_t ReplayItem::GetManaCost() {
+    return m_manaCost;
+}
+
+
+uint32_t ReplayItem::GetNumberOfProjectiles() {
+    return m_projectiles;
+}
+
+
+float ReplayItem::GetReloadTime(int32_t) {
+    // Only ever recorded for a full clip, which is all the hooks ask for
+    return m_reloadTime;
+}
+
+
+bool ReplayItem::HasPartialReload() {
+    return m_partialReload;
+}
+
+
+float ReplayItem::GetRange() {
+    return m_range;
+}
+
+
+ReplayActor::ReplayActor(uint32_t id, const std::string& blueprint) : Actor(blueprint), m_flags(0) {
+    SetId(id);
+}
+
+
+bool ReplayActor::IsPlayer() {
+    return false;
+}
+
+
+bool ReplayActor::IsCharacter() {
+    return m_flags & TraceCharacterActor;
+}
+
+
+bool ReplayActor::IsNPC() {
+    return m_flags & TraceNPCActor;
+}
+
+
+void ReplayActor::SetSnapshot(const char* blueprint, uint8_t flags, int32_t health, const Vector3& position) {
+    m_blueprintName = blueprint;
+    m_flags = flags;
+    m_health = health;
+    m_remotePosition = position;
+}
+
+
+ReplayPlayer::ReplayPlayer(uint32_t id) : Player(false), m_canReload(true) {
+    SetId(id);
+}
+
+
+bool ReplayPlayer::CanReload() {
+    return m_canReload;
+}
+
+
+void ReplayPlayer::SetPose(const Vector3& position, const Rotation& rotation) {
+    m_remotePosition = position;
+    m_remoteRotation = rotation;
+}
+
+
+void ReplayPlayer::SetHealth(int32_t health) {
+    m_health = health;
+}
+
+
+ReplayWorld::ReplayWorld() {
+    m_localPlayer = NULL;
+    m_nextId = 0;
+    m_timeUntilNextNetTick = 0;
+}
+
+
+ReplayWorld::~ReplayWorld() {
+    for (size_t i = 0; i < m_owned.size(); i++) {
+        delete m_owned[i];
+    }
+}
+
+
+Actor* ReplayWorld::GetActor(uint32_t id) {
+    auto found = m_byId.find(id);
+    if (found != m_byId.end()) {
+        return found->second;
+    }
+    return GetNonPlayer(id);
+}
+
+
+ReplayPlayer* ReplayWorld::GetPlayer(uint32_t id) {
+    auto found = m_byId.find(id);
+    if (found != m_byId.end() && found->second->IsPlayer()) {
+        return (ReplayPlayer*)found->second;
+    }
+    ReplayPlayer* player = new ReplayPlayer(id);
+    m_owned.push_back(player);
+    m_byId[id] = player;
+    return player;
+}
+
+
+ReplayActor* ReplayWorld::GetNonPlayer(uint32_t id) {
+    auto found = m_byId.find(id);
+    if (found != m_byId.end() && !found->second->IsPlayer()) {
+        return (ReplayActor*)found->second;
+    }
+    ReplayActor* actor = new ReplayActor(id, "");
+    m_owned.push_back(actor);
+    m_byId[id] = actor;
+    return actor;
+}
+
+
+ReplayItem* ReplayWorld::GetItem(uint32_t index) {
+    if (index == TRACE_NONE || index == TRACE_SELF) {
+        return NULL;
+    }
+    while (m_items.size() <= index) {
+        m_items.emplace_back();
+    }
+    return &m_items[index];
+}
+
+
+void ReplayWorld::SetActivePlayer(ReplayPlayer* player) {
+    m_activePlayer = ActorRef<IPlayer>(player);
+}
+
+
+void ReplayWorld::ClearMembers() {
+    m_players.clear();
+    m_actors.clear();
+}
+
+
+void ReplayWorld::AddPlayerMember(Player* player) {
+    m_players.insert(ActorRef<IPlayer>(player));
+}
+
+
+void ReplayWorld::AddActorMember(Actor* actor) {
+    m_actors.insert(ActorRef<IActor>(actor));
+}
+
+
+void ReplayWorld::RemoveActorMember(Actor* actor) {
+    m_actors.erase(ActorRef<IActor>(actor));
+}
+
+
+size_t ReplayWorld::GetActorCount() const {
+    return m_actors.size();
+}
+
+
+size_t ReplayWorld::GetPlayerCount() const {
+    return m_players.size();
+}
@@ -0,0 +1,98 @@
+#ifndef WORLD_H
+#define WORLD_H
+
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "game.h"
+#include "recorder.h"
+
+
+// What a recorded item reported about itself
+class ReplayItem : public IItem {
+  public:
+    std::string m_name;
+    int32_t m_manaCost;
+    int32_t m_damage;
+    int32_t m_damagePerSecond;
+    uint32_t m_projectiles;
+    DamageType m_damageType;
+    float m_cooldown;
+    uint32_t m_clipSize;
+    float m_reloadTime;
+    bool m_partialReload;
+    float m_range;
+    bool m_canEquip;
+    IItem* m_ammo;
+
+    ReplayItem();
+    virtual const char * GetName();
+    virtual bool CanEquip();
+    virtual float GetCooldownTime();
+    virtual IItem * GetAmmoType();
+    virtual uint32_t GetClipSize();
+    virtual int32_t GetDamage();
+    virtual int32_t GetDamagePerSecond();
+    virtual DamageType GetDamageType();
+    virtual int32_t GetManaCost();
+    virtual uint32_t GetNumberOfProjectiles();
+    virtual float GetReloadTime(int32_t);
+    virtual bool HasPartialReload();
+    virtual float GetRange();
+};
+
+
+// Non-player actors only know what the snapshot said they are
+class ReplayActor : public Actor {
+  public:
+    uint8_t m_flags;
+
+    ReplayActor(uint32_t, const std::string &);
+    virtual bool IsPlayer();
+    virtual bool IsCharacter();
+    virtual bool IsNPC();
+    void SetSnapshot(const char *, uint8_t, int32_t, const Vector3 &);
+};
+
+
+class ReplayPlayer : public Player {
+  public:
+    bool m_canReload;
+
+    ReplayPlayer(uint32_t);
+    virtual bool CanReload();
+    void SetPose(const Vector3 &, const Rotation &);
+    void SetHealth(int32_t);
+};
+
+
+// Owns every object a trace or a generated scene refers to. Objects are never
+// freed before the world is, since the hooks may still hold on to them.
+class ReplayWorld : public ClientWorld {
+  private:
+    std::unordered_map<uint32_t, Actor*> m_byId;
+    std::vector<Actor*> m_owned;
+    std::deque<ReplayItem> m_items;
+
+  public:
+    ReplayWorld();
+    virtual ~ReplayWorld();
+    // Looks an actor up by id, creating a plain one if it hasn't been seen
+    Actor * GetActor(uint32_t);
+    // Same, but replaces a plain actor with a player if it turns out to be one
+    ReplayPlayer * GetPlayer(uint32_t);
+    ReplayActor * GetNonPlayer(uint32_t);
+    ReplayItem * GetItem(uint32_t);
+    void SetActivePlayer(ReplayPlayer *);
+    // Membership is rebuilt from scratch for every snapshot
+    void ClearMembers();
+    void AddPlayerMember(Player *);
+    void AddActorMember(Actor *);
+    void RemoveActorMember(Actor *);
+    size_t GetActorCount() const;
+    size_t GetPlayerCount() const;
+};
+
+#endif